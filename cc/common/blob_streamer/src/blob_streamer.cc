@@ -186,8 +186,21 @@ ExecutionResult BlobStreamer::GetBlobStream(
   // switching to handling stream chunks in multiple threads.
   return async_executor_->Schedule(
       [result, is_done, get_blob_stream_context,
-       callback = get_blob_context.GetCallback(), this]() mutable {
+       get_blob_context = move(get_blob_context), this]() mutable {
+        // Once cancelled, what the client still streams is dropped.
+        auto pass_chunk = [&get_blob_context](
+                              const GetBlobStreamResponse& response) {
+          if (!get_blob_context.IsCancelled()) {
+            get_blob_context.GetCallback()(response.blob_portion().data(),
+                                           /* is_done */ false,
+                                           SuccessExecutionResult());
+          }
+        };
         while (!stop_.load()) {
+          if (get_blob_context.IsCancelled() &&
+              !get_blob_stream_context.IsCancelled()) {
+            get_blob_stream_context.TryCancel();
+          }
           auto response = get_blob_stream_context.TryGetNextResponse();
 
           if (response == nullptr && get_blob_stream_context.IsMarkedDone()) {
@@ -199,14 +212,13 @@ ExecutionResult BlobStreamer::GetBlobStream(
             if (response == nullptr && is_done->load()) {
               // Just return empty data. We actually return to exit out of this
               // loop.
-              return callback(string_view(), /* is_done */ true, *result);
+              return get_blob_context.GetCallback()(
+                  string_view(), /* is_done */ true, *result);
             } else if (response != nullptr) {
-              callback(response->blob_portion().data(),
-                       /* is done */ false, SuccessExecutionResult());
+              pass_chunk(*response);
             }
           } else if (response != nullptr) {
-            callback(response->blob_portion().data(), /* is_done */ false,
-                     SuccessExecutionResult());
+            pass_chunk(*response);
           }
         }
       },
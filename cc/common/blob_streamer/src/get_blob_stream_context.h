@@ -14,7 +14,9 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <string>
 #include <string_view>
 
@@ -79,6 +81,17 @@ class GetBlobStreamContext {
     return cloud_identity_info_;
   }
 
+  /**
+   * @brief Ask for the stream to stop. Chunks are no longer passed to the
+   * callback, which is still invoked with is_done once the stream ends. Copies
+   * of the context share the cancellation, so a copy kept by the caller can
+   * cancel the stream started with another.
+   *
+   */
+  void TryCancel() const { is_cancelled_->store(true); }
+
+  bool IsCancelled() const { return is_cancelled_->load(); }
+
  private:
   std::string bucket_name_;
   std::string blob_path_;
@@ -86,5 +99,7 @@ class GetBlobStreamContext {
   GetBlobStreamChunkProcessorCallback callback_;
   std::optional<google::cmrt::sdk::common::v1::CloudIdentityInfo>
       cloud_identity_info_;
+  std::shared_ptr<std::atomic<bool>> is_cancelled_ =
+      std::make_shared<std::atomic<bool>>(false);
 };
 }  // namespace google::pair::common
\ No newline at end of file
@@ -230,6 +230,44 @@ TEST_F(BlobStreamerTest, GetBlob_ShouldPassResultToContextCallback) {
   EXPECT_SUCCESS(streamer_.Stop());
 }
 
+TEST_F(BlobStreamerTest, GetBlob_CancellingWorks) {
+  vector<string> data_chunks;
+  atomic<bool> is_finished{false};
+  ExecutionResult stream_result;
+  auto get_blob_context = GetBlobStreamContext(
+      /* bucket_name */ "test-bucket", /* blob_path */ "test-file",
+      /* max_bytes_per_chunk */ 123,
+      [&data_chunks, &is_finished, &stream_result](auto chunk, bool is_done,
+                                                   const auto& result) {
+        if (is_done) {
+          stream_result = result;
+          is_finished.store(true);
+        } else {
+          data_chunks.emplace_back(chunk);
+        }
+      });
+  EXPECT_CALL(storage_client_mock_, GetBlobStream).WillOnce([](auto context) {
+    thread writer_thread([context]() mutable {
+      WaitUntil([&context]() { return context.IsCancelled(); });
+      // Chunks the client still streams after cancelling are dropped.
+      AddDataChunkToStream(context, "hello");
+      MarkStreamDone(context, FailureExecutionResult(12345));
+    });
+    writer_thread.detach();
+  });
+  EXPECT_SUCCESS(streamer_.Init());
+  EXPECT_SUCCESS(streamer_.Run());
+
+  // A copy of the context cancels the stream.
+  EXPECT_SUCCESS(streamer_.GetBlobStream(get_blob_context));
+  get_blob_context.TryCancel();
+
+  WaitUntil([&is_finished]() { return is_finished.load(); });
+  EXPECT_TRUE(data_chunks.empty());
+  EXPECT_THAT(stream_result, ResultIs(FailureExecutionResult(12345)));
+  EXPECT_SUCCESS(streamer_.Stop());
+}
+
 TEST_F(BlobStreamerTest,
        PutBlob_ShouldUseContextInformationToBuildStreamingContext) {
   auto put_blob_context = PutBlobStreamContext(
@@ -0,0 +1,229 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/common/csv_parser/src/csv_scanner.h"
+#include "cc/common/csv_parser/src/csv_stream_parser.h"
+#include "cc/common/csv_parser/src/csv_stream_parser_config.h"
+#include "cc/common/csv_parser/src/parallel_csv_parser.h"
+#include "cc/core/async_executor/src/async_executor.h"
+
+using google::scp::core::AsyncExecutor;
+using std::shared_ptr;
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace google::pair::common {
+
+namespace {
+
+constexpr size_t kDefaultNumRows = 10000000;
+// The size of the chunks the blob streamer hands the parser.
+constexpr size_t kChunkSize = 4 * 1024 * 1024;
+// The number of threads of the CPU executor, as in the worker runner.
+constexpr size_t kNumCpuThreads = 16;
+
+// Returns an email list with num_rows rows.
+string BuildEmailList(size_t num_rows) {
+  string data;
+  for (size_t i = 0; i < num_rows; i++) {
+    absl::StrAppend(&data, "user", i, "@example.com\n");
+  }
+  return data;
+}
+
+void PrintThroughput(const string& name, size_t num_bytes,
+                     absl::Duration time) {
+  std::cout << name << "\ttime=" << absl::FormatDuration(time) << " ("
+            << num_bytes / absl::ToDoubleSeconds(time) / 1e9 << " GB/s)"
+            << std::endl;
+}
+
+// Parses data in chunks with a parser configured for zero copy and SIMD
+// scanning as given, reading every row's column as the MatchWorker would.
+// Rows are taken one by one if batch_size is 1, in batches of it otherwise.
+void RunParserBenchmark(const string& name, const string& data, bool zero_copy,
+                        bool simd_scan, size_t batch_size) {
+  CsvStreamParser parser(CsvStreamParserConfig(
+      /* num_cols */ 1, /* remove_whitespace */ true, kDefaultCsvRowDelimiter,
+      kDefaultCsvLineBreak, kMaxCsvStreamParserBufferedDataSizeBytes,
+      zero_copy, simd_scan));
+  size_t num_rows = 0;
+  size_t num_id_bytes = 0;
+  vector<CsvRow> rows;
+  vector<CsvRowView> row_views;
+  auto start = absl::Now();
+  for (size_t i = 0; i < data.size(); i += kChunkSize) {
+    if (!parser.AddCsvChunk(string_view(data).substr(i, kChunkSize))
+             .Successful()) {
+      std::cerr << name << ": failed adding a chunk" << std::endl;
+      return;
+    }
+    while (batch_size > 1 && parser.HasRow()) {
+      if (zero_copy) {
+        row_views.clear();
+        parser.GetNextRowViews(batch_size, &row_views);
+        for (const auto& row : row_views) {
+          num_id_bytes += row.GetColumnView(0)->size();
+        }
+        num_rows += row_views.size();
+      } else {
+        rows.clear();
+        parser.GetNextRows(batch_size, &rows);
+        for (const auto& row : rows) {
+          num_id_bytes += row.GetColumn(0)->size();
+        }
+        num_rows += rows.size();
+      }
+    }
+    while (parser.HasRow()) {
+      if (zero_copy) {
+        auto row_or = parser.GetNextRowView();
+        num_id_bytes += row_or->GetColumnView(0)->size();
+      } else {
+        auto row_or = parser.GetNextRow();
+        num_id_bytes += row_or->GetColumn(0)->size();
+      }
+      num_rows++;
+    }
+  }
+  auto time = absl::Now() - start;
+  PrintThroughput(
+      absl::StrCat(name, "\tbatch_size=", batch_size, "\trows=", num_rows,
+                   "\tid_bytes=", num_id_bytes),
+      data.size(), time);
+}
+
+// Finds every line break in data with the scanner alone.
+void RunScannerBenchmark(const string& name, const string& data,
+                         CsvScannerIsa isa) {
+  CsvScanner scanner(isa);
+  vector<size_t> positions;
+  size_t num_line_breaks = 0;
+  auto start = absl::Now();
+  for (size_t i = 0; i < data.size(); i += kChunkSize) {
+    positions.clear();
+    scanner.FindAll(string_view(data).substr(i, kChunkSize),
+                    kDefaultCsvLineBreak, positions);
+    num_line_breaks += positions.size();
+  }
+  auto time = absl::Now() - start;
+  if (scanner.GetIsa() != isa) {
+    std::cout << name << "\tnot supported by this CPU" << std::endl;
+    return;
+  }
+  PrintThroughput(absl::StrCat(name, "\tline_breaks=", num_line_breaks),
+                  data.size(), time);
+}
+
+// Parses the whole of data at once, split into num_ranges ranges parsed
+// concurrently on cpu_async_executor.
+void RunParallelParserBenchmark(
+    const shared_ptr<const string>& data,
+    const shared_ptr<AsyncExecutor>& cpu_async_executor, size_t num_ranges) {
+  ParallelCsvParser parser(
+      cpu_async_executor,
+      CsvStreamParserConfig(
+          /* num_cols */ 1, /* remove_whitespace */ true,
+          kDefaultCsvRowDelimiter, kDefaultCsvLineBreak,
+          kMaxCsvStreamParserBufferedDataSizeBytes, /* zero_copy */ true,
+          /* simd_scan */ true),
+      num_ranges);
+  size_t num_rows = 0;
+  size_t num_id_bytes = 0;
+  auto start = absl::Now();
+  auto batches_or = parser.Parse(data);
+  if (!batches_or.Successful()) {
+    std::cerr << "ParallelCsvParser: failed parsing" << std::endl;
+    return;
+  }
+  for (const auto& batch : *batches_or) {
+    for (const auto& row : batch.rows) {
+      num_id_bytes += row.GetColumnView(0)->size();
+    }
+    num_rows += batch.rows.size();
+  }
+  auto time = absl::Now() - start;
+  PrintThroughput(
+      absl::StrCat("ParallelCsvParser\tnum_ranges=", num_ranges,
+                   "\trows=", num_rows, "\tid_bytes=", num_id_bytes),
+      data->size(), time);
+}
+
+}  // namespace
+
+}  // namespace google::pair::common
+
+// Compares the throughput of the line break scanner on each instruction set,
+// and of the CSV stream parser with and without zero copy and SIMD scanning,
+// taking rows one by one and in batches, on an email list streamed in 4 MiB
+// chunks. Then measures how the parallel parser scales with the number of
+// ranges it parses the whole list in.
+// Usage: csv_parser_benchmark [num_rows]
+// num_rows defaults to 10M, roughly 250 MB of emails.
+int main(int argc, char** argv) {
+  using google::pair::common::CsvScannerIsa;
+  using google::pair::common::RunParallelParserBenchmark;
+  using google::pair::common::RunParserBenchmark;
+  using google::pair::common::RunScannerBenchmark;
+
+  size_t num_rows = google::pair::common::kDefaultNumRows;
+  if (argc > 1) {
+    num_rows = std::strtoul(argv[1], nullptr, 10);
+  }
+  auto data = google::pair::common::BuildEmailList(num_rows);
+  std::cout << "Benchmarking with " << num_rows << " rows, " << data.size()
+            << " bytes" << std::endl;
+
+  RunScannerBenchmark("CsvScanner scalar", data, CsvScannerIsa::kScalar);
+  RunScannerBenchmark("CsvScanner SSE2", data, CsvScannerIsa::kSse2);
+  RunScannerBenchmark("CsvScanner AVX2", data, CsvScannerIsa::kAvx2);
+
+  for (size_t batch_size : {1, 1024}) {
+    RunParserBenchmark("CsvStreamParser", data, /* zero_copy */ false,
+                       /* simd_scan */ false, batch_size);
+    RunParserBenchmark("CsvStreamParser simd_scan", data,
+                       /* zero_copy */ false, /* simd_scan */ true, batch_size);
+    RunParserBenchmark("CsvStreamParser zero_copy", data, /* zero_copy */ true,
+                       /* simd_scan */ false, batch_size);
+    RunParserBenchmark("CsvStreamParser zero_copy simd_scan", data,
+                       /* zero_copy */ true, /* simd_scan */ true, batch_size);
+  }
+
+  auto cpu_async_executor = std::make_shared<google::scp::core::AsyncExecutor>(
+      google::pair::common::kNumCpuThreads, 10000000);
+  if (!cpu_async_executor->Init().Successful() ||
+      !cpu_async_executor->Run().Successful()) {
+    std::cerr << "Failed starting the CPU executor" << std::endl;
+    return 1;
+  }
+  auto shared_data = std::make_shared<const std::string>(std::move(data));
+  for (size_t num_ranges : {1, 2, 4, 8, 16}) {
+    RunParallelParserBenchmark(shared_data, cpu_async_executor, num_ranges);
+  }
+  cpu_async_executor->Stop();
+  return 0;
+}
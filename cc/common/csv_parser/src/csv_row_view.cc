@@ -0,0 +1,189 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "csv_row_view.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "absl/strings/ascii.h"
+#include "absl/types/span.h"
+#include "cc/public/core/interface/execution_result.h"
+
+#include "csv_scanner.h"
+#include "error_codes.h"
+
+using absl::ascii_isspace;
+using absl::Span;
+using google::pair::common::errors::CSV_COL_INDEX_OUT_OF_BOUNDS;
+using google::pair::common::errors::CSV_ROW_TOO_LONG;
+using google::pair::common::errors::CSV_ROW_UNEXPECTED_NUMBER_OF_COLUMNS;
+using google::scp::core::ExecutionResultOr;
+using google::scp::core::FailureExecutionResult;
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::string_view;
+using std::vector;
+
+namespace {
+
+// Whether two whitespace characters follow each other in column.
+bool HasWhitespaceRun(string_view column) {
+  for (size_t i = 1; i < column.size(); i++) {
+    if (ascii_isspace(column[i - 1]) && ascii_isspace(column[i])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Appends column to out with every run of whitespace replaced by its last
+// character, as absl::RemoveExtraAsciiWhitespace does.
+void AppendCollapsingWhitespace(string_view column, string& out) {
+  for (size_t i = 0; i < column.size(); i++) {
+    if (i + 1 < column.size() && ascii_isspace(column[i]) &&
+        ascii_isspace(column[i + 1])) {
+      continue;
+    }
+    out.push_back(column[i]);
+  }
+}
+
+}  // namespace
+
+namespace google::pair::common {
+
+ExecutionResultOr<CsvRowView> CsvRowView::Build(string_view csv_row,
+                                                size_t num_cols,
+                                                bool remove_whitespace,
+                                                char delimiter) {
+  // Checked before scanning, as the column offsets must fit in 32 bits.
+  if (csv_row.size() > std::numeric_limits<uint32_t>::max()) {
+    return FailureExecutionResult(CSV_ROW_TOO_LONG);
+  }
+  static const CsvScanner scanner;
+  // Reused across the rows built on a thread, so that finding the delimiters
+  // allocates nothing once it has grown to the widest row.
+  thread_local vector<size_t> delimiters;
+  delimiters.clear();
+  scanner.FindAll(csv_row, delimiter, delimiters);
+  return Build(csv_row, delimiters, num_cols, remove_whitespace);
+}
+
+ExecutionResultOr<CsvRowView> CsvRowView::Build(string_view csv_row,
+                                                Span<const size_t> delimiters,
+                                                size_t num_cols,
+                                                bool remove_whitespace) {
+  CsvRowView ret;
+  ret.row_ = csv_row;
+  // If the input is empty just return an empty row
+  if (csv_row.empty() && num_cols == 0) {
+    return ret;
+  }
+  if (csv_row.empty() && num_cols != 0) {
+    return FailureExecutionResult(CSV_ROW_UNEXPECTED_NUMBER_OF_COLUMNS);
+  }
+  // The column offsets must fit in 32 bits.
+  if (csv_row.size() > std::numeric_limits<uint32_t>::max()) {
+    return FailureExecutionResult(CSV_ROW_TOO_LONG);
+  }
+
+  // Every delimiter ends a column, and the last column ends the row.
+  if (delimiters.size() + 1 != num_cols) {
+    return FailureExecutionResult(CSV_ROW_UNEXPECTED_NUMBER_OF_COLUMNS);
+  }
+
+  bool has_whitespace_run = false;
+  ret.columns_.reserve(num_cols);
+  // A row ending with a delimiter ends with an empty column.
+  for (size_t i = 0, begin = 0; i <= delimiters.size(); i++) {
+    size_t end = i < delimiters.size() ? delimiters[i] : csv_row.size();
+    auto next_begin = end + 1;
+    if (remove_whitespace) {
+      while (begin < end && ascii_isspace(csv_row[begin])) {
+        begin++;
+      }
+      while (begin < end && ascii_isspace(csv_row[end - 1])) {
+        end--;
+      }
+      has_whitespace_run = has_whitespace_run ||
+                           HasWhitespaceRun(csv_row.substr(begin, end - begin));
+    }
+    ret.columns_.push_back(ColumnOffsets{static_cast<uint32_t>(begin),
+                                         static_cast<uint32_t>(end)});
+    begin = next_begin;
+  }
+
+  // Collapsing whitespace inside a column rewrites it, so the row is copied.
+  // This is rare enough in practice for rows to be zero-copy otherwise.
+  if (has_whitespace_run) {
+    auto collapsed = make_shared<string>();
+    collapsed->reserve(csv_row.size());
+    for (auto& column : ret.columns_) {
+      auto begin = static_cast<uint32_t>(collapsed->size());
+      AppendCollapsingWhitespace(
+          csv_row.substr(column.begin, column.end - column.begin),
+          *collapsed);
+      column = ColumnOffsets{begin, static_cast<uint32_t>(collapsed->size())};
+    }
+    ret.row_ = *collapsed;
+    ret.buffer_ = std::move(collapsed);
+  }
+
+  // As in CsvRow, a row ending with a delimiter ends with a column of a single
+  // space when whitespace is kept. That space is not in the row, so the row is
+  // copied with it appended.
+  if (!remove_whitespace && !delimiters.empty() &&
+      delimiters.back() + 1 == csv_row.size()) {
+    if (csv_row.size() == std::numeric_limits<uint32_t>::max()) {
+      return FailureExecutionResult(CSV_ROW_TOO_LONG);
+    }
+    auto padded = make_shared<string>();
+    padded->reserve(csv_row.size() + 1);
+    padded->append(csv_row).push_back(' ');
+    ret.columns_.back().end++;
+    ret.row_ = *padded;
+    ret.buffer_ = std::move(padded);
+  }
+
+  return ret;
+}
+
+ExecutionResultOr<CsvRowView> CsvRowView::Build(
+    shared_ptr<const string> buffer, string_view csv_row, size_t num_cols,
+    bool remove_whitespace, char delimiter) {
+  ASSIGN_OR_RETURN(auto ret,
+                   Build(csv_row, num_cols, remove_whitespace, delimiter));
+  // A row whose whitespace was collapsed already owns its copy.
+  if (!ret.buffer_) {
+    ret.buffer_ = std::move(buffer);
+  }
+  return ret;
+}
+
+ExecutionResultOr<string_view> CsvRowView::GetColumnView(size_t index) const {
+  if (index >= columns_.size()) {
+    return FailureExecutionResult(CSV_COL_INDEX_OUT_OF_BOUNDS);
+  }
+
+  const auto& column = columns_[index];
+  return row_.substr(column.begin, column.end - column.begin);
+}
+
+}  // namespace google::pair::common
@@ -0,0 +1,121 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "absl/container/inlined_vector.h"
+#include "absl/types/span.h"
+#include "cc/public/core/interface/execution_result.h"
+
+namespace google::pair::common {
+/**
+ * @brief Class representing a CSV row as the offsets of its columns within the
+ * unparsed row, so that building it copies no column and, for rows of up to
+ * kNumInlinedColumns columns, allocates nothing. Whitespace is removed as in
+ * CsvRow. Leading and trailing whitespace is trimmed by moving the offsets;
+ * only a row with a run of whitespace inside a column is copied, to collapse
+ * the run, and so is a row ending with a delimiter when whitespace is kept.
+ *
+ */
+class CsvRowView {
+ public:
+  /**
+   * @brief Rows with up to this many columns keep their offsets inline.
+   *
+   */
+  static constexpr size_t kNumInlinedColumns = 4;
+
+  /**
+   * @brief Build a CSV row view object, splitting csv_row into its columns at
+   * the delimiters, which are found with a CsvScanner. The row refers to
+   * csv_row, which must outlive it, unless it had to be copied to collapse
+   * whitespace or, as in CsvRow, to end it with a column of a single space
+   * when it ends with a delimiter and whitespace is kept.
+   *
+   * @param csv_row the unparsed CSV row
+   * @param num_cols the expected number of columns in the CSV row
+   * @param remove_whitespace whether to trim leading and trailing whitespace
+   * from the columns and collapse runs of whitespace inside them, as
+   * absl::RemoveExtraAsciiWhitespace does
+   * @param delimiter the column value delimiter
+   * @return scp::core::ExecutionResultOr<CsvRowView> a failure if the row has
+   * the wrong number of columns or is 4 GiB or longer
+   */
+  static scp::core::ExecutionResultOr<CsvRowView> Build(
+      std::string_view csv_row, size_t num_cols, bool remove_whitespace,
+      char delimiter);
+
+  /**
+   * @brief Like Build, but splits csv_row at delimiters already found, e.g.
+   * by scanning a whole chunk of rows for both line breaks and delimiters at
+   * once with CsvScanner.
+   *
+   * @param csv_row the unparsed CSV row
+   * @param delimiters the offsets of the delimiters within csv_row, in order
+   * @param num_cols the expected number of columns in the CSV row
+   * @param remove_whitespace whether to trim whitespace from the columns
+   * @return scp::core::ExecutionResultOr<CsvRowView>
+   */
+  static scp::core::ExecutionResultOr<CsvRowView> Build(
+      std::string_view csv_row, absl::Span<const size_t> delimiters,
+      size_t num_cols, bool remove_whitespace);
+
+  /**
+   * @brief Like Build, but the row shares ownership of the buffer csv_row is
+   * a part of, so it stays valid for as long as the row lives.
+   *
+   * @param buffer the buffer which csv_row is a part of
+   * @param csv_row the unparsed CSV row
+   * @param num_cols the expected number of columns in the CSV row
+   * @param remove_whitespace whether to trim whitespace from the columns
+   * @param delimiter the column value delimiter
+   * @return scp::core::ExecutionResultOr<CsvRowView>
+   */
+  static scp::core::ExecutionResultOr<CsvRowView> Build(
+      std::shared_ptr<const std::string> buffer, std::string_view csv_row,
+      size_t num_cols, bool remove_whitespace, char delimiter);
+
+  /**
+   * @brief Get a given column.
+   *
+   * @param index the index of the column
+   * @return scp::core::ExecutionResultOr<std::string_view> returns a failure
+   * if the index is out of bounds
+   */
+  scp::core::ExecutionResultOr<std::string_view> GetColumnView(
+      size_t index) const;
+
+ private:
+  /**
+   * @brief The offsets of a column within row_, the end being exclusive.
+   *
+   */
+  struct ColumnOffsets {
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  CsvRowView() = default;
+
+  std::shared_ptr<const std::string> buffer_;
+  std::string_view row_;
+  absl::InlinedVector<ColumnOffsets, kNumInlinedColumns> columns_;
+};
+
+}  // namespace google::pair::common
@@ -0,0 +1,156 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "csv_scanner.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+using std::string_view;
+using std::vector;
+
+namespace {
+
+constexpr size_t kBlockSize = 64;
+
+// Appends the offset of every a or b in data at or after begin to positions.
+void FindAllScalar(string_view data, char a, char b, size_t begin,
+                   vector<size_t>& positions) {
+  if (a == b) {
+    for (auto pos = data.find(a, begin); pos != string_view::npos;
+         pos = data.find(a, pos + 1)) {
+      positions.push_back(pos);
+    }
+    return;
+  }
+  const char needles[] = {a, b};
+  const string_view needle_set(needles, sizeof(needles));
+  for (auto pos = data.find_first_of(needle_set, begin);
+       pos != string_view::npos;
+       pos = data.find_first_of(needle_set, pos + 1)) {
+    positions.push_back(pos);
+  }
+}
+
+// Appends the offset of every set bit of mask, plus block_begin, to positions.
+inline void AppendMaskPositions(uint64_t mask, size_t block_begin,
+                                vector<size_t>& positions) {
+  while (mask != 0) {
+    positions.push_back(block_begin + __builtin_ctzll(mask));
+    mask &= mask - 1;
+  }
+}
+
+#if defined(__x86_64__)
+// The mask of the bytes of a 64 byte block equal to a or b, with SSE2.
+__attribute__((target("sse2"))) inline uint64_t MatchBlockSse2(
+    const char* block, __m128i a, __m128i b) {
+  uint64_t mask = 0;
+  for (size_t lane = 0; lane < kBlockSize / 16; lane++) {
+    auto bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + lane * 16));
+    auto matches =
+        _mm_or_si128(_mm_cmpeq_epi8(bytes, a), _mm_cmpeq_epi8(bytes, b));
+    uint64_t lane_mask = static_cast<uint16_t>(_mm_movemask_epi8(matches));
+    mask |= lane_mask << (lane * 16);
+  }
+  return mask;
+}
+
+__attribute__((target("sse2"))) void FindAllSse2(string_view data, char a,
+                                                 char b,
+                                                 vector<size_t>& positions) {
+  const __m128i needle_a = _mm_set1_epi8(a);
+  const __m128i needle_b = _mm_set1_epi8(b);
+  size_t i = 0;
+  for (; i + kBlockSize <= data.size(); i += kBlockSize) {
+    AppendMaskPositions(MatchBlockSse2(data.data() + i, needle_a, needle_b), i,
+                        positions);
+  }
+  FindAllScalar(data, a, b, i, positions);
+}
+
+// The mask of the bytes of a 32 byte half block equal to a or b, with AVX2.
+__attribute__((target("avx2"))) inline uint64_t MatchHalfBlockAvx2(
+    const char* half_block, __m256i a, __m256i b) {
+  auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(half_block));
+  auto matches = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, a),
+                                 _mm256_cmpeq_epi8(bytes, b));
+  return static_cast<uint32_t>(_mm256_movemask_epi8(matches));
+}
+
+__attribute__((target("avx2"))) void FindAllAvx2(string_view data, char a,
+                                                 char b,
+                                                 vector<size_t>& positions) {
+  const __m256i needle_a = _mm256_set1_epi8(a);
+  const __m256i needle_b = _mm256_set1_epi8(b);
+  const char* bytes = data.data();
+  size_t i = 0;
+  for (; i + kBlockSize <= data.size(); i += kBlockSize) {
+    uint64_t low_mask = MatchHalfBlockAvx2(bytes + i, needle_a, needle_b);
+    uint64_t high_mask =
+        MatchHalfBlockAvx2(bytes + i + kBlockSize / 2, needle_a, needle_b);
+    AppendMaskPositions(low_mask | (high_mask << 32), i, positions);
+  }
+  FindAllScalar(data, a, b, i, positions);
+}
+#endif
+
+}  // namespace
+
+namespace google::pair::common {
+
+CsvScannerIsa GetSupportedCsvScannerIsa() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2")) {
+    return CsvScannerIsa::kAvx2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return CsvScannerIsa::kSse2;
+  }
+#endif
+  return CsvScannerIsa::kScalar;
+}
+
+CsvScanner::CsvScanner(CsvScannerIsa isa)
+    : isa_(std::min(isa, GetSupportedCsvScannerIsa())) {}
+
+void CsvScanner::FindAll(string_view data, char c,
+                         vector<size_t>& positions) const {
+  FindAll(data, c, c, positions);
+}
+
+void CsvScanner::FindAll(string_view data, char a, char b,
+                         vector<size_t>& positions) const {
+  switch (isa_) {
+#if defined(__x86_64__)
+    case CsvScannerIsa::kAvx2:
+      FindAllAvx2(data, a, b, positions);
+      return;
+    case CsvScannerIsa::kSse2:
+      FindAllSse2(data, a, b, positions);
+      return;
+#endif
+    default:
+      FindAllScalar(data, a, b, 0, positions);
+  }
+}
+
+}  // namespace google::pair::common
@@ -0,0 +1,83 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace google::pair::common {
+
+/**
+ * @brief The instruction sets a CsvScanner can scan with, from the slowest to
+ * the fastest.
+ *
+ */
+enum class CsvScannerIsa { kScalar, kSse2, kAvx2 };
+
+/**
+ * @brief Get the fastest instruction set the CPU running this supports.
+ *
+ * @return CsvScannerIsa
+ */
+CsvScannerIsa GetSupportedCsvScannerIsa();
+
+/**
+ * @brief Finds the line breaks or delimiters in CSV data 64 bytes at a time,
+ * comparing them against one or two characters and collecting the matches into
+ * a bit mask with SSE2 or AVX2. Finding both characters in one pass lets a
+ * parser split a chunk into rows and columns with a single scan. Falls back to
+ * scanning with std::string_view::find on CPUs without either.
+ *
+ */
+class CsvScanner {
+ public:
+  /**
+   * @brief Construct a new Csv Scanner object
+   *
+   * @param isa the instruction set to scan with. Lowered to the fastest one
+   * the CPU supports.
+   */
+  explicit CsvScanner(CsvScannerIsa isa = GetSupportedCsvScannerIsa());
+
+  /**
+   * @brief Appends the offset of every c in data to positions, in order.
+   *
+   * @param data the data to scan
+   * @param c the character to find, e.g. the line break
+   * @param positions where the offsets are appended
+   */
+  void FindAll(std::string_view data, char c,
+               std::vector<size_t>& positions) const;
+
+  /**
+   * @brief Appends the offset of every a or b in data to positions, in order,
+   * matching both characters in the same pass over each block.
+   *
+   * @param data the data to scan
+   * @param a a character to find, e.g. the line break
+   * @param b another character to find, e.g. the delimiter
+   * @param positions where the offsets are appended
+   */
+  void FindAll(std::string_view data, char a, char b,
+               std::vector<size_t>& positions) const;
+
+  CsvScannerIsa GetIsa() const { return isa_; }
+
+ private:
+  const CsvScannerIsa isa_;
+};
+
+}  // namespace google::pair::common
@@ -14,9 +14,11 @@
 
 #include "csv_stream_parser.h"
 
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string_view>
+#include <utility>
 
 #include "error_codes.h"
 
@@ -30,10 +32,13 @@ using google::scp::core::SuccessExecutionResult;
 using google::scp::core::common::ConcurrentQueue;
 using std::getline;
 using std::ios;
+using std::make_shared;
 using std::make_unique;
+using std::shared_ptr;
 using std::string;
 using std::string_view;
 using std::stringstream;
+using std::vector;
 
 // Very large number since we don't expect the insertion into the
 // concurrent queue to fail and it is treated as an error.
@@ -43,8 +48,16 @@ namespace google::pair::common {
 
 CsvStreamParser::CsvStreamParser(const CsvStreamParserConfig& config)
     : config_(config),
-      rows_(make_unique<ConcurrentQueue<string>>(
-          kCsvStreamParserConcurrentQueueCapacity)),
+      rows_(config.GetZeroCopy()
+                ? nullptr
+                : make_unique<ConcurrentQueue<shared_ptr<vector<string>>>>(
+                      kCsvStreamParserConcurrentQueueCapacity)),
+      row_batches_(config.GetZeroCopy()
+                       ? make_unique<ConcurrentQueue<shared_ptr<RowBatch>>>(
+                             kCsvStreamParserConcurrentQueueCapacity)
+                       : nullptr),
+      scanner_(config.GetSimdScan() ? GetSupportedCsvScannerIsa()
+                                    : CsvScannerIsa::kScalar),
       buffered_data_size_(0) {}
 
 ExecutionResult CsvStreamParser::AddCsvChunk(string_view chunk) noexcept {
@@ -57,9 +70,14 @@ ExecutionResult CsvStreamParser::AddCsvChunk(string_view chunk) noexcept {
 
   buffered_data_size_ += chunk.size();
 
+  if (config_.GetZeroCopy() || config_.GetSimdScan()) {
+    return AddCsvChunkScanned(chunk);
+  }
+
   stringstream current_data = move(rolling_data_);
   current_data << chunk;
   string line;
+  auto rows = make_shared<vector<string>>();
   auto rolling_cursor = current_data.tellg();
 
   while (getline(current_data, line, config_.GetLineBreak())) {
@@ -83,13 +101,11 @@ ExecutionResult CsvStreamParser::AddCsvChunk(string_view chunk) noexcept {
       } else {
         // Even though we reached the end of the stream, we did find a full
         // row.
-        // If this fails, it is unexpected and it is an error condition.
-        RETURN_IF_FAILURE(rows_->TryEnqueue(line));
+        rows->push_back(line);
       }
     } else {
       // We found a full row.
-      // If this fails, it is unexpected and it is an error condition.
-      RETURN_IF_FAILURE(rows_->TryEnqueue(line));
+      rows->push_back(line);
       rolling_cursor = current_data.tellg();
     }
   }
@@ -102,28 +118,190 @@ ExecutionResult CsvStreamParser::AddCsvChunk(string_view chunk) noexcept {
     rolling_data_ << current_data.rdbuf();
   }
 
+  if (!rows->empty()) {
+    // If this fails, it is unexpected and it is an error condition.
+    RETURN_IF_FAILURE(rows_->TryEnqueue(rows));
+  }
+
+  return SuccessExecutionResult();
+}
+
+ExecutionResult CsvStreamParser::AddCsvChunkScanned(
+    string_view chunk) noexcept {
+  auto buffer = make_shared<string>();
+  buffer->reserve(partial_row_.size() + chunk.size());
+  buffer->append(partial_row_).append(chunk);
+  partial_row_.clear();
+
+  string_view data(*buffer);
+  line_breaks_.clear();
+  scanner_.FindAll(data, config_.GetLineBreak(), line_breaks_);
+  size_t begin = 0;
+  if (config_.GetZeroCopy()) {
+    auto batch = make_shared<RowBatch>();
+    batch->rows.reserve(line_breaks_.size());
+    for (auto end : line_breaks_) {
+      batch->rows.push_back(data.substr(begin, end - begin));
+      begin = end + 1;
+    }
+    if (!batch->rows.empty()) {
+      batch->buffer = buffer;
+      // If this fails, it is unexpected and it is an error condition.
+      RETURN_IF_FAILURE(row_batches_->TryEnqueue(batch));
+    }
+  } else {
+    auto rows = make_shared<vector<string>>();
+    rows->reserve(line_breaks_.size());
+    for (auto end : line_breaks_) {
+      rows->emplace_back(data.substr(begin, end - begin));
+      begin = end + 1;
+    }
+    if (!rows->empty()) {
+      // If this fails, it is unexpected and it is an error condition.
+      RETURN_IF_FAILURE(rows_->TryEnqueue(rows));
+    }
+  }
+
+  if (begin == 0) {
+    // No row refers to the buffer, so it becomes the partial row as is.
+    partial_row_ = std::move(*buffer);
+  } else {
+    partial_row_.assign(data.substr(begin));
+  }
+
   return SuccessExecutionResult();
 }
 
 bool CsvStreamParser::HasRow() const noexcept {
+  if (next_row_ < GetNumCurrentRows()) {
+    return true;
+  }
+  if (config_.GetZeroCopy()) {
+    return row_batches_->Size() > 0;
+  }
   return rows_->Size() > 0;
 }
 
-ExecutionResultOr<CsvRow> CsvStreamParser::GetNextRow() noexcept {
+size_t CsvStreamParser::GetNumCurrentRows() const noexcept {
+  if (config_.GetZeroCopy()) {
+    return current_row_batch_ ? current_row_batch_->rows.size() : 0;
+  }
+  return current_rows_ ? current_rows_->size() : 0;
+}
+
+ExecutionResult CsvStreamParser::LoadNextRow() noexcept {
+  if (next_row_ < GetNumCurrentRows()) {
+    return SuccessExecutionResult();
+  }
   if (!HasRow()) {
     return FailureExecutionResult(CSV_STREAM_PARSER_NO_ROW_AVAILABLE);
   }
 
-  string row;
-  RETURN_IF_FAILURE(rows_->TryDequeue(row));
+  next_row_ = 0;
+  if (config_.GetZeroCopy()) {
+    return row_batches_->TryDequeue(current_row_batch_);
+  }
+  return rows_->TryDequeue(current_rows_);
+}
+
+ExecutionResultOr<string> CsvStreamParser::TakeRow(size_t& num_bytes) noexcept {
+  RETURN_IF_FAILURE(LoadNextRow());
+  string row = config_.GetZeroCopy()
+                   ? string(current_row_batch_->rows[next_row_])
+                   : std::move((*current_rows_)[next_row_]);
+  next_row_++;
 
   // We add one to account for the line break char
-  buffered_data_size_ -= row.size() + 1;
+  num_bytes += row.size() + 1;
+  return row;
+}
+
+ExecutionResultOr<CsvStreamParser::BufferedRow>
+CsvStreamParser::TakeBufferedRow(size_t& num_bytes) noexcept {
+  RETURN_IF_FAILURE(LoadNextRow());
+  BufferedRow row;
+  if (config_.GetZeroCopy()) {
+    row = BufferedRow{current_row_batch_->buffer,
+                      current_row_batch_->rows[next_row_]};
+  } else {
+    shared_ptr<const string> buffer =
+        make_shared<string>(std::move((*current_rows_)[next_row_]));
+    row = BufferedRow{buffer, *buffer};
+  }
+  next_row_++;
+
+  // We add one to account for the line break char
+  num_bytes += row.row.size() + 1;
+  return row;
+}
+
+ExecutionResultOr<CsvRow> CsvStreamParser::GetNextRow() noexcept {
+  size_t num_bytes = 0;
+  ASSIGN_OR_RETURN(auto row, TakeRow(num_bytes));
+  buffered_data_size_ -= num_bytes;
 
   return CsvRow::Build(row, config_.GetNumCols(), config_.GetRemoveWhitespace(),
                        config_.GetDelimiter());
 }
 
+ExecutionResultOr<CsvRowView> CsvStreamParser::GetNextRowView() noexcept {
+  size_t num_bytes = 0;
+  ASSIGN_OR_RETURN(auto row, TakeBufferedRow(num_bytes));
+  buffered_data_size_ -= num_bytes;
+
+  return CsvRowView::Build(std::move(row.buffer), row.row, config_.GetNumCols(),
+                           config_.GetRemoveWhitespace(),
+                           config_.GetDelimiter());
+}
+
+ExecutionResult CsvStreamParser::GetNextRows(size_t max_rows,
+                                             vector<CsvRow>* rows) noexcept {
+  size_t num_bytes = 0;
+  ExecutionResult result = SuccessExecutionResult();
+  for (size_t i = 0; i < max_rows && HasRow(); i++) {
+    auto row_or = TakeRow(num_bytes);
+    if (!row_or.Successful()) {
+      result = row_or.result();
+      break;
+    }
+    auto csv_row_or =
+        CsvRow::Build(*row_or, config_.GetNumCols(),
+                      config_.GetRemoveWhitespace(), config_.GetDelimiter());
+    if (!csv_row_or.Successful()) {
+      result = csv_row_or.result();
+      break;
+    }
+    rows->push_back(std::move(*csv_row_or));
+  }
+  // Accounted for once for the whole batch.
+  buffered_data_size_ -= num_bytes;
+  return result;
+}
+
+ExecutionResult CsvStreamParser::GetNextRowViews(
+    size_t max_rows, vector<CsvRowView>* rows) noexcept {
+  size_t num_bytes = 0;
+  ExecutionResult result = SuccessExecutionResult();
+  for (size_t i = 0; i < max_rows && HasRow(); i++) {
+    auto row_or = TakeBufferedRow(num_bytes);
+    if (!row_or.Successful()) {
+      result = row_or.result();
+      break;
+    }
+    auto csv_row_or = CsvRowView::Build(
+        std::move(row_or->buffer), row_or->row, config_.GetNumCols(),
+        config_.GetRemoveWhitespace(), config_.GetDelimiter());
+    if (!csv_row_or.Successful()) {
+      result = csv_row_or.result();
+      break;
+    }
+    rows->push_back(std::move(*csv_row_or));
+  }
+  // Accounted for once for the whole batch.
+  buffered_data_size_ -= num_bytes;
+  return result;
+}
+
 size_t CsvStreamParser::GetBufferedDataSize() const noexcept {
   return buffered_data_size_.load();
 }
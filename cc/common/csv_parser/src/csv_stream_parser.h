@@ -20,11 +20,14 @@
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include "cc/core/common/concurrent_queue/src/concurrent_queue.h"
 #include "cc/public/core/interface/execution_result.h"
 
 #include "csv_row.h"
+#include "csv_row_view.h"
+#include "csv_scanner.h"
 #include "csv_stream_parser_config.h"
 #include "csv_stream_parser_interface.h"
 
@@ -41,9 +44,74 @@ class CsvStreamParser : public CsvStreamParserInterface {
 
   scp::core::ExecutionResultOr<CsvRow> GetNextRow() noexcept override;
 
+  scp::core::ExecutionResultOr<CsvRowView> GetNextRowView() noexcept override;
+
+  scp::core::ExecutionResult GetNextRows(
+      size_t max_rows, std::vector<CsvRow>* rows) noexcept override;
+
+  scp::core::ExecutionResult GetNextRowViews(
+      size_t max_rows, std::vector<CsvRowView>* rows) noexcept override;
+
   size_t GetBufferedDataSize() const noexcept override;
 
  private:
+  /**
+   * @brief A complete row, and the buffer it is in.
+   *
+   */
+  struct BufferedRow {
+    std::shared_ptr<const std::string> buffer;
+    std::string_view row;
+  };
+
+  /**
+   * @brief The complete rows of a chunk in zero copy mode, and the chunk
+   * buffer they are in.
+   *
+   */
+  struct RowBatch {
+    std::shared_ptr<const std::string> buffer;
+    std::vector<std::string_view> rows;
+  };
+
+  /**
+   * @brief AddCsvChunk in zero copy or SIMD scan mode. The chunk is copied
+   * once into a new buffer, after the partial row left over from the previous
+   * chunk, and the line breaks in it are found with scanner_. In zero copy
+   * mode the complete rows are queued as views of that buffer, otherwise as
+   * copies.
+   *
+   */
+  scp::core::ExecutionResult AddCsvChunkScanned(
+      std::string_view chunk) noexcept;
+
+  /**
+   * @brief The number of rows in the batch rows are being taken from.
+   *
+   */
+  size_t GetNumCurrentRows() const noexcept;
+
+  /**
+   * @brief Makes sure the batch rows are being taken from has a row left,
+   * dequeuing the next batch if needed, or fails if no rows are available.
+   *
+   */
+  scp::core::ExecutionResult LoadNextRow() noexcept;
+
+  /**
+   * @brief Takes the next row, adding the bytes it buffered to num_bytes.
+   *
+   */
+  scp::core::ExecutionResultOr<std::string> TakeRow(size_t& num_bytes) noexcept;
+
+  /**
+   * @brief Takes the next row along with a buffer that keeps it alive, adding
+   * the bytes it buffered to num_bytes.
+   *
+   */
+  scp::core::ExecutionResultOr<BufferedRow> TakeBufferedRow(
+      size_t& num_bytes) noexcept;
+
   /**
    * @brief The config object that the parser was initialized with.
    *
@@ -51,10 +119,14 @@ class CsvStreamParser : public CsvStreamParserInterface {
   const CsvStreamParserConfig config_;
 
   /**
-   * @brief Holds the rows that have been parsed so far.
+   * @brief Holds the rows that have been parsed so far, a chunk's rows at a
+   * time so that taking rows synchronizes with adding chunks once per chunk
+   * rather than once per row.
    *
    */
-  std::unique_ptr<scp::core::common::ConcurrentQueue<std::string>> rows_;
+  std::unique_ptr<scp::core::common::ConcurrentQueue<
+      std::shared_ptr<std::vector<std::string>>>>
+      rows_;
 
   /**
    * @brief Buffer containing the data that has been added to the parser so far.
@@ -62,6 +134,45 @@ class CsvStreamParser : public CsvStreamParserInterface {
    */
   std::stringstream rolling_data_;
 
+  /**
+   * @brief Holds the rows that have been parsed so far in zero copy mode, a
+   * chunk's rows at a time.
+   *
+   */
+  std::unique_ptr<
+      scp::core::common::ConcurrentQueue<std::shared_ptr<RowBatch>>>
+      row_batches_;
+
+  /**
+   * @brief The batch rows are being taken from, which is current_rows_ or, in
+   * zero copy mode, current_row_batch_, and the index of its next row. Only
+   * used by the thread taking rows.
+   *
+   */
+  std::shared_ptr<std::vector<std::string>> current_rows_;
+  std::shared_ptr<RowBatch> current_row_batch_;
+  size_t next_row_ = 0;
+
+  /**
+   * @brief The trailing partial row of the chunks added so far in zero copy
+   * or SIMD scan mode.
+   *
+   */
+  std::string partial_row_;
+
+  /**
+   * @brief Finds the line breaks in zero copy or SIMD scan mode.
+   *
+   */
+  const CsvScanner scanner_;
+
+  /**
+   * @brief The offsets of the line breaks in the chunk being added, kept
+   * around to reuse its memory.
+   *
+   */
+  std::vector<size_t> line_breaks_;
+
   /**
    * @brief This is a best effort accumulator to keep an upper limit on how much
    * data has been buffered.
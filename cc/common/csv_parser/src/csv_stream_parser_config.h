@@ -42,18 +42,26 @@ class CsvStreamParserConfig {
    * @param line_break The line break character used to distinguish rows
    * @param max_buffered_data_size The maximum amount of data to buffer at a
    * time
+   * @param zero_copy Whether the parser keeps the added chunks in shared
+   * buffers and its rows refer to them, rather than copying every row out
+   * @param simd_scan Whether the parser finds the line breaks with SSE2 or
+   * AVX2 when the CPU supports them. It then splits rows without a stream,
+   * like in zero copy mode, producing the same rows.
    */
   CsvStreamParserConfig(size_t num_cols, bool remove_whitespace = true,
                         char delimiter = kDefaultCsvRowDelimiter,
                         char line_break = kDefaultCsvLineBreak,
                         size_t max_buffered_data_size =
-                            kDefaultCsvStreamParserBufferedDataSizeBytes)
+                            kDefaultCsvStreamParserBufferedDataSizeBytes,
+                        bool zero_copy = false, bool simd_scan = false)
       : num_cols_(num_cols),
         remove_whitespace_(remove_whitespace),
         delimiter_(delimiter),
         line_break_(line_break),
         max_buffered_data_size_(std::min(
-            max_buffered_data_size, kMaxCsvStreamParserBufferedDataSizeBytes)) {
+            max_buffered_data_size, kMaxCsvStreamParserBufferedDataSizeBytes)),
+        zero_copy_(zero_copy),
+        simd_scan_(simd_scan) {
 
   }
 
@@ -67,12 +75,18 @@ class CsvStreamParserConfig {
 
   size_t GetMaxBufferedDataSize() const { return max_buffered_data_size_; }
 
+  bool GetZeroCopy() const { return zero_copy_; }
+
+  bool GetSimdScan() const { return simd_scan_; }
+
  private:
   size_t num_cols_;
   bool remove_whitespace_;
   char delimiter_;
   char line_break_;
   size_t max_buffered_data_size_;
+  bool zero_copy_;
+  bool simd_scan_;
 };
 
 }  // namespace google::pair::common
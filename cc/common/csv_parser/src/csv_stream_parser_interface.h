@@ -15,10 +15,12 @@
 #pragma once
 
 #include <string_view>
+#include <vector>
 
 #include "cc/public/core/interface/execution_result.h"
 
 #include "csv_row.h"
+#include "csv_row_view.h"
 
 namespace google::pair::common {
 /**
@@ -61,6 +63,40 @@ class CsvStreamParserInterface {
    */
   virtual scp::core::ExecutionResultOr<CsvRow> GetNextRow() noexcept = 0;
 
+  /**
+   * @brief Get a row from the parser whose columns refer to the parser's
+   * buffers rather than copies of them, or a failure if no rows are available.
+   * Only avoids copying the row if the parser was configured for zero copy.
+   *
+   * @return scp::core::ExecutionResultOr<CsvRowView>
+   */
+  virtual scp::core::ExecutionResultOr<CsvRowView>
+  GetNextRowView() noexcept = 0;
+
+  /**
+   * @brief Get up to max_rows rows from the parser at once, which takes far
+   * fewer synchronizations with the thread adding chunks than getting them
+   * one by one.
+   *
+   * @param max_rows the maximum number of rows to get
+   * @param rows where the rows are appended. Fewer than max_rows, possibly
+   * none, are appended if fewer are available.
+   * @return scp::core::ExecutionResult a failure if a row failed to parse, in
+   * which case the rows before it were appended and it is dropped
+   */
+  virtual scp::core::ExecutionResult GetNextRows(
+      size_t max_rows, std::vector<CsvRow>* rows) noexcept = 0;
+
+  /**
+   * @brief Like GetNextRows, but gets rows like GetNextRowView.
+   *
+   * @param max_rows the maximum number of rows to get
+   * @param rows where the rows are appended
+   * @return scp::core::ExecutionResult
+   */
+  virtual scp::core::ExecutionResult GetNextRowViews(
+      size_t max_rows, std::vector<CsvRowView>* rows) noexcept = 0;
+
   /**
    * @brief Get the current buffered data size.
    *
@@ -32,6 +32,10 @@ DEFINE_ERROR_CODE(CSV_COL_INDEX_OUT_OF_BOUNDS, CSV_ROW, 0x0002,
                   "Column index out of bounds.",
                   scp::core::errors::HttpStatusCode::BAD_REQUEST)
 
+DEFINE_ERROR_CODE(CSV_ROW_TOO_LONG, CSV_ROW, 0x0003,
+                  "The row is too long to be parsed.",
+                  scp::core::errors::HttpStatusCode::BAD_REQUEST)
+
 REGISTER_COMPONENT_CODE(CSV_STREAM_PARSER, 0x0602)
 
 DEFINE_ERROR_CODE(CSV_STREAM_PARSER_BUFFER_AT_CAPACITY, CSV_STREAM_PARSER,
@@ -0,0 +1,152 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "parallel_csv_parser.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using google::scp::core::AsyncExecutorInterface;
+using google::scp::core::AsyncPriority;
+using google::scp::core::ExecutionResult;
+using google::scp::core::ExecutionResultOr;
+using google::scp::core::SuccessExecutionResult;
+using std::condition_variable;
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+using std::string;
+using std::string_view;
+using std::unique_lock;
+using std::vector;
+
+namespace google::pair::common {
+
+ParallelCsvParser::ParallelCsvParser(
+    shared_ptr<AsyncExecutorInterface> cpu_async_executor,
+    const CsvStreamParserConfig& config, size_t num_ranges)
+    : cpu_async_executor_(std::move(cpu_async_executor)),
+      config_(config),
+      num_ranges_(num_ranges != 0
+                      ? num_ranges
+                      : std::max(1u, std::thread::hardware_concurrency())),
+      scanner_(config.GetSimdScan() ? GetSupportedCsvScannerIsa()
+                                    : CsvScannerIsa::kScalar) {}
+
+ExecutionResultOr<vector<CsvRowBatch>> ParallelCsvParser::Parse(
+    shared_ptr<const string> buffer, CsvRowBatchOrder order) const {
+  string_view data(*buffer);
+  auto range_begins = SplitIntoRanges(data);
+  auto num_ranges = range_begins.size() - 1;
+
+  mutex mu;
+  condition_variable all_parsed;
+  size_t num_pending = 0;
+  ExecutionResult result = SuccessExecutionResult();
+  vector<CsvRowBatch> batches;
+  if (order == CsvRowBatchOrder::kBufferOrder) {
+    batches.resize(num_ranges);
+  } else {
+    batches.reserve(num_ranges);
+  }
+
+  for (size_t i = 0; i < num_ranges; i++) {
+    auto parse_range = [&, i]() {
+      CsvRowBatch batch{i, buffer};
+      batch.result = ParseRange(
+          data.substr(range_begins[i], range_begins[i + 1] - range_begins[i]),
+          batch.rows);
+      lock_guard lock(mu);
+      if (order == CsvRowBatchOrder::kBufferOrder) {
+        batches[i] = std::move(batch);
+      } else {
+        batches.push_back(std::move(batch));
+      }
+      if (--num_pending == 0) {
+        all_parsed.notify_all();
+      }
+    };
+    {
+      lock_guard lock(mu);
+      num_pending++;
+    }
+    if (auto schedule_result =
+            cpu_async_executor_->Schedule(parse_range, AsyncPriority::Normal);
+        !schedule_result.Successful()) {
+      lock_guard lock(mu);
+      num_pending--;
+      result = schedule_result;
+      break;
+    }
+  }
+
+  // The ranges which were scheduled refer to the state above, so they must
+  // finish even if scheduling the others failed.
+  unique_lock lock(mu);
+  all_parsed.wait(lock, [&num_pending]() { return num_pending == 0; });
+  if (!result.Successful()) {
+    return result;
+  }
+  return batches;
+}
+
+vector<size_t> ParallelCsvParser::SplitIntoRanges(string_view data) const {
+  vector<size_t> range_begins = {0};
+  for (size_t i = 1; i < num_ranges_; i++) {
+    auto line_break = data.find(config_.GetLineBreak(),
+                                std::max(data.size() * i / num_ranges_,
+                                         range_begins.back()));
+    if (line_break == string_view::npos || line_break + 1 == data.size()) {
+      break;
+    }
+    range_begins.push_back(line_break + 1);
+  }
+  range_begins.push_back(data.size());
+  return range_begins;
+}
+
+ExecutionResult ParallelCsvParser::ParseRange(
+    string_view range, vector<CsvRowView>& rows) const {
+  // The line breaks and the delimiters are found in a single scan, and told
+  // apart afterwards.
+  const char line_break = config_.GetLineBreak();
+  vector<size_t> positions;
+  scanner_.FindAll(range, line_break, config_.GetDelimiter(), positions);
+
+  size_t begin = 0;
+  vector<size_t> delimiters;
+  for (auto position : positions) {
+    if (range[position] != line_break) {
+      delimiters.push_back(position - begin);
+      continue;
+    }
+    ASSIGN_OR_RETURN(
+        auto row,
+        CsvRowView::Build(range.substr(begin, position - begin), delimiters,
+                          config_.GetNumCols(), config_.GetRemoveWhitespace()));
+    rows.push_back(std::move(row));
+    delimiters.clear();
+    begin = position + 1;
+  }
+  return SuccessExecutionResult();
+}
+
+}  // namespace google::pair::common
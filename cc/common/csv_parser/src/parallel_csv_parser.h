@@ -0,0 +1,119 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cc/core/interface/async_executor_interface.h"
+#include "cc/public/core/interface/execution_result.h"
+
+#include "csv_row_view.h"
+#include "csv_scanner.h"
+#include "csv_stream_parser_config.h"
+
+namespace google::pair::common {
+
+/**
+ * @brief The rows parsed out of one range of a buffer. The rows refer to the
+ * buffer, which the batch keeps alive.
+ *
+ */
+struct CsvRowBatch {
+  // The index of the range in the buffer, the first range being 0.
+  size_t range_index = 0;
+  std::shared_ptr<const std::string> buffer;
+  // The rows of the range up to the first which failed to parse, if any.
+  std::vector<CsvRowView> rows;
+  // The failure of the first row of the range which failed to parse, if any.
+  scp::core::ExecutionResult result = scp::core::SuccessExecutionResult();
+};
+
+/**
+ * @brief The order in which ParallelCsvParser returns the row batches.
+ *
+ */
+enum class CsvRowBatchOrder {
+  // In the order of their ranges, so the rows are in the buffer's order.
+  kBufferOrder,
+  // In the order the ranges finished parsing in.
+  kCompletionOrder,
+};
+
+/**
+ * @brief Parses a complete CSV buffer, such as a whole blob downloaded into
+ * memory, on many threads at once. The buffer is split at line breaks into
+ * ranges of about the same size, which are parsed concurrently on an
+ * AsyncExecutor.
+ *
+ */
+class ParallelCsvParser {
+ public:
+  /**
+   * @brief Construct a new Parallel Csv Parser object
+   *
+   * @param cpu_async_executor the executor to parse the ranges on
+   * @param config how to parse the rows. The buffered data size limit does
+   * not apply.
+   * @param num_ranges the number of ranges to split buffers into, at most.
+   * Defaults to the number of hardware threads if 0.
+   */
+  ParallelCsvParser(
+      std::shared_ptr<scp::core::AsyncExecutorInterface> cpu_async_executor,
+      const CsvStreamParserConfig& config, size_t num_ranges = 0);
+
+  /**
+   * @brief Parses buffer into rows and waits until they are all parsed. Must
+   * not be called on the executor's own threads, which it waits for. As in
+   * CsvStreamParser, data after the last line break is not a complete row and
+   * is not parsed.
+   *
+   * @param buffer the complete CSV data
+   * @param order the order to return the row batches in
+   * @return scp::core::ExecutionResultOr<std::vector<CsvRowBatch>> the rows,
+   * one batch per range, each with the result of parsing its range. A failure
+   * if the ranges could not all be scheduled.
+   */
+  scp::core::ExecutionResultOr<std::vector<CsvRowBatch>> Parse(
+      std::shared_ptr<const std::string> buffer,
+      CsvRowBatchOrder order = CsvRowBatchOrder::kBufferOrder) const;
+
+  size_t GetNumRanges() const { return num_ranges_; }
+
+ private:
+  /**
+   * @brief Returns the offsets at which the ranges of data begin, each right
+   * after a line break, followed by the size of data.
+   *
+   */
+  std::vector<size_t> SplitIntoRanges(std::string_view data) const;
+
+  /**
+   * @brief Parses the rows of range into rows, stopping at the first which
+   * fails to parse.
+   *
+   */
+  scp::core::ExecutionResult ParseRange(std::string_view range,
+                                        std::vector<CsvRowView>& rows) const;
+
+  std::shared_ptr<scp::core::AsyncExecutorInterface> cpu_async_executor_;
+  const CsvStreamParserConfig config_;
+  const size_t num_ranges_;
+  const CsvScanner scanner_;
+};
+
+}  // namespace google::pair::common
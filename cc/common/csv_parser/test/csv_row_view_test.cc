@@ -0,0 +1,247 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/common/csv_parser/src/csv_row_view.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cc/common/csv_parser/src/csv_row.h"
+#include "cc/common/csv_parser/src/error_codes.h"
+#include "cc/public/core/test/interface/execution_result_matchers.h"
+
+using google::pair::common::CsvRow;
+using google::pair::common::CsvRowView;
+using google::pair::common::errors::CSV_COL_INDEX_OUT_OF_BOUNDS;
+using google::pair::common::errors::CSV_ROW_TOO_LONG;
+using google::pair::common::errors::CSV_ROW_UNEXPECTED_NUMBER_OF_COLUMNS;
+using google::scp::core::FailureExecutionResult;
+using google::scp::core::test::IsSuccessfulAndHolds;
+using google::scp::core::test::ResultIs;
+using std::make_shared;
+using std::string;
+using std::string_view;
+using std::vector;
+using std::weak_ptr;
+
+namespace google::pair::common::test {
+
+TEST(CsvRowViewTest, BuildShouldSplitColumnsWithoutCopying) {
+  auto buffer = make_shared<const string>("val1,val2,val3\n");
+  string_view line(buffer->data(), 14);
+
+  ASSERT_SUCCESS_AND_ASSIGN(auto row,
+                            CsvRowView::Build(buffer, line, /* num_cols */ 3,
+                                              /* remove_whitespace */ true,
+                                              /* delimiter */ ','));
+
+  EXPECT_THAT(row.GetColumnView(0), IsSuccessfulAndHolds("val1"));
+  EXPECT_THAT(row.GetColumnView(1), IsSuccessfulAndHolds("val2"));
+  EXPECT_THAT(row.GetColumnView(2), IsSuccessfulAndHolds("val3"));
+  EXPECT_EQ(row.GetColumnView(1)->data(), buffer->data() + 5);
+}
+
+TEST(CsvRowViewTest, BuildShouldSplitAtDelimitersFoundBeforehand) {
+  string line = "val1,val2, val3";
+  vector<size_t> delimiters = {4, 9};
+
+  ASSERT_SUCCESS_AND_ASSIGN(auto row,
+                            CsvRowView::Build(line, delimiters,
+                                              /* num_cols */ 3,
+                                              /* remove_whitespace */ true));
+
+  EXPECT_THAT(row.GetColumnView(0), IsSuccessfulAndHolds("val1"));
+  EXPECT_THAT(row.GetColumnView(1), IsSuccessfulAndHolds("val2"));
+  EXPECT_THAT(row.GetColumnView(2), IsSuccessfulAndHolds("val3"));
+  EXPECT_THAT(CsvRowView::Build(line, delimiters, /* num_cols */ 2,
+                                /* remove_whitespace */ true),
+              ResultIs(FailureExecutionResult(
+                  CSV_ROW_UNEXPECTED_NUMBER_OF_COLUMNS)));
+}
+
+TEST(CsvRowViewTest, BuildShouldStripWhitespaceIfAsked) {
+  auto buffer = make_shared<const string>("  val1 , val 2\t");
+
+  ASSERT_SUCCESS_AND_ASSIGN(auto stripped,
+                            CsvRowView::Build(buffer, *buffer, /* num_cols */ 2,
+                                              /* remove_whitespace */ true,
+                                              /* delimiter */ ','));
+  ASSERT_SUCCESS_AND_ASSIGN(auto kept,
+                            CsvRowView::Build(buffer, *buffer, /* num_cols */ 2,
+                                              /* remove_whitespace */ false,
+                                              /* delimiter */ ','));
+
+  EXPECT_THAT(stripped.GetColumnView(0), IsSuccessfulAndHolds("val1"));
+  EXPECT_THAT(stripped.GetColumnView(1), IsSuccessfulAndHolds("val 2"));
+  EXPECT_THAT(kept.GetColumnView(0), IsSuccessfulAndHolds("  val1 "));
+  EXPECT_THAT(kept.GetColumnView(1), IsSuccessfulAndHolds(" val 2\t"));
+}
+
+TEST(CsvRowViewTest, BuildShouldRemoveWhitespaceLikeCsvRow) {
+  for (string line : {" a  b ,c\t\t d", "a \t\n b,  ", "\t\t,x y  z"}) {
+    auto buffer = make_shared<const string>(line);
+
+    ASSERT_SUCCESS_AND_ASSIGN(auto row,
+                              CsvRowView::Build(buffer, *buffer,
+                                                /* num_cols */ 2,
+                                                /* remove_whitespace */ true,
+                                                /* delimiter */ ','));
+    ASSERT_SUCCESS_AND_ASSIGN(auto expected,
+                              CsvRow::Build(line, /* num_cols */ 2,
+                                            /* remove_whitespace */ true,
+                                            /* delimiter */ ','));
+
+    for (size_t i = 0; i < 2; i++) {
+      EXPECT_EQ(*row.GetColumnView(i), *expected.GetColumn(i))
+          << "line: " << line << " column: " << i;
+    }
+  }
+}
+
+TEST(CsvRowViewTest, BuildShouldKeepWhitespaceLikeCsvRow) {
+  // CsvRow ends a row ending with a delimiter with a column of a single space
+  // when whitespace is kept.
+  for (string line : {"a, b ,", " a ,\t,", ",,", "a,b, c"}) {
+    ASSERT_SUCCESS_AND_ASSIGN(auto row,
+                              CsvRowView::Build(line, /* num_cols */ 3,
+                                                /* remove_whitespace */ false,
+                                                /* delimiter */ ','));
+    ASSERT_SUCCESS_AND_ASSIGN(auto expected,
+                              CsvRow::Build(line, /* num_cols */ 3,
+                                            /* remove_whitespace */ false,
+                                            /* delimiter */ ','));
+
+    for (size_t i = 0; i < 3; i++) {
+      EXPECT_EQ(*row.GetColumnView(i), *expected.GetColumn(i))
+          << "line: " << line << " column: " << i;
+    }
+  }
+}
+
+TEST(CsvRowViewTest, BuildShouldCopyARowWhoseWhitespaceIsCollapsed) {
+  string line = "a  b,c";
+
+  ASSERT_SUCCESS_AND_ASSIGN(auto row,
+                            CsvRowView::Build(line, /* num_cols */ 2,
+                                              /* remove_whitespace */ true,
+                                              /* delimiter */ ','));
+  line.assign(line.size(), 'x');
+
+  EXPECT_THAT(row.GetColumnView(0), IsSuccessfulAndHolds("a b"));
+  EXPECT_THAT(row.GetColumnView(1), IsSuccessfulAndHolds("c"));
+}
+
+TEST(CsvRowViewTest, BuildShouldHandleEmptyColumns) {
+  auto buffer = make_shared<const string>(",val2,");
+
+  ASSERT_SUCCESS_AND_ASSIGN(auto row,
+                            CsvRowView::Build(buffer, *buffer, /* num_cols */ 3,
+                                              /* remove_whitespace */ true,
+                                              /* delimiter */ ','));
+
+  EXPECT_THAT(row.GetColumnView(0), IsSuccessfulAndHolds(""));
+  EXPECT_THAT(row.GetColumnView(1), IsSuccessfulAndHolds("val2"));
+  EXPECT_THAT(row.GetColumnView(2), IsSuccessfulAndHolds(""));
+}
+
+TEST(CsvRowViewTest, BuildShouldReferToARowItDoesNotOwn) {
+  string line = " val1 ,\t,val3";
+
+  ASSERT_SUCCESS_AND_ASSIGN(auto row,
+                            CsvRowView::Build(line, /* num_cols */ 3,
+                                              /* remove_whitespace */ true,
+                                              /* delimiter */ ','));
+
+  EXPECT_THAT(row.GetColumnView(0), IsSuccessfulAndHolds("val1"));
+  EXPECT_EQ(row.GetColumnView(0)->data(), line.data() + 1);
+  // A column of whitespace only is trimmed to nothing.
+  EXPECT_THAT(row.GetColumnView(1), IsSuccessfulAndHolds(""));
+  EXPECT_THAT(row.GetColumnView(2), IsSuccessfulAndHolds("val3"));
+}
+
+TEST(CsvRowViewTest, BuildShouldHandleMoreColumnsThanAreInlined) {
+  string line = "0,1,2,3,4,5,6,7,8,9";
+
+  ASSERT_SUCCESS_AND_ASSIGN(auto row,
+                            CsvRowView::Build(line, /* num_cols */ 10,
+                                              /* remove_whitespace */ true,
+                                              /* delimiter */ ','));
+
+  for (size_t i = 0; i < 10; i++) {
+    EXPECT_THAT(row.GetColumnView(i),
+                IsSuccessfulAndHolds(std::to_string(i)));
+  }
+}
+
+TEST(CsvRowViewTest, BuildShouldFailIfLengthDoesNotMatchTheExpected) {
+  auto buffer = make_shared<const string>("val1,val2");
+
+  EXPECT_THAT(
+      CsvRowView::Build(buffer, *buffer, /* num_cols */ 3,
+                        /* remove_whitespace */ true,
+                        /* delimiter */ ','),
+      ResultIs(FailureExecutionResult(CSV_ROW_UNEXPECTED_NUMBER_OF_COLUMNS)));
+  EXPECT_THAT(
+      CsvRowView::Build(buffer, "", /* num_cols */ 1,
+                        /* remove_whitespace */ true,
+                        /* delimiter */ ','),
+      ResultIs(FailureExecutionResult(CSV_ROW_UNEXPECTED_NUMBER_OF_COLUMNS)));
+}
+
+TEST(CsvRowViewTest, BuildShouldFailIfTheRowIsTooLong) {
+  string line = "val1";
+  // Only the size of the row is checked, so it is never read past line.
+  string_view too_long(line.data(),
+                       size_t{std::numeric_limits<uint32_t>::max()} + 1);
+
+  EXPECT_THAT(CsvRowView::Build(too_long, /* num_cols */ 1,
+                                /* remove_whitespace */ true,
+                                /* delimiter */ ','),
+              ResultIs(FailureExecutionResult(CSV_ROW_TOO_LONG)));
+}
+
+TEST(CsvRowViewTest, GetColumnShouldFailIfOutOfBounds) {
+  auto buffer = make_shared<const string>("val1");
+
+  ASSERT_SUCCESS_AND_ASSIGN(auto row,
+                            CsvRowView::Build(buffer, *buffer, /* num_cols */ 1,
+                                              /* remove_whitespace */ true,
+                                              /* delimiter */ ','));
+
+  EXPECT_THAT(row.GetColumnView(1),
+              ResultIs(FailureExecutionResult(CSV_COL_INDEX_OUT_OF_BOUNDS)));
+}
+
+TEST(CsvRowViewTest, RowShouldKeepTheBufferAlive) {
+  auto buffer = make_shared<const string>("val1");
+  weak_ptr<const string> weak_buffer = buffer;
+  string_view line = *buffer;
+
+  ASSERT_SUCCESS_AND_ASSIGN(auto row,
+                            CsvRowView::Build(std::move(buffer), line,
+                                              /* num_cols */ 1,
+                                              /* remove_whitespace */ true,
+                                              /* delimiter */ ','));
+
+  EXPECT_FALSE(weak_buffer.expired());
+  EXPECT_THAT(row.GetColumnView(0), IsSuccessfulAndHolds("val1"));
+}
+
+}  // namespace google::pair::common::test
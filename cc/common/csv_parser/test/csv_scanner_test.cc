@@ -0,0 +1,106 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/common/csv_parser/src/csv_scanner.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+using testing::ElementsAre;
+using testing::IsEmpty;
+using testing::Values;
+
+namespace google::pair::common::test {
+
+class CsvScannerTest : public testing::TestWithParam<CsvScannerIsa> {};
+
+INSTANTIATE_TEST_SUITE_P(AllIsas, CsvScannerTest,
+                         Values(CsvScannerIsa::kScalar, CsvScannerIsa::kSse2,
+                                CsvScannerIsa::kAvx2));
+
+TEST_P(CsvScannerTest, ShouldFindNothingInEmptyData) {
+  CsvScanner scanner(GetParam());
+  vector<size_t> positions;
+
+  scanner.FindAll("", '\n', positions);
+
+  EXPECT_THAT(positions, IsEmpty());
+}
+
+TEST_P(CsvScannerTest, ShouldFindAllOccurrencesInOrder) {
+  CsvScanner scanner(GetParam());
+  vector<size_t> positions = {42};
+
+  scanner.FindAll("a\nbc\n\nd", '\n', positions);
+
+  // Appends to what is already there.
+  EXPECT_THAT(positions, ElementsAre(42, 1, 4, 5));
+}
+
+TEST_P(CsvScannerTest, ShouldMatchTheScalarScanAcrossBlocks) {
+  // Rows of varying length so that the matches land on every offset within
+  // and across the 64 byte blocks, followed by a tail shorter than a block.
+  string data;
+  for (size_t i = 0; i < 300; i++) {
+    data += string(i % 70, 'x') + (i % 3 == 0 ? ",\n" : "\n");
+  }
+  data += "tail,";
+  CsvScanner scalar_scanner(CsvScannerIsa::kScalar);
+  CsvScanner scanner(GetParam());
+
+  for (char c : {'\n', ','}) {
+    vector<size_t> expected;
+    scalar_scanner.FindAll(data, c, expected);
+    vector<size_t> actual;
+    scanner.FindAll(data, c, actual);
+
+    EXPECT_EQ(actual, expected);
+    EXPECT_FALSE(expected.empty());
+  }
+}
+
+TEST_P(CsvScannerTest, ShouldFindEitherCharacterInOnePass) {
+  string data;
+  for (size_t i = 0; i < 300; i++) {
+    data += string(i % 70, 'x') + (i % 3 == 0 ? ",\n" : "\n");
+  }
+  data += "tail,";
+  CsvScanner scalar_scanner(CsvScannerIsa::kScalar);
+  CsvScanner scanner(GetParam());
+  vector<size_t> expected;
+  scalar_scanner.FindAll(data, '\n', expected);
+  scalar_scanner.FindAll(data, ',', expected);
+  std::sort(expected.begin(), expected.end());
+
+  vector<size_t> actual;
+  scanner.FindAll(data, '\n', ',', actual);
+
+  EXPECT_EQ(actual, expected);
+}
+
+TEST(CsvScannerIsaTest, ShouldNotScanWithUnsupportedInstructions) {
+  CsvScanner scanner(CsvScannerIsa::kAvx2);
+
+  EXPECT_LE(scanner.GetIsa(), GetSupportedCsvScannerIsa());
+  EXPECT_EQ(CsvScanner(CsvScannerIsa::kScalar).GetIsa(),
+            CsvScannerIsa::kScalar);
+}
+
+}  // namespace google::pair::common::test
@@ -89,4 +89,19 @@ TEST(CsvStreamParserConfigTest,
             config.GetMaxBufferedDataSize());
 }
 
+TEST(CsvStreamParserConfigTest, ShouldSetZeroCopyToFalseByDefault) {
+  CsvStreamParserConfig config(/* num_cols */ 1);
+
+  EXPECT_FALSE(config.GetZeroCopy());
+}
+
+TEST(CsvStreamParserConfigTest, ShouldSetZeroCopyBasedOnConstructor) {
+  CsvStreamParserConfig config(/* num_cols */ 1, /* remove_whitespace */ true,
+                               /* delimiter */ ',', /* line_break */ '\n',
+                               /* max_buffered_data_size */ 123,
+                               /* zero_copy */ true);
+
+  EXPECT_TRUE(config.GetZeroCopy());
+}
+
 }  // namespace google::pair::common::test
@@ -29,6 +29,7 @@
 #include "core/test/utils/conditional_wait.h"
 
 using google::pair::common::CsvRow;
+using google::pair::common::CsvRowView;
 using google::pair::common::CsvStreamParser;
 using google::pair::common::CsvStreamParserConfig;
 using google::pair::common::errors::CSV_STREAM_PARSER_BUFFER_AT_CAPACITY;
@@ -258,4 +259,189 @@ TEST(CsvStreamParserTest, ShouldSupportAddAndGetFromTwoDifferentThreads) {
   }
 }
 
+CsvStreamParserConfig BuildZeroCopyConfig(size_t num_cols,
+                                          size_t max_buffered_data_size) {
+  return CsvStreamParserConfig(num_cols, /* remove_whitespace */ true,
+                               /* delimiter */ ',', /* line_break */ '\n',
+                               max_buffered_data_size, /* zero_copy */ true);
+}
+
+TEST(CsvStreamParserTest, ZeroCopyShouldHoldLeftoverData) {
+  CsvStreamParser parser(BuildZeroCopyConfig(/* num_cols */ 3, 1024));
+
+  EXPECT_SUCCESS(parser.AddCsvChunk("val1"));
+  EXPECT_SUCCESS(parser.AddCsvChunk(",val2 ,"));
+  EXPECT_FALSE(parser.HasRow());
+  // This completes a row but also leaves more data in the buffer
+  EXPECT_SUCCESS(parser.AddCsvChunk("val3 \nrow2-1, row2-2,row2-3"));
+
+  EXPECT_TRUE(parser.HasRow());
+  auto row = parser.GetNextRowView();
+  EXPECT_SUCCESS(row);
+  EXPECT_EQ(*row->GetColumnView(0), "val1");
+  EXPECT_EQ(*row->GetColumnView(1), "val2");
+  EXPECT_EQ(*row->GetColumnView(2), "val3");
+  EXPECT_FALSE(parser.HasRow());
+
+  // This completes that row that we had leftover
+  EXPECT_SUCCESS(parser.AddCsvChunk("\n"));
+  EXPECT_TRUE(parser.HasRow());
+  auto copied_row = parser.GetNextRow();
+  EXPECT_SUCCESS(copied_row);
+  EXPECT_EQ(*copied_row->GetColumn(0), "row2-1");
+  EXPECT_EQ(*copied_row->GetColumn(1), "row2-2");
+  EXPECT_EQ(*copied_row->GetColumn(2), "row2-3");
+  EXPECT_EQ(0, parser.GetBufferedDataSize());
+}
+
+TEST(CsvStreamParserTest, ZeroCopyRowsShouldOutliveLaterChunks) {
+  CsvStreamParser parser(BuildZeroCopyConfig(/* num_cols */ 1, 1024));
+
+  EXPECT_SUCCESS(parser.AddCsvChunk("row1\nrow2\nro"));
+  auto row1 = parser.GetNextRowView();
+  EXPECT_SUCCESS(parser.AddCsvChunk("w3\n"));
+  auto row2 = parser.GetNextRowView();
+  auto row3 = parser.GetNextRowView();
+
+  EXPECT_EQ(*row1->GetColumnView(0), "row1");
+  EXPECT_EQ(*row2->GetColumnView(0), "row2");
+  EXPECT_EQ(*row3->GetColumnView(0), "row3");
+  EXPECT_FALSE(parser.HasRow());
+}
+
+TEST(CsvStreamParserTest, ZeroCopyShouldFailToAddChunkIfBufferIsAtCapacity) {
+  CsvStreamParser parser(BuildZeroCopyConfig(/* num_cols */ 2, 10));
+
+  EXPECT_SUCCESS(parser.AddCsvChunk("val1,val2\n"));
+  EXPECT_THAT(
+      parser.AddCsvChunk("1"),
+      ResultIs(RetryExecutionResult(CSV_STREAM_PARSER_BUFFER_AT_CAPACITY)));
+
+  EXPECT_SUCCESS(parser.GetNextRowView());
+  EXPECT_SUCCESS(parser.AddCsvChunk("1"));
+}
+
+TEST(CsvStreamParserTest, GetNextRowViewShouldWorkWithoutZeroCopy) {
+  CsvStreamParserConfig config(/* num_cols */ 2);
+  CsvStreamParser parser(config);
+
+  EXPECT_SUCCESS(parser.AddCsvChunk("val1, val2\n"));
+
+  auto row = parser.GetNextRowView();
+  EXPECT_SUCCESS(row);
+  EXPECT_EQ(*row->GetColumnView(0), "val1");
+  EXPECT_EQ(*row->GetColumnView(1), "val2");
+  EXPECT_THAT(parser.GetNextRowView(),
+              ResultIs(FailureExecutionResult(
+                  errors::CSV_STREAM_PARSER_NO_ROW_AVAILABLE)));
+}
+
+TEST(CsvStreamParserTest, GetNextRowsShouldGetUpToMaxRows) {
+  CsvStreamParserConfig config(/* num_cols */ 1);
+  CsvStreamParser parser(config);
+  EXPECT_SUCCESS(parser.AddCsvChunk("row1\nrow2\n"));
+  EXPECT_SUCCESS(parser.AddCsvChunk("row3\nrow4"));
+  vector<CsvRow> rows;
+
+  EXPECT_SUCCESS(parser.GetNextRows(/* max_rows */ 2, &rows));
+  EXPECT_EQ(rows.size(), 2);
+  // Gets the rest, across chunks, without failing for running out of them.
+  EXPECT_SUCCESS(parser.GetNextRows(/* max_rows */ 10, &rows));
+
+  ASSERT_EQ(rows.size(), 3);
+  EXPECT_EQ(*rows[0].GetColumn(0), "row1");
+  EXPECT_EQ(*rows[1].GetColumn(0), "row2");
+  EXPECT_EQ(*rows[2].GetColumn(0), "row3");
+  EXPECT_FALSE(parser.HasRow());
+  EXPECT_EQ(4, parser.GetBufferedDataSize());
+}
+
+TEST(CsvStreamParserTest, GetNextRowsShouldStopAtARowWhichFailsToParse) {
+  CsvStreamParserConfig config(/* num_cols */ 2);
+  CsvStreamParser parser(config);
+  EXPECT_SUCCESS(parser.AddCsvChunk("a,b\nc\nd,e\n"));
+  vector<CsvRow> rows;
+
+  EXPECT_THAT(parser.GetNextRows(/* max_rows */ 10, &rows),
+              ResultIs(FailureExecutionResult(
+                  errors::CSV_ROW_UNEXPECTED_NUMBER_OF_COLUMNS)));
+  ASSERT_EQ(rows.size(), 1);
+  EXPECT_EQ(*rows[0].GetColumn(1), "b");
+
+  EXPECT_SUCCESS(parser.GetNextRows(/* max_rows */ 10, &rows));
+  ASSERT_EQ(rows.size(), 2);
+  EXPECT_EQ(*rows[1].GetColumn(0), "d");
+}
+
+TEST(CsvStreamParserTest, GetNextRowViewsShouldWorkInEveryMode) {
+  for (bool zero_copy : {false, true}) {
+    CsvStreamParser parser(CsvStreamParserConfig(
+        /* num_cols */ 2, /* remove_whitespace */ true, /* delimiter */ ',',
+        /* line_break */ '\n', /* max_buffered_data_size */ 1024, zero_copy));
+    EXPECT_SUCCESS(parser.AddCsvChunk("a,b\nc,"));
+    EXPECT_SUCCESS(parser.AddCsvChunk("d\n"));
+    vector<CsvRowView> rows;
+
+    EXPECT_SUCCESS(parser.GetNextRowViews(/* max_rows */ 10, &rows));
+
+    ASSERT_EQ(rows.size(), 2) << "zero_copy: " << zero_copy;
+    EXPECT_EQ(*rows[0].GetColumnView(0), "a");
+    EXPECT_EQ(*rows[1].GetColumnView(1), "d");
+    EXPECT_EQ(0, parser.GetBufferedDataSize());
+  }
+}
+
+// Adds data to a parser with config in chunks of chunk_size and returns its
+// rows, each as its columns joined by '|', or "error" if it failed to parse.
+vector<string> ParseInChunks(const CsvStreamParserConfig& config,
+                             const string& data, size_t chunk_size) {
+  CsvStreamParser parser(config);
+  vector<string> rows;
+  for (size_t i = 0; i < data.size(); i += chunk_size) {
+    EXPECT_SUCCESS(parser.AddCsvChunk(data.substr(i, chunk_size)));
+    while (parser.HasRow()) {
+      auto row_or = parser.GetNextRow();
+      rows.push_back(row_or.Successful()
+                         ? *row_or->GetColumn(0) + "|" + *row_or->GetColumn(1)
+                         : "error");
+    }
+  }
+  return rows;
+}
+
+TEST(CsvStreamParserTest, ShouldProduceTheSameRowsInEveryMode) {
+  string data;
+  for (size_t i = 0; i < 200; i++) {
+    data += " id" + std::to_string(i) + string(i % 80, 'x') + " ,val \t " +
+            std::to_string(i) + "\n";
+    if (i % 50 == 0) {
+      data += "\nnot a row\n";
+    }
+  }
+  data += "partial,row";
+
+  for (size_t chunk_size : {1, 7, 64, 1000, 100000}) {
+    auto expected = ParseInChunks(
+        CsvStreamParserConfig(/* num_cols */ 2, /* remove_whitespace */ true,
+                              /* delimiter */ ',', /* line_break */ '\n',
+                              kMaxCsvStreamParserBufferedDataSizeBytes),
+        data, chunk_size);
+    EXPECT_EQ(expected.size(), 208);
+    for (bool zero_copy : {false, true}) {
+      for (bool simd_scan : {false, true}) {
+        EXPECT_EQ(ParseInChunks(CsvStreamParserConfig(
+                                    /* num_cols */ 2,
+                                    /* remove_whitespace */ true,
+                                    /* delimiter */ ',', /* line_break */ '\n',
+                                    kMaxCsvStreamParserBufferedDataSizeBytes,
+                                    zero_copy, simd_scan),
+                                data, chunk_size),
+                  expected)
+            << "chunk_size: " << chunk_size << " zero_copy: " << zero_copy
+            << " simd_scan: " << simd_scan;
+      }
+    }
+  }
+}
+
 }  // namespace google::pair::common::test
@@ -0,0 +1,172 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/common/csv_parser/src/parallel_csv_parser.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "cc/common/csv_parser/src/error_codes.h"
+#include "cc/core/async_executor/src/async_executor.h"
+#include "cc/public/core/test/interface/execution_result_matchers.h"
+
+using google::pair::common::errors::CSV_ROW_UNEXPECTED_NUMBER_OF_COLUMNS;
+using google::scp::core::AsyncExecutor;
+using google::scp::core::FailureExecutionResult;
+using google::scp::core::test::ResultIs;
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+namespace google::pair::common::test {
+
+constexpr size_t kNumRows = 1000;
+
+class ParallelCsvParserTest : public testing::TestWithParam<size_t> {
+ protected:
+  ParallelCsvParserTest()
+      : cpu_async_executor_(make_shared<AsyncExecutor>(4, 100000)) {
+    EXPECT_SUCCESS(cpu_async_executor_->Init());
+    EXPECT_SUCCESS(cpu_async_executor_->Run());
+  }
+
+  ~ParallelCsvParserTest() { EXPECT_SUCCESS(cpu_async_executor_->Stop()); }
+
+  ParallelCsvParser BuildParser(bool simd_scan = false) {
+    return ParallelCsvParser(
+        cpu_async_executor_,
+        CsvStreamParserConfig(/* num_cols */ 2, /* remove_whitespace */ true,
+                              kDefaultCsvRowDelimiter, kDefaultCsvLineBreak,
+                              kMaxCsvStreamParserBufferedDataSizeBytes,
+                              /* zero_copy */ true, simd_scan),
+        /* num_ranges */ GetParam());
+  }
+
+  // Returns the first column of every row, in the order of the batches.
+  static vector<string> GetIds(const vector<CsvRowBatch>& batches) {
+    vector<string> ids;
+    for (const auto& batch : batches) {
+      for (const auto& row : batch.rows) {
+        ids.emplace_back(*row.GetColumnView(0));
+      }
+    }
+    return ids;
+  }
+
+  shared_ptr<AsyncExecutor> cpu_async_executor_;
+};
+
+// Returns kNumRows rows of varying length, and their IDs in expected_ids.
+shared_ptr<const string> BuildCsv(vector<string>& expected_ids) {
+  string csv;
+  for (size_t i = 0; i < kNumRows; i++) {
+    auto id = absl::StrCat("user", string(i % 50, 'x'), i, "@example.com");
+    absl::StrAppend(&csv, " ", id, " ,value", i, "\n");
+    expected_ids.push_back(std::move(id));
+  }
+  return make_shared<const string>(std::move(csv));
+}
+
+TEST_P(ParallelCsvParserTest, ShouldParseEveryRowInBufferOrder) {
+  vector<string> expected_ids;
+  auto buffer = BuildCsv(expected_ids);
+
+  for (bool simd_scan : {false, true}) {
+    auto parser = BuildParser(simd_scan);
+    ASSERT_SUCCESS_AND_ASSIGN(auto batches, parser.Parse(buffer));
+
+    EXPECT_LE(batches.size(), GetParam());
+    for (size_t i = 0; i < batches.size(); i++) {
+      EXPECT_EQ(batches[i].range_index, i);
+      EXPECT_EQ(batches[i].buffer, buffer);
+      EXPECT_SUCCESS(batches[i].result);
+    }
+    EXPECT_EQ(GetIds(batches), expected_ids);
+  }
+}
+
+TEST_P(ParallelCsvParserTest, ShouldParseEveryRowInCompletionOrder) {
+  vector<string> expected_ids;
+  auto buffer = BuildCsv(expected_ids);
+  auto parser = BuildParser();
+
+  ASSERT_SUCCESS_AND_ASSIGN(
+      auto batches, parser.Parse(buffer, CsvRowBatchOrder::kCompletionOrder));
+
+  std::sort(batches.begin(), batches.end(),
+            [](const CsvRowBatch& a, const CsvRowBatch& b) {
+              return a.range_index < b.range_index;
+            });
+  EXPECT_EQ(GetIds(batches), expected_ids);
+}
+
+TEST_P(ParallelCsvParserTest, ShouldNotParseDataAfterTheLastLineBreak) {
+  auto parser = BuildParser();
+
+  ASSERT_SUCCESS_AND_ASSIGN(
+      auto batches, parser.Parse(make_shared<const string>("a,1\nb,2\nc,3")));
+
+  EXPECT_EQ(GetIds(batches), (vector<string>{"a", "b"}));
+}
+
+TEST_P(ParallelCsvParserTest, ShouldParseAnEmptyBuffer) {
+  auto parser = BuildParser();
+
+  ASSERT_SUCCESS_AND_ASSIGN(auto batches,
+                            parser.Parse(make_shared<const string>()));
+
+  EXPECT_TRUE(GetIds(batches).empty());
+}
+
+TEST_P(ParallelCsvParserTest, ShouldStopARangeAtItsFirstBadRow) {
+  string csv;
+  vector<string> expected_ids;
+  for (size_t i = 0; i < kNumRows; i++) {
+    if (i == kNumRows / 2) {
+      csv += "no delimiter\n";
+    }
+    absl::StrAppend(&csv, "id", i, ",value\n");
+    expected_ids.push_back(absl::StrCat("id", i));
+  }
+  expected_ids.resize(kNumRows / 2);
+  auto parser = BuildParser();
+
+  ASSERT_SUCCESS_AND_ASSIGN(
+      auto batches, parser.Parse(make_shared<const string>(std::move(csv))));
+
+  // The rows up to the bad one are as a CsvStreamParser would return them.
+  vector<CsvRowBatch> batches_to_bad_row;
+  for (auto& batch : batches) {
+    bool successful = batch.result.Successful();
+    batches_to_bad_row.push_back(std::move(batch));
+    if (!successful) {
+      break;
+    }
+  }
+  EXPECT_THAT(batches_to_bad_row.back().result,
+              ResultIs(FailureExecutionResult(
+                  CSV_ROW_UNEXPECTED_NUMBER_OF_COLUMNS)));
+  EXPECT_EQ(GetIds(batches_to_bad_row), expected_ids);
+}
+
+INSTANTIATE_TEST_SUITE_P(NumRanges, ParallelCsvParserTest,
+                         testing::Values(1, 2, 3, 8, 5000));
+
+}  // namespace google::pair::common::test
@@ -0,0 +1,216 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/matcher/match_table/src/dense_match_table_hash_map.h"
+#include "cc/matcher/match_table/src/match_table.h"
+#include "cc/matcher/match_table/src/match_table_hash_map.h"
+#include "cc/matcher/match_table/src/mmap_match_table.h"
+#include "cc/matcher/match_table/src/open_addressing_match_table.h"
+#include "cc/matcher/match_table/src/sharded_match_table.h"
+
+using std::function;
+using std::optional;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace google::pair::matcher {
+
+namespace {
+
+constexpr size_t kDefaultNumEntries = 100000000;
+constexpr size_t kThreadCounts[] = {1, 4, 16, 64};
+constexpr size_t kBatchSize = 1024;
+
+using TableFactory = function<unique_ptr<MatchTable<string, string>>()>;
+
+string GetPlaintextId(size_t i) {
+  return absl::StrCat("user", i, "@example.com");
+}
+
+string GetEncryptedId(size_t i) {
+  return absl::StrCat("encrypted", i);
+}
+
+// Runs fn(i) for every i in [0, num_entries) split evenly across num_threads
+// and returns the wall time it took.
+absl::Duration RunOnThreads(size_t num_entries, size_t num_threads,
+                            const function<void(size_t)>& fn) {
+  auto start = absl::Now();
+  vector<std::thread> threads;
+  for (size_t t = 0; t < num_threads; t++) {
+    threads.emplace_back([t, num_entries, num_threads, &fn]() {
+      for (size_t i = t; i < num_entries; i += num_threads) {
+        fn(i);
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  return absl::Now() - start;
+}
+
+// Like RunOnThreads but hands each thread contiguous batches of kBatchSize.
+absl::Duration RunBatchesOnThreads(
+    size_t num_entries, size_t num_threads,
+    const function<void(size_t, size_t)>& fn) {
+  return RunOnThreads(
+      (num_entries + kBatchSize - 1) / kBatchSize, num_threads,
+      [num_entries, &fn](size_t batch) {
+        fn(batch * kBatchSize,
+           std::min(num_entries, (batch + 1) * kBatchSize));
+      });
+}
+
+void RunBenchmark(const string& name, const TableFactory& factory,
+                  size_t num_entries) {
+  for (auto num_threads : kThreadCounts) {
+    // Load a table which was sized up front, as the MatchWorker does with the
+    // publisher mapping's row count.
+    absl::Duration reserved_load_time;
+    {
+      auto reserved_table = factory();
+      reserved_table->Reserve(num_entries);
+      reserved_load_time =
+          RunOnThreads(num_entries, num_threads, [&reserved_table](size_t i) {
+            reserved_table->AddElement(GetPlaintextId(i), GetEncryptedId(i));
+          });
+    }
+    // Load another table in batches through BulkLoad.
+    absl::Duration bulk_load_time;
+    {
+      auto bulk_table = factory();
+      bulk_load_time = RunBatchesOnThreads(
+          num_entries, num_threads, [&bulk_table](size_t begin, size_t end) {
+            vector<std::pair<string, string>> elements;
+            elements.reserve(end - begin);
+            for (size_t i = begin; i < end; i++) {
+              elements.emplace_back(GetPlaintextId(i), GetEncryptedId(i));
+            }
+            vector<string> duplicate_keys;
+            bulk_table->BulkLoad(std::move(elements), &duplicate_keys);
+          });
+    }
+    auto table = factory();
+    auto load_time = RunOnThreads(num_entries, num_threads, [&table](size_t i) {
+      table->AddElement(GetPlaintextId(i), GetEncryptedId(i));
+    });
+    // Probe with twice as many IDs as were loaded so that half of the probes
+    // miss, roughly matching an advertiser list with a 50% match rate.
+    auto probe_time =
+        RunOnThreads(num_entries * 2, num_threads, [&table](size_t i) {
+          table->MarkMatched(GetPlaintextId(i));
+        });
+    // Probe the same IDs again through MarkMatchedBatch.
+    auto batch_probe_time = RunBatchesOnThreads(
+        num_entries * 2, num_threads, [&table](size_t begin, size_t end) {
+          vector<string> keys;
+          keys.reserve(end - begin);
+          for (size_t i = begin; i < end; i++) {
+            keys.push_back(GetPlaintextId(i));
+          }
+          vector<optional<string>> values;
+          table->MarkMatchedBatch(keys, &values);
+        });
+    std::cout << name << "\tthreads=" << num_threads
+              << "\tload=" << absl::FormatDuration(load_time) << " ("
+              << num_entries / absl::ToDoubleSeconds(load_time) << " rows/s)"
+              << "\treserved_load=" << absl::FormatDuration(reserved_load_time)
+              << " ("
+              << num_entries / absl::ToDoubleSeconds(reserved_load_time)
+              << " rows/s)\tbulk_load=" << absl::FormatDuration(bulk_load_time)
+              << " (" << num_entries / absl::ToDoubleSeconds(bulk_load_time)
+              << " rows/s)\tprobe=" << absl::FormatDuration(probe_time) << " ("
+              << num_entries * 2 / absl::ToDoubleSeconds(probe_time)
+              << " rows/s)\tbatch_probe="
+              << absl::FormatDuration(batch_probe_time) << " ("
+              << num_entries * 2 / absl::ToDoubleSeconds(batch_probe_time)
+              << " rows/s)\tbytes_per_entry=" << table->GetBytesPerEntry()
+              << std::endl;
+  }
+}
+
+}  // namespace
+
+}  // namespace google::pair::matcher
+
+// Compares the load (plain, after Reserve and through BulkLoad), probe and
+// batched probe throughput of the MatchTable implementations from 1, 4, 16 and
+// 64 threads, and their memory usage per entry.
+// Usage: match_table_benchmark [num_entries] [on_disk_directory]
+// num_entries defaults to 100M which needs a machine with plenty of memory.
+// on_disk_directory is where MmapMatchTable keeps its files, /tmp by default.
+int main(int argc, char** argv) {
+  using google::pair::matcher::DenseMatchTableHashMap;
+  using google::pair::matcher::MatchTable;
+  using google::pair::matcher::MatchTableHashMap;
+  using google::pair::matcher::MmapMatchTable;
+  using google::pair::matcher::OpenAddressingMatchTable;
+  using google::pair::matcher::RunBenchmark;
+  using google::pair::matcher::ShardedMatchTable;
+
+  size_t num_entries = google::pair::matcher::kDefaultNumEntries;
+  if (argc > 1) {
+    num_entries = std::strtoul(argv[1], nullptr, 10);
+  }
+  string on_disk_directory = argc > 2 ? argv[2] : "/tmp";
+  std::cout << "Benchmarking with " << num_entries << " entries" << std::endl;
+
+  RunBenchmark(
+      "MatchTableHashMap",
+      []() { return std::make_unique<MatchTableHashMap<string, string>>(); },
+      num_entries);
+  RunBenchmark(
+      "DenseMatchTableHashMap",
+      []() {
+        return std::make_unique<DenseMatchTableHashMap<string, string>>();
+      },
+      num_entries);
+  RunBenchmark(
+      "OpenAddressingMatchTable",
+      []() {
+        return std::make_unique<OpenAddressingMatchTable<string, string>>();
+      },
+      num_entries);
+  RunBenchmark(
+      "ShardedMatchTable",
+      []() { return std::make_unique<ShardedMatchTable<string, string>>(); },
+      num_entries);
+  RunBenchmark(
+      "MmapMatchTable",
+      [&on_disk_directory]() -> std::unique_ptr<MatchTable<string, string>> {
+        auto table_or = MmapMatchTable::Create(on_disk_directory);
+        if (!table_or.Successful()) {
+          std::cerr << "Cannot create files in " << on_disk_directory
+                    << std::endl;
+          std::exit(EXIT_FAILURE);
+        }
+        return table_or.release();
+      },
+      num_entries);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,110 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "blocked_bloom_filter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string_view>
+
+#include "absl/hash/hash.h"
+#include "absl/numeric/int128.h"
+
+using std::string_view;
+
+namespace {
+
+constexpr size_t kBitsPerBlock = 512;
+constexpr size_t kBitsPerProbe = 9;
+constexpr size_t kMaxNumProbes = 16;
+// Keys cluster unevenly over the blocks, which raises the false positive rate
+// of a blocked filter. Allocate this many times the bits of a classic Bloom
+// filter to stay at the target rate.
+constexpr double kBlockingOverhead = 1.2;
+// Step between the seeds of successive Remix calls, as in SplitMix64.
+constexpr uint64_t kGoldenGamma = 0x9e3779b97f4a7c15;
+
+// SplitMix64 finalizer, so that the bits picked within a block are independent
+// of the high bits of the hash that pick the block.
+uint64_t Remix(uint64_t hash) {
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111eb;
+  return hash ^ (hash >> 31);
+}
+
+}  // namespace
+
+namespace google::pair::matcher {
+
+BlockedBloomFilter::BlockedBloomFilter(size_t num_elements,
+                                       double false_positive_rate) {
+  const double ln2 = std::log(2.0);
+  double bits_per_element = -std::log(false_positive_rate) / (ln2 * ln2);
+  num_probes_ = std::clamp<size_t>(std::lround(bits_per_element * ln2), 1,
+                                   kMaxNumProbes);
+  auto num_bits = static_cast<size_t>(std::max<size_t>(num_elements, 1) *
+                                      bits_per_element * kBlockingOverhead);
+  blocks_.resize(std::max<size_t>((num_bits + kBitsPerBlock - 1) /
+                                      kBitsPerBlock,
+                                  1));
+}
+
+uint64_t BlockedBloomFilter::Hash(string_view key) {
+  return absl::Hash<string_view>{}(key);
+}
+
+size_t BlockedBloomFilter::GetBlockAndMasks(
+    uint64_t hash, uint64_t (&masks)[kWordsPerBlock]) const {
+  auto block =
+      absl::Uint128High64(absl::uint128(hash) * absl::uint128(blocks_.size()));
+  // Each probe takes 9 fresh bits to pick one of the 512 bits in the block.
+  // Deriving the probes from each other instead (e.g. double hashing) limits
+  // the number of distinct bit patterns and puts a floor under the false
+  // positive rate.
+  std::fill(std::begin(masks), std::end(masks), 0);
+  uint64_t bits = 0;
+  for (size_t i = 0, bits_left = 0; i < num_probes_; i++) {
+    if (bits_left < kBitsPerProbe) {
+      hash += kGoldenGamma;
+      bits = Remix(hash);
+      bits_left = 64;
+    }
+    auto index = bits % kBitsPerBlock;
+    masks[index / 64] |= uint64_t{1} << (index % 64);
+    bits >>= kBitsPerProbe;
+    bits_left -= kBitsPerProbe;
+  }
+  return block;
+}
+
+void BlockedBloomFilter::AddHash(uint64_t hash) {
+  uint64_t masks[kWordsPerBlock];
+  auto& block = blocks_[GetBlockAndMasks(hash, masks)];
+  for (size_t i = 0; i < kWordsPerBlock; i++) {
+    block.words[i] |= masks[i];
+  }
+}
+
+bool BlockedBloomFilter::MayContain(string_view key) const {
+  uint64_t masks[kWordsPerBlock];
+  const auto& block = blocks_[GetBlockAndMasks(Hash(key), masks)];
+  for (size_t i = 0; i < kWordsPerBlock; i++) {
+    if ((block.words[i] & masks[i]) != masks[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace google::pair::matcher
@@ -0,0 +1,93 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace google::pair::matcher {
+
+/**
+ * @brief Approximate membership filter used to skip match table lookups for
+ * IDs which are certainly not in the publisher mapping.
+ *
+ * All of the bits for a key are set within one 64 byte block, so a lookup
+ * touches a single cache line. This costs a higher false positive rate than a
+ * classic Bloom filter of the same size, which the filter compensates for with
+ * 20% more bits.
+ *
+ * Add must not be called concurrently with any other method, MayContain may be
+ * called from many threads once all keys have been added.
+ *
+ */
+class BlockedBloomFilter {
+ public:
+  /**
+   * @brief Construct a new Blocked Bloom Filter object
+   *
+   * @param num_elements the expected number of elements to be added
+   * @param false_positive_rate the target rate of MayContain returning true
+   * for keys which were not added, in (0, 1)
+   */
+  BlockedBloomFilter(size_t num_elements, double false_positive_rate);
+
+  /**
+   * @brief Get the hash of a key which AddHash takes.
+   *
+   */
+  static uint64_t Hash(std::string_view key);
+
+  void Add(std::string_view key) { AddHash(Hash(key)); }
+
+  /**
+   * @brief Add the key with the given hash, as returned by Hash. This lets
+   * callers hash keys before they know how many there are to size the filter.
+   *
+   */
+  void AddHash(uint64_t hash);
+
+  /**
+   * @brief Whether the key may have been added.
+   *
+   * @return false if the key was definitely not added
+   */
+  bool MayContain(std::string_view key) const;
+
+  /**
+   * @brief Get the number of bits set per key.
+   *
+   */
+  size_t GetNumProbes() const { return num_probes_; }
+
+  size_t GetMemoryUsageBytes() const { return blocks_.size() * sizeof(Block); }
+
+ private:
+  static constexpr size_t kWordsPerBlock = 8;
+
+  struct alignas(64) Block {
+    uint64_t words[kWordsPerBlock] = {};
+  };
+
+  // Returns the index of the block of the key with the given hash and fills
+  // masks with the bits to set or check in each of the block's words.
+  size_t GetBlockAndMasks(uint64_t hash,
+                          uint64_t (&masks)[kWordsPerBlock]) const;
+
+  size_t num_probes_;
+  std::vector<Block> blocks_;
+};
+
+}  // namespace google::pair::matcher
@@ -0,0 +1,247 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/span.h"
+
+#include "error_codes.h"
+#include "match_table.h"
+#include "matched_bitset.h"
+#include "memory_usage.h"
+
+namespace google::pair::matcher {
+
+/**
+ * @brief MatchTable which keeps only a 32-bit element index in the hash map
+ * slot. Values are stored densely in insertion order and the matched flags are
+ * packed into a separate bitset indexed by element.
+ *
+ * Compared to MatchTableHashMap this removes the per-element heap allocation
+ * of ValueInfo and its padding, and empty map slots no longer pay for a value.
+ *
+ * @tparam K the key type for the elements
+ * @tparam V the value type for the elements
+ */
+template <typename K, typename V>
+class DenseMatchTableHashMap : public MatchTable<K, V> {
+ public:
+  using MatchTable<K, V>::MarkMatched;
+
+  // The most elements 32-bit indices can address.
+  static constexpr size_t kMaxElements = size_t{1} << 32;
+
+  /**
+   * @brief Construct a new Dense Match Table Hash Map object
+   *
+   * @param max_elements the number of elements past which adding fails with
+   * MATCH_TABLE_FULL, at most kMaxElements
+   */
+  explicit DenseMatchTableHashMap(size_t max_elements = kMaxElements)
+      : max_elements_(std::min(max_elements, kMaxElements)) {}
+
+  scp::core::ExecutionResult AddElement(const K& key, const V& value) override {
+    std::lock_guard lock(data_mutex_);
+
+    if (frozen_) {
+      return scp::core::FailureExecutionResult(errors::MATCH_TABLE_FROZEN);
+    }
+    if (values_.size() >= max_elements_) {
+      return scp::core::FailureExecutionResult(errors::MATCH_TABLE_FULL);
+    }
+    if (!index_.try_emplace(key, static_cast<uint32_t>(values_.size()))
+             .second) {
+      return scp::core::FailureExecutionResult(
+          errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS);
+    }
+    values_.push_back(value);
+    GrowMatchedBits();
+    return scp::core::SuccessExecutionResult();
+  }
+
+  /**
+   * @brief Takes the lock once for the whole batch and grows the matched
+   * bitset at most once. Like MmapMatchTable, fails the whole batch if it
+   * could take the table past max_elements, counting any duplicates in it.
+   *
+   */
+  scp::core::ExecutionResult BulkLoad(
+      std::vector<std::pair<K, V>> elements,
+      std::vector<K>* duplicate_keys) override {
+    std::lock_guard lock(data_mutex_);
+
+    if (frozen_) {
+      return scp::core::FailureExecutionResult(errors::MATCH_TABLE_FROZEN);
+    }
+    if (elements.size() > max_elements_ - values_.size()) {
+      return scp::core::FailureExecutionResult(errors::MATCH_TABLE_FULL);
+    }
+    index_.reserve(index_.size() + elements.size());
+    for (auto& [key, value] : elements) {
+      // try_emplace leaves key untouched if it already exists.
+      auto index = static_cast<uint32_t>(values_.size());
+      if (index_.try_emplace(std::move(key), index).second) {
+        values_.push_back(std::move(value));
+      } else {
+        duplicate_keys->push_back(std::move(key));
+      }
+    }
+    GrowMatchedBits();
+    return scp::core::SuccessExecutionResult();
+  }
+
+  void Reserve(size_t num_elements) override {
+    std::lock_guard lock(data_mutex_);
+    if (frozen_) {
+      return;
+    }
+    index_.reserve(num_elements);
+    if (num_elements >
+        matched_bits_.GetNumWords() * MatchedBitset::kBitsPerWord) {
+      matched_bits_.Resize(num_elements);
+    }
+  }
+
+  scp::core::ExecutionResultOr<V> MarkMatched(const K& key) override {
+    return MarkMatched(key, nullptr);
+  }
+
+  scp::core::ExecutionResultOr<V> MarkMatched(const K& key,
+                                              bool* newly_matched) override {
+    std::unique_lock lock(data_mutex_, std::defer_lock);
+    if (!frozen_.load(std::memory_order_acquire)) {
+      lock.lock();
+    }
+
+    if (auto it = index_.find(key); it != index_.end()) {
+      bool newly_matched_key = matched_bits_.Set(it->second);
+      if (newly_matched) {
+        *newly_matched = newly_matched_key;
+      }
+      return values_[it->second];
+    }
+
+    return scp::core::FailureExecutionResult(
+        errors::MATCH_TABLE_ELEMENT_DOES_NOT_EXIST);
+  }
+
+  /**
+   * @brief Element indices are the indices into values_, in insertion order.
+   *
+   */
+  scp::core::ExecutionResult MarkMatchedBatchWithIndices(
+      absl::Span<const K> keys, std::vector<std::optional<V>>* values,
+      std::vector<size_t>* element_indices) override {
+    values->clear();
+    values->reserve(keys.size());
+    element_indices->assign(keys.size(), 0);
+    std::unique_lock lock(data_mutex_, std::defer_lock);
+    if (!frozen_.load(std::memory_order_acquire)) {
+      lock.lock();
+    }
+
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (auto it = index_.find(keys[i]); it != index_.end()) {
+        matched_bits_.Set(it->second);
+        (*element_indices)[i] = it->second;
+        values->emplace_back(values_[it->second]);
+      } else {
+        values->emplace_back();
+      }
+    }
+    return scp::core::SuccessExecutionResult();
+  }
+
+  size_t GetNumElementIndices() const override {
+    std::lock_guard lock(data_mutex_);
+    return values_.size();
+  }
+
+  void Freeze() override {
+    std::lock_guard lock(data_mutex_);
+    frozen_.store(true, std::memory_order_release);
+  }
+
+  void VisitMatched(
+      typename MatchTable<K, V>::VisitorCallback visitor) override {
+    std::lock_guard lock(data_mutex_);
+
+    for (const auto& [key, index] : index_) {
+      if (matched_bits_.Test(index)) {
+        visitor(key, values_[index]);
+      }
+    }
+  }
+
+  size_t Size() const override {
+    std::lock_guard lock(data_mutex_);
+    return values_.size();
+  }
+
+  size_t GetMemoryUsageBytes() const override {
+    std::lock_guard lock(data_mutex_);
+
+    size_t bytes = GetHashMapSlotBytes(index_) + values_.size() * sizeof(V) +
+                   matched_bits_.GetMemoryUsageBytes();
+    for (const auto& [key, index] : index_) {
+      bytes += GetOwnedHeapBytes(key) + GetOwnedHeapBytes(values_[index]);
+    }
+    return bytes;
+  }
+
+ private:
+  // Doubles the matched bitset until it has a bit for every value.
+  void GrowMatchedBits() {
+    auto num_bits = matched_bits_.GetNumWords() * MatchedBitset::kBitsPerWord;
+    if (values_.size() > num_bits) {
+      auto new_num_bits = std::max(num_bits, MatchedBitset::kBitsPerWord);
+      while (new_num_bits < values_.size()) {
+        new_num_bits *= 2;
+      }
+      matched_bits_.Resize(new_num_bits);
+    }
+  }
+
+  /**
+   * @brief Map from key to the index of the element in values_ and
+   * matched_bits_.
+   *
+   */
+  absl::flat_hash_map<K, uint32_t> index_;
+  /**
+   * @brief The values in insertion order. A deque avoids the up to 2x slack
+   * and the copy on growth of a vector.
+   *
+   */
+  std::deque<V> values_;
+  /**
+   * @brief One bit per element, set once the element is matched.
+   *
+   */
+  MatchedBitset matched_bits_;
+  const size_t max_elements_;
+  mutable std::mutex data_mutex_;
+  std::atomic_bool frozen_ = false;
+};
+}  // namespace google::pair::matcher
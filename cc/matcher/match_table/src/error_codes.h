@@ -31,4 +31,27 @@ DEFINE_ERROR_CODE(MATCH_TABLE_ELEMENT_DOES_NOT_EXIST, MATCH_TABLE, 0x0002,
                   "The element does not exist in the match table.",
                   scp::core::errors::HttpStatusCode::BAD_REQUEST)
 
+DEFINE_ERROR_CODE(MATCH_TABLE_FULL, MATCH_TABLE, 0x0003,
+                  "The match table cannot hold any more elements.",
+                  scp::core::errors::HttpStatusCode::BAD_REQUEST)
+
+DEFINE_ERROR_CODE(MATCH_TABLE_FROZEN, MATCH_TABLE, 0x0004,
+                  "Elements cannot be added to a frozen match table.",
+                  scp::core::errors::HttpStatusCode::BAD_REQUEST)
+
+DEFINE_ERROR_CODE(MATCH_TABLE_FILE_ERROR, MATCH_TABLE, 0x0005,
+                  "Failed to create, grow or map a file backing the match "
+                  "table.",
+                  scp::core::errors::HttpStatusCode::UNKNOWN)
+
+DEFINE_ERROR_CODE(MATCH_TABLE_ELEMENT_INDICES_NOT_SUPPORTED, MATCH_TABLE,
+                  0x0006,
+                  "The match table cannot tell the indices of its elements.",
+                  scp::core::errors::HttpStatusCode::BAD_REQUEST)
+
+DEFINE_ERROR_CODE(MATCH_TABLE_NEWLY_MATCHED_NOT_SUPPORTED, MATCH_TABLE, 0x0007,
+                  "The match table cannot tell whether an element was "
+                  "matched before.",
+                  scp::core::errors::HttpStatusCode::BAD_REQUEST)
+
 }  // namespace google::pair::matcher::errors
@@ -0,0 +1,463 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "hashed_id_match_table.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/escaping.h"
+
+#include "error_codes.h"
+#include "memory_usage.h"
+
+using google::scp::core::ExecutionResult;
+using google::scp::core::ExecutionResultOr;
+using google::scp::core::FailureExecutionResult;
+using google::scp::core::SuccessExecutionResult;
+using std::lock_guard;
+using std::nullopt;
+using std::optional;
+using std::string;
+using std::string_view;
+using std::unique_lock;
+using std::vector;
+
+namespace google::pair::matcher {
+
+namespace {
+
+constexpr size_t kHexHashedIdLength = 64;
+constexpr size_t kBase64HashedIdLength = 44;
+constexpr size_t kWebSafeBase64HashedIdLength = 43;
+constexpr size_t kUuidLength = 36;
+// The most elements the 32-bit matched flag indices can address.
+constexpr size_t kMaxElements = size_t{1} << 32;
+constexpr char kLowerHexDigits[] = "0123456789abcdef";
+constexpr char kUpperHexDigits[] = "0123456789ABCDEF";
+
+// Returns the value of the hex digit or -1 if c is not a hex digit of the
+// given letter case.
+int HexDigitValue(char c, bool uppercase) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (!uppercase && c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (uppercase && c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+bool IsUuidDashPosition(size_t i) {
+  return i == 8 || i == 13 || i == 18 || i == 23;
+}
+
+// Decodes hex of a single letter case into out, which must be exactly half the
+// size of hex.
+bool DecodeHex(string_view hex, bool uppercase, uint8_t* out) {
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    int high = HexDigitValue(hex[i], uppercase);
+    int low = HexDigitValue(hex[i + 1], uppercase);
+    if (high < 0 || low < 0) {
+      return false;
+    }
+    out[i / 2] = static_cast<uint8_t>((high << 4) | low);
+  }
+  return true;
+}
+
+void EncodeHex(const uint8_t* bytes, size_t size, bool uppercase,
+               string& out) {
+  const char* digits = uppercase ? kUpperHexDigits : kLowerHexDigits;
+  for (size_t i = 0; i < size; i++) {
+    out += digits[bytes[i] >> 4];
+    out += digits[bytes[i] & 0xF];
+  }
+}
+
+}  // namespace
+
+optional<HashedIdEncoding> DetectHashedIdEncoding(string_view id) {
+  if (id.size() == kHexHashedIdLength &&
+      std::all_of(id.begin(), id.end(), absl::ascii_isxdigit)) {
+    if (std::none_of(id.begin(), id.end(), absl::ascii_isupper)) {
+      return HashedIdEncoding::kHexLower;
+    }
+    if (std::none_of(id.begin(), id.end(), absl::ascii_islower)) {
+      return HashedIdEncoding::kHexUpper;
+    }
+    return nullopt;
+  }
+  absl::string_view absl_id(id.data(), id.size());
+  string decoded;
+  if (id.size() == kBase64HashedIdLength && id.back() == '=' &&
+      absl::Base64Unescape(absl_id, &decoded) && decoded.size() == 32 &&
+      absl::Base64Escape(decoded) == id) {
+    return HashedIdEncoding::kBase64;
+  }
+  if (id.size() == kWebSafeBase64HashedIdLength &&
+      absl::WebSafeBase64Unescape(absl_id, &decoded) &&
+      decoded.size() == 32 &&
+      absl::WebSafeBase64Escape(decoded) == id) {
+    return HashedIdEncoding::kWebSafeBase64;
+  }
+  return nullopt;
+}
+
+bool IsUuid(string_view id, bool& is_uppercase) {
+  if (id.size() != kUuidLength) {
+    return false;
+  }
+  bool has_upper = false, has_lower = false;
+  for (size_t i = 0; i < id.size(); i++) {
+    if (IsUuidDashPosition(i)) {
+      if (id[i] != '-') return false;
+    } else if (!absl::ascii_isxdigit(id[i])) {
+      return false;
+    }
+    has_upper |= absl::ascii_isupper(id[i]);
+    has_lower |= absl::ascii_islower(id[i]);
+  }
+  if (has_upper && has_lower) {
+    return false;
+  }
+  is_uppercase = has_upper;
+  return true;
+}
+
+HashedIdMatchTable::HashedIdMatchTable(HashedIdEncoding key_encoding,
+                                       bool uppercase_values)
+    : key_encoding_(key_encoding), uppercase_values_(uppercase_values) {}
+
+optional<HashedIdKey> HashedIdMatchTable::DecodeKey(string_view key) const {
+  HashedIdKey decoded_key;
+  switch (key_encoding_) {
+    case HashedIdEncoding::kHexLower:
+    case HashedIdEncoding::kHexUpper:
+      // Hex of a single letter case always round-trips.
+      if (key.size() != kHexHashedIdLength ||
+          !DecodeHex(key, key_encoding_ == HashedIdEncoding::kHexUpper,
+                     decoded_key.data())) {
+        return nullopt;
+      }
+      return decoded_key;
+    case HashedIdEncoding::kBase64:
+    case HashedIdEncoding::kWebSafeBase64: {
+      absl::string_view absl_key(key.data(), key.size());
+      string bytes;
+      bool decoded = key_encoding_ == HashedIdEncoding::kBase64
+                         ? key.size() == kBase64HashedIdLength &&
+                               absl::Base64Unescape(absl_key, &bytes)
+                         : key.size() == kWebSafeBase64HashedIdLength &&
+                               absl::WebSafeBase64Unescape(absl_key, &bytes);
+      if (!decoded || bytes.size() != decoded_key.size()) {
+        return nullopt;
+      }
+      std::copy(bytes.begin(), bytes.end(), decoded_key.begin());
+      break;
+    }
+  }
+  // Only accept keys that encode back to exactly the same string so that two
+  // different strings never map to the same binary key. Base64 decoding is
+  // lenient about e.g. trailing bits, so check explicitly.
+  if (EncodeKey(decoded_key) != key) {
+    return nullopt;
+  }
+  return decoded_key;
+}
+
+string HashedIdMatchTable::EncodeKey(const HashedIdKey& key) const {
+  absl::string_view bytes(reinterpret_cast<const char*>(key.data()),
+                          key.size());
+  string encoded;
+  switch (key_encoding_) {
+    case HashedIdEncoding::kHexLower:
+    case HashedIdEncoding::kHexUpper:
+      encoded.reserve(kHexHashedIdLength);
+      EncodeHex(key.data(), key.size(),
+                key_encoding_ == HashedIdEncoding::kHexUpper, encoded);
+      break;
+    case HashedIdEncoding::kBase64:
+      absl::Base64Escape(bytes, &encoded);
+      break;
+    case HashedIdEncoding::kWebSafeBase64:
+      absl::WebSafeBase64Escape(bytes, &encoded);
+      break;
+  }
+  return encoded;
+}
+
+optional<UuidValue> HashedIdMatchTable::DecodeValue(string_view value) const {
+  if (value.size() != kUuidLength) {
+    return nullopt;
+  }
+  UuidValue decoded_value;
+  size_t offset = 0;
+  for (size_t i = 0; i < value.size(); i++) {
+    if (IsUuidDashPosition(i)) {
+      if (value[i] != '-') return nullopt;
+      continue;
+    }
+    if (!DecodeHex(value.substr(i, 2), uppercase_values_,
+                   decoded_value.data() + offset)) {
+      return nullopt;
+    }
+    offset++;
+    i++;
+  }
+  return decoded_value;
+}
+
+string HashedIdMatchTable::EncodeValue(const UuidValue& value) const {
+  string encoded;
+  encoded.reserve(kUuidLength);
+  EncodeHex(value.data(), 4, uppercase_values_, encoded);
+  for (size_t offset : {4, 6, 8, 10}) {
+    encoded += '-';
+    EncodeHex(value.data() + offset, offset == 10 ? 6 : 2, uppercase_values_,
+              encoded);
+  }
+  return encoded;
+}
+
+ExecutionResult HashedIdMatchTable::AddElement(const string& key,
+                                               const string& value) {
+  auto decoded_key = DecodeKey(key);
+  auto decoded_value = DecodeValue(value);
+
+  lock_guard lock(data_mutex_);
+  if (frozen_) {
+    return FailureExecutionResult(errors::MATCH_TABLE_FROZEN);
+  }
+  return AddElementLocked(key, value, decoded_key, decoded_value);
+}
+
+ExecutionResult HashedIdMatchTable::BulkLoad(
+    vector<std::pair<string, string>> elements,
+    vector<string>* duplicate_keys) {
+  vector<optional<HashedIdKey>> decoded_keys;
+  vector<optional<UuidValue>> decoded_values;
+  decoded_keys.reserve(elements.size());
+  decoded_values.reserve(elements.size());
+  for (const auto& [key, value] : elements) {
+    decoded_keys.push_back(DecodeKey(key));
+    decoded_values.push_back(DecodeValue(value));
+  }
+
+  lock_guard lock(data_mutex_);
+  if (frozen_) {
+    return FailureExecutionResult(errors::MATCH_TABLE_FROZEN);
+  }
+  data_.reserve(data_.size() + elements.size());
+  for (size_t i = 0; i < elements.size(); i++) {
+    auto& [key, value] = elements[i];
+    auto result =
+        AddElementLocked(key, value, decoded_keys[i], decoded_values[i]);
+    if (result.status_code == errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS) {
+      duplicate_keys->push_back(std::move(key));
+    } else if (!result.Successful()) {
+      return result;
+    }
+  }
+  return SuccessExecutionResult();
+}
+
+ExecutionResult HashedIdMatchTable::AddElementLocked(
+    const string& key, const string& value,
+    const optional<HashedIdKey>& decoded_key,
+    const optional<UuidValue>& decoded_value) {
+  auto size = data_.size() + fallback_.size();
+  if (size >= kMaxElements) {
+    return FailureExecutionResult(errors::MATCH_TABLE_FULL);
+  }
+  auto index = static_cast<uint32_t>(size);
+  bool added;
+  if (decoded_key && decoded_value) {
+    added = !fallback_.contains(key) &&
+            data_.try_emplace(*decoded_key, ValueInfo{*decoded_value, index})
+                .second;
+  } else if (!(decoded_key && data_.contains(*decoded_key))) {
+    auto [it, inserted] =
+        fallback_.try_emplace(key, FallbackValueInfo{value, index});
+    added = inserted;
+    if (inserted) {
+      fallback_heap_bytes_ +=
+          GetOwnedHeapBytes(it->first) + GetOwnedHeapBytes(it->second.value);
+    }
+  } else {
+    added = false;
+  }
+  if (!added) {
+    return FailureExecutionResult(errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS);
+  }
+  GrowMatchedBits(size + 1);
+  return SuccessExecutionResult();
+}
+
+void HashedIdMatchTable::GrowMatchedBits(size_t num_elements) {
+  auto num_bits = matched_bits_.GetNumWords() * MatchedBitset::kBitsPerWord;
+  if (num_elements > num_bits) {
+    auto new_num_bits = std::max(num_bits, MatchedBitset::kBitsPerWord);
+    while (new_num_bits < num_elements) {
+      new_num_bits *= 2;
+    }
+    matched_bits_.Resize(new_num_bits);
+  }
+}
+
+void HashedIdMatchTable::Reserve(size_t num_elements) {
+  lock_guard lock(data_mutex_);
+  if (!frozen_) {
+    data_.reserve(num_elements);
+    GrowMatchedBits(std::min(num_elements, kMaxElements));
+  }
+}
+
+unique_lock<std::mutex> HashedIdMatchTable::LockUnlessFrozen() const {
+  unique_lock lock(data_mutex_, std::defer_lock);
+  if (!frozen_.load(std::memory_order_acquire)) {
+    lock.lock();
+  }
+  return lock;
+}
+
+optional<string> HashedIdMatchTable::MarkMatchedLocked(
+    const string& key, const optional<HashedIdKey>& decoded_key,
+    bool& newly_matched, uint32_t& index) {
+  if (decoded_key) {
+    if (auto it = data_.find(*decoded_key); it != data_.end()) {
+      index = it->second.index;
+      newly_matched = matched_bits_.Set(index);
+      return EncodeValue(it->second.value);
+    }
+  }
+  if (auto it = fallback_.find(key); it != fallback_.end()) {
+    index = it->second.index;
+    newly_matched = matched_bits_.Set(index);
+    return it->second.value;
+  }
+  return nullopt;
+}
+
+ExecutionResultOr<string> HashedIdMatchTable::MarkMatched(
+    const string& key) {
+  return MarkMatched(key, nullptr);
+}
+
+ExecutionResultOr<string> HashedIdMatchTable::MarkMatched(
+    const string& key, bool* newly_matched) {
+  auto decoded_key = DecodeKey(key);
+
+  auto lock = LockUnlessFrozen();
+  bool newly_matched_key = false;
+  uint32_t index;
+  if (auto value =
+          MarkMatchedLocked(key, decoded_key, newly_matched_key, index);
+      value) {
+    if (newly_matched) {
+      *newly_matched = newly_matched_key;
+    }
+    return *std::move(value);
+  }
+  return FailureExecutionResult(errors::MATCH_TABLE_ELEMENT_DOES_NOT_EXIST);
+}
+
+void HashedIdMatchTable::MarkMatchedBatch(absl::Span<const string> keys,
+                                          vector<optional<string>>* values,
+                                          vector<bool>* newly_matched) {
+  MarkMatchedBatchImpl(keys, values, newly_matched, nullptr);
+}
+
+ExecutionResult HashedIdMatchTable::MarkMatchedBatchWithIndices(
+    absl::Span<const string> keys, vector<optional<string>>* values,
+    vector<size_t>* element_indices) {
+  MarkMatchedBatchImpl(keys, values, nullptr, element_indices);
+  return SuccessExecutionResult();
+}
+
+void HashedIdMatchTable::MarkMatchedBatchImpl(
+    absl::Span<const string> keys, vector<optional<string>>* values,
+    vector<bool>* newly_matched, vector<size_t>* element_indices) {
+  vector<optional<HashedIdKey>> decoded_keys;
+  decoded_keys.reserve(keys.size());
+  for (const auto& key : keys) {
+    decoded_keys.push_back(DecodeKey(key));
+  }
+  values->clear();
+  values->reserve(keys.size());
+  if (newly_matched) {
+    newly_matched->assign(keys.size(), false);
+  }
+  if (element_indices) {
+    element_indices->assign(keys.size(), 0);
+  }
+
+  auto lock = LockUnlessFrozen();
+  for (size_t i = 0; i < keys.size(); i++) {
+    bool newly_matched_key = false;
+    uint32_t index = 0;
+    values->push_back(
+        MarkMatchedLocked(keys[i], decoded_keys[i], newly_matched_key, index));
+    if (newly_matched) {
+      (*newly_matched)[i] = newly_matched_key;
+    }
+    if (element_indices) {
+      (*element_indices)[i] = index;
+    }
+  }
+}
+
+size_t HashedIdMatchTable::GetNumElementIndices() const {
+  auto lock = LockUnlessFrozen();
+  return data_.size() + fallback_.size();
+}
+
+void HashedIdMatchTable::Freeze() {
+  lock_guard lock(data_mutex_);
+  frozen_.store(true, std::memory_order_release);
+}
+
+void HashedIdMatchTable::VisitMatched(VisitorCallback visitor) {
+  lock_guard lock(data_mutex_);
+
+  for (const auto& [key, val] : data_) {
+    if (matched_bits_.Test(val.index)) {
+      visitor(EncodeKey(key), EncodeValue(val.value));
+    }
+  }
+  for (const auto& [key, val] : fallback_) {
+    if (matched_bits_.Test(val.index)) {
+      visitor(key, val.value);
+    }
+  }
+}
+
+size_t HashedIdMatchTable::Size() const {
+  lock_guard lock(data_mutex_);
+  return data_.size() + fallback_.size();
+}
+
+size_t HashedIdMatchTable::GetMemoryUsageBytes() const {
+  lock_guard lock(data_mutex_);
+
+  return GetHashMapSlotBytes(data_) + GetHashMapSlotBytes(fallback_) +
+         matched_bits_.GetMemoryUsageBytes() + fallback_heap_bytes_;
+}
+
+size_t HashedIdMatchTable::GetFallbackSize() const {
+  lock_guard lock(data_mutex_);
+  return fallback_.size();
+}
+
+}  // namespace google::pair::matcher
@@ -0,0 +1,278 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/types/span.h"
+
+#include "match_table.h"
+#include "matched_bitset.h"
+
+namespace google::pair::matcher {
+
+/**
+ * @brief A SHA-256 hashed ID in binary form.
+ *
+ */
+using HashedIdKey = std::array<uint8_t, 32>;
+
+/**
+ * @brief A UUID-sized encrypted ID in binary form.
+ *
+ */
+using UuidValue = std::array<uint8_t, 16>;
+
+/**
+ * @brief The text encodings a hashed ID can come in.
+ *
+ */
+enum class HashedIdEncoding {
+  // 64 lowercase hex characters.
+  kHexLower,
+  // 64 uppercase hex characters.
+  kHexUpper,
+  // 44 standard base64 characters including padding.
+  kBase64,
+  // 43 web safe base64 characters without padding.
+  kWebSafeBase64,
+};
+
+/**
+ * @brief Detects whether the ID looks like a SHA-256 hash in one of the
+ * supported encodings.
+ *
+ * @param id the text ID
+ * @return std::optional<HashedIdEncoding> the detected encoding or nullopt
+ */
+std::optional<HashedIdEncoding> DetectHashedIdEncoding(std::string_view id);
+
+/**
+ * @brief Whether the ID is a UUID in the 8-4-4-4-12 hex format with a single
+ * letter case.
+ *
+ * @param id the text ID
+ * @param is_uppercase set to whether the hex letters are uppercase
+ */
+bool IsUuid(std::string_view id, bool& is_uppercase);
+
+/**
+ * @brief MatchTable specialised for publisher mappings from SHA-256 hashed IDs
+ * to UUID encrypted IDs. Both are stored in fixed-width binary form, and the
+ * uniformly distributed key bytes are used as the hash directly.
+ *
+ * Elements that do not round-trip exactly through the binary form (e.g. a
+ * different encoding or letter case than the rest of the mapping) are kept in
+ * a string-keyed fallback table so that matching stays byte-for-byte
+ * equivalent to MatchTableHashMap. The matched flags of both tables are packed
+ * into one bitset, indexed by the order the elements were added, which limits
+ * the table to 2^32 elements.
+ *
+ */
+class HashedIdMatchTable : public MatchTable<std::string, std::string> {
+ public:
+  /**
+   * @brief Construct a new Hashed Id Match Table object
+   *
+   * @param key_encoding the encoding of the hashed IDs used as keys
+   * @param uppercase_values whether the UUID values use uppercase hex
+   */
+  HashedIdMatchTable(HashedIdEncoding key_encoding, bool uppercase_values);
+
+  scp::core::ExecutionResult AddElement(const std::string& key,
+                                        const std::string& value) override;
+
+  /**
+   * @brief Decodes the batch before taking the lock once for all of it.
+   *
+   */
+  scp::core::ExecutionResult BulkLoad(
+      std::vector<std::pair<std::string, std::string>> elements,
+      std::vector<std::string>* duplicate_keys) override;
+
+  /**
+   * @brief Reserves room in the binary table only, the fallback is expected
+   * to stay small.
+   *
+   */
+  void Reserve(size_t num_elements) override;
+
+  using MatchTable<std::string, std::string>::MarkMatched;
+  using MatchTable<std::string, std::string>::MarkMatchedBatch;
+
+  scp::core::ExecutionResultOr<std::string> MarkMatched(
+      const std::string& key) override;
+
+  scp::core::ExecutionResultOr<std::string> MarkMatched(
+      const std::string& key, bool* newly_matched) override;
+
+  /**
+   * @brief Decodes the keys before taking the lock once for the whole batch.
+   *
+   */
+  void MarkMatchedBatch(absl::Span<const std::string> keys,
+                        std::vector<std::optional<std::string>>* values,
+                        std::vector<bool>* newly_matched) override;
+
+  /**
+   * @brief Element indices number the elements of both maps in the order they
+   * were added.
+   *
+   */
+  scp::core::ExecutionResult MarkMatchedBatchWithIndices(
+      absl::Span<const std::string> keys,
+      std::vector<std::optional<std::string>>* values,
+      std::vector<size_t>* element_indices) override;
+
+  size_t GetNumElementIndices() const override;
+
+  /**
+   * @brief Once frozen the maps are only read, so MarkMatched and
+   * MarkMatchedBatch skip the lock and the matched flags are set atomically.
+   *
+   */
+  void Freeze() override;
+
+  void VisitMatched(VisitorCallback visitor) override;
+
+  size_t Size() const override;
+
+  size_t GetMemoryUsageBytes() const override;
+
+  /**
+   * @brief Get the number of elements that did not fit the binary form and
+   * were stored in the fallback table.
+   *
+   * @return size_t
+   */
+  size_t GetFallbackSize() const;
+
+ private:
+  /**
+   * @brief Folds the four 64 bit words of the hashed ID into the hash with
+   * XOR, without rehashing, so uniformly distributed digests stay uniform.
+   * The words are read big-endian, so that the trailing bytes, where
+   * structured IDs such as zero-padded counters differ, land in the low bits
+   * the table is indexed with.
+   *
+   */
+  struct HashedIdKeyHash {
+    size_t operator()(const HashedIdKey& key) const {
+      uint64_t hash = 0;
+      for (size_t i = 0; i < key.size(); i += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        for (size_t j = 0; j < sizeof(uint64_t); j++) {
+          word = (word << 8) | key[i + j];
+        }
+        hash ^= word;
+      }
+      return static_cast<size_t>(hash);
+    }
+  };
+
+  /**
+   * @brief Struct to hold the value information.
+   * It contains the actual value and the index of the element's matched flag.
+   *
+   */
+  struct ValueInfo {
+    UuidValue value;
+    uint32_t index;
+  };
+
+  /**
+   * @brief Struct to hold the value information of fallback elements.
+   *
+   */
+  struct FallbackValueInfo {
+    std::string value;
+    uint32_t index;
+  };
+
+  std::optional<HashedIdKey> DecodeKey(std::string_view key) const;
+
+  std::string EncodeKey(const HashedIdKey& key) const;
+
+  std::optional<UuidValue> DecodeValue(std::string_view value) const;
+
+  std::string EncodeValue(const UuidValue& value) const;
+
+  // Adds the element, data_mutex_ must be held. Fails if it already exists or
+  // the table is full.
+  scp::core::ExecutionResult AddElementLocked(
+      const std::string& key, const std::string& value,
+      const std::optional<HashedIdKey>& decoded_key,
+      const std::optional<UuidValue>& decoded_value);
+
+  // Marks the element as matched and returns its value, data_mutex_ must be
+  // held. newly_matched is set to whether it was not matched before, and index
+  // to the index of its matched flag.
+  std::optional<std::string> MarkMatchedLocked(
+      const std::string& key, const std::optional<HashedIdKey>& decoded_key,
+      bool& newly_matched, uint32_t& index);
+
+  // Marks the batch as matched, telling whichever of newly_matched and
+  // element_indices is not null.
+  void MarkMatchedBatchImpl(absl::Span<const std::string> keys,
+                            std::vector<std::optional<std::string>>* values,
+                            std::vector<bool>* newly_matched,
+                            std::vector<size_t>* element_indices);
+
+  // Doubles the matched bitset until it has a bit for every element,
+  // data_mutex_ must be held.
+  void GrowMatchedBits(size_t num_elements);
+
+  // Only locks while the table can still change.
+  std::unique_lock<std::mutex> LockUnlessFrozen() const;
+
+  const HashedIdEncoding key_encoding_;
+  const bool uppercase_values_;
+
+  /**
+   * @brief Map containing the binary key value pairs and match info.
+   *
+   */
+  absl::flat_hash_map<HashedIdKey, ValueInfo, HashedIdKeyHash> data_;
+  /**
+   * @brief Map for elements which do not round-trip through the binary form.
+   *
+   */
+  absl::flat_hash_map<std::string, FallbackValueInfo> fallback_;
+  /**
+   * @brief The heap memory owned by the keys and values of fallback_, counted
+   * as they are added so that GetMemoryUsageBytes does not walk the map.
+   *
+   */
+  size_t fallback_heap_bytes_ = 0;
+  /**
+   * @brief One bit per element of either map, in the order they were added,
+   * set once the element is matched.
+   *
+   */
+  MatchedBitset matched_bits_;
+  mutable std::mutex data_mutex_;
+  std::atomic_bool frozen_ = false;
+};
+
+}  // namespace google::pair::matcher
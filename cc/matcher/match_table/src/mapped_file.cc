@@ -0,0 +1,110 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+
+#include "error_codes.h"
+
+using google::scp::core::ExecutionResult;
+using google::scp::core::ExecutionResultOr;
+using google::scp::core::FailureExecutionResult;
+using google::scp::core::SuccessExecutionResult;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+constexpr char kFileNameTemplate[] = "match_table_XXXXXX";
+
+// Allocates the disk blocks of the file from offset to offset + size, growing
+// it if needed, so that writing to the mapping never faults for lack of disk
+// space. glibc writes the blocks itself on file systems without fallocate.
+bool Allocate(int fd, size_t offset, size_t size) {
+  return posix_fallocate(fd, offset, size) == 0;
+}
+
+char* Map(int fd, size_t size) {
+  auto* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                    /* offset */ 0);
+  return data == MAP_FAILED ? nullptr : static_cast<char*>(data);
+}
+
+}  // namespace
+
+namespace google::pair::matcher {
+
+ExecutionResultOr<unique_ptr<MappedFile>> MappedFile::Create(
+    const string& directory, size_t size) {
+  auto path = absl::StrCat(directory, "/", kFileNameTemplate);
+  vector<char> path_buffer(path.begin(), path.end());
+  path_buffer.push_back('\0');
+  int fd = mkstemp(path_buffer.data());
+  if (fd < 0) {
+    return FailureExecutionResult(errors::MATCH_TABLE_FILE_ERROR);
+  }
+  unlink(path_buffer.data());
+
+  char* data = nullptr;
+  if (size == 0 || !Allocate(fd, /* offset */ 0, size) ||
+      (data = Map(fd, size)) == nullptr) {
+    close(fd);
+    return FailureExecutionResult(errors::MATCH_TABLE_FILE_ERROR);
+  }
+  return unique_ptr<MappedFile>(new MappedFile(fd, data, size));
+}
+
+MappedFile::~MappedFile() {
+  munmap(data_, size_);
+  close(fd_);
+}
+
+ExecutionResult MappedFile::Grow(size_t size) {
+  if (size <= size_) {
+    return SuccessExecutionResult();
+  }
+  if (!Allocate(fd_, size_, size - size_)) {
+    return FailureExecutionResult(errors::MATCH_TABLE_FILE_ERROR);
+  }
+  // The old mapping stays valid until the new one is in place, so a failure
+  // leaves the file usable at its old size.
+  char* data = Map(fd_, size);
+  if (data == nullptr) {
+    return FailureExecutionResult(errors::MATCH_TABLE_FILE_ERROR);
+  }
+  munmap(data_, size_);
+  data_ = data;
+  size_ = size;
+  if (random_access_) {
+    madvise(data_, size_, MADV_RANDOM);
+  }
+  return SuccessExecutionResult();
+}
+
+void MappedFile::AdviseRandomAccess() {
+  random_access_ = true;
+  madvise(data_, size_, MADV_RANDOM);
+}
+
+}  // namespace google::pair::matcher
@@ -0,0 +1,89 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "cc/public/core/interface/execution_result.h"
+
+namespace google::pair::matcher {
+
+/**
+ * @brief A file on local disk mapped into memory, used to hold data which may
+ * not fit in RAM. The kernel pages it in on access and writes dirty pages back
+ * under memory pressure.
+ *
+ * The file is unlinked as soon as it is created, so it is never visible to
+ * other processes and its disk space is freed once the MappedFile is
+ * destroyed, even if the process crashes.
+ *
+ */
+class MappedFile {
+ public:
+  /**
+   * @brief Create a zero-filled file of the given size and map it. The disk
+   * space of the file is allocated up front, so that writing to it cannot
+   * fault once the disk is full.
+   *
+   * @param directory the directory to create the file in
+   * @param size the initial size in bytes, at least 1
+   * @return scp::core::ExecutionResultOr<std::unique_ptr<MappedFile>> a
+   * failure if the file could not be created or there is not enough disk
+   * space
+   */
+  static scp::core::ExecutionResultOr<std::unique_ptr<MappedFile>> Create(
+      const std::string& directory, size_t size);
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile();
+
+  /**
+   * @brief Grow the file to size bytes, zero-filling the new bytes and keeping
+   * the existing ones. This maps the file again, so pointers returned by
+   * GetData before the call are invalidated. As in Create, the disk space of
+   * the new bytes is allocated up front.
+   *
+   * @param size the new size in bytes, at least the current size
+   * @return scp::core::ExecutionResult a failure if there is not enough disk
+   * space, leaving the file mapped at its old size
+   */
+  scp::core::ExecutionResult Grow(size_t size);
+
+  /**
+   * @brief Hint that the file will be accessed at random, which disables
+   * readahead of the neighbouring pages on a page fault.
+   *
+   */
+  void AdviseRandomAccess();
+
+  char* GetData() const { return data_; }
+
+  size_t GetSize() const { return size_; }
+
+ private:
+  MappedFile(int fd, char* data, size_t size)
+      : fd_(fd), data_(data), size_(size) {}
+
+  const int fd_;
+  char* data_;
+  size_t size_;
+  bool random_access_ = false;
+};
+
+}  // namespace google::pair::matcher
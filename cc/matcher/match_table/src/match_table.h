@@ -14,11 +14,36 @@
 
 #pragma once
 
+#include <deque>
 #include <functional>
+#include <optional>
+#include <utility>
+#include <vector>
 
+#include "absl/types/span.h"
 #include "cc/public/core/interface/execution_result.h"
 
+#include "error_codes.h"
+
 namespace google::pair::matcher {
+
+/**
+ * @brief Maximum number of elements passed to a MatchedBatchCallback at once.
+ *
+ */
+inline constexpr size_t kMatchedBatchSize = 1024;
+
+/**
+ * @brief A matched element as passed to a MatchedBatchCallback. The pointers
+ * are only valid for the duration of the callback.
+ *
+ */
+template <typename K, typename V>
+struct MatchedElement {
+  const K* key;
+  const V* value;
+};
+
 /**
  * @brief This interface is used to represent a matching set.
  * Key-value pairs can be added to the set and then these keys can be marked as
@@ -37,6 +62,14 @@ class MatchTable {
    */
   using VisitorCallback = std::function<void(const K& key, const V& value)>;
 
+  /**
+   * @brief Callback invoked with batches of up to kMatchedBatchSize matched
+   * elements.
+   *
+   */
+  using MatchedBatchCallback =
+      std::function<void(absl::Span<const MatchedElement<K, V>> batch)>;
+
   /**
    * @brief Add an element (KV pair) to the table for later matching and
    * retrieval. This function should return a failure if the element
@@ -49,6 +82,40 @@ class MatchTable {
   virtual scp::core::ExecutionResult AddElement(const K& key,
                                                 const V& value) = 0;
 
+  /**
+   * @brief Add a batch of elements to the table. Unlike AddElement, a key that
+   * already exists (in the table or earlier in the batch) does not fail the
+   * load: the element is skipped and its key appended to duplicate_keys, so
+   * that all of the duplicates are reported together once the batch is
+   * loaded. Implementations can override this to take their lock once per
+   * batch, by default it calls AddElement once per element.
+   *
+   * @param elements the key-value pairs to add, consumed by the call
+   * @param duplicate_keys the keys of the skipped elements are appended here
+   * @return success, or a failure other than a duplicate key, e.g. if the
+   * table is frozen
+   */
+  virtual scp::core::ExecutionResult BulkLoad(
+      std::vector<std::pair<K, V>> elements, std::vector<K>* duplicate_keys) {
+    for (auto& [key, value] : elements) {
+      auto result = AddElement(key, value);
+      if (result.status_code == errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS) {
+        duplicate_keys->push_back(std::move(key));
+      } else if (!result.Successful()) {
+        return result;
+      }
+    }
+    return scp::core::SuccessExecutionResult();
+  }
+
+  /**
+   * @brief Reserve room for at least num_elements elements, so that adding
+   * them does not grow the table step by step. By default this does nothing.
+   *
+   * @param num_elements the expected number of elements
+   */
+  virtual void Reserve(size_t num_elements) {}
+
   /**
    * @brief Mark an element as matched.
    *
@@ -58,6 +125,114 @@ class MatchTable {
    */
   virtual scp::core::ExecutionResultOr<V> MarkMatched(const K& key) = 0;
 
+  /**
+   * @brief Mark an element as matched and tell whether it was marked before.
+   * The matched flag is read and set in one atomic step, so of any number of
+   * concurrent calls for the same key exactly one sees it newly matched.
+   * Tables which only implement the single-key MarkMatched cannot tell, so by
+   * default this fails if newly_matched is not null.
+   *
+   * @param key the key of the element
+   * @param newly_matched if not null, set to whether the element was not
+   * marked as matched before, if it exists
+   * @return the value that was stored for the given element by key if it exists
+   * or a FailureExecutionResult
+   */
+  virtual scp::core::ExecutionResultOr<V> MarkMatched(const K& key,
+                                                      bool* newly_matched) {
+    if (newly_matched) {
+      return scp::core::FailureExecutionResult(
+          errors::MATCH_TABLE_NEWLY_MATCHED_NOT_SUPPORTED);
+    }
+    return MarkMatched(key);
+  }
+
+  /**
+   * @brief Mark a batch of elements as matched.
+   *
+   * @param keys the keys of the elements
+   * @param values replaced with one entry per key holding the stored value, or
+   * nullopt if the element does not exist
+   */
+  void MarkMatchedBatch(absl::Span<const K> keys,
+                        std::vector<std::optional<V>>* values) {
+    MarkMatchedBatch(keys, values, nullptr);
+  }
+
+  /**
+   * @brief Mark a batch of elements as matched and tell which of them were
+   * marked before, see MarkMatched. Implementations can override this to
+   * amortize locking and overlap the memory accesses of the lookups, by
+   * default it calls MarkMatched once per key.
+   *
+   * @param keys the keys of the elements
+   * @param values replaced with one entry per key holding the stored value, or
+   * nullopt if the element does not exist
+   * @param newly_matched if not null, replaced with one entry per key which is
+   * true if the element exists and was not marked as matched before
+   */
+  virtual void MarkMatchedBatch(absl::Span<const K> keys,
+                                std::vector<std::optional<V>>* values,
+                                std::vector<bool>* newly_matched) {
+    values->clear();
+    values->reserve(keys.size());
+    if (newly_matched) {
+      newly_matched->clear();
+      newly_matched->reserve(keys.size());
+    }
+    for (const auto& key : keys) {
+      bool newly_matched_key = false;
+      auto value_or =
+          MarkMatched(key, newly_matched ? &newly_matched_key : nullptr);
+      if (value_or.Successful()) {
+        values->push_back(value_or.release());
+      } else {
+        values->emplace_back();
+      }
+      if (newly_matched) {
+        newly_matched->push_back(newly_matched_key);
+      }
+    }
+  }
+
+  /**
+   * @brief Mark a batch of elements as matched like MarkMatchedBatch, and tell
+   * the index of each element found. Indices are less than
+   * GetNumElementIndices() and stay the same once the table is frozen, so that
+   * callers can keep matched state of their own in a MatchedBitset, e.g. one
+   * per list matched against a shared table. Tables whose elements have no
+   * such index fail by default.
+   *
+   * @param keys the keys of the elements
+   * @param values replaced with one entry per key holding the stored value, or
+   * nullopt if the element does not exist
+   * @param element_indices replaced with one entry per key holding the index
+   * of the element, unspecified if the element does not exist
+   * @return success, or a failure if the table cannot tell element indices
+   */
+  virtual scp::core::ExecutionResult MarkMatchedBatchWithIndices(
+      absl::Span<const K> keys, std::vector<std::optional<V>>* values,
+      std::vector<size_t>* element_indices) {
+    return scp::core::FailureExecutionResult(
+        errors::MATCH_TABLE_ELEMENT_INDICES_NOT_SUPPORTED);
+  }
+
+  /**
+   * @brief Get the bound on the indices told by MarkMatchedBatchWithIndices.
+   *
+   * @return size_t 0 if the table cannot tell element indices
+   */
+  virtual size_t GetNumElementIndices() const { return 0; }
+
+  /**
+   * @brief Freeze the table once all elements have been added. Implementations
+   * can then serve MarkMatched and MarkMatchedBatch from many threads without
+   * taking a lock, and fail any further AddElement calls. By default this does
+   * nothing and the table keeps locking.
+   *
+   */
+  virtual void Freeze() {}
+
   /**
    * @brief This method iterates over the matched elements and calls the
    * provided callback once per element with the matched element.
@@ -66,6 +241,70 @@ class MatchTable {
    */
   virtual void VisitMatched(VisitorCallback visitor) = 0;
 
+  /**
+   * @brief Get the number of ranges the table is split into for
+   * VisitMatchedRange.
+   *
+   * @return size_t
+   */
+  virtual size_t GetNumVisitRanges() const { return 1; }
+
+  /**
+   * @brief Visits the matched elements in one range of the table, in batches.
+   * Implementations split the table so that different ranges can be visited
+   * from different threads at the same time once the table is frozen. By
+   * default there is a single range which copies the elements from
+   * VisitMatched into batches.
+   *
+   * @param range the range to visit, less than GetNumVisitRanges()
+   * @param visitor the callback to invoke with each batch
+   */
+  virtual void VisitMatchedRange(size_t range, MatchedBatchCallback visitor) {
+    // A deque keeps the elements in place while the batch is filled.
+    std::deque<std::pair<K, V>> elements;
+    std::vector<MatchedElement<K, V>> batch;
+    auto flush = [&elements, &batch, &visitor]() {
+      if (!batch.empty()) {
+        visitor(batch);
+      }
+      elements.clear();
+      batch.clear();
+    };
+    VisitMatched([&elements, &batch, &flush](const K& key, const V& value) {
+      const auto& element = elements.emplace_back(key, value);
+      batch.push_back({&element.first, &element.second});
+      if (batch.size() == kMatchedBatchSize) {
+        flush();
+      }
+    });
+    flush();
+  }
+
+  /**
+   * @brief Get the number of elements in the table.
+   *
+   * @return size_t
+   */
+  virtual size_t Size() const = 0;
+
+  /**
+   * @brief Estimate the number of bytes used by the table, including the
+   * memory owned by its keys and values.
+   *
+   * @return size_t
+   */
+  virtual size_t GetMemoryUsageBytes() const = 0;
+
+  /**
+   * @brief Estimate the average number of bytes used per element.
+   *
+   * @return double 0 if the table is empty
+   */
+  double GetBytesPerEntry() const {
+    auto size = Size();
+    return size == 0 ? 0 : static_cast<double>(GetMemoryUsageBytes()) / size;
+  }
+
   virtual ~MatchTable() = default;
 };
 
@@ -14,43 +14,107 @@
 
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 
 #include "error_codes.h"
 #include "match_table.h"
+#include "memory_usage.h"
 
 namespace google::pair::matcher {
 
 template <typename K, typename V>
 class MatchTableHashMap : public MatchTable<K, V> {
  public:
+  using MatchTable<K, V>::MarkMatched;
+
   scp::core::ExecutionResult AddElement(const K& key, const V& value) override {
     std::lock_guard lock(data_mutex_);
 
-    if (data_.contains(key)) {
+    if (frozen_) {
+      return scp::core::FailureExecutionResult(errors::MATCH_TABLE_FROZEN);
+    }
+    // A single lookup both checks for the key and makes room for it.
+    auto [it, inserted] = data_.try_emplace(key);
+    if (!inserted) {
       return scp::core::FailureExecutionResult(
           errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS);
     }
 
-    data_[key] = std::make_unique<ValueInfo>(value);
+    it->second = std::make_unique<ValueInfo>(value);
     return scp::core::SuccessExecutionResult();
   }
 
-  scp::core::ExecutionResultOr<V> MarkMatched(const K& key) override {
+  /**
+   * @brief Takes the lock once for the whole batch and hashes each key once.
+   *
+   */
+  scp::core::ExecutionResult BulkLoad(
+      std::vector<std::pair<K, V>> elements,
+      std::vector<K>* duplicate_keys) override {
+    std::lock_guard lock(data_mutex_);
+
+    if (frozen_) {
+      return scp::core::FailureExecutionResult(errors::MATCH_TABLE_FROZEN);
+    }
+    data_.reserve(data_.size() + elements.size());
+    for (auto& [key, value] : elements) {
+      // try_emplace leaves key untouched if it already exists.
+      auto [it, inserted] = data_.try_emplace(std::move(key));
+      if (inserted) {
+        it->second = std::make_unique<ValueInfo>(value);
+      } else {
+        duplicate_keys->push_back(std::move(key));
+      }
+    }
+    return scp::core::SuccessExecutionResult();
+  }
+
+  void Reserve(size_t num_elements) override {
     std::lock_guard lock(data_mutex_);
+    if (!frozen_) {
+      data_.reserve(num_elements);
+    }
+  }
+
+  /**
+   * @brief Once frozen the map is only read, so lookups skip the lock and the
+   * matched flag is set atomically.
+   *
+   */
+  scp::core::ExecutionResultOr<V> MarkMatched(const K& key) override {
+    return MarkMatched(key, nullptr);
+  }
 
-    if (data_.contains(key)) {
-      data_[key]->MarkMatched();
-      return data_[key]->GetValue();
+  scp::core::ExecutionResultOr<V> MarkMatched(const K& key,
+                                              bool* newly_matched) override {
+    std::unique_lock lock(data_mutex_, std::defer_lock);
+    if (!frozen_.load(std::memory_order_acquire)) {
+      lock.lock();
+    }
+
+    if (auto it = data_.find(key); it != data_.end()) {
+      bool newly_matched_key = it->second->MarkMatched();
+      if (newly_matched) {
+        *newly_matched = newly_matched_key;
+      }
+      return it->second->GetValue();
     }
 
     return scp::core::FailureExecutionResult(
         errors::MATCH_TABLE_ELEMENT_DOES_NOT_EXIST);
   }
 
+  void Freeze() override {
+    std::lock_guard lock(data_mutex_);
+    frozen_.store(true, std::memory_order_release);
+  }
+
   void VisitMatched(
       typename MatchTable<K, V>::VisitorCallback visitor) override {
     std::lock_guard lock(data_mutex_);
@@ -62,6 +126,27 @@ class MatchTableHashMap : public MatchTable<K, V> {
     }
   }
 
+  size_t Size() const override {
+    std::lock_guard lock(data_mutex_);
+    return data_.size();
+  }
+
+  /**
+   * @brief Walks every element to account for the separately allocated
+   * ValueInfo and the heap memory owned by keys and values.
+   *
+   */
+  size_t GetMemoryUsageBytes() const override {
+    std::lock_guard lock(data_mutex_);
+
+    size_t bytes = GetHashMapSlotBytes(data_);
+    for (const auto& [key, val] : data_) {
+      bytes += GetHeapAllocationBytes(sizeof(ValueInfo)) +
+               GetOwnedHeapBytes(key) + GetOwnedHeapBytes(val->value);
+    }
+    return bytes;
+  }
+
  private:
   /**
    * @brief Struct to hold the value information.
@@ -70,18 +155,21 @@ class MatchTableHashMap : public MatchTable<K, V> {
    */
   struct ValueInfo {
     V value;
-    bool is_matched;
+    std::atomic_bool is_matched;
 
-    ValueInfo(const V& value, bool is_matched = false) {
-      this->value = value;
-      this->is_matched = is_matched;
-    }
+    ValueInfo(const V& value, bool is_matched = false)
+        : value(value), is_matched(is_matched) {}
 
-    void MarkMatched() { this->is_matched = true; }
+    // Returns whether the value was not matched before.
+    bool MarkMatched() {
+      return !is_matched.exchange(true, std::memory_order_relaxed);
+    }
 
     V& GetValue() { return value; }
 
-    bool IsMatched() const { return is_matched; }
+    bool IsMatched() const {
+      return is_matched.load(std::memory_order_relaxed);
+    }
   };
 
   /**
@@ -90,5 +178,6 @@ class MatchTableHashMap : public MatchTable<K, V> {
    */
   absl::flat_hash_map<K, std::unique_ptr<ValueInfo>> data_;
   mutable std::mutex data_mutex_;
+  std::atomic_bool frozen_ = false;
 };
 }  // namespace google::pair::matcher
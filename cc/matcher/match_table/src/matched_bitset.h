@@ -0,0 +1,94 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace google::pair::matcher {
+
+/**
+ * @brief Bitset of matched flags which can be set concurrently from many
+ * threads. Bits are set with relaxed atomics since they are only read once all
+ * of the threads marking elements have been joined.
+ *
+ */
+class MatchedBitset {
+ public:
+  static constexpr size_t kBitsPerWord = 64;
+
+  MatchedBitset() = default;
+
+  explicit MatchedBitset(size_t num_bits) { Resize(num_bits); }
+
+  /**
+   * @brief Resize the bitset to hold num_bits, keeping the bits that are
+   * already set. Must not be called concurrently with any other method.
+   *
+   * @param num_bits
+   */
+  void Resize(size_t num_bits) {
+    auto num_words = (num_bits + kBitsPerWord - 1) / kBitsPerWord;
+    auto words = std::make_unique<std::atomic<uint64_t>[]>(num_words);
+    for (size_t i = 0; i < num_words; i++) {
+      words[i].store(i < num_words_ ? GetWord(i) : 0,
+                     std::memory_order_relaxed);
+    }
+    words_ = std::move(words);
+    num_words_ = num_words;
+  }
+
+  /**
+   * @brief Set the bit at index.
+   *
+   * @param index
+   * @return true if the bit was not set before
+   */
+  bool Set(size_t index) {
+    auto mask = GetBitMask(index);
+    return (words_[index / kBitsPerWord].fetch_or(
+                mask, std::memory_order_relaxed) &
+            mask) == 0;
+  }
+
+  bool Test(size_t index) const {
+    return (GetWord(index / kBitsPerWord) & GetBitMask(index)) != 0;
+  }
+
+  /**
+   * @brief Get the word holding bits [word_index * 64, word_index * 64 + 64),
+   * which allows skipping 64 unmatched elements at a time.
+   *
+   */
+  uint64_t GetWord(size_t word_index) const {
+    return words_[word_index].load(std::memory_order_relaxed);
+  }
+
+  size_t GetNumWords() const { return num_words_; }
+
+  size_t GetMemoryUsageBytes() const { return num_words_ * sizeof(uint64_t); }
+
+ private:
+  static uint64_t GetBitMask(size_t index) {
+    return uint64_t{1} << (index % kBitsPerWord);
+  }
+
+  size_t num_words_ = 0;
+  std::unique_ptr<std::atomic<uint64_t>[]> words_;
+};
+
+}  // namespace google::pair::matcher
@@ -0,0 +1,63 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+
+namespace google::pair::matcher {
+
+/**
+ * @brief Estimates the bytes a heap allocation of the given size really takes,
+ * assuming a glibc-style allocator with an 8 byte chunk header and 16 byte
+ * alignment.
+ *
+ */
+inline size_t GetHeapAllocationBytes(size_t size) {
+  return (size + sizeof(size_t) + 15) & ~size_t{15};
+}
+
+/**
+ * @brief Estimates the heap bytes owned by a value, excluding the value itself.
+ * Trivial types own no heap memory.
+ *
+ */
+template <typename T>
+size_t GetOwnedHeapBytes(const T&) {
+  return 0;
+}
+
+/**
+ * @brief Strings only own heap memory once they outgrow the small string
+ * buffer.
+ *
+ */
+inline size_t GetOwnedHeapBytes(const std::string& str) {
+  static const size_t kSmallStringCapacity = std::string().capacity();
+  return str.capacity() > kSmallStringCapacity
+             ? GetHeapAllocationBytes(str.capacity() + 1)
+             : 0;
+}
+
+/**
+ * @brief Estimates the bytes used by the slot and control byte arrays of an
+ * absl raw_hash_set based container, excluding memory owned by the elements.
+ *
+ */
+template <typename Map>
+size_t GetHashMapSlotBytes(const Map& map) {
+  return map.capacity() * (sizeof(typename Map::value_type) + 1);
+}
+
+}  // namespace google::pair::matcher
@@ -0,0 +1,438 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "mmap_match_table.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/hash/hash.h"
+#include "absl/numeric/bits.h"
+#include "cc/core/common/global_logger/src/global_logger.h"
+#include "cc/core/common/uuid/src/uuid.h"
+
+#include "error_codes.h"
+
+using google::scp::core::ExecutionResult;
+using google::scp::core::ExecutionResultOr;
+using google::scp::core::FailureExecutionResult;
+using google::scp::core::SuccessExecutionResult;
+using google::scp::core::common::kZeroUuid;
+using std::atomic;
+using std::lock_guard;
+using std::make_pair;
+using std::move;
+using std::nullopt;
+using std::optional;
+using std::string;
+using std::string_view;
+using std::unique_lock;
+using std::unique_ptr;
+using std::vector;
+
+namespace {
+
+constexpr char kMmapMatchTable[] = "MmapMatchTable";
+constexpr size_t kInitialCapacity = 1024;
+constexpr size_t kInitialRecordsBytes = 64 * 1024;
+constexpr size_t kBitsPerWord = 64;
+// Element numbers are stored in 32 bits of the slot, and the index is kept
+// at most half full.
+constexpr size_t kMaxElements = size_t{1} << 31;
+// Each record starts with the sizes of its key and value.
+constexpr size_t kRecordHeaderBytes = 2 * sizeof(uint32_t);
+
+static_assert(atomic<uint64_t>::is_always_lock_free &&
+                  sizeof(atomic<uint64_t>) == sizeof(uint64_t),
+              "The matched bitmap is accessed in place as atomic words.");
+
+uint32_t HashKey(string_view key) {
+  return static_cast<uint32_t>(absl::Hash<string_view>{}(key) >> 32);
+}
+
+uint64_t MakeSlot(uint32_t hash, uint32_t element) {
+  return (static_cast<uint64_t>(hash) << 32) | (element + 1);
+}
+
+uint32_t GetSlotHash(uint64_t slot) {
+  return static_cast<uint32_t>(slot >> 32);
+}
+
+uint32_t GetSlotElement(uint64_t slot) {
+  return static_cast<uint32_t>(slot) - 1;
+}
+
+// Writes slot into the first empty slot of its probe sequence.
+void InsertSlot(uint64_t* slots, size_t capacity, uint64_t slot) {
+  auto mask = capacity - 1;
+  for (auto pos = GetSlotHash(slot) & mask;; pos = (pos + 1) & mask) {
+    if (slots[pos] == 0) {
+      slots[pos] = slot;
+      return;
+    }
+  }
+}
+
+// Grows the file to at least min_size bytes, at least doubling it so that
+// appending stays amortized constant time.
+ExecutionResult GrowToAtLeast(google::pair::matcher::MappedFile& file,
+                              size_t min_size) {
+  if (min_size <= file.GetSize()) {
+    return SuccessExecutionResult();
+  }
+  return file.Grow(std::max(file.GetSize() * 2, min_size));
+}
+
+}  // namespace
+
+namespace google::pair::matcher {
+
+ExecutionResultOr<unique_ptr<MmapMatchTable>> MmapMatchTable::Create(
+    const string& directory) {
+  ASSIGN_OR_RETURN(auto records,
+                   MappedFile::Create(directory, kInitialRecordsBytes));
+  ASSIGN_OR_RETURN(
+      auto offsets,
+      MappedFile::Create(directory, kInitialCapacity / 2 * sizeof(uint64_t)));
+  ASSIGN_OR_RETURN(
+      auto index,
+      MappedFile::Create(directory, kInitialCapacity * sizeof(uint64_t)));
+  ASSIGN_OR_RETURN(auto matched_bits,
+                   MappedFile::Create(directory, kInitialCapacity / 2 / 8));
+  // Lookups jump around all of the files, so reading ahead only evicts pages
+  // which are still needed.
+  records->AdviseRandomAccess();
+  offsets->AdviseRandomAccess();
+  index->AdviseRandomAccess();
+  matched_bits->AdviseRandomAccess();
+  return unique_ptr<MmapMatchTable>(
+      new MmapMatchTable(directory, move(records), move(offsets), move(index),
+                         move(matched_bits)));
+}
+
+MmapMatchTable::MmapMatchTable(string directory,
+                               unique_ptr<MappedFile> records,
+                               unique_ptr<MappedFile> offsets,
+                               unique_ptr<MappedFile> index,
+                               unique_ptr<MappedFile> matched_bits)
+    : directory_(move(directory)),
+      records_(move(records)),
+      offsets_(move(offsets)),
+      index_(move(index)),
+      matched_bits_(move(matched_bits)) {}
+
+std::pair<string_view, string_view> MmapMatchTable::GetRecord(
+    uint32_t element) const {
+  const char* record = records_->GetData() + GetOffsets()[element];
+  uint32_t sizes[2];
+  std::memcpy(sizes, record, kRecordHeaderBytes);
+  const char* key = record + kRecordHeaderBytes;
+  return make_pair(string_view(key, sizes[0]),
+                   string_view(key + sizes[0], sizes[1]));
+}
+
+optional<uint32_t> MmapMatchTable::Find(string_view key, uint32_t hash) const {
+  const auto* slots = GetSlots();
+  auto mask = GetCapacity() - 1;
+  // Elements are never removed, so an empty slot ends the probe sequence.
+  for (auto pos = hash & mask; slots[pos] != 0; pos = (pos + 1) & mask) {
+    if (GetSlotHash(slots[pos]) == hash &&
+        GetRecord(GetSlotElement(slots[pos])).first == key) {
+      return GetSlotElement(slots[pos]);
+    }
+  }
+  return nullopt;
+}
+
+ExecutionResult MmapMatchTable::ReserveLocked(size_t num_elements) {
+  if (num_elements > kMaxElements) {
+    return FailureExecutionResult(errors::MATCH_TABLE_FULL);
+  }
+  RETURN_IF_FAILURE(
+      GrowToAtLeast(*offsets_, num_elements * sizeof(uint64_t)));
+  RETURN_IF_FAILURE(GrowToAtLeast(
+      *matched_bits_,
+      (num_elements + kBitsPerWord - 1) / kBitsPerWord * sizeof(uint64_t)));
+
+  auto capacity = GetCapacity();
+  while (num_elements * 2 > capacity) {
+    capacity *= 2;
+  }
+  if (capacity == GetCapacity()) {
+    return SuccessExecutionResult();
+  }
+  // Build the larger index in a new file from the hashes in the slots,
+  // without reading any records.
+  ASSIGN_OR_RETURN(auto index,
+                   MappedFile::Create(directory_, capacity * sizeof(uint64_t)));
+  index->AdviseRandomAccess();
+  auto* new_slots = reinterpret_cast<uint64_t*>(index->GetData());
+  const auto* slots = GetSlots();
+  for (size_t i = 0; i < GetCapacity(); i++) {
+    if (slots[i] != 0) {
+      InsertSlot(new_slots, capacity, slots[i]);
+    }
+  }
+  index_ = move(index);
+  return SuccessExecutionResult();
+}
+
+ExecutionResultOr<bool> MmapMatchTable::AddElementLocked(const string& key,
+                                                         const string& value,
+                                                         uint32_t hash) {
+  if (Find(key, hash)) {
+    return false;
+  }
+  RETURN_IF_FAILURE(ReserveLocked(size_ + 1));
+  auto record_size = kRecordHeaderBytes + key.size() + value.size();
+  RETURN_IF_FAILURE(GrowToAtLeast(*records_, records_size_ + record_size));
+
+  char* record = records_->GetData() + records_size_;
+  uint32_t sizes[2] = {static_cast<uint32_t>(key.size()),
+                       static_cast<uint32_t>(value.size())};
+  std::memcpy(record, sizes, kRecordHeaderBytes);
+  std::memcpy(record + kRecordHeaderBytes, key.data(), key.size());
+  std::memcpy(record + kRecordHeaderBytes + key.size(), value.data(),
+              value.size());
+  GetOffsets()[size_] = records_size_;
+  records_size_ += record_size;
+  InsertSlot(GetSlots(), GetCapacity(),
+             MakeSlot(hash, static_cast<uint32_t>(size_)));
+  size_++;
+  return true;
+}
+
+ExecutionResult MmapMatchTable::AddElement(const string& key,
+                                           const string& value) {
+  auto hash = HashKey(key);
+  lock_guard lock(data_mutex_);
+
+  if (frozen_) {
+    return FailureExecutionResult(errors::MATCH_TABLE_FROZEN);
+  }
+  ASSIGN_OR_RETURN(auto added, AddElementLocked(key, value, hash));
+  if (!added) {
+    return FailureExecutionResult(errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS);
+  }
+  return SuccessExecutionResult();
+}
+
+ExecutionResult MmapMatchTable::BulkLoad(
+    vector<std::pair<string, string>> elements,
+    vector<string>* duplicate_keys) {
+  vector<uint32_t> hashes;
+  hashes.reserve(elements.size());
+  for (const auto& element : elements) {
+    hashes.push_back(HashKey(element.first));
+  }
+  lock_guard lock(data_mutex_);
+
+  if (frozen_) {
+    return FailureExecutionResult(errors::MATCH_TABLE_FROZEN);
+  }
+  RETURN_IF_FAILURE(ReserveLocked(size_ + elements.size()));
+  for (size_t i = 0; i < elements.size(); i++) {
+    auto& [key, value] = elements[i];
+    ASSIGN_OR_RETURN(auto added, AddElementLocked(key, value, hashes[i]));
+    if (!added) {
+      duplicate_keys->push_back(move(key));
+    }
+  }
+  return SuccessExecutionResult();
+}
+
+void MmapMatchTable::Reserve(size_t num_elements) {
+  lock_guard lock(data_mutex_);
+  if (frozen_) {
+    return;
+  }
+  // Growing the files is retried, and fails again, as the elements are added.
+  if (auto result = ReserveLocked(num_elements); !result.Successful()) {
+    SCP_ERROR(kMmapMatchTable, kZeroUuid, result,
+              "Failed reserving room for %zu elements", num_elements);
+  }
+}
+
+unique_lock<std::mutex> MmapMatchTable::LockUnlessFrozen() const {
+  unique_lock lock(data_mutex_, std::defer_lock);
+  if (!frozen_.load(std::memory_order_acquire)) {
+    lock.lock();
+  }
+  return lock;
+}
+
+optional<string> MmapMatchTable::MarkMatchedLocked(const string& key,
+                                                   uint32_t hash,
+                                                   bool& newly_matched,
+                                                   uint32_t& element) {
+  auto found = Find(key, hash);
+  if (!found) {
+    return nullopt;
+  }
+  element = *found;
+  auto mask = uint64_t{1} << (element % kBitsPerWord);
+  newly_matched = (GetMatchedWords()[element / kBitsPerWord].fetch_or(
+                       mask, std::memory_order_relaxed) &
+                   mask) == 0;
+  return string(GetRecord(element).second);
+}
+
+ExecutionResultOr<string> MmapMatchTable::MarkMatched(const string& key) {
+  return MarkMatched(key, nullptr);
+}
+
+ExecutionResultOr<string> MmapMatchTable::MarkMatched(const string& key,
+                                                      bool* newly_matched) {
+  auto hash = HashKey(key);
+  auto lock = LockUnlessFrozen();
+
+  bool newly_matched_key = false;
+  uint32_t element;
+  if (auto value = MarkMatchedLocked(key, hash, newly_matched_key, element);
+      value) {
+    if (newly_matched) {
+      *newly_matched = newly_matched_key;
+    }
+    return *move(value);
+  }
+  return FailureExecutionResult(errors::MATCH_TABLE_ELEMENT_DOES_NOT_EXIST);
+}
+
+void MmapMatchTable::MarkMatchedBatch(absl::Span<const string> keys,
+                                      vector<optional<string>>* values,
+                                      vector<bool>* newly_matched) {
+  MarkMatchedBatchImpl(keys, values, newly_matched, nullptr);
+}
+
+ExecutionResult MmapMatchTable::MarkMatchedBatchWithIndices(
+    absl::Span<const string> keys, vector<optional<string>>* values,
+    vector<size_t>* element_indices) {
+  MarkMatchedBatchImpl(keys, values, nullptr, element_indices);
+  return SuccessExecutionResult();
+}
+
+void MmapMatchTable::MarkMatchedBatchImpl(absl::Span<const string> keys,
+                                          vector<optional<string>>* values,
+                                          vector<bool>* newly_matched,
+                                          vector<size_t>* element_indices) {
+  vector<uint32_t> hashes;
+  hashes.reserve(keys.size());
+  for (const auto& key : keys) {
+    hashes.push_back(HashKey(key));
+  }
+  values->clear();
+  values->reserve(keys.size());
+  if (newly_matched) {
+    newly_matched->assign(keys.size(), false);
+  }
+  if (element_indices) {
+    element_indices->assign(keys.size(), 0);
+  }
+
+  auto lock = LockUnlessFrozen();
+  for (size_t i = 0; i < keys.size(); i++) {
+    bool newly_matched_key = false;
+    uint32_t element = 0;
+    values->push_back(
+        MarkMatchedLocked(keys[i], hashes[i], newly_matched_key, element));
+    if (newly_matched) {
+      (*newly_matched)[i] = newly_matched_key;
+    }
+    if (element_indices) {
+      (*element_indices)[i] = element;
+    }
+  }
+}
+
+size_t MmapMatchTable::GetNumElementIndices() const {
+  auto lock = LockUnlessFrozen();
+  return size_;
+}
+
+void MmapMatchTable::Freeze() {
+  lock_guard lock(data_mutex_);
+  frozen_.store(true, std::memory_order_release);
+}
+
+void MmapMatchTable::VisitMatched(VisitorCallback visitor) {
+  lock_guard lock(data_mutex_);
+
+  const auto* words = GetMatchedWords();
+  for (size_t w = 0; w * kBitsPerWord < size_; w++) {
+    for (auto word = words[w].load(std::memory_order_relaxed); word != 0;
+         word &= word - 1) {
+      auto [key, value] =
+          GetRecord(w * kBitsPerWord + absl::countr_zero(word));
+      visitor(string(key), string(value));
+    }
+  }
+}
+
+size_t MmapMatchTable::GetNumVisitRanges() const {
+  auto lock = LockUnlessFrozen();
+  return (size_ + kElementsPerVisitRange - 1) / kElementsPerVisitRange;
+}
+
+void MmapMatchTable::VisitMatchedRange(size_t range,
+                                       MatchedBatchCallback visitor) {
+  auto lock = LockUnlessFrozen();
+
+  constexpr size_t kWordsPerRange = kElementsPerVisitRange / kBitsPerWord;
+  auto end_word =
+      std::min((size_ + kBitsPerWord - 1) / kBitsPerWord,
+               (range + 1) * kWordsPerRange);
+  // The records are not strings, so the batch holds copies of them. Reserving
+  // up front keeps the copies in place while the batch is filled.
+  vector<std::pair<string, string>> elements;
+  elements.reserve(kMatchedBatchSize);
+  vector<MatchedElement<string, string>> batch;
+  auto flush = [&elements, &batch, &visitor]() {
+    if (!batch.empty()) {
+      visitor(batch);
+    }
+    elements.clear();
+    batch.clear();
+  };
+  const auto* words = GetMatchedWords();
+  for (size_t w = range * kWordsPerRange; w < end_word; w++) {
+    for (auto word = words[w].load(std::memory_order_relaxed); word != 0;
+         word &= word - 1) {
+      auto [key, value] =
+          GetRecord(w * kBitsPerWord + absl::countr_zero(word));
+      const auto& element = elements.emplace_back(key, value);
+      batch.push_back({&element.first, &element.second});
+      if (batch.size() == kMatchedBatchSize) {
+        flush();
+      }
+    }
+  }
+  flush();
+}
+
+size_t MmapMatchTable::Size() const {
+  lock_guard lock(data_mutex_);
+  return size_;
+}
+
+size_t MmapMatchTable::GetMemoryUsageBytes() const {
+  lock_guard lock(data_mutex_);
+  return records_->GetSize() + offsets_->GetSize() + index_->GetSize() +
+         matched_bits_->GetSize();
+}
+
+}  // namespace google::pair::matcher
@@ -0,0 +1,201 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/types/span.h"
+
+#include "mapped_file.h"
+#include "match_table.h"
+
+namespace google::pair::matcher {
+
+/**
+ * @brief MatchTable which keeps all of its data in memory-mapped files on
+ * local disk, for publisher mappings which do not fit in RAM. Only the pages
+ * being touched need to be resident, the kernel writes the rest back to disk.
+ *
+ * Elements are appended to a records file as length-prefixed key and value
+ * bytes, and a second file holds the offset of each element's record. The
+ * index is an open-addressing table of 8 byte slots, each holding 32 bits of
+ * the key's hash and the element's number, probed linearly so that a lookup
+ * usually stays within one page. The matched flags are a bitmap in a fourth
+ * file, indexed by element number.
+ *
+ * Since the slots keep the hash, growing the index never reads the records.
+ * The table holds at most 2^31 elements.
+ *
+ */
+class MmapMatchTable : public MatchTable<std::string, std::string> {
+ public:
+  /**
+   * @brief Create an empty table backed by files in directory. The files are
+   * deleted when the table is destroyed.
+   *
+   * @param directory a directory on local disk with room for the table
+   * @return scp::core::ExecutionResultOr<std::unique_ptr<MmapMatchTable>>
+   */
+  static scp::core::ExecutionResultOr<std::unique_ptr<MmapMatchTable>> Create(
+      const std::string& directory);
+
+  scp::core::ExecutionResult AddElement(const std::string& key,
+                                        const std::string& value) override;
+
+  /**
+   * @brief Hashes the batch before taking the lock once for all of it.
+   *
+   */
+  scp::core::ExecutionResult BulkLoad(
+      std::vector<std::pair<std::string, std::string>> elements,
+      std::vector<std::string>* duplicate_keys) override;
+
+  /**
+   * @brief Grows the index, offsets and bitmap files up front. The size of the
+   * records is not known, so the records file still grows as it fills.
+   *
+   */
+  void Reserve(size_t num_elements) override;
+
+  using MatchTable<std::string, std::string>::MarkMatched;
+  using MatchTable<std::string, std::string>::MarkMatchedBatch;
+
+  scp::core::ExecutionResultOr<std::string> MarkMatched(
+      const std::string& key) override;
+
+  scp::core::ExecutionResultOr<std::string> MarkMatched(
+      const std::string& key, bool* newly_matched) override;
+
+  /**
+   * @brief Hashes the batch before taking the lock once for all of it.
+   *
+   */
+  void MarkMatchedBatch(absl::Span<const std::string> keys,
+                        std::vector<std::optional<std::string>>* values,
+                        std::vector<bool>* newly_matched) override;
+
+  /**
+   * @brief Element indices are element numbers, in the order the elements were
+   * added.
+   *
+   */
+  scp::core::ExecutionResult MarkMatchedBatchWithIndices(
+      absl::Span<const std::string> keys,
+      std::vector<std::optional<std::string>>* values,
+      std::vector<size_t>* element_indices) override;
+
+  size_t GetNumElementIndices() const override;
+
+  void Freeze() override;
+
+  void VisitMatched(VisitorCallback visitor) override;
+
+  /**
+   * @brief Ranges are runs of kElementsPerVisitRange elements, in the order
+   * they were added.
+   *
+   */
+  size_t GetNumVisitRanges() const override;
+
+  void VisitMatchedRange(size_t range, MatchedBatchCallback visitor) override;
+
+  size_t Size() const override;
+
+  /**
+   * @brief Counts the size of the mapped files, which bounds how much of the
+   * table can be resident. Under memory pressure the kernel keeps only the
+   * recently touched pages in RAM.
+   *
+   */
+  size_t GetMemoryUsageBytes() const override;
+
+ private:
+  static constexpr size_t kElementsPerVisitRange = 64 * 1024;
+
+  MmapMatchTable(std::string directory, std::unique_ptr<MappedFile> records,
+                 std::unique_ptr<MappedFile> offsets,
+                 std::unique_ptr<MappedFile> index,
+                 std::unique_ptr<MappedFile> matched_bits);
+
+  uint64_t* GetOffsets() const {
+    return reinterpret_cast<uint64_t*>(offsets_->GetData());
+  }
+
+  uint64_t* GetSlots() const {
+    return reinterpret_cast<uint64_t*>(index_->GetData());
+  }
+
+  std::atomic<uint64_t>* GetMatchedWords() const {
+    return reinterpret_cast<std::atomic<uint64_t>*>(matched_bits_->GetData());
+  }
+
+  size_t GetCapacity() const { return index_->GetSize() / sizeof(uint64_t); }
+
+  // Returns the key and value stored for the element.
+  std::pair<std::string_view, std::string_view> GetRecord(
+      uint32_t element) const;
+
+  // Returns the number of the element holding key, or nullopt.
+  std::optional<uint32_t> Find(std::string_view key, uint32_t hash) const;
+
+  // Marks the element holding key as matched and returns its value,
+  // data_mutex_ must be held unless the table is frozen. newly_matched is set
+  // to whether it was not matched before, and element to its number.
+  std::optional<std::string> MarkMatchedLocked(const std::string& key,
+                                               uint32_t hash,
+                                               bool& newly_matched,
+                                               uint32_t& element);
+
+  // Marks the batch as matched, telling whichever of newly_matched and
+  // element_indices is not null.
+  void MarkMatchedBatchImpl(absl::Span<const std::string> keys,
+                            std::vector<std::optional<std::string>>* values,
+                            std::vector<bool>* newly_matched,
+                            std::vector<size_t>* element_indices);
+
+  // Adds the element if the key does not exist yet, data_mutex_ must be held.
+  // Returns whether it was added, or a failure if a file could not grow.
+  scp::core::ExecutionResultOr<bool> AddElementLocked(const std::string& key,
+                                                      const std::string& value,
+                                                      uint32_t hash);
+
+  // Grows the files to hold num_elements elements, data_mutex_ must be held.
+  scp::core::ExecutionResult ReserveLocked(size_t num_elements);
+
+  // Only locks while the table can still change.
+  std::unique_lock<std::mutex> LockUnlessFrozen() const;
+
+  // Where the files are created, kept to create a larger index.
+  const std::string directory_;
+  std::unique_ptr<MappedFile> records_;
+  std::unique_ptr<MappedFile> offsets_;
+  std::unique_ptr<MappedFile> index_;
+  std::unique_ptr<MappedFile> matched_bits_;
+  size_t records_size_ = 0;
+  size_t size_ = 0;
+  mutable std::mutex data_mutex_;
+  std::atomic_bool frozen_ = false;
+};
+
+}  // namespace google::pair::matcher
@@ -0,0 +1,436 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "absl/hash/hash.h"
+#include "absl/numeric/bits.h"
+#include "absl/types/span.h"
+
+#include "error_codes.h"
+#include "match_table.h"
+#include "matched_bitset.h"
+#include "memory_usage.h"
+
+namespace google::pair::matcher {
+
+/**
+ * @brief Number of keys ahead of the current one whose slots
+ * OpenAddressingMatchTable::MarkMatchedBatch prefetches.
+ *
+ */
+inline constexpr size_t kMatchTablePrefetchDistance = 16;
+
+/**
+ * @brief MatchTable backed by an open-addressing hash table in the style of
+ * absl's SwissTable. Slots are split into groups of 16, each slot having a
+ * control byte which is either empty or holds 7 bits of the key's hash, so that
+ * a whole group is probed with one SSE2 compare before touching any keys.
+ *
+ * Elements are stored inline in the slots and the matched flags in a side
+ * bitset indexed by slot. MarkMatchedBatch hashes the batch before taking the
+ * lock, and prefetches the groups of upcoming keys while probing the current
+ * one so that cache misses overlap. Once frozen, lookups take no lock at all.
+ *
+ * @tparam K the key type for the elements
+ * @tparam V the value type for the elements
+ */
+template <typename K, typename V>
+class OpenAddressingMatchTable : public MatchTable<K, V> {
+ public:
+  using MatchTable<K, V>::MarkMatched;
+  using MatchTable<K, V>::MarkMatchedBatch;
+
+  OpenAddressingMatchTable() { Resize(kGroupSize); }
+
+  scp::core::ExecutionResult AddElement(const K& key, const V& value) override {
+    auto hash = absl::Hash<K>{}(key);
+    std::lock_guard lock(data_mutex_);
+
+    if (frozen_) {
+      return scp::core::FailureExecutionResult(errors::MATCH_TABLE_FROZEN);
+    }
+    if (Find(key, hash) != kNotFound) {
+      return scp::core::FailureExecutionResult(
+          errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS);
+    }
+    // Keep the load factor at most 7/8 so every probe sequence ends in a group
+    // with an empty slot.
+    if ((size_ + 1) * 8 > capacity_ * 7) {
+      Resize(capacity_ * 2);
+    }
+    AddSlotLocked(hash, Slot{key, value});
+    return scp::core::SuccessExecutionResult();
+  }
+
+  /**
+   * @brief Hashes the batch before taking the lock, then takes it once and
+   * grows the table at most once.
+   *
+   */
+  scp::core::ExecutionResult BulkLoad(
+      std::vector<std::pair<K, V>> elements,
+      std::vector<K>* duplicate_keys) override {
+    std::vector<size_t> hashes;
+    hashes.reserve(elements.size());
+    for (const auto& element : elements) {
+      hashes.push_back(absl::Hash<K>{}(element.first));
+    }
+    std::lock_guard lock(data_mutex_);
+
+    if (frozen_) {
+      return scp::core::FailureExecutionResult(errors::MATCH_TABLE_FROZEN);
+    }
+    ReserveLocked(size_ + elements.size());
+    for (size_t i = 0; i < elements.size(); i++) {
+      auto& [key, value] = elements[i];
+      if (Find(key, hashes[i]) != kNotFound) {
+        duplicate_keys->push_back(std::move(key));
+        continue;
+      }
+      AddSlotLocked(hashes[i], Slot{std::move(key), std::move(value)});
+    }
+    return scp::core::SuccessExecutionResult();
+  }
+
+  void Reserve(size_t num_elements) override {
+    std::lock_guard lock(data_mutex_);
+    if (!frozen_) {
+      ReserveLocked(num_elements);
+    }
+  }
+
+  scp::core::ExecutionResultOr<V> MarkMatched(const K& key) override {
+    return MarkMatched(key, nullptr);
+  }
+
+  scp::core::ExecutionResultOr<V> MarkMatched(const K& key,
+                                              bool* newly_matched) override {
+    auto hash = absl::Hash<K>{}(key);
+    auto lock = LockUnlessFrozen();
+
+    auto index = Find(key, hash);
+    if (index == kNotFound) {
+      return scp::core::FailureExecutionResult(
+          errors::MATCH_TABLE_ELEMENT_DOES_NOT_EXIST);
+    }
+    bool newly_matched_key = matched_bits_.Set(index);
+    if (newly_matched) {
+      *newly_matched = newly_matched_key;
+    }
+    return slots_[index].value;
+  }
+
+  void MarkMatchedBatch(absl::Span<const K> keys,
+                        std::vector<std::optional<V>>* values,
+                        std::vector<bool>* newly_matched) override {
+    MarkMatchedBatchImpl(keys, values, newly_matched, nullptr);
+  }
+
+  /**
+   * @brief Element indices are slot indices, which only change when the table
+   * grows.
+   *
+   */
+  scp::core::ExecutionResult MarkMatchedBatchWithIndices(
+      absl::Span<const K> keys, std::vector<std::optional<V>>* values,
+      std::vector<size_t>* element_indices) override {
+    MarkMatchedBatchImpl(keys, values, nullptr, element_indices);
+    return scp::core::SuccessExecutionResult();
+  }
+
+  size_t GetNumElementIndices() const override {
+    auto lock = LockUnlessFrozen();
+    return capacity_;
+  }
+
+  void Freeze() override {
+    std::lock_guard lock(data_mutex_);
+    frozen_.store(true, std::memory_order_release);
+  }
+
+  void VisitMatched(
+      typename MatchTable<K, V>::VisitorCallback visitor) override {
+    std::lock_guard lock(data_mutex_);
+
+    for (size_t w = 0; w < matched_bits_.GetNumWords(); w++) {
+      for (auto word = matched_bits_.GetWord(w); word != 0; word &= word - 1) {
+        auto index = w * MatchedBitset::kBitsPerWord + absl::countr_zero(word);
+        visitor(slots_[index].key, slots_[index].value);
+      }
+    }
+  }
+
+  /**
+   * @brief Ranges are contiguous runs of kSlotsPerVisitRange slots.
+   *
+   */
+  size_t GetNumVisitRanges() const override {
+    auto lock = LockUnlessFrozen();
+    return (capacity_ + kSlotsPerVisitRange - 1) / kSlotsPerVisitRange;
+  }
+
+  /**
+   * @brief Scans the matched bitset of the range a word at a time, so runs of
+   * 64 unmatched slots are skipped without touching the slots.
+   *
+   */
+  void VisitMatchedRange(
+      size_t range,
+      typename MatchTable<K, V>::MatchedBatchCallback visitor) override {
+    auto lock = LockUnlessFrozen();
+
+    constexpr size_t kWordsPerRange =
+        kSlotsPerVisitRange / MatchedBitset::kBitsPerWord;
+    auto end_word =
+        std::min(matched_bits_.GetNumWords(), (range + 1) * kWordsPerRange);
+    std::vector<MatchedElement<K, V>> batch;
+    for (size_t w = range * kWordsPerRange; w < end_word; w++) {
+      for (auto word = matched_bits_.GetWord(w); word != 0; word &= word - 1) {
+        auto index = w * MatchedBitset::kBitsPerWord + absl::countr_zero(word);
+        batch.push_back({&slots_[index].key, &slots_[index].value});
+        if (batch.size() == kMatchedBatchSize) {
+          visitor(batch);
+          batch.clear();
+        }
+      }
+    }
+    if (!batch.empty()) {
+      visitor(batch);
+    }
+  }
+
+  size_t Size() const override {
+    std::lock_guard lock(data_mutex_);
+    return size_;
+  }
+
+  size_t GetMemoryUsageBytes() const override {
+    std::lock_guard lock(data_mutex_);
+
+    // The heap bytes of the elements are counted as they are added, so this
+    // does not walk the table.
+    return capacity_ * (sizeof(Slot) + sizeof(int8_t)) +
+           matched_bits_.GetMemoryUsageBytes() + owned_heap_bytes_;
+  }
+
+ private:
+  static constexpr size_t kGroupSize = 16;
+  static constexpr int8_t kEmpty = -128;
+  static constexpr size_t kNotFound = static_cast<size_t>(-1);
+  static constexpr size_t kSlotsPerVisitRange = 64 * 1024;
+
+  struct Slot {
+    K key;
+    V value;
+  };
+
+  // The low 7 bits of the hash are stored in the control byte, the rest select
+  // the first group to probe.
+  static int8_t H2(size_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+
+  size_t FirstGroup(size_t hash) const {
+    return (hash >> 7) & (capacity_ / kGroupSize - 1);
+  }
+
+  // Returns a bitmask of the slots in the group whose control byte equals c.
+  static uint32_t MatchGroup(const int8_t* group, int8_t c) {
+#if defined(__SSE2__)
+    auto ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(c))));
+#else
+    uint32_t mask = 0;
+    for (size_t i = 0; i < kGroupSize; i++) {
+      mask |= static_cast<uint32_t>(group[i] == c) << i;
+    }
+    return mask;
+#endif
+  }
+
+  void Prefetch(size_t hash) const {
+#if defined(__GNUC__)
+    auto offset = FirstGroup(hash) * kGroupSize;
+    __builtin_prefetch(&ctrl_[offset]);
+    __builtin_prefetch(&slots_[offset]);
+#endif
+  }
+
+  // Returns the index of the slot holding key or kNotFound. Groups are probed
+  // triangularly, which visits every group since their count is a power of 2.
+  size_t Find(const K& key, size_t hash) const {
+    auto group_mask = capacity_ / kGroupSize - 1;
+    auto group = FirstGroup(hash);
+    for (size_t step = 1;; step++) {
+      const int8_t* ctrl = &ctrl_[group * kGroupSize];
+      for (auto mask = MatchGroup(ctrl, H2(hash)); mask != 0;
+           mask &= mask - 1) {
+        auto index = group * kGroupSize + absl::countr_zero(mask);
+        if (slots_[index].key == key) {
+          return index;
+        }
+      }
+      // Elements are never removed, so an empty slot ends the probe sequence.
+      if (MatchGroup(ctrl, kEmpty) != 0) {
+        return kNotFound;
+      }
+      group = (group + step) & group_mask;
+    }
+  }
+
+  // Marks the batch as matched, telling whichever of newly_matched and
+  // element_indices is not null.
+  void MarkMatchedBatchImpl(absl::Span<const K> keys,
+                            std::vector<std::optional<V>>* values,
+                            std::vector<bool>* newly_matched,
+                            std::vector<size_t>* element_indices) {
+    std::vector<size_t> hashes;
+    hashes.reserve(keys.size());
+    for (const auto& key : keys) {
+      hashes.push_back(absl::Hash<K>{}(key));
+    }
+    values->clear();
+    values->reserve(keys.size());
+    if (newly_matched) {
+      newly_matched->assign(keys.size(), false);
+    }
+    if (element_indices) {
+      element_indices->assign(keys.size(), kNotFound);
+    }
+
+    auto lock = LockUnlessFrozen();
+    for (size_t i = 0; i < std::min(keys.size(), kMatchTablePrefetchDistance);
+         i++) {
+      Prefetch(hashes[i]);
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (i + kMatchTablePrefetchDistance < keys.size()) {
+        Prefetch(hashes[i + kMatchTablePrefetchDistance]);
+      }
+      auto index = Find(keys[i], hashes[i]);
+      if (index == kNotFound) {
+        values->emplace_back();
+      } else {
+        bool newly_matched_key = matched_bits_.Set(index);
+        if (newly_matched) {
+          (*newly_matched)[i] = newly_matched_key;
+        }
+        if (element_indices) {
+          (*element_indices)[i] = index;
+        }
+        values->emplace_back(slots_[index].value);
+      }
+    }
+  }
+
+  // Only locks while the table can still change.
+  std::unique_lock<std::mutex> LockUnlessFrozen() const {
+    std::unique_lock lock(data_mutex_, std::defer_lock);
+    if (!frozen_.load(std::memory_order_acquire)) {
+      lock.lock();
+    }
+    return lock;
+  }
+
+  // Grows the table to keep the load factor at most 7/8 with num_elements
+  // elements, data_mutex_ must be held.
+  void ReserveLocked(size_t num_elements) {
+    auto capacity = capacity_;
+    while (num_elements * 8 > capacity * 7) {
+      capacity *= 2;
+    }
+    if (capacity > capacity_) {
+      Resize(capacity);
+    }
+  }
+
+  // Inserts a new element and counts it, data_mutex_ must be held. The caller
+  // must have checked that the key does not exist and that there is room.
+  void AddSlotLocked(size_t hash, Slot slot) {
+    auto index = Insert(hash, std::move(slot));
+    size_++;
+    owned_heap_bytes_ += GetOwnedHeapBytes(slots_[index].key) +
+                         GetOwnedHeapBytes(slots_[index].value);
+  }
+
+  // Inserts slot into the first empty slot of its probe sequence and returns
+  // its index. The caller must have checked that the key does not exist and
+  // that there is room.
+  size_t Insert(size_t hash, Slot slot) {
+    auto group_mask = capacity_ / kGroupSize - 1;
+    auto group = FirstGroup(hash);
+    for (size_t step = 1;; step++) {
+      auto mask = MatchGroup(&ctrl_[group * kGroupSize], kEmpty);
+      if (mask != 0) {
+        auto index = group * kGroupSize + absl::countr_zero(mask);
+        ctrl_[index] = H2(hash);
+        slots_[index] = std::move(slot);
+        return index;
+      }
+      group = (group + step) & group_mask;
+    }
+  }
+
+  void Resize(size_t new_capacity) {
+    auto old_ctrl = std::move(ctrl_);
+    auto old_slots = std::move(slots_);
+    auto old_matched_bits = std::move(matched_bits_);
+    auto old_capacity = capacity_;
+
+    capacity_ = new_capacity;
+    ctrl_ = std::make_unique<int8_t[]>(capacity_);
+    std::fill_n(ctrl_.get(), capacity_, kEmpty);
+    slots_ = std::make_unique<Slot[]>(capacity_);
+    matched_bits_ = MatchedBitset(capacity_);
+    for (size_t i = 0; i < old_capacity; i++) {
+      if (old_ctrl[i] != kEmpty) {
+        auto hash = absl::Hash<K>{}(old_slots[i].key);
+        auto index = Insert(hash, std::move(old_slots[i]));
+        if (old_matched_bits.Test(i)) {
+          matched_bits_.Set(index);
+        }
+      }
+    }
+  }
+
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+  // The heap memory owned by the keys and values of the elements. Moving them
+  // when the table grows keeps their heap memory.
+  size_t owned_heap_bytes_ = 0;
+  /**
+   * @brief One control byte per slot, either kEmpty or H2 of the slot's key.
+   *
+   */
+  std::unique_ptr<int8_t[]> ctrl_;
+  std::unique_ptr<Slot[]> slots_;
+  MatchedBitset matched_bits_;
+  mutable std::mutex data_mutex_;
+  std::atomic_bool frozen_ = false;
+};
+
+}  // namespace google::pair::matcher
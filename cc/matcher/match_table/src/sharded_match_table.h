@@ -0,0 +1,311 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/numeric/int128.h"
+#include "cc/core/interface/async_executor_interface.h"
+
+#include "error_codes.h"
+#include "match_table.h"
+#include "memory_usage.h"
+
+namespace google::pair::matcher {
+
+// Default number of shards, sized so that the 16 threads of the CPU executor
+// rarely contend on the same shard.
+constexpr size_t kDefaultMatchTableNumShards = 256;
+
+/**
+ * @brief MatchTable which splits the key space across a fixed number of
+ * independently locked shards, so that concurrent AddElement and MarkMatched
+ * calls only contend when their keys land in the same shard.
+ *
+ * @tparam K the key type for the elements
+ * @tparam V the value type for the elements
+ */
+template <typename K, typename V>
+class ShardedMatchTable : public MatchTable<K, V> {
+ public:
+  using MatchTable<K, V>::MarkMatched;
+
+  /**
+   * @brief Construct a new Sharded Match Table object
+   *
+   * @param num_shards the number of independently locked shards, at least 1
+   * @param cpu_async_executor the executor BulkLoad splits large batches
+   * across, or null to load every batch on the calling thread
+   * @param num_bulk_load_tasks the maximum number of tasks BulkLoad splits a
+   * batch into, at least 1
+   */
+  explicit ShardedMatchTable(
+      size_t num_shards = kDefaultMatchTableNumShards,
+      std::shared_ptr<scp::core::AsyncExecutorInterface> cpu_async_executor =
+          nullptr,
+      size_t num_bulk_load_tasks = 1)
+      : num_shards_(std::max<size_t>(num_shards, 1)),
+        cpu_async_executor_(std::move(cpu_async_executor)),
+        num_bulk_load_tasks_(cpu_async_executor_
+                                 ? std::max<size_t>(num_bulk_load_tasks, 1)
+                                 : 1),
+        shards_(std::make_unique<Shard[]>(num_shards_)) {}
+
+  scp::core::ExecutionResult AddElement(const K& key, const V& value) override {
+    auto& shard = GetShard(key);
+    std::lock_guard lock(shard.data_mutex);
+
+    if (!shard.data.try_emplace(key, value).second) {
+      return scp::core::FailureExecutionResult(
+          errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS);
+    }
+    return scp::core::SuccessExecutionResult();
+  }
+
+  /**
+   * @brief Builds the batch in two phases. First each task partitions a slice
+   * of the batch by shard, then each task merges the partitions of its own set
+   * of shards into them, so that every shard lock is taken once per batch and
+   * tasks never contend. Batches too small to be worth splitting are built by
+   * a single task on the calling thread. The duplicates found by each task
+   * are merged at the end, in no particular order.
+   *
+   * Must not be called on the executor's own threads, which it waits for.
+   *
+   */
+  scp::core::ExecutionResult BulkLoad(
+      std::vector<std::pair<K, V>> elements,
+      std::vector<K>* duplicate_keys) override {
+    auto num_tasks = std::min(
+        num_bulk_load_tasks_,
+        std::max<size_t>(elements.size() / kMinBulkLoadElementsPerTask, 1));
+    // partitions[t][s] holds the elements of task t's slice in shard s.
+    std::vector<std::vector<std::vector<std::pair<K, V>>>> partitions(
+        num_tasks);
+    std::vector<std::vector<K>> task_duplicate_keys(num_tasks);
+    auto partition_slice = [this, &elements, &partitions,
+                            num_tasks](size_t t) {
+      partitions[t].resize(num_shards_);
+      auto begin = elements.size() * t / num_tasks;
+      auto end = elements.size() * (t + 1) / num_tasks;
+      for (auto i = begin; i < end; i++) {
+        partitions[t][GetShardIndex(elements[i].first)].push_back(
+            std::move(elements[i]));
+      }
+    };
+    auto merge_shards = [this, &partitions, &task_duplicate_keys,
+                         num_tasks](size_t t) {
+      for (auto s = t; s < num_shards_; s += num_tasks) {
+        std::lock_guard lock(shards_[s].data_mutex);
+        for (auto& slice_partitions : partitions) {
+          for (auto& [key, value] : slice_partitions[s]) {
+            // try_emplace leaves key untouched if it already exists.
+            if (!shards_[s].data.try_emplace(std::move(key), value).second) {
+              task_duplicate_keys[t].push_back(std::move(key));
+            }
+          }
+        }
+      }
+    };
+    RunTasks(num_tasks, partition_slice);
+    RunTasks(num_tasks, merge_shards);
+    for (auto& keys : task_duplicate_keys) {
+      duplicate_keys->insert(duplicate_keys->end(),
+                             std::make_move_iterator(keys.begin()),
+                             std::make_move_iterator(keys.end()));
+    }
+    return scp::core::SuccessExecutionResult();
+  }
+
+  /**
+   * @brief Spreads the reservation evenly over the shards.
+   *
+   */
+  void Reserve(size_t num_elements) override {
+    auto num_elements_per_shard =
+        (num_elements + num_shards_ - 1) / num_shards_;
+    for (size_t i = 0; i < num_shards_; i++) {
+      std::lock_guard lock(shards_[i].data_mutex);
+      shards_[i].data.reserve(num_elements_per_shard);
+    }
+  }
+
+  scp::core::ExecutionResultOr<V> MarkMatched(const K& key) override {
+    return MarkMatched(key, nullptr);
+  }
+
+  scp::core::ExecutionResultOr<V> MarkMatched(const K& key,
+                                              bool* newly_matched) override {
+    auto& shard = GetShard(key);
+    std::lock_guard lock(shard.data_mutex);
+
+    if (auto it = shard.data.find(key); it != shard.data.end()) {
+      bool newly_matched_key = it->second.MarkMatched();
+      if (newly_matched) {
+        *newly_matched = newly_matched_key;
+      }
+      return it->second.GetValue();
+    }
+
+    return scp::core::FailureExecutionResult(
+        errors::MATCH_TABLE_ELEMENT_DOES_NOT_EXIST);
+  }
+
+  void VisitMatched(
+      typename MatchTable<K, V>::VisitorCallback visitor) override {
+    for (size_t i = 0; i < num_shards_; i++) {
+      std::lock_guard lock(shards_[i].data_mutex);
+
+      for (const auto& [key, val] : shards_[i].data) {
+        if (val.IsMatched()) {
+          visitor(key, val.GetValue());
+        }
+      }
+    }
+  }
+
+  /**
+   * @brief Each shard is a range, so ranges only contend on their own shard's
+   * lock.
+   *
+   */
+  size_t GetNumVisitRanges() const override { return num_shards_; }
+
+  void VisitMatchedRange(
+      size_t range,
+      typename MatchTable<K, V>::MatchedBatchCallback visitor) override {
+    std::lock_guard lock(shards_[range].data_mutex);
+
+    std::vector<MatchedElement<K, V>> batch;
+    for (const auto& [key, val] : shards_[range].data) {
+      if (val.IsMatched()) {
+        batch.push_back({&key, &val.GetValue()});
+        if (batch.size() == kMatchedBatchSize) {
+          visitor(batch);
+          batch.clear();
+        }
+      }
+    }
+    if (!batch.empty()) {
+      visitor(batch);
+    }
+  }
+
+  size_t Size() const override {
+    size_t size = 0;
+    for (size_t i = 0; i < num_shards_; i++) {
+      std::lock_guard lock(shards_[i].data_mutex);
+      size += shards_[i].data.size();
+    }
+    return size;
+  }
+
+  size_t GetMemoryUsageBytes() const override {
+    size_t bytes = num_shards_ * sizeof(Shard);
+    for (size_t i = 0; i < num_shards_; i++) {
+      std::lock_guard lock(shards_[i].data_mutex);
+      bytes += GetHashMapSlotBytes(shards_[i].data);
+      for (const auto& [key, val] : shards_[i].data) {
+        bytes += GetOwnedHeapBytes(key) + GetOwnedHeapBytes(val.value);
+      }
+    }
+    return bytes;
+  }
+
+  size_t GetNumShards() const { return num_shards_; }
+
+ private:
+  // Batches smaller than this per task are not worth splitting.
+  static constexpr size_t kMinBulkLoadElementsPerTask = 4096;
+
+  /**
+   * @brief Struct to hold the value information.
+   * It contains the actual value and whether this value has been matched.
+   *
+   */
+  struct ValueInfo {
+    V value;
+    bool is_matched;
+
+    ValueInfo(const V& value, bool is_matched = false)
+        : value(value), is_matched(is_matched) {}
+
+    // Returns whether the value was not matched before.
+    bool MarkMatched() { return !std::exchange(is_matched, true); }
+
+    const V& GetValue() const { return value; }
+
+    bool IsMatched() const { return is_matched; }
+  };
+
+  /**
+   * @brief A single lock-protected partition of the key space. Aligned to a
+   * cache line so that neighbouring shard locks do not false-share.
+   *
+   */
+  struct alignas(64) Shard {
+    absl::flat_hash_map<K, ValueInfo> data;
+    std::mutex data_mutex;
+  };
+
+  size_t GetShardIndex(const K& key) const {
+    // Select the shard from the high bits of the hash (multiply-shift range
+    // reduction). The maps inside a shard use the low bits of the same hash,
+    // so using them here would cluster every key of a shard together.
+    auto hash = static_cast<uint64_t>(absl::Hash<K>{}(key));
+    return absl::Uint128High64(absl::uint128(hash) * num_shards_);
+  }
+
+  Shard& GetShard(const K& key) const { return shards_[GetShardIndex(key)]; }
+
+  // Calls fn(t) for t in [0, num_tasks), scheduling all but the first on the
+  // executor and running the first on the calling thread, as well as any the
+  // executor could not take. Returns once every call is done.
+  template <typename Fn>
+  void RunTasks(size_t num_tasks, const Fn& fn) {
+    std::mutex mu;
+    std::condition_variable all_done;
+    size_t num_pending = num_tasks - 1;
+    for (size_t t = 1; t < num_tasks; t++) {
+      auto task = [&, t]() {
+        fn(t);
+        std::lock_guard lock(mu);
+        if (--num_pending == 0) {
+          all_done.notify_all();
+        }
+      };
+      if (!cpu_async_executor_->Schedule(task, scp::core::AsyncPriority::Normal)
+               .Successful()) {
+        task();
+      }
+    }
+    fn(0);
+    std::unique_lock lock(mu);
+    all_done.wait(lock, [&num_pending]() { return num_pending == 0; });
+  }
+
+  const size_t num_shards_;
+  std::shared_ptr<scp::core::AsyncExecutorInterface> cpu_async_executor_;
+  const size_t num_bulk_load_tasks_;
+  std::unique_ptr<Shard[]> shards_;
+};
+}  // namespace google::pair::matcher
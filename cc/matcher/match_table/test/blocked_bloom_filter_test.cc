@@ -0,0 +1,88 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cc/matcher/match_table/src/blocked_bloom_filter.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "absl/strings/str_cat.h"
+
+using absl::StrCat;
+
+namespace google::pair::matcher::test {
+
+TEST(BlockedBloomFilterTest, ShouldContainAllAddedKeys) {
+  constexpr int kNumElements = 10000;
+  BlockedBloomFilter filter(kNumElements, /* false_positive_rate */ 0.01);
+
+  for (int i = 0; i < kNumElements; i++) {
+    filter.Add(StrCat("key", i));
+  }
+
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_TRUE(filter.MayContain(StrCat("key", i)));
+  }
+}
+
+TEST(BlockedBloomFilterTest, ShouldContainKeysAddedByHash) {
+  constexpr int kNumElements = 10000;
+  BlockedBloomFilter filter(kNumElements, /* false_positive_rate */ 0.01);
+
+  for (int i = 0; i < kNumElements; i++) {
+    filter.AddHash(BlockedBloomFilter::Hash(StrCat("key", i)));
+  }
+
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_TRUE(filter.MayContain(StrCat("key", i)));
+  }
+}
+
+TEST(BlockedBloomFilterTest, ShouldStayCloseToTheFalsePositiveRate) {
+  constexpr int kNumElements = 100000;
+  for (double false_positive_rate : {0.1, 0.01, 0.001}) {
+    BlockedBloomFilter filter(kNumElements, false_positive_rate);
+    for (int i = 0; i < kNumElements; i++) {
+      filter.Add(StrCat("key", i));
+    }
+
+    int num_false_positives = 0;
+    for (int i = 0; i < kNumElements; i++) {
+      num_false_positives += filter.MayContain(StrCat("other", i));
+    }
+    EXPECT_LT(num_false_positives, kNumElements * false_positive_rate * 1.5)
+        << "false_positive_rate=" << false_positive_rate;
+  }
+}
+
+TEST(BlockedBloomFilterTest, LowerRatesShouldUseMoreMemoryAndProbes) {
+  BlockedBloomFilter coarse(1000, /* false_positive_rate */ 0.1);
+  BlockedBloomFilter fine(1000, /* false_positive_rate */ 0.001);
+
+  EXPECT_LT(coarse.GetMemoryUsageBytes(), fine.GetMemoryUsageBytes());
+  EXPECT_LT(coarse.GetNumProbes(), fine.GetNumProbes());
+}
+
+TEST(BlockedBloomFilterTest, ShouldWorkWhenEmpty) {
+  BlockedBloomFilter filter(0, /* false_positive_rate */ 0.01);
+
+  EXPECT_FALSE(filter.MayContain("key"));
+  filter.Add("key");
+  EXPECT_TRUE(filter.MayContain("key"));
+}
+
+}  // namespace google::pair::matcher::test
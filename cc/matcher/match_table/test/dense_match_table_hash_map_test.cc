@@ -0,0 +1,237 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cc/matcher/match_table/src/dense_match_table_hash_map.h"
+
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "cc/matcher/match_table/src/error_codes.h"
+#include "cc/public/core/interface/execution_result.h"
+#include "cc/public/core/test/interface/execution_result_matchers.h"
+
+using absl::flat_hash_map;
+using google::pair::matcher::errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS;
+using google::pair::matcher::errors::MATCH_TABLE_ELEMENT_DOES_NOT_EXIST;
+using google::pair::matcher::errors::MATCH_TABLE_FROZEN;
+using google::pair::matcher::errors::MATCH_TABLE_FULL;
+using google::scp::core::FailureExecutionResult;
+using google::scp::core::test::IsSuccessfulAndHolds;
+using google::scp::core::test::ResultIs;
+using std::nullopt;
+using std::optional;
+using std::string;
+using std::to_string;
+using std::vector;
+using testing::ElementsAre;
+using testing::Pair;
+using testing::UnorderedElementsAre;
+
+namespace google::pair::matcher::test {
+
+TEST(DenseMatchTableHashMapTest, ShouldSuccessfullyAddElement) {
+  DenseMatchTableHashMap<string, string> table;
+
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+}
+
+TEST(DenseMatchTableHashMapTest, ShouldGetValueIfMatchedElementExists) {
+  DenseMatchTableHashMap<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+
+  EXPECT_THAT(table.MarkMatched("key"), IsSuccessfulAndHolds("value"));
+}
+
+TEST(DenseMatchTableHashMapTest, MarkMatchedShouldTellNewlyMatched) {
+  DenseMatchTableHashMap<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+
+  bool newly_matched = false;
+  EXPECT_THAT(table.MarkMatched("key", &newly_matched),
+              IsSuccessfulAndHolds("value"));
+  EXPECT_TRUE(newly_matched);
+  EXPECT_THAT(table.MarkMatched("key", &newly_matched),
+              IsSuccessfulAndHolds("value"));
+  EXPECT_FALSE(newly_matched);
+}
+
+TEST(DenseMatchTableHashMapTest, MarkMatchedBatchShouldTellElementIndices) {
+  DenseMatchTableHashMap<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+
+  vector<string> keys = {"key2", "missing", "key1"};
+  vector<optional<string>> values;
+  vector<size_t> element_indices;
+  EXPECT_SUCCESS(
+      table.MarkMatchedBatchWithIndices(keys, &values, &element_indices));
+
+  EXPECT_THAT(values, ElementsAre("value2", nullopt, "value1"));
+  ASSERT_EQ(element_indices.size(), keys.size());
+  EXPECT_EQ(element_indices[0], 1);
+  EXPECT_EQ(element_indices[2], 0);
+  EXPECT_EQ(table.GetNumElementIndices(), 2);
+}
+
+TEST(DenseMatchTableHashMapTest, AddingShouldFailIfElementAlreadyExists) {
+  DenseMatchTableHashMap<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+
+  EXPECT_THAT(
+      table.AddElement("key", "value"),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_ALREADY_EXISTS)));
+}
+
+TEST(DenseMatchTableHashMapTest, MarkingMatchedShouldFailIfMissing) {
+  DenseMatchTableHashMap<string, string> table;
+
+  EXPECT_THAT(
+      table.MarkMatched("key"),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_DOES_NOT_EXIST)));
+}
+
+TEST(DenseMatchTableHashMapTest, ShouldAddAndMarkMatchedMultipleElements) {
+  DenseMatchTableHashMap<string, string> table;
+
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+
+  EXPECT_THAT(table.MarkMatched("key1"), IsSuccessfulAndHolds("value1"));
+  EXPECT_THAT(table.MarkMatched("key2"), IsSuccessfulAndHolds("value2"));
+}
+
+TEST(DenseMatchTableHashMapTest, VisitorShouldGetCalledWithMatchedElements) {
+  DenseMatchTableHashMap<string, string> table;
+
+  // Add 5 elements
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+  EXPECT_SUCCESS(table.AddElement("key3", "value3"));
+  EXPECT_SUCCESS(table.AddElement("key4", "value4"));
+  EXPECT_SUCCESS(table.AddElement("key5", "value5"));
+
+  // Only mark 3 as matched
+  EXPECT_SUCCESS(table.MarkMatched("key1"));
+  EXPECT_SUCCESS(table.MarkMatched("key4"));
+  EXPECT_SUCCESS(table.MarkMatched("key5"));
+
+  flat_hash_map<string, string> matched_items;
+
+  table.VisitMatched(
+      [&matched_items](const auto& k, const auto& v) { matched_items[k] = v; });
+
+  EXPECT_EQ(3, matched_items.size());
+  EXPECT_THAT(matched_items, UnorderedElementsAre(Pair("key1", "value1"),
+                                                  Pair("key4", "value4"),
+                                                  Pair("key5", "value5")));
+}
+
+TEST(DenseMatchTableHashMapTest, VisitorShouldNotGetCalledIfNoneMatched) {
+  DenseMatchTableHashMap<string, string> table;
+
+  // Add 5 elements
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+  EXPECT_SUCCESS(table.AddElement("key3", "value3"));
+  EXPECT_SUCCESS(table.AddElement("key4", "value4"));
+  EXPECT_SUCCESS(table.AddElement("key5", "value5"));
+
+  table.VisitMatched([](const auto& k, const auto& v) {
+    FAIL() << "Did not expect visitor to be called";
+  });
+}
+
+TEST(DenseMatchTableHashMapTest, AddingShouldFailOnceFrozen) {
+  DenseMatchTableHashMap<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  table.Freeze();
+
+  EXPECT_THAT(table.AddElement("key2", "value2"),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FROZEN)));
+  EXPECT_THAT(table.MarkMatched("key1"), IsSuccessfulAndHolds("value1"));
+  EXPECT_EQ(table.Size(), 1);
+}
+
+TEST(DenseMatchTableHashMapTest, AddingShouldFailOnceFull) {
+  DenseMatchTableHashMap<string, string> table(/* max_elements */ 2);
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+
+  vector<string> duplicate_keys;
+  EXPECT_THAT(table.BulkLoad({{"key2", "value2"}, {"key3", "value3"}},
+                             &duplicate_keys),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FULL)));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+  EXPECT_THAT(table.AddElement("key3", "value3"),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FULL)));
+  EXPECT_EQ(table.Size(), 2);
+  EXPECT_THAT(table.MarkMatched("key2"), IsSuccessfulAndHolds("value2"));
+}
+
+TEST(DenseMatchTableHashMapTest, BulkLoadShouldReportAllDuplicates) {
+  constexpr int kNumElements = 1000;
+  DenseMatchTableHashMap<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("0", "value"));
+
+  // Every key is loaded twice, the second copy is a duplicate.
+  vector<std::pair<string, string>> elements;
+  for (int i = 0; i < kNumElements * 2; i++) {
+    elements.emplace_back(to_string(i % kNumElements), to_string(i));
+  }
+  vector<string> duplicate_keys;
+  EXPECT_SUCCESS(table.BulkLoad(elements, &duplicate_keys));
+
+  // Both copies of the key added up front are duplicates.
+  EXPECT_EQ(duplicate_keys.size(), kNumElements + 1);
+  EXPECT_EQ(table.Size(), kNumElements);
+  EXPECT_THAT(table.MarkMatched("0"), IsSuccessfulAndHolds("value"));
+  // The matched bitset must have grown to cover every loaded element.
+  auto last_key = to_string(kNumElements - 1);
+  EXPECT_THAT(table.MarkMatched(last_key), IsSuccessfulAndHolds(last_key));
+  flat_hash_map<string, string> matched_items;
+  table.VisitMatched(
+      [&matched_items](const auto& k, const auto& v) { matched_items[k] = v; });
+  EXPECT_THAT(matched_items, UnorderedElementsAre(Pair("0", "value"),
+                                                  Pair(last_key, last_key)));
+}
+
+TEST(DenseMatchTableHashMapTest, ShouldAddElementsAfterReserve) {
+  DenseMatchTableHashMap<string, string> table;
+  table.Reserve(1000);
+
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+  EXPECT_THAT(table.MarkMatched("key"), IsSuccessfulAndHolds("value"));
+  EXPECT_EQ(table.Size(), 1);
+}
+
+TEST(DenseMatchTableHashMapTest, ShouldReportSizeAndMemoryUsage) {
+  DenseMatchTableHashMap<string, string> table;
+  EXPECT_EQ(table.Size(), 0);
+  EXPECT_EQ(table.GetBytesPerEntry(), 0);
+
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+
+  EXPECT_EQ(table.Size(), 2);
+  EXPECT_GT(table.GetMemoryUsageBytes(), 0);
+  EXPECT_GT(table.GetBytesPerEntry(), 0);
+}
+
+}  // namespace google::pair::matcher::test
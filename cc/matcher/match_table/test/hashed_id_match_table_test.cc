@@ -0,0 +1,338 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cc/matcher/match_table/src/hashed_id_match_table.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_format.h"
+#include "cc/matcher/match_table/src/error_codes.h"
+#include "cc/matcher/match_table/src/match_table_hash_map.h"
+#include "cc/public/core/interface/execution_result.h"
+#include "cc/public/core/test/interface/execution_result_matchers.h"
+
+using absl::flat_hash_map;
+using google::pair::matcher::errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS;
+using google::pair::matcher::errors::MATCH_TABLE_ELEMENT_DOES_NOT_EXIST;
+using google::pair::matcher::errors::MATCH_TABLE_FROZEN;
+using google::scp::core::FailureExecutionResult;
+using google::scp::core::test::IsSuccessfulAndHolds;
+using google::scp::core::test::ResultIs;
+using std::nullopt;
+using std::optional;
+using std::string;
+using std::thread;
+using std::vector;
+using testing::ElementsAre;
+using testing::Optional;
+using testing::Pair;
+using testing::UnorderedElementsAre;
+
+namespace {
+// Example SHA-256 hashes in lowercase hex.
+constexpr char kHexHash1[] =
+    "973dfe463ec85785f5f95af5ba3906eedb2d931c24e69824a89ea65dba4e813b";
+constexpr char kHexHash2[] =
+    "0d9c7a2a0c2f4ba0bbb1b8b5b1f0cb9b3c5e5f0c9c1f2b9d6f0e3f4a5b6c7d8e";
+constexpr char kUuid1[] = "0ba0e3b4-5b6c-4d8e-9f00-112233445566";
+constexpr char kUuid2[] = "ffeeddcc-bbaa-4998-8877-665544332211";
+
+// SplitMix64, to derive digest-like words from a counter.
+uint64_t Mix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+// A distinct, uniformly distributed 256 bit digest in lowercase hex, like a
+// SHA-256 hash.
+string GetHexHash(int i) {
+  uint64_t seed = static_cast<uint64_t>(i) * 4;
+  return absl::StrFormat("%016x%016x%016x%016x", Mix(seed), Mix(seed + 1),
+                         Mix(seed + 2), Mix(seed + 3));
+}
+
+string GetUuid(int i) {
+  return absl::StrFormat("00000000-0000-0000-0000-%012x", i);
+}
+}  // namespace
+
+namespace google::pair::matcher::test {
+
+TEST(HashedIdMatchTableTest, ShouldDetectHashedIdEncodings) {
+  string bytes = absl::HexStringToBytes(kHexHash1);
+
+  EXPECT_THAT(DetectHashedIdEncoding(kHexHash1),
+              Optional(HashedIdEncoding::kHexLower));
+  EXPECT_THAT(DetectHashedIdEncoding(absl::AsciiStrToUpper(kHexHash1)),
+              Optional(HashedIdEncoding::kHexUpper));
+  EXPECT_THAT(DetectHashedIdEncoding(absl::Base64Escape(bytes)),
+              Optional(HashedIdEncoding::kBase64));
+  EXPECT_THAT(DetectHashedIdEncoding(absl::WebSafeBase64Escape(bytes)),
+              Optional(HashedIdEncoding::kWebSafeBase64));
+  EXPECT_EQ(DetectHashedIdEncoding("test@example.com"), std::nullopt);
+  EXPECT_EQ(DetectHashedIdEncoding(string(kHexHash1).substr(1)), std::nullopt);
+}
+
+TEST(HashedIdMatchTableTest, ShouldDetectUuids) {
+  bool is_uppercase = true;
+  EXPECT_TRUE(IsUuid(kUuid1, is_uppercase));
+  EXPECT_FALSE(is_uppercase);
+  EXPECT_TRUE(IsUuid(absl::AsciiStrToUpper(kUuid1), is_uppercase));
+  EXPECT_TRUE(is_uppercase);
+  EXPECT_FALSE(IsUuid("0ba0e3b4-5b6c-4d8e-9f00-11223344556", is_uppercase));
+  EXPECT_FALSE(IsUuid("0ba0e3b4-5b6c-4d8e-9F00-112233445566", is_uppercase));
+}
+
+TEST(HashedIdMatchTableTest, ShouldAddAndMarkMatchedHexHashes) {
+  HashedIdMatchTable table(HashedIdEncoding::kHexLower,
+                           /* uppercase_values */ false);
+
+  EXPECT_SUCCESS(table.AddElement(kHexHash1, kUuid1));
+  EXPECT_SUCCESS(table.AddElement(kHexHash2, kUuid2));
+
+  EXPECT_THAT(table.MarkMatched(kHexHash1), IsSuccessfulAndHolds(kUuid1));
+  EXPECT_THAT(table.MarkMatched(kHexHash2), IsSuccessfulAndHolds(kUuid2));
+  EXPECT_EQ(table.GetFallbackSize(), 0);
+}
+
+TEST(HashedIdMatchTableTest, ShouldAddAndMarkMatchedBase64Hashes) {
+  HashedIdMatchTable table(HashedIdEncoding::kBase64,
+                           /* uppercase_values */ true);
+  auto key = absl::Base64Escape(absl::HexStringToBytes(kHexHash1));
+  auto value = absl::AsciiStrToUpper(kUuid1);
+
+  EXPECT_SUCCESS(table.AddElement(key, value));
+
+  EXPECT_THAT(table.MarkMatched(key), IsSuccessfulAndHolds(value));
+  EXPECT_EQ(table.GetFallbackSize(), 0);
+}
+
+TEST(HashedIdMatchTableTest, AddingShouldFailIfElementAlreadyExists) {
+  HashedIdMatchTable table(HashedIdEncoding::kHexLower,
+                           /* uppercase_values */ false);
+  EXPECT_SUCCESS(table.AddElement(kHexHash1, kUuid1));
+
+  EXPECT_THAT(
+      table.AddElement(kHexHash1, kUuid2),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_ALREADY_EXISTS)));
+  // The same key with a value that does not fit the binary form.
+  EXPECT_THAT(
+      table.AddElement(kHexHash1, "not_a_uuid"),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_ALREADY_EXISTS)));
+}
+
+TEST(HashedIdMatchTableTest, BulkLoadShouldReportAllDuplicates) {
+  HashedIdMatchTable table(HashedIdEncoding::kHexLower,
+                           /* uppercase_values */ false);
+  EXPECT_SUCCESS(table.AddElement(kHexHash1, kUuid1));
+
+  vector<std::pair<string, string>> elements = {
+      {kHexHash1, kUuid2},
+      {kHexHash2, kUuid2},
+      {"test@example.com", "value"},
+      {kHexHash2, "not_a_uuid"},
+      {"test@example.com", "other"}};
+  vector<string> duplicate_keys;
+  EXPECT_SUCCESS(table.BulkLoad(elements, &duplicate_keys));
+
+  EXPECT_THAT(duplicate_keys,
+              ElementsAre(kHexHash1, kHexHash2, "test@example.com"));
+  EXPECT_EQ(table.Size(), 3);
+  EXPECT_EQ(table.GetFallbackSize(), 1);
+  EXPECT_THAT(table.MarkMatched(kHexHash1), IsSuccessfulAndHolds(kUuid1));
+  EXPECT_THAT(table.MarkMatched(kHexHash2), IsSuccessfulAndHolds(kUuid2));
+  EXPECT_THAT(table.MarkMatched("test@example.com"),
+              IsSuccessfulAndHolds("value"));
+}
+
+TEST(HashedIdMatchTableTest, MarkingMatchedShouldFailIfElementDoesNotExist) {
+  HashedIdMatchTable table(HashedIdEncoding::kHexLower,
+                           /* uppercase_values */ false);
+  EXPECT_SUCCESS(table.AddElement(kHexHash1, kUuid1));
+
+  EXPECT_THAT(
+      table.MarkMatched(kHexHash2),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_DOES_NOT_EXIST)));
+  // Different letter case is a different ID, as with MatchTableHashMap.
+  EXPECT_THAT(
+      table.MarkMatched(absl::AsciiStrToUpper(kHexHash1)),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_DOES_NOT_EXIST)));
+}
+
+TEST(HashedIdMatchTableTest, ShouldKeepNonConformingElementsInFallback) {
+  HashedIdMatchTable table(HashedIdEncoding::kHexLower,
+                           /* uppercase_values */ false);
+  auto upper_key = absl::AsciiStrToUpper(kHexHash1);
+
+  EXPECT_SUCCESS(table.AddElement("test@example.com", kUuid1));
+  EXPECT_SUCCESS(table.AddElement(kHexHash1, "not_a_uuid"));
+  EXPECT_SUCCESS(table.AddElement(upper_key, kUuid2));
+  EXPECT_EQ(table.GetFallbackSize(), 3);
+  EXPECT_EQ(table.Size(), 3);
+
+  EXPECT_THAT(table.MarkMatched("test@example.com"),
+              IsSuccessfulAndHolds(kUuid1));
+  EXPECT_THAT(table.MarkMatched(kHexHash1), IsSuccessfulAndHolds("not_a_uuid"));
+  EXPECT_THAT(table.MarkMatched(upper_key), IsSuccessfulAndHolds(kUuid2));
+}
+
+TEST(HashedIdMatchTableTest, ShouldMarkMatchedBatch) {
+  HashedIdMatchTable table(HashedIdEncoding::kHexLower,
+                           /* uppercase_values */ false);
+  EXPECT_SUCCESS(table.AddElement(kHexHash1, kUuid1));
+  EXPECT_SUCCESS(table.AddElement("test@example.com", "value"));
+
+  vector<string> keys = {kHexHash2, "test@example.com", kHexHash1};
+  vector<optional<string>> values;
+  table.MarkMatchedBatch(keys, &values);
+
+  EXPECT_THAT(values, ElementsAre(nullopt, "value", kUuid1));
+}
+
+TEST(HashedIdMatchTableTest, MarkMatchedBatchShouldTellNewlyMatched) {
+  HashedIdMatchTable table(HashedIdEncoding::kHexLower,
+                           /* uppercase_values */ false);
+  EXPECT_SUCCESS(table.AddElement(kHexHash1, kUuid1));
+  EXPECT_SUCCESS(table.AddElement("test@example.com", "value"));
+
+  vector<string> keys = {kHexHash1, "test@example.com", kHexHash1,
+                         "test@example.com", kHexHash2};
+  vector<optional<string>> values;
+  vector<bool> newly_matched;
+  table.MarkMatchedBatch(keys, &values, &newly_matched);
+
+  EXPECT_THAT(values,
+              ElementsAre(kUuid1, "value", kUuid1, "value", nullopt));
+  EXPECT_THAT(newly_matched, ElementsAre(true, true, false, false, false));
+}
+
+TEST(HashedIdMatchTableTest, MarkMatchedBatchShouldTellElementIndices) {
+  HashedIdMatchTable table(HashedIdEncoding::kHexLower,
+                           /* uppercase_values */ false);
+  EXPECT_SUCCESS(table.AddElement(kHexHash1, kUuid1));
+  EXPECT_SUCCESS(table.AddElement("test@example.com", "value"));
+
+  vector<string> keys = {"test@example.com", kHexHash2, kHexHash1, kHexHash1};
+  vector<optional<string>> values;
+  vector<size_t> element_indices;
+  EXPECT_SUCCESS(
+      table.MarkMatchedBatchWithIndices(keys, &values, &element_indices));
+
+  EXPECT_THAT(values, ElementsAre("value", nullopt, kUuid1, kUuid1));
+  // The binary and fallback elements are numbered together, in the order they
+  // were added.
+  ASSERT_EQ(element_indices.size(), keys.size());
+  EXPECT_EQ(element_indices[0], 1);
+  EXPECT_EQ(element_indices[2], 0);
+  EXPECT_EQ(element_indices[3], 0);
+  EXPECT_EQ(table.GetNumElementIndices(), 2);
+}
+
+TEST(HashedIdMatchTableTest, VisitorShouldGetCalledWithAllMatchedElements) {
+  HashedIdMatchTable table(HashedIdEncoding::kHexLower,
+                           /* uppercase_values */ false);
+  EXPECT_SUCCESS(table.AddElement(kHexHash1, kUuid1));
+  EXPECT_SUCCESS(table.AddElement(kHexHash2, kUuid2));
+  EXPECT_SUCCESS(table.AddElement("test@example.com", "value"));
+
+  EXPECT_SUCCESS(table.MarkMatched(kHexHash1));
+  EXPECT_SUCCESS(table.MarkMatched("test@example.com"));
+
+  flat_hash_map<string, string> matched_items;
+  table.VisitMatched(
+      [&matched_items](const auto& k, const auto& v) { matched_items[k] = v; });
+
+  EXPECT_THAT(matched_items,
+              UnorderedElementsAre(Pair(kHexHash1, kUuid1),
+                                   Pair("test@example.com", "value")));
+}
+
+TEST(HashedIdMatchTableTest, AddingShouldFailOnceFrozen) {
+  HashedIdMatchTable table(HashedIdEncoding::kHexLower,
+                           /* uppercase_values */ false);
+  EXPECT_SUCCESS(table.AddElement(kHexHash1, kUuid1));
+  table.Freeze();
+
+  EXPECT_THAT(table.AddElement(kHexHash2, kUuid2),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FROZEN)));
+  vector<string> duplicate_keys;
+  EXPECT_THAT(table.BulkLoad({{kHexHash2, kUuid2}}, &duplicate_keys),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FROZEN)));
+  EXPECT_THAT(table.MarkMatched(kHexHash1), IsSuccessfulAndHolds(kUuid1));
+  EXPECT_EQ(table.Size(), 1);
+}
+
+TEST(HashedIdMatchTableTest, ShouldMarkMatchedConcurrentlyOnceFrozen) {
+  constexpr int kNumThreads = 8;
+  constexpr int kNumElements = 10000;
+  HashedIdMatchTable table(HashedIdEncoding::kHexLower,
+                           /* uppercase_values */ false);
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(table.AddElement(GetHexHash(i), GetUuid(i)));
+  }
+  // The fallback is marked without the lock as well.
+  EXPECT_SUCCESS(table.AddElement("test@example.com", "value"));
+  table.Freeze();
+
+  // Every thread marks every third ID starting at its own offset, so most IDs
+  // are marked from several threads at once.
+  vector<thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&table, t]() {
+      for (int i = t; i < kNumElements; i += 3) {
+        EXPECT_THAT(table.MarkMatched(GetHexHash(i)),
+                    IsSuccessfulAndHolds(GetUuid(i)));
+      }
+      EXPECT_THAT(table.MarkMatched("test@example.com"),
+                  IsSuccessfulAndHolds("value"));
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  int num_matched = 0;
+  table.VisitMatched(
+      [&num_matched](const auto&, const auto&) { num_matched++; });
+  EXPECT_EQ(num_matched, kNumElements + 1);
+}
+
+TEST(HashedIdMatchTableTest, ShouldUseLessMemoryThanStringKeyedTable) {
+  constexpr int kNumElements = 100000;
+  HashedIdMatchTable table(HashedIdEncoding::kHexLower,
+                           /* uppercase_values */ false);
+  MatchTableHashMap<string, string> string_table;
+
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(table.AddElement(GetHexHash(i), GetUuid(i)));
+    EXPECT_SUCCESS(string_table.AddElement(GetHexHash(i), GetUuid(i)));
+  }
+
+  EXPECT_EQ(table.GetFallbackSize(), 0);
+  EXPECT_LT(table.GetBytesPerEntry() * 3, string_table.GetBytesPerEntry());
+}
+
+}  // namespace google::pair::matcher::test
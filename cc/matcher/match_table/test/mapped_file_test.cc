@@ -0,0 +1,61 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cc/matcher/match_table/src/mapped_file.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "cc/matcher/match_table/src/error_codes.h"
+#include "cc/public/core/interface/execution_result.h"
+#include "cc/public/core/test/interface/execution_result_matchers.h"
+
+using google::pair::matcher::errors::MATCH_TABLE_FILE_ERROR;
+using google::scp::core::FailureExecutionResult;
+using google::scp::core::test::ResultIs;
+using std::string;
+
+namespace google::pair::matcher::test {
+
+TEST(MappedFileTest, ShouldCreateZeroFilledFile) {
+  ASSERT_SUCCESS_AND_ASSIGN(auto file,
+                            MappedFile::Create(testing::TempDir(), 4096));
+
+  EXPECT_EQ(file->GetSize(), 4096);
+  EXPECT_EQ(string(file->GetData(), 4096), string(4096, '\0'));
+}
+
+TEST(MappedFileTest, GrowShouldKeepContents) {
+  ASSERT_SUCCESS_AND_ASSIGN(auto file,
+                            MappedFile::Create(testing::TempDir(), 16));
+  file->AdviseRandomAccess();
+  string contents = "0123456789abcdef";
+  contents.copy(file->GetData(), contents.size());
+
+  EXPECT_SUCCESS(file->Grow(1024 * 1024));
+
+  EXPECT_EQ(file->GetSize(), 1024 * 1024);
+  EXPECT_EQ(string(file->GetData(), contents.size()), contents);
+  EXPECT_EQ(file->GetData()[1024 * 1024 - 1], '\0');
+}
+
+TEST(MappedFileTest, CreateShouldFailIfDirectoryDoesNotExist) {
+  EXPECT_THAT(MappedFile::Create("/does/not/exist", 4096).result(),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FILE_ERROR)));
+}
+
+}  // namespace google::pair::matcher::test
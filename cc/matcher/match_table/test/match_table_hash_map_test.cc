@@ -18,20 +18,38 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <optional>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "cc/matcher/match_table/src/dense_match_table_hash_map.h"
 #include "cc/matcher/match_table/src/error_codes.h"
 #include "cc/public/core/interface/execution_result.h"
 #include "cc/public/core/test/interface/execution_result_matchers.h"
 
 using absl::flat_hash_map;
+using absl::StrCat;
 using google::pair::matcher::errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS;
 using google::pair::matcher::errors::MATCH_TABLE_ELEMENT_DOES_NOT_EXIST;
+using google::pair::matcher::errors::MATCH_TABLE_FROZEN;
+using google::pair::matcher::errors::MATCH_TABLE_NEWLY_MATCHED_NOT_SUPPORTED;
+using google::scp::core::ExecutionResult;
+using google::scp::core::ExecutionResultOr;
 using google::scp::core::FailureExecutionResult;
 using google::scp::core::test::IsSuccessfulAndHolds;
 using google::scp::core::test::ResultIs;
+using std::atomic_int;
+using std::nullopt;
+using std::optional;
 using std::string;
+using std::thread;
+using std::vector;
+using testing::ElementsAre;
 using testing::Pair;
 using testing::UnorderedElementsAre;
 
@@ -118,4 +136,262 @@ TEST(MatchTableHashMapTest, VisitorShouldNotGetCalledIfElementsWereNotMatched) {
   });
 }
 
+TEST(MatchTableHashMapTest, DefaultMarkMatchedBatchShouldMarkEachKey) {
+  MatchTableHashMap<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+
+  vector<string> keys = {"key2", "missing", "key1"};
+  vector<optional<string>> values;
+  table.MarkMatchedBatch(keys, &values);
+
+  EXPECT_THAT(values, ElementsAre("value2", nullopt, "value1"));
+}
+
+TEST(MatchTableHashMapTest, DefaultMarkMatchedBatchShouldTellNewlyMatched) {
+  MatchTableHashMap<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+  EXPECT_SUCCESS(table.MarkMatched("key2"));
+
+  vector<string> keys = {"key2", "missing", "key1", "key1"};
+  vector<optional<string>> values;
+  vector<bool> newly_matched;
+  table.MarkMatchedBatch(keys, &values, &newly_matched);
+
+  EXPECT_THAT(values, ElementsAre("value2", nullopt, "value1", "value1"));
+  EXPECT_THAT(newly_matched, ElementsAre(false, false, true, false));
+}
+
+TEST(MatchTableHashMapTest, AddingShouldFailOnceFrozen) {
+  MatchTableHashMap<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  table.Freeze();
+
+  EXPECT_THAT(table.AddElement("key2", "value2"),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FROZEN)));
+  EXPECT_THAT(table.MarkMatched("key1"), IsSuccessfulAndHolds("value1"));
+  EXPECT_EQ(table.Size(), 1);
+}
+
+TEST(MatchTableHashMapTest, ShouldMarkMatchedConcurrentlyOnceFrozen) {
+  constexpr int kNumThreads = 8;
+  constexpr int kNumElements = 10000;
+  MatchTableHashMap<string, string> table;
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(table.AddElement(StrCat("key", i), StrCat("value", i)));
+  }
+  table.Freeze();
+
+  // Every thread marks every third ID starting at its own offset, so most IDs
+  // are marked from several threads at once.
+  vector<thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&table, t]() {
+      for (int i = t; i < kNumElements; i += 3) {
+        EXPECT_THAT(table.MarkMatched(StrCat("key", i)),
+                    IsSuccessfulAndHolds(StrCat("value", i)));
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  int num_matched = 0;
+  table.VisitMatched([&num_matched](const auto& k, const auto& v) {
+    EXPECT_EQ(k.substr(3), v.substr(5));
+    num_matched++;
+  });
+  EXPECT_EQ(num_matched, kNumElements);
+}
+
+TEST(MatchTableHashMapTest, OnlyOneConcurrentCallShouldMatchNewly) {
+  constexpr int kNumThreads = 8;
+  constexpr int kNumElements = 10000;
+  MatchTableHashMap<string, string> table;
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(table.AddElement(StrCat("key", i), StrCat("value", i)));
+  }
+  table.Freeze();
+
+  // Every thread marks every ID, so each is marked from all threads at once.
+  atomic_int num_newly_matched(0);
+  vector<thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&table, &num_newly_matched]() {
+      for (int i = 0; i < kNumElements; i++) {
+        bool newly_matched = false;
+        EXPECT_SUCCESS(table.MarkMatched(StrCat("key", i), &newly_matched));
+        if (newly_matched) {
+          num_newly_matched++;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  EXPECT_EQ(num_newly_matched.load(), kNumElements);
+}
+
+TEST(MatchTableHashMapTest, DefaultVisitMatchedRangeShouldBatchElements) {
+  constexpr int kNumElements = 2500;
+  MatchTableHashMap<string, string> table;
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(table.AddElement(StrCat("key", i), StrCat("value", i)));
+    EXPECT_SUCCESS(table.MarkMatched(StrCat("key", i)));
+  }
+  EXPECT_SUCCESS(table.AddElement("unmatched", "value"));
+
+  ASSERT_EQ(table.GetNumVisitRanges(), 1);
+  vector<size_t> batch_sizes;
+  flat_hash_map<string, string> matched_items;
+  table.VisitMatchedRange(0, [&batch_sizes, &matched_items](auto batch) {
+    batch_sizes.push_back(batch.size());
+    for (const auto& element : batch) {
+      matched_items[*element.key] = *element.value;
+    }
+  });
+
+  EXPECT_THAT(batch_sizes, ElementsAre(1024, 1024, 452));
+  EXPECT_EQ(matched_items.size(), kNumElements);
+  EXPECT_EQ(matched_items["key7"], "value7");
+}
+
+TEST(MatchTableHashMapTest, BulkLoadShouldReportAllDuplicates) {
+  MatchTableHashMap<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+
+  vector<std::pair<string, string>> elements = {{"key1", "other"},
+                                                {"key2", "value2"},
+                                                {"key3", "value3"},
+                                                {"key2", "other"}};
+  vector<string> duplicate_keys;
+  EXPECT_SUCCESS(table.BulkLoad(elements, &duplicate_keys));
+
+  EXPECT_THAT(duplicate_keys, ElementsAre("key1", "key2"));
+  EXPECT_EQ(table.Size(), 3);
+  EXPECT_THAT(table.MarkMatched("key1"), IsSuccessfulAndHolds("value1"));
+  EXPECT_THAT(table.MarkMatched("key2"), IsSuccessfulAndHolds("value2"));
+  EXPECT_THAT(table.MarkMatched("key3"), IsSuccessfulAndHolds("value3"));
+}
+
+using StringMatchTable = MatchTable<string, string>;
+
+TEST(MatchTableHashMapTest, DefaultBulkLoadShouldAddEachElement) {
+  MatchTableHashMap<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+
+  vector<std::pair<string, string>> elements = {{"key1", "other"},
+                                                {"key2", "value2"}};
+  vector<string> duplicate_keys;
+  // Call the MatchTable implementation, which goes through AddElement.
+  EXPECT_SUCCESS(table.StringMatchTable::BulkLoad(elements, &duplicate_keys));
+
+  EXPECT_THAT(duplicate_keys, ElementsAre("key1"));
+  EXPECT_THAT(table.MarkMatched("key2"), IsSuccessfulAndHolds("value2"));
+
+  table.Freeze();
+  elements = {{"key3", "value3"}};
+  EXPECT_THAT(table.StringMatchTable::BulkLoad(elements, &duplicate_keys),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FROZEN)));
+}
+
+TEST(MatchTableHashMapTest, BulkLoadShouldFailOnceFrozen) {
+  MatchTableHashMap<string, string> table;
+  table.Freeze();
+
+  vector<std::pair<string, string>> elements = {{"key1", "value1"}};
+  vector<string> duplicate_keys;
+  EXPECT_THAT(table.BulkLoad(elements, &duplicate_keys),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FROZEN)));
+  EXPECT_EQ(table.Size(), 0);
+}
+
+TEST(MatchTableHashMapTest, ShouldAddElementsAfterReserve) {
+  MatchTableHashMap<string, string> table;
+  auto empty_bytes = table.GetMemoryUsageBytes();
+
+  table.Reserve(1000);
+  EXPECT_GT(table.GetMemoryUsageBytes(), empty_bytes);
+
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+  EXPECT_THAT(table.MarkMatched("key"), IsSuccessfulAndHolds("value"));
+}
+
+TEST(MatchTableHashMapTest, ShouldReportSizeAndMemoryUsage) {
+  MatchTableHashMap<string, string> table;
+  EXPECT_EQ(table.Size(), 0);
+  EXPECT_EQ(table.GetBytesPerEntry(), 0);
+
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+
+  EXPECT_EQ(table.Size(), 2);
+  EXPECT_GT(table.GetMemoryUsageBytes(), 0);
+  EXPECT_GT(table.GetBytesPerEntry(), 0);
+}
+
+TEST(MatchTableHashMapTest, DenseLayoutShouldUseLessMemoryPerEntry) {
+  constexpr int kNumElements = 100000;
+  MatchTableHashMap<string, string> table;
+  DenseMatchTableHashMap<string, string> dense_table;
+
+  for (int i = 0; i < kNumElements; i++) {
+    // Use IDs long enough to be heap allocated, like real emails and UUIDs.
+    auto key = StrCat("publisher_user_", i, "@example.com");
+    auto value = StrCat("00000000-0000-0000-0000-", i);
+    EXPECT_SUCCESS(table.AddElement(key, value));
+    EXPECT_SUCCESS(dense_table.AddElement(key, value));
+  }
+
+  // Each element of MatchTableHashMap additionally pays for a separately
+  // allocated and padded ValueInfo.
+  EXPECT_LT(dense_table.GetBytesPerEntry() + 8, table.GetBytesPerEntry());
+}
+
+// A table implementing only the pure virtual methods of MatchTable, as a
+// table written outside of this library would.
+class SingleKeyMatchTable : public MatchTable<string, string> {
+ public:
+  ExecutionResult AddElement(const string& key, const string& value) override {
+    return table_.AddElement(key, value);
+  }
+
+  ExecutionResultOr<string> MarkMatched(const string& key) override {
+    return table_.MarkMatched(key);
+  }
+
+  void VisitMatched(VisitorCallback visitor) override {
+    table_.VisitMatched(visitor);
+  }
+
+  size_t Size() const override { return table_.Size(); }
+
+  size_t GetMemoryUsageBytes() const override {
+    return table_.GetMemoryUsageBytes();
+  }
+
+  using MatchTable<string, string>::MarkMatched;
+
+ private:
+  MatchTableHashMap<string, string> table_;
+};
+
+TEST(MatchTableTest, TablesImplementingOnlySingleKeyMarkMatchedStillWork) {
+  SingleKeyMatchTable table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+
+  EXPECT_THAT(table.MarkMatched("key1", nullptr),
+              IsSuccessfulAndHolds("value1"));
+  vector<optional<string>> values;
+  table.MarkMatchedBatch(vector<string>{"key2", "key3"}, &values);
+  EXPECT_THAT(values, ElementsAre("value2", nullopt));
+  // Whether an element was matched before is only known to tables which
+  // implement it.
+  bool newly_matched = false;
+  EXPECT_THAT(table.MarkMatched("key1", &newly_matched),
+              ResultIs(FailureExecutionResult(
+                  MATCH_TABLE_NEWLY_MATCHED_NOT_SUPPORTED)));
+}
+
 }  // namespace google::pair::matcher::test
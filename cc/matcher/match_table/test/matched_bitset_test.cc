@@ -0,0 +1,78 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cc/matcher/match_table/src/matched_bitset.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+using std::thread;
+using std::vector;
+
+namespace google::pair::matcher::test {
+
+TEST(MatchedBitsetTest, ShouldSetAndTestBits) {
+  MatchedBitset bits(130);
+  EXPECT_EQ(bits.GetNumWords(), 3);
+
+  EXPECT_TRUE(bits.Set(0));
+  EXPECT_TRUE(bits.Set(129));
+  EXPECT_FALSE(bits.Set(129));
+
+  EXPECT_TRUE(bits.Test(0));
+  EXPECT_FALSE(bits.Test(1));
+  EXPECT_TRUE(bits.Test(129));
+  EXPECT_EQ(bits.GetWord(0), 1);
+  EXPECT_EQ(bits.GetWord(1), 0);
+  EXPECT_EQ(bits.GetWord(2), 2);
+}
+
+TEST(MatchedBitsetTest, ResizingShouldKeepSetBits) {
+  MatchedBitset bits(64);
+  EXPECT_TRUE(bits.Set(63));
+
+  bits.Resize(256);
+
+  EXPECT_EQ(bits.GetNumWords(), 4);
+  EXPECT_TRUE(bits.Test(63));
+  EXPECT_FALSE(bits.Test(64));
+  EXPECT_EQ(bits.GetMemoryUsageBytes(), 32);
+}
+
+TEST(MatchedBitsetTest, ShouldSetBitsConcurrently) {
+  constexpr int kNumThreads = 8;
+  constexpr int kNumBits = 64 * 100;
+  MatchedBitset bits(kNumBits);
+
+  // All threads set bits in the same words, each thread its own bits.
+  vector<thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&bits, t]() {
+      for (int i = t; i < kNumBits; i += kNumThreads) {
+        EXPECT_TRUE(bits.Set(i));
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  for (size_t w = 0; w < bits.GetNumWords(); w++) {
+    EXPECT_EQ(bits.GetWord(w), ~uint64_t{0});
+  }
+}
+
+}  // namespace google::pair::matcher::test
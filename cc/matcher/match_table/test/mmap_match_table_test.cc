@@ -0,0 +1,267 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cc/matcher/match_table/src/mmap_match_table.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "cc/matcher/match_table/src/error_codes.h"
+#include "cc/public/core/interface/execution_result.h"
+#include "cc/public/core/test/interface/execution_result_matchers.h"
+
+using absl::flat_hash_map;
+using absl::StrCat;
+using google::pair::matcher::errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS;
+using google::pair::matcher::errors::MATCH_TABLE_ELEMENT_DOES_NOT_EXIST;
+using google::pair::matcher::errors::MATCH_TABLE_FILE_ERROR;
+using google::pair::matcher::errors::MATCH_TABLE_FROZEN;
+using google::scp::core::FailureExecutionResult;
+using google::scp::core::test::IsSuccessfulAndHolds;
+using google::scp::core::test::ResultIs;
+using std::nullopt;
+using std::optional;
+using std::string;
+using std::thread;
+using std::unique_ptr;
+using std::vector;
+using testing::ElementsAre;
+using testing::Pair;
+using testing::UnorderedElementsAre;
+
+namespace google::pair::matcher::test {
+
+unique_ptr<MmapMatchTable> CreateTable() {
+  auto table_or = MmapMatchTable::Create(testing::TempDir());
+  EXPECT_SUCCESS(table_or);
+  return table_or.release();
+}
+
+TEST(MmapMatchTableTest, ShouldGetValueIfMatchedElementExists) {
+  auto table = CreateTable();
+  EXPECT_SUCCESS(table->AddElement("key", "value"));
+
+  EXPECT_THAT(table->MarkMatched("key"), IsSuccessfulAndHolds("value"));
+}
+
+TEST(MmapMatchTableTest, AddingShouldFailIfElementAlreadyExists) {
+  auto table = CreateTable();
+  EXPECT_SUCCESS(table->AddElement("key", "value"));
+
+  EXPECT_THAT(
+      table->AddElement("key", "other"),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_ALREADY_EXISTS)));
+  EXPECT_EQ(table->Size(), 1);
+}
+
+TEST(MmapMatchTableTest, MarkingMatchedShouldFailIfMissing) {
+  auto table = CreateTable();
+  EXPECT_SUCCESS(table->AddElement("key", "value"));
+
+  EXPECT_THAT(
+      table->MarkMatched("other"),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_DOES_NOT_EXIST)));
+  // A key which is a prefix of an existing one is a different key.
+  EXPECT_THAT(
+      table->MarkMatched("ke"),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_DOES_NOT_EXIST)));
+}
+
+TEST(MmapMatchTableTest, CreateShouldFailIfDirectoryDoesNotExist) {
+  EXPECT_THAT(MmapMatchTable::Create("/does/not/exist").result(),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FILE_ERROR)));
+}
+
+TEST(MmapMatchTableTest, ShouldFindAllElementsAfterGrowing) {
+  constexpr int kNumElements = 20000;
+  auto table = CreateTable();
+
+  // Long values grow the records file several times along with the index.
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(
+        table->AddElement(StrCat("key", i), StrCat(string(100, 'v'), i)));
+  }
+
+  EXPECT_EQ(table->Size(), kNumElements);
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_THAT(table->MarkMatched(StrCat("key", i)),
+                IsSuccessfulAndHolds(StrCat(string(100, 'v'), i)));
+  }
+  EXPECT_THAT(
+      table->MarkMatched(StrCat("key", kNumElements)),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_DOES_NOT_EXIST)));
+}
+
+TEST(MmapMatchTableTest, VisitorShouldGetCalledWithMatchedElements) {
+  auto table = CreateTable();
+  EXPECT_SUCCESS(table->AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table->AddElement("key2", "value2"));
+  EXPECT_SUCCESS(table->AddElement("key3", ""));
+  EXPECT_SUCCESS(table->MarkMatched("key1"));
+  EXPECT_SUCCESS(table->MarkMatched("key3"));
+
+  flat_hash_map<string, string> matched_items;
+  table->VisitMatched(
+      [&matched_items](const auto& k, const auto& v) { matched_items[k] = v; });
+
+  EXPECT_THAT(matched_items,
+              UnorderedElementsAre(Pair("key1", "value1"), Pair("key3", "")));
+}
+
+TEST(MmapMatchTableTest, ShouldMarkMatchedBatch) {
+  auto table = CreateTable();
+  EXPECT_SUCCESS(table->AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table->AddElement("key2", "value2"));
+
+  vector<string> keys = {"key2", "missing", "key1"};
+  vector<optional<string>> values;
+  table->MarkMatchedBatch(keys, &values);
+
+  EXPECT_THAT(values, ElementsAre("value2", nullopt, "value1"));
+}
+
+TEST(MmapMatchTableTest, MarkMatchedBatchShouldTellNewlyMatched) {
+  auto table = CreateTable();
+  EXPECT_SUCCESS(table->AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table->AddElement("key2", "value2"));
+  EXPECT_SUCCESS(table->MarkMatched("key2"));
+
+  vector<string> keys = {"key2", "missing", "key1", "key1"};
+  vector<optional<string>> values;
+  vector<bool> newly_matched;
+  table->MarkMatchedBatch(keys, &values, &newly_matched);
+
+  EXPECT_THAT(values, ElementsAre("value2", nullopt, "value1", "value1"));
+  EXPECT_THAT(newly_matched, ElementsAre(false, false, true, false));
+}
+
+TEST(MmapMatchTableTest, MarkMatchedBatchShouldTellElementIndices) {
+  auto table = CreateTable();
+  EXPECT_SUCCESS(table->AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table->AddElement("key2", "value2"));
+
+  vector<string> keys = {"key2", "missing", "key1", "key1"};
+  vector<optional<string>> values;
+  vector<size_t> element_indices;
+  EXPECT_SUCCESS(
+      table->MarkMatchedBatchWithIndices(keys, &values, &element_indices));
+
+  EXPECT_THAT(values, ElementsAre("value2", nullopt, "value1", "value1"));
+  // Elements are numbered in the order they were added.
+  ASSERT_EQ(element_indices.size(), keys.size());
+  EXPECT_EQ(element_indices[0], 1);
+  EXPECT_EQ(element_indices[2], 0);
+  EXPECT_EQ(element_indices[3], 0);
+  EXPECT_EQ(table->GetNumElementIndices(), 2);
+}
+
+TEST(MmapMatchTableTest, BulkLoadShouldReportAllDuplicates) {
+  constexpr int kNumElements = 1000;
+  auto table = CreateTable();
+  EXPECT_SUCCESS(table->AddElement("key0", "value"));
+
+  vector<std::pair<string, string>> elements;
+  for (int i = 0; i < kNumElements * 2; i++) {
+    elements.emplace_back(StrCat("key", i % kNumElements), StrCat("value", i));
+  }
+  vector<string> duplicate_keys;
+  EXPECT_SUCCESS(table->BulkLoad(elements, &duplicate_keys));
+
+  // Both copies of the key added up front are duplicates.
+  EXPECT_EQ(duplicate_keys.size(), kNumElements + 1);
+  EXPECT_EQ(table->Size(), kNumElements);
+  EXPECT_THAT(table->MarkMatched("key0"), IsSuccessfulAndHolds("value"));
+  EXPECT_THAT(table->MarkMatched("key1"), IsSuccessfulAndHolds("value1"));
+}
+
+TEST(MmapMatchTableTest, AddingShouldFailOnceFrozen) {
+  auto table = CreateTable();
+  EXPECT_SUCCESS(table->AddElement("key1", "value1"));
+  table->Freeze();
+
+  EXPECT_THAT(table->AddElement("key2", "value2"),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FROZEN)));
+  EXPECT_THAT(table->MarkMatched("key1"), IsSuccessfulAndHolds("value1"));
+  EXPECT_EQ(table->Size(), 1);
+}
+
+TEST(MmapMatchTableTest, ShouldMarkMatchedConcurrentlyOnceFrozen) {
+  constexpr int kNumThreads = 8;
+  constexpr int kNumElements = 10000;
+  auto table = CreateTable();
+  table->Reserve(kNumElements);
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(table->AddElement(StrCat("key", i), StrCat("value", i)));
+  }
+  table->Freeze();
+
+  // Every thread marks every third ID starting at its own offset, so most IDs
+  // are marked from several threads at once.
+  vector<thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&table, t]() {
+      for (int i = t; i < kNumElements; i += 3) {
+        EXPECT_THAT(table->MarkMatched(StrCat("key", i)),
+                    IsSuccessfulAndHolds(StrCat("value", i)));
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  int num_matched = 0;
+  table->VisitMatched([&num_matched](const auto& k, const auto& v) {
+    EXPECT_EQ(k.substr(3), v.substr(5));
+    num_matched++;
+  });
+  EXPECT_EQ(num_matched, kNumElements);
+}
+
+TEST(MmapMatchTableTest, ShouldVisitMatchedRanges) {
+  constexpr int kNumElements = 200000;
+  auto table = CreateTable();
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(table->AddElement(StrCat("key", i), StrCat("value", i)));
+    if (i % 3 == 0) {
+      EXPECT_SUCCESS(table->MarkMatched(StrCat("key", i)));
+    }
+  }
+  table->Freeze();
+
+  auto num_ranges = table->GetNumVisitRanges();
+  EXPECT_GT(num_ranges, 1);
+  int num_matched = 0;
+  for (size_t range = 0; range < num_ranges; range++) {
+    table->VisitMatchedRange(range, [&num_matched](auto batch) {
+      EXPECT_LE(batch.size(), kMatchedBatchSize);
+      for (const auto& element : batch) {
+        EXPECT_EQ(element.key->substr(3), element.value->substr(5));
+        EXPECT_EQ(std::stoi(element.key->substr(3)) % 3, 0);
+      }
+      num_matched += batch.size();
+    });
+  }
+  EXPECT_EQ(num_matched, (kNumElements + 2) / 3);
+}
+
+}  // namespace google::pair::matcher::test
@@ -0,0 +1,398 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cc/matcher/match_table/src/open_addressing_match_table.h"
+
+#include <gtest/gtest.h>
+
+#include <optional>
+#include <string>
+#include <utility>
+#include <thread>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "cc/matcher/match_table/src/error_codes.h"
+#include "cc/public/core/interface/execution_result.h"
+#include "cc/public/core/test/interface/execution_result_matchers.h"
+
+using absl::flat_hash_map;
+using absl::StrCat;
+using google::pair::matcher::errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS;
+using google::pair::matcher::errors::MATCH_TABLE_ELEMENT_DOES_NOT_EXIST;
+using google::pair::matcher::errors::MATCH_TABLE_FROZEN;
+using google::scp::core::FailureExecutionResult;
+using google::scp::core::test::IsSuccessfulAndHolds;
+using google::scp::core::test::ResultIs;
+using std::nullopt;
+using std::optional;
+using std::string;
+using std::thread;
+using std::vector;
+using testing::ElementsAre;
+using testing::Pair;
+using testing::UnorderedElementsAre;
+
+namespace google::pair::matcher::test {
+
+TEST(OpenAddressingMatchTableTest, ShouldSuccessfullyAddElement) {
+  OpenAddressingMatchTable<string, string> table;
+
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+}
+
+TEST(OpenAddressingMatchTableTest, ShouldGetValueIfMatchedElementExists) {
+  OpenAddressingMatchTable<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+
+  EXPECT_THAT(table.MarkMatched("key"), IsSuccessfulAndHolds("value"));
+}
+
+TEST(OpenAddressingMatchTableTest, AddingShouldFailIfElementAlreadyExists) {
+  OpenAddressingMatchTable<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+
+  EXPECT_THAT(
+      table.AddElement("key", "value"),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_ALREADY_EXISTS)));
+}
+
+TEST(OpenAddressingMatchTableTest, MarkingMatchedShouldFailIfMissing) {
+  OpenAddressingMatchTable<string, string> table;
+
+  EXPECT_THAT(
+      table.MarkMatched("key"),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_DOES_NOT_EXIST)));
+}
+
+TEST(OpenAddressingMatchTableTest, ShouldAddAndMarkMatchedMultipleElements) {
+  OpenAddressingMatchTable<string, string> table;
+
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+
+  EXPECT_THAT(table.MarkMatched("key1"), IsSuccessfulAndHolds("value1"));
+  EXPECT_THAT(table.MarkMatched("key2"), IsSuccessfulAndHolds("value2"));
+}
+
+TEST(OpenAddressingMatchTableTest, VisitorShouldGetCalledWithMatchedElements) {
+  OpenAddressingMatchTable<string, string> table;
+
+  // Add 5 elements
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+  EXPECT_SUCCESS(table.AddElement("key3", "value3"));
+  EXPECT_SUCCESS(table.AddElement("key4", "value4"));
+  EXPECT_SUCCESS(table.AddElement("key5", "value5"));
+
+  // Only mark 3 as matched
+  EXPECT_SUCCESS(table.MarkMatched("key1"));
+  EXPECT_SUCCESS(table.MarkMatched("key4"));
+  EXPECT_SUCCESS(table.MarkMatched("key5"));
+
+  flat_hash_map<string, string> matched_items;
+
+  table.VisitMatched(
+      [&matched_items](const auto& k, const auto& v) { matched_items[k] = v; });
+
+  EXPECT_EQ(3, matched_items.size());
+  EXPECT_THAT(matched_items, UnorderedElementsAre(Pair("key1", "value1"),
+                                                  Pair("key4", "value4"),
+                                                  Pair("key5", "value5")));
+}
+
+TEST(OpenAddressingMatchTableTest, VisitorShouldNotGetCalledIfNoneMatched) {
+  OpenAddressingMatchTable<string, string> table;
+
+  // Add 5 elements
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+  EXPECT_SUCCESS(table.AddElement("key3", "value3"));
+  EXPECT_SUCCESS(table.AddElement("key4", "value4"));
+  EXPECT_SUCCESS(table.AddElement("key5", "value5"));
+
+  table.VisitMatched([](const auto& k, const auto& v) {
+    FAIL() << "Did not expect visitor to be called";
+  });
+}
+
+TEST(OpenAddressingMatchTableTest, ShouldFindAllElementsAfterGrowing) {
+  constexpr int kNumElements = 10000;
+  OpenAddressingMatchTable<string, string> table;
+
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(table.AddElement(StrCat("key", i), StrCat("value", i)));
+  }
+
+  EXPECT_EQ(table.Size(), kNumElements);
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_THAT(table.MarkMatched(StrCat("key", i)),
+                IsSuccessfulAndHolds(StrCat("value", i)));
+  }
+  EXPECT_THAT(
+      table.MarkMatched(StrCat("key", kNumElements)),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_DOES_NOT_EXIST)));
+}
+
+TEST(OpenAddressingMatchTableTest, ShouldMarkMatchedBatch) {
+  OpenAddressingMatchTable<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+  EXPECT_SUCCESS(table.AddElement("key3", "value3"));
+
+  vector<string> keys = {"key3", "missing", "key1", "key3"};
+  vector<optional<string>> values = {"stale"};
+  table.MarkMatchedBatch(keys, &values);
+
+  EXPECT_THAT(values, ElementsAre("value3", nullopt, "value1", "value3"));
+  flat_hash_map<string, string> matched_items;
+  table.VisitMatched(
+      [&matched_items](const auto& k, const auto& v) { matched_items[k] = v; });
+  EXPECT_THAT(matched_items, UnorderedElementsAre(Pair("key1", "value1"),
+                                                  Pair("key3", "value3")));
+}
+
+TEST(OpenAddressingMatchTableTest, MarkMatchedBatchShouldTellNewlyMatched) {
+  OpenAddressingMatchTable<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+  bool newly_matched_key = false;
+  EXPECT_THAT(table.MarkMatched("key2", &newly_matched_key),
+              IsSuccessfulAndHolds("value2"));
+  EXPECT_TRUE(newly_matched_key);
+
+  vector<string> keys = {"key2", "missing", "key1", "key1"};
+  vector<optional<string>> values;
+  vector<bool> newly_matched;
+  table.MarkMatchedBatch(keys, &values, &newly_matched);
+
+  EXPECT_THAT(values, ElementsAre("value2", nullopt, "value1", "value1"));
+  EXPECT_THAT(newly_matched, ElementsAre(false, false, true, false));
+}
+
+TEST(OpenAddressingMatchTableTest, MarkMatchedBatchShouldTellElementIndices) {
+  OpenAddressingMatchTable<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+  table.Freeze();
+
+  vector<string> keys = {"key2", "missing", "key1", "key1"};
+  vector<optional<string>> values;
+  vector<size_t> element_indices;
+  EXPECT_SUCCESS(
+      table.MarkMatchedBatchWithIndices(keys, &values, &element_indices));
+
+  EXPECT_THAT(values, ElementsAre("value2", nullopt, "value1", "value1"));
+  ASSERT_EQ(element_indices.size(), keys.size());
+  EXPECT_NE(element_indices[0], element_indices[2]);
+  EXPECT_EQ(element_indices[2], element_indices[3]);
+  EXPECT_LT(element_indices[0], table.GetNumElementIndices());
+  EXPECT_LT(element_indices[2], table.GetNumElementIndices());
+}
+
+TEST(OpenAddressingMatchTableTest, ShouldMarkMatchedLongBatch) {
+  constexpr int kNumElements = 1000;
+  OpenAddressingMatchTable<string, string> table;
+  vector<string> keys;
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(table.AddElement(StrCat("key", i), StrCat("value", i)));
+    keys.push_back(StrCat("key", i * 2));
+  }
+
+  vector<optional<string>> values;
+  table.MarkMatchedBatch(keys, &values);
+
+  ASSERT_EQ(values.size(), kNumElements);
+  for (int i = 0; i < kNumElements; i++) {
+    if (i * 2 < kNumElements) {
+      EXPECT_EQ(values[i], StrCat("value", i * 2));
+    } else {
+      EXPECT_EQ(values[i], nullopt);
+    }
+  }
+}
+
+TEST(OpenAddressingMatchTableTest, AddingShouldFailOnceFrozen) {
+  OpenAddressingMatchTable<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  table.Freeze();
+
+  EXPECT_THAT(table.AddElement("key2", "value2"),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FROZEN)));
+  EXPECT_THAT(table.MarkMatched("key1"), IsSuccessfulAndHolds("value1"));
+  EXPECT_EQ(table.Size(), 1);
+}
+
+TEST(OpenAddressingMatchTableTest, ShouldMarkMatchedConcurrentlyOnceFrozen) {
+  constexpr int kNumThreads = 8;
+  constexpr int kNumElements = 10000;
+  OpenAddressingMatchTable<string, string> table;
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(table.AddElement(StrCat("key", i), StrCat("value", i)));
+  }
+  table.Freeze();
+
+  // Every thread marks every third ID starting at its own offset, so most IDs
+  // are marked from several threads at once.
+  vector<thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&table, t]() {
+      for (int i = t; i < kNumElements; i += 3) {
+        EXPECT_THAT(table.MarkMatched(StrCat("key", i)),
+                    IsSuccessfulAndHolds(StrCat("value", i)));
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  int num_matched = 0;
+  table.VisitMatched([&num_matched](const auto& k, const auto& v) {
+    EXPECT_EQ(k.substr(3), v.substr(5));
+    num_matched++;
+  });
+  EXPECT_EQ(num_matched, kNumElements);
+}
+
+TEST(OpenAddressingMatchTableTest, ShouldVisitMatchedRangesConcurrently) {
+  constexpr int kNumElements = 200000;
+  OpenAddressingMatchTable<string, string> table;
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(table.AddElement(StrCat("key", i), StrCat("value", i)));
+    if (i % 3 == 0) {
+      EXPECT_SUCCESS(table.MarkMatched(StrCat("key", i)));
+    }
+  }
+  table.Freeze();
+
+  auto num_ranges = table.GetNumVisitRanges();
+  EXPECT_GT(num_ranges, 1);
+  vector<int> num_matched(num_ranges);
+  vector<thread> threads;
+  for (size_t range = 0; range < num_ranges; range++) {
+    threads.emplace_back([&table, &num_matched, range]() {
+      table.VisitMatchedRange(range, [&num_matched, range](auto batch) {
+        EXPECT_LE(batch.size(), kMatchedBatchSize);
+        for (const auto& element : batch) {
+          EXPECT_EQ(element.key->substr(3), element.value->substr(5));
+          EXPECT_EQ(std::stoi(element.key->substr(3)) % 3, 0);
+        }
+        num_matched[range] += batch.size();
+      });
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  int total_matched = 0;
+  for (auto n : num_matched) total_matched += n;
+  EXPECT_EQ(total_matched, (kNumElements + 2) / 3);
+}
+
+TEST(OpenAddressingMatchTableTest, BulkLoadShouldReportAllDuplicates) {
+  constexpr int kNumElements = 1000;
+  OpenAddressingMatchTable<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key0", "value"));
+
+  // Large enough to grow the table, with every key loaded twice.
+  vector<std::pair<string, string>> elements;
+  for (int i = 0; i < kNumElements * 2; i++) {
+    elements.emplace_back(StrCat("key", i % kNumElements), StrCat("value", i));
+  }
+  vector<string> duplicate_keys;
+  EXPECT_SUCCESS(table.BulkLoad(elements, &duplicate_keys));
+
+  // Both copies of the key added up front are duplicates.
+  EXPECT_EQ(duplicate_keys.size(), kNumElements + 1);
+  EXPECT_EQ(table.Size(), kNumElements);
+  EXPECT_THAT(table.MarkMatched("key0"), IsSuccessfulAndHolds("value"));
+  for (int i = 1; i < kNumElements; i++) {
+    EXPECT_THAT(table.MarkMatched(StrCat("key", i)),
+                IsSuccessfulAndHolds(StrCat("value", i)));
+  }
+}
+
+TEST(OpenAddressingMatchTableTest, BulkLoadShouldFailOnceFrozen) {
+  OpenAddressingMatchTable<string, string> table;
+  table.Freeze();
+
+  vector<std::pair<string, string>> elements = {{"key1", "value1"}};
+  vector<string> duplicate_keys;
+  EXPECT_THAT(table.BulkLoad(elements, &duplicate_keys),
+              ResultIs(FailureExecutionResult(MATCH_TABLE_FROZEN)));
+  EXPECT_EQ(table.Size(), 0);
+}
+
+TEST(OpenAddressingMatchTableTest, ShouldNotGrowAfterReserve) {
+  constexpr int kNumElements = 1000;
+  OpenAddressingMatchTable<string, string> table;
+  table.Reserve(kNumElements);
+  // Short keys and values fit in the slots, so only growing changes this.
+  auto reserved_bytes = table.GetMemoryUsageBytes();
+
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(table.AddElement(StrCat("key", i), StrCat("value", i)));
+  }
+
+  EXPECT_EQ(table.GetMemoryUsageBytes(), reserved_bytes);
+  EXPECT_THAT(table.MarkMatched("key123"), IsSuccessfulAndHolds("value123"));
+}
+
+TEST(OpenAddressingMatchTableTest, ReserveShouldKeepExistingElements) {
+  OpenAddressingMatchTable<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.MarkMatched("key1"));
+
+  table.Reserve(10000);
+
+  EXPECT_EQ(table.Size(), 1);
+  flat_hash_map<string, string> matched_items;
+  table.VisitMatched(
+      [&matched_items](const auto& k, const auto& v) { matched_items[k] = v; });
+  EXPECT_THAT(matched_items, UnorderedElementsAre(Pair("key1", "value1")));
+}
+
+TEST(OpenAddressingMatchTableTest, ShouldReportSizeAndMemoryUsage) {
+  OpenAddressingMatchTable<string, string> table;
+  EXPECT_EQ(table.Size(), 0);
+  EXPECT_EQ(table.GetBytesPerEntry(), 0);
+
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+
+  EXPECT_EQ(table.Size(), 2);
+  EXPECT_GT(table.GetMemoryUsageBytes(), 0);
+  EXPECT_GT(table.GetBytesPerEntry(), 0);
+}
+
+TEST(OpenAddressingMatchTableTest, ShouldCountHeapMemoryOfLongElements) {
+  constexpr int kNumElements = 1000;
+  OpenAddressingMatchTable<string, string> short_table;
+  OpenAddressingMatchTable<string, string> long_table;
+
+  for (int i = 0; i < kNumElements; i++) {
+    EXPECT_SUCCESS(short_table.AddElement(StrCat(i), StrCat(i)));
+    // Past the small string buffer, so they own heap memory.
+    EXPECT_SUCCESS(long_table.AddElement(StrCat(string(64, 'k'), i),
+                                         StrCat(string(64, 'v'), i)));
+  }
+
+  // Both tables grew to the same capacity, so only the heap memory of the
+  // elements, which moved along as they grew, differs.
+  EXPECT_GE(long_table.GetMemoryUsageBytes(),
+            short_table.GetMemoryUsageBytes() + kNumElements * 2 * 64);
+}
+
+}  // namespace google::pair::matcher::test
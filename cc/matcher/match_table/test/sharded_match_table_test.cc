@@ -0,0 +1,225 @@
+/*
+ * Copyright 2024 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cc/matcher/match_table/src/sharded_match_table.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <thread>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "cc/core/async_executor/src/async_executor.h"
+#include "cc/matcher/match_table/src/error_codes.h"
+#include "cc/public/core/interface/execution_result.h"
+#include "cc/public/core/test/interface/execution_result_matchers.h"
+
+using absl::flat_hash_map;
+using google::scp::core::AsyncExecutor;
+using google::pair::matcher::errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS;
+using google::pair::matcher::errors::MATCH_TABLE_ELEMENT_DOES_NOT_EXIST;
+using google::scp::core::FailureExecutionResult;
+using google::scp::core::test::IsSuccessfulAndHolds;
+using google::scp::core::test::ResultIs;
+using std::make_shared;
+using std::string;
+using std::thread;
+using std::to_string;
+using std::vector;
+using testing::Pair;
+using testing::UnorderedElementsAre;
+
+namespace google::pair::matcher::test {
+
+TEST(ShardedMatchTableTest, ShouldSuccessfullyAddElement) {
+  ShardedMatchTable<string, string> table;
+
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+}
+
+TEST(ShardedMatchTableTest, ShouldClampNumShardsToAtLeastOne) {
+  ShardedMatchTable<string, string> table(/* num_shards */ 0);
+
+  EXPECT_EQ(table.GetNumShards(), 1);
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+  EXPECT_THAT(table.MarkMatched("key"), IsSuccessfulAndHolds("value"));
+}
+
+TEST(ShardedMatchTableTest, ShouldGetValueIfElementMarkedAsMatchedExists) {
+  ShardedMatchTable<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+
+  EXPECT_THAT(table.MarkMatched("key"), IsSuccessfulAndHolds("value"));
+}
+
+TEST(ShardedMatchTableTest, MarkMatchedShouldTellNewlyMatched) {
+  ShardedMatchTable<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+
+  bool newly_matched = false;
+  EXPECT_THAT(table.MarkMatched("key", &newly_matched),
+              IsSuccessfulAndHolds("value"));
+  EXPECT_TRUE(newly_matched);
+  EXPECT_THAT(table.MarkMatched("key", &newly_matched),
+              IsSuccessfulAndHolds("value"));
+  EXPECT_FALSE(newly_matched);
+}
+
+TEST(ShardedMatchTableTest, AddingShouldFailIfElementAlreadyExists) {
+  ShardedMatchTable<string, string> table;
+  EXPECT_SUCCESS(table.AddElement("key", "value"));
+
+  EXPECT_THAT(
+      table.AddElement("key", "value"),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_ALREADY_EXISTS)));
+}
+
+TEST(ShardedMatchTableTest, MarkingMatchedShouldFailIfElementDoesNotExist) {
+  ShardedMatchTable<string, string> table;
+
+  EXPECT_THAT(
+      table.MarkMatched("key"),
+      ResultIs(FailureExecutionResult(MATCH_TABLE_ELEMENT_DOES_NOT_EXIST)));
+}
+
+TEST(ShardedMatchTableTest, VisitorShouldGetCalledWithAllMatchedElements) {
+  ShardedMatchTable<string, string> table(/* num_shards */ 4);
+
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+  EXPECT_SUCCESS(table.AddElement("key2", "value2"));
+  EXPECT_SUCCESS(table.AddElement("key3", "value3"));
+  EXPECT_SUCCESS(table.AddElement("key4", "value4"));
+  EXPECT_SUCCESS(table.AddElement("key5", "value5"));
+
+  EXPECT_SUCCESS(table.MarkMatched("key1"));
+  EXPECT_SUCCESS(table.MarkMatched("key4"));
+  EXPECT_SUCCESS(table.MarkMatched("key5"));
+
+  flat_hash_map<string, string> matched_items;
+
+  table.VisitMatched(
+      [&matched_items](const auto& k, const auto& v) { matched_items[k] = v; });
+
+  EXPECT_THAT(matched_items, UnorderedElementsAre(Pair("key1", "value1"),
+                                                  Pair("key4", "value4"),
+                                                  Pair("key5", "value5")));
+}
+
+TEST(ShardedMatchTableTest, ShouldVisitMatchedRangePerShard) {
+  ShardedMatchTable<string, string> table(/* num_shards */ 4);
+  for (int i = 0; i < 100; i++) {
+    EXPECT_SUCCESS(table.AddElement(to_string(i), to_string(i)));
+    if (i % 2 == 0) {
+      EXPECT_SUCCESS(table.MarkMatched(to_string(i)));
+    }
+  }
+
+  ASSERT_EQ(table.GetNumVisitRanges(), 4);
+  flat_hash_map<string, string> matched_items;
+  for (size_t range = 0; range < 4; range++) {
+    table.VisitMatchedRange(range, [&matched_items](auto batch) {
+      for (const auto& element : batch) {
+        EXPECT_TRUE(
+            matched_items.try_emplace(*element.key, *element.value).second);
+      }
+    });
+  }
+
+  EXPECT_EQ(matched_items.size(), 50);
+  EXPECT_EQ(matched_items["42"], "42");
+}
+
+TEST(ShardedMatchTableTest, BulkLoadShouldReportAllDuplicates) {
+  ShardedMatchTable<string, string> table(/* num_shards */ 4);
+  EXPECT_SUCCESS(table.AddElement("key1", "value1"));
+
+  vector<std::pair<string, string>> elements = {
+      {"key1", "other"}, {"key2", "value2"}, {"key2", "other"}};
+  vector<string> duplicate_keys;
+  EXPECT_SUCCESS(table.BulkLoad(elements, &duplicate_keys));
+
+  EXPECT_THAT(duplicate_keys, UnorderedElementsAre("key1", "key2"));
+  EXPECT_EQ(table.Size(), 2);
+  EXPECT_THAT(table.MarkMatched("key2"), IsSuccessfulAndHolds("value2"));
+}
+
+TEST(ShardedMatchTableTest, ShouldBulkLoadPartitionsInParallel) {
+  constexpr int kNumElements = 100000;
+  auto cpu_async_executor = make_shared<AsyncExecutor>(4, 100000);
+  EXPECT_SUCCESS(cpu_async_executor->Init());
+  EXPECT_SUCCESS(cpu_async_executor->Run());
+  ShardedMatchTable<string, string> table(/* num_shards */ 16,
+                                          cpu_async_executor,
+                                          /* num_bulk_load_tasks */ 4);
+
+  // The second half repeats the keys of the first, so that duplicates are
+  // found by every task.
+  vector<std::pair<string, string>> elements;
+  for (int i = 0; i < kNumElements; i++) {
+    elements.emplace_back(to_string(i % (kNumElements / 2)), to_string(i));
+  }
+  vector<string> duplicate_keys;
+  EXPECT_SUCCESS(table.BulkLoad(elements, &duplicate_keys));
+
+  EXPECT_EQ(duplicate_keys.size(), kNumElements / 2);
+  EXPECT_EQ(table.Size(), kNumElements / 2);
+  for (int i = 0; i < kNumElements / 2; i++) {
+    EXPECT_THAT(table.MarkMatched(to_string(i)),
+                IsSuccessfulAndHolds(to_string(i)));
+  }
+  EXPECT_SUCCESS(cpu_async_executor->Stop());
+}
+
+TEST(ShardedMatchTableTest, ShouldSupportConcurrentAddAndMarkMatched) {
+  constexpr int kNumThreads = 8;
+  constexpr int kElementsPerThread = 1000;
+  ShardedMatchTable<string, string> table(/* num_shards */ 16);
+
+  vector<thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&table, t]() {
+      for (int i = 0; i < kElementsPerThread; i++) {
+        auto id = to_string(t * kElementsPerThread + i);
+        EXPECT_SUCCESS(table.AddElement(id, id));
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  threads.clear();
+
+  // Every thread marks the even IDs of its own range.
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([&table, t]() {
+      for (int i = 0; i < kElementsPerThread; i += 2) {
+        auto id = to_string(t * kElementsPerThread + i);
+        EXPECT_THAT(table.MarkMatched(id), IsSuccessfulAndHolds(id));
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  size_t num_matched = 0;
+  table.VisitMatched([&num_matched](const auto& k, const auto& v) {
+    EXPECT_EQ(std::stoi(k) % 2, 0);
+    num_matched++;
+  });
+  EXPECT_EQ(num_matched, kNumThreads * kElementsPerThread / 2);
+}
+
+}  // namespace google::pair::matcher::test
@@ -0,0 +1,174 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gmock/gmock.h>
+
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "cc/common/blob_streamer/mock/mock_blob_streamer.h"
+#include "cc/core/async_executor/src/async_executor.h"
+#include "cc/matcher/match_worker/src/match_worker.h"
+#include "cc/public/core/interface/execution_result.h"
+#include "cc/public/cpio/mock/blob_storage_client/mock_blob_storage_client.h"
+
+using google::pair::common::BlobStreamerInterface;
+using google::pair::common::MockBlobStreamer;
+using google::pair::common::PutBlobCallback;
+using google::scp::core::AsyncExecutor;
+using google::scp::core::ExecutionResult;
+using google::scp::core::SuccessExecutionResult;
+using google::scp::cpio::MockBlobStorageClient;
+using std::make_shared;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+using testing::NiceMock;
+
+namespace google::pair::matcher {
+
+namespace {
+
+constexpr size_t kDefaultNumRows = 10000000;
+constexpr double kDefaultDownloadMibPerSecond = 100;
+constexpr size_t kThreadCounts[] = {0, 4, 16};
+// The chunk size the BlobStreamer is asked for by the MatchWorker.
+constexpr size_t kChunkSize = 80 * 1024 * 1024;
+constexpr char kMappingBucketName[] = "mapping_bucket";
+
+// Process CPU time used so far, over all threads.
+absl::Duration GetCpuTime() {
+  timespec cpu_time;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_time);
+  return absl::DurationFromTimespec(cpu_time);
+}
+
+// Runs one export of advertiser_list against mapping. Both are streamed in at
+// download_mib_per_second from another thread like the BlobStreamer does.
+// num_threads is the size of the CPU AsyncExecutor, 0 runs without one.
+void RunBenchmark(const string& mapping, const string& advertiser_list,
+                  double download_mib_per_second, size_t num_threads) {
+  shared_ptr<AsyncExecutor> cpu_async_executor;
+  if (num_threads > 0) {
+    cpu_async_executor = make_shared<AsyncExecutor>(num_threads, 10000000);
+    cpu_async_executor->Init();
+    cpu_async_executor->Run();
+  }
+  auto blob_storage_client = make_shared<NiceMock<MockBlobStorageClient>>();
+  auto* blob_streamer = new NiceMock<MockBlobStreamer>();
+  vector<std::thread> download_threads;
+  ON_CALL(*blob_streamer, GetBlobStream).WillByDefault([&](auto context) {
+    const string& blob = context.GetBucketName() == kMappingBucketName
+                             ? mapping
+                             : advertiser_list;
+    download_threads.emplace_back([&blob, download_mib_per_second,
+                                   callback = context.GetCallback()] {
+      for (size_t i = 0; i < blob.size(); i += kChunkSize) {
+        auto chunk = std::string_view(blob).substr(i, kChunkSize);
+        absl::SleepFor(absl::Seconds(chunk.size() / (1024.0 * 1024.0) /
+                                     download_mib_per_second));
+        callback(chunk, /* is_done */ false, SuccessExecutionResult());
+      }
+      callback("", /* is_done */ true, SuccessExecutionResult());
+    });
+    return SuccessExecutionResult();
+  });
+  size_t uploaded_bytes = 0;
+  ON_CALL(*blob_streamer, PutBlobStream)
+      .WillByDefault([&uploaded_bytes](auto context) -> PutBlobCallback {
+        uploaded_bytes += context.GetInitialData().size();
+        return [&uploaded_bytes](auto chunk_or) -> ExecutionResult {
+          if (chunk_or.Successful() && chunk_or->has_value()) {
+            uploaded_bytes += (*chunk_or)->size();
+          }
+          return SuccessExecutionResult();
+        };
+      });
+  MatchWorker worker(blob_storage_client,
+                     unique_ptr<BlobStreamerInterface>(blob_streamer),
+                     kDefaultOnDiskMatchTableDirectory, cpu_async_executor);
+
+  auto start_time = absl::Now();
+  auto start_cpu_time = GetCpuTime();
+  auto result = worker.ExportMatches(
+      {kMappingBucketName, "mapping", "advertiser_bucket", "advertiser_list",
+       "output_bucket", "matches"});
+  auto cpu_time = GetCpuTime() - start_cpu_time;
+  auto wall_time = absl::Now() - start_time;
+  for (auto& thread : download_threads) thread.join();
+  if (cpu_async_executor) cpu_async_executor->Stop();
+  if (!result.Successful()) {
+    std::cerr << "ExportMatches failed" << std::endl;
+    std::exit(EXIT_FAILURE);
+  }
+  std::cout << "threads=" << num_threads
+            << "\twall=" << absl::FormatDuration(wall_time)
+            << "\tcpu_seconds=" << absl::ToDoubleSeconds(cpu_time)
+            << "\tcpu_utilization="
+            << absl::ToDoubleSeconds(cpu_time) /
+                   absl::ToDoubleSeconds(wall_time)
+            << "\tmatched=" << worker.GetLastExportMatchesStats().num_matched
+            << "\tuploaded_bytes=" << uploaded_bytes << std::endl;
+}
+
+}  // namespace
+
+}  // namespace google::pair::matcher
+
+// Measures the wall time and the CPU seconds of one MatchWorker::ExportMatches
+// job, which matches an advertiser list with a 50% match rate against a
+// publisher mapping. Both are throttled to a download rate, so CPU time spent
+// while waiting on the downloads shows up as CPU seconds beyond what loading
+// and matching need.
+// Usage: match_worker_benchmark [num_rows] [download_mib_per_second]
+// num_rows is the number of publisher mapping rows, the advertiser list has
+// twice as many. It defaults to 10M.
+int main(int argc, char** argv) {
+  using google::pair::matcher::RunBenchmark;
+
+  size_t num_rows = google::pair::matcher::kDefaultNumRows;
+  if (argc > 1) {
+    num_rows = std::strtoul(argv[1], nullptr, 10);
+  }
+  double download_mib_per_second =
+      google::pair::matcher::kDefaultDownloadMibPerSecond;
+  if (argc > 2) {
+    download_mib_per_second = std::strtod(argv[2], nullptr);
+  }
+  string mapping, advertiser_list;
+  for (size_t i = 0; i < num_rows; i++) {
+    absl::StrAppend(&mapping, "user", i, "@example.com,encrypted", i, "\n");
+  }
+  for (size_t i = 0; i < num_rows * 2; i++) {
+    absl::StrAppend(&advertiser_list, "user", i, "@example.com\n");
+  }
+  std::cout << "Benchmarking with " << num_rows << " mapping rows at "
+            << download_mib_per_second << " MiB/s" << std::endl;
+
+  for (auto num_threads : google::pair::matcher::kThreadCounts) {
+    RunBenchmark(mapping, advertiser_list, download_mib_per_second,
+                 num_threads);
+  }
+  return EXIT_SUCCESS;
+}
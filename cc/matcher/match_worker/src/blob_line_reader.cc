@@ -0,0 +1,102 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "blob_line_reader.h"
+
+#include <utility>
+
+#include "cc/common/csv_parser/src/csv_stream_parser_config.h"
+
+using google::pair::common::GetBlobStreamChunkProcessorCallback;
+using google::scp::core::ExecutionResult;
+using google::scp::core::ExecutionResultOr;
+using std::string;
+using std::string_view;
+using std::unique_lock;
+
+namespace google::pair::matcher {
+
+BlobLineReader::BlobLineReader(uint64_t max_buffered_bytes)
+    : max_buffered_bytes_(max_buffered_bytes) {}
+
+GetBlobStreamChunkProcessorCallback BlobLineReader::GetCallback() {
+  return [this](string_view chunk, bool is_done,
+                const ExecutionResult& result) {
+    AddChunk(chunk, is_done, result);
+  };
+}
+
+void BlobLineReader::AddChunk(string_view chunk, bool is_done,
+                              const ExecutionResult& result) {
+  unique_lock lock(mu_);
+  if (is_done) {
+    stream_done_ = true;
+    result_ = result;
+    cv_.notify_all();
+    return;
+  }
+  cv_.wait(lock, [this] {
+    return closed_ || num_buffered_bytes_ < max_buffered_bytes_;
+  });
+  if (closed_ || chunk.empty()) {
+    return;
+  }
+  chunks_.emplace_back(chunk);
+  num_buffered_bytes_ += chunk.size();
+  cv_.notify_all();
+}
+
+ExecutionResultOr<bool> BlobLineReader::NextLine(string& line) {
+  line.clear();
+  // Whether part of the line was in the chunks before.
+  bool has_partial_line = false;
+  while (true) {
+    auto end = chunk_.find(kDefaultCsvLineBreak, chunk_pos_);
+    if (end != string::npos) {
+      line.append(chunk_, chunk_pos_, end - chunk_pos_);
+      chunk_pos_ = end + 1;
+      return true;
+    }
+    if (chunk_pos_ < chunk_.size()) {
+      line.append(chunk_, chunk_pos_);
+      has_partial_line = true;
+    }
+    chunk_.clear();
+    chunk_pos_ = 0;
+
+    unique_lock lock(mu_);
+    cv_.wait(lock, [this] { return !chunks_.empty() || stream_done_; });
+    if (chunks_.empty()) {
+      if (!result_.Successful()) {
+        return result_;
+      }
+      return has_partial_line;
+    }
+    chunk_ = std::move(chunks_.front());
+    chunks_.pop_front();
+    num_buffered_bytes_ -= chunk_.size();
+    cv_.notify_all();
+  }
+}
+
+void BlobLineReader::Close() {
+  unique_lock lock(mu_);
+  closed_ = true;
+  chunks_.clear();
+  num_buffered_bytes_ = 0;
+  cv_.notify_all();
+  cv_.wait(lock, [this] { return stream_done_; });
+}
+
+}  // namespace google::pair::matcher
@@ -0,0 +1,88 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "cc/common/blob_streamer/src/get_blob_stream_context.h"
+#include "cc/public/core/interface/execution_result.h"
+
+namespace google::pair::matcher {
+
+/**
+ * @brief Turns the chunks a BlobStreamer pushes into a blob which can be read
+ * line by line. Only a bounded number of bytes is buffered, the stream
+ * callback blocks until the reader catches up.
+ *
+ * The reader has to outlive the stream. Once the stream was started with
+ * GetCallback(), Close() must be called before the reader is destroyed.
+ *
+ */
+class BlobLineReader {
+ public:
+  /**
+   * @brief Construct a new Blob Line Reader object
+   *
+   * @param max_buffered_bytes the stream callback blocks while this many bytes
+   * are buffered. One chunk is always accepted, however large.
+   */
+  explicit BlobLineReader(uint64_t max_buffered_bytes);
+
+  /**
+   * @brief Get the callback to stream the blob in with.
+   *
+   * @return common::GetBlobStreamChunkProcessorCallback
+   */
+  common::GetBlobStreamChunkProcessorCallback GetCallback();
+
+  /**
+   * @brief Reads the next line of the blob, without its line break. The last
+   * line need not end in a line break.
+   *
+   * @param line replaced with the next line
+   * @return false if the blob ended, or the failure of the stream
+   */
+  scp::core::ExecutionResultOr<bool> NextLine(std::string& line);
+
+  /**
+   * @brief Drops the rest of the blob and waits for the stream to end.
+   *
+   */
+  void Close();
+
+ private:
+  void AddChunk(std::string_view chunk, bool is_done,
+                const scp::core::ExecutionResult& result);
+
+  const uint64_t max_buffered_bytes_;
+  std::mutex mu_;
+  // Notified when a chunk is added or taken, and when the stream ends.
+  std::condition_variable cv_;
+  std::deque<std::string> chunks_;
+  uint64_t num_buffered_bytes_ = 0;
+  bool stream_done_ = false;
+  bool closed_ = false;
+  scp::core::ExecutionResult result_ = scp::core::SuccessExecutionResult();
+  // The chunk lines are read from, only accessed by the reader.
+  std::string chunk_;
+  size_t chunk_pos_ = 0;
+};
+
+}  // namespace google::pair::matcher
@@ -0,0 +1,106 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "disk_partitions.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "absl/hash/hash.h"
+#include "absl/numeric/int128.h"
+#include "cc/common/csv_parser/src/csv_stream_parser_config.h"
+
+using google::scp::core::ExecutionResult;
+using google::scp::core::SuccessExecutionResult;
+using std::string;
+using std::string_view;
+
+namespace {
+
+// Size of the file of a partition when its first row is added. Files double
+// in size whenever they fill up.
+constexpr size_t kInitialPartitionFileSize = 64 * 1024;
+
+// The finalizer of MurmurHash3. The match tables index by absl::Hash as
+// well, so the partition is picked from remixed bits to keep the keys of a
+// partition spread over the table it is joined in.
+uint64_t Mix(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccd;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+}  // namespace
+
+namespace google::pair::matcher {
+
+DiskPartitions::DiskPartitions(string directory, size_t num_partitions)
+    : directory_(std::move(directory)), partitions_(num_partitions) {}
+
+size_t DiskPartitions::GetPartitionIndex(string_view key,
+                                         size_t num_partitions) {
+  auto hash = Mix(absl::Hash<string_view>{}(key));
+  return absl::Uint128High64(absl::uint128(hash) *
+                             absl::uint128(num_partitions));
+}
+
+ExecutionResult DiskPartitions::Add(string_view key) {
+  return Append(key, "", "");
+}
+
+ExecutionResult DiskPartitions::Add(string_view key, string_view value) {
+  static constexpr char kDelimiter[] = {kDefaultCsvRowDelimiter, '\0'};
+  return Append(key, kDelimiter, value);
+}
+
+ExecutionResult DiskPartitions::Append(string_view key, string_view delimiter,
+                                       string_view value) {
+  auto& partition =
+      partitions_[GetPartitionIndex(key, partitions_.size())];
+  auto size =
+      partition.size + key.size() + delimiter.size() + value.size() + 1;
+  if (!partition.file) {
+    ASSIGN_OR_RETURN(
+        partition.file,
+        MappedFile::Create(directory_,
+                           std::max(size, kInitialPartitionFileSize)));
+  } else if (size > partition.file->GetSize()) {
+    RETURN_IF_FAILURE(
+        partition.file->Grow(std::max(size, 2 * partition.file->GetSize())));
+  }
+  auto* data = partition.file->GetData() + partition.size;
+  data = std::copy(key.begin(), key.end(), data);
+  data = std::copy(delimiter.begin(), delimiter.end(), data);
+  data = std::copy(value.begin(), value.end(), data);
+  *data = kDefaultCsvLineBreak;
+  partition.size = size;
+  return SuccessExecutionResult();
+}
+
+string_view DiskPartitions::GetPartition(size_t index) const {
+  const auto& partition = partitions_[index];
+  if (!partition.file) {
+    return string_view();
+  }
+  return string_view(partition.file->GetData(), partition.size);
+}
+
+void DiskPartitions::Release(size_t index) {
+  partitions_[index] = Partition();
+}
+
+}  // namespace google::pair::matcher
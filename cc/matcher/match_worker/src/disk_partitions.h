@@ -0,0 +1,109 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cc/matcher/match_table/src/mapped_file.h"
+#include "cc/public/core/interface/execution_result.h"
+
+namespace google::pair::matcher {
+
+/**
+ * @brief CSV rows hash-partitioned by their first column into files on local
+ * disk, for joins whose inputs do not fit in memory. Rows with the same first
+ * column always land in the same partition, in the order they were added.
+ *
+ * Each partition is a MappedFile of whole lines, created on the first row
+ * added to it. Different partitions can be read and released concurrently,
+ * adding rows is not thread-safe.
+ *
+ */
+class DiskPartitions {
+ public:
+  /**
+   * @brief Construct a new Disk Partitions object
+   *
+   * @param directory the directory on local disk to create the files in
+   * @param num_partitions the number of partitions, at least 1
+   */
+  DiskPartitions(std::string directory, size_t num_partitions);
+
+  /**
+   * @brief Get the partition rows with the given first column go to.
+   *
+   * @param key the first column
+   * @param num_partitions the number of partitions
+   * @return size_t
+   */
+  static size_t GetPartitionIndex(std::string_view key, size_t num_partitions);
+
+  /**
+   * @brief Adds a row of one column.
+   *
+   * @param key the column, which must not hold a line break
+   * @return scp::core::ExecutionResult
+   */
+  scp::core::ExecutionResult Add(std::string_view key);
+
+  /**
+   * @brief Adds a row of two columns, separated by kDefaultCsvRowDelimiter.
+   *
+   * @param key the first column, which must not hold the delimiter or a line
+   * break, as parsed CSV columns never do
+   * @param value the second column, which must not hold a line break
+   * @return scp::core::ExecutionResult
+   */
+  scp::core::ExecutionResult Add(std::string_view key, std::string_view value);
+
+  size_t GetNumPartitions() const { return partitions_.size(); }
+
+  /**
+   * @brief Get the rows of a partition, each followed by a line break. Valid
+   * until rows are added or the partition is released.
+   *
+   * @param index the partition
+   * @return std::string_view
+   */
+  std::string_view GetPartition(size_t index) const;
+
+  /**
+   * @brief Frees the disk space of a partition once it is no longer needed.
+   *
+   * @param index the partition
+   */
+  void Release(size_t index);
+
+ private:
+  struct Partition {
+    std::unique_ptr<MappedFile> file;
+    // The number of bytes of the file written so far.
+    size_t size = 0;
+  };
+
+  // Appends the parts, followed by a line break, to the partition of key.
+  scp::core::ExecutionResult Append(std::string_view key,
+                                    std::string_view delimiter,
+                                    std::string_view value);
+
+  const std::string directory_;
+  std::vector<Partition> partitions_;
+};
+
+}  // namespace google::pair::matcher
@@ -28,4 +28,29 @@ DEFINE_ERROR_CODE(
     "The publisher mapping acquired from storage could not be parsed.",
     scp::core::errors::HttpStatusCode::BAD_REQUEST)
 
+DEFINE_ERROR_CODE(
+    MATCH_WORKER_INVALID_PREFILTER_FALSE_POSITIVE_RATE, MATCH_WORKER, 0x0002,
+    "The prefilter false positive rate must be greater than 0 and less than 1.",
+    scp::core::errors::HttpStatusCode::BAD_REQUEST)
+
+DEFINE_ERROR_CODE(
+    MATCH_WORKER_UNSORTED_PUBLISHER_MAPPING, MATCH_WORKER, 0x0003,
+    "The publisher mapping is not sorted by plaintext ID.",
+    scp::core::errors::HttpStatusCode::BAD_REQUEST)
+
+DEFINE_ERROR_CODE(
+    MATCH_WORKER_UNSORTED_ADVERTISER_LIST, MATCH_WORKER, 0x0004,
+    "The advertiser list is not sorted by plaintext ID.",
+    scp::core::errors::HttpStatusCode::BAD_REQUEST)
+
+DEFINE_ERROR_CODE(MATCH_WORKER_INVALID_NUM_JOIN_PARTITIONS, MATCH_WORKER,
+                  0x0005, "The number of join partitions must be at least 1.",
+                  scp::core::errors::HttpStatusCode::BAD_REQUEST)
+
+DEFINE_ERROR_CODE(
+    MATCH_WORKER_INVALID_BATCH, MATCH_WORKER, 0x0006,
+    "The requests of a batch must share the publisher mapping and may not "
+    "use sorted inputs, a partitioned join or concurrent download.",
+    scp::core::errors::HttpStatusCode::BAD_REQUEST)
+
 }  // namespace google::pair::matcher::errors
@@ -0,0 +1,86 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "match_table_cache.h"
+
+#include <iterator>
+#include <utility>
+
+using std::list;
+using std::lock_guard;
+using std::nullopt;
+using std::optional;
+
+namespace google::pair::matcher {
+
+MatchTableCache::MatchTableCache(uint64_t max_bytes) : max_bytes_(max_bytes) {}
+
+optional<LoadedMapping> MatchTableCache::Get(const MatchTableCacheKey& key) {
+  lock_guard lock(mu_);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    stats_.num_misses++;
+    return nullopt;
+  }
+  stats_.num_hits++;
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return it->second->mapping;
+}
+
+void MatchTableCache::Put(const MatchTableCacheKey& key, LoadedMapping mapping,
+                          uint64_t num_bytes) {
+  lock_guard lock(mu_);
+  if (auto it = index_.find(key); it != index_.end()) {
+    Erase(it->second);
+  }
+  if (num_bytes > max_bytes_) {
+    return;
+  }
+  while (stats_.num_bytes + num_bytes > max_bytes_) {
+    Erase(std::prev(entries_.end()));
+  }
+  entries_.push_front(Entry{key, std::move(mapping), num_bytes});
+  index_[key] = entries_.begin();
+  stats_.num_entries++;
+  stats_.num_bytes += num_bytes;
+}
+
+void MatchTableCache::MakeRoomToLoad(const MatchTableCacheKey& key) {
+  lock_guard lock(mu_);
+  if (index_.contains(key)) {
+    return;
+  }
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    auto next = std::next(it);
+    if (it->key.bucket == key.bucket && it->key.name == key.name &&
+        it->key.version != key.version) {
+      Erase(it);
+    }
+    it = next;
+  }
+}
+
+MatchTableCacheStats MatchTableCache::GetStats() const {
+  lock_guard lock(mu_);
+  return stats_;
+}
+
+void MatchTableCache::Erase(list<Entry>::iterator it) {
+  stats_.num_entries--;
+  stats_.num_bytes -= it->num_bytes;
+  index_.erase(it->key);
+  entries_.erase(it);
+}
+
+}  // namespace google::pair::matcher
@@ -0,0 +1,153 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "cc/matcher/match_table/src/blocked_bloom_filter.h"
+#include "cc/matcher/match_table/src/match_table.h"
+
+namespace google::pair::matcher {
+
+/**
+ * @brief A publisher mapping loaded into a frozen match table.
+ *
+ */
+struct LoadedMapping {
+  std::shared_ptr<MatchTable<std::string, std::string>> match_table;
+  // Only set if the mapping was loaded with a prefilter.
+  std::shared_ptr<const BlockedBloomFilter> prefilter;
+};
+
+/**
+ * @brief Identifies a version of a publisher mapping, loaded with a given
+ * prefilter.
+ *
+ */
+struct MatchTableCacheKey {
+  std::string bucket;
+  std::string name;
+  // The version of the blob, such as its generation or etag. A blob which is
+  // overwritten must get a new version.
+  std::string version;
+  std::optional<double> prefilter_false_positive_rate;
+
+  bool operator==(const MatchTableCacheKey& other) const {
+    return bucket == other.bucket && name == other.name &&
+           version == other.version &&
+           prefilter_false_positive_rate ==
+               other.prefilter_false_positive_rate;
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H h, const MatchTableCacheKey& key) {
+    return H::combine(std::move(h), key.bucket, key.name, key.version,
+                      key.prefilter_false_positive_rate);
+  }
+};
+
+/**
+ * @brief Statistics of a MatchTableCache since it was created.
+ *
+ */
+struct MatchTableCacheStats {
+  uint64_t num_hits = 0;
+  uint64_t num_misses = 0;
+  // The number of mappings cached right now.
+  uint64_t num_entries = 0;
+  // The memory used by the mappings cached right now.
+  uint64_t num_bytes = 0;
+};
+
+/**
+ * @brief Least recently used cache of loaded publisher mappings, so that jobs
+ * against a mapping which was loaded before skip downloading and loading it.
+ * The cached match tables are frozen, so any number of jobs can match against
+ * them at once. A mapping evicted while in use stays alive until the jobs
+ * using it are done.
+ *
+ * All methods are thread-safe.
+ *
+ */
+class MatchTableCache {
+ public:
+  /**
+   * @brief Construct a new Match Table Cache object
+   *
+   * @param max_bytes the memory the cached mappings may use in total
+   */
+  explicit MatchTableCache(uint64_t max_bytes);
+
+  /**
+   * @brief Get a cached mapping, marking it as the most recently used.
+   *
+   * @param key
+   * @return std::optional<LoadedMapping> the mapping, if cached
+   */
+  std::optional<LoadedMapping> Get(const MatchTableCacheKey& key);
+
+  /**
+   * @brief Caches a mapping, evicting the least recently used ones as needed
+   * to stay within the memory limit. Mappings larger than the limit are not
+   * cached.
+   *
+   * @param key
+   * @param mapping a mapping with a frozen match table
+   * @param num_bytes the memory the mapping's match table and prefilter use,
+   * which counts against the limit
+   */
+  void Put(const MatchTableCacheKey& key, LoadedMapping mapping,
+           uint64_t num_bytes);
+
+  /**
+   * @brief Makes room for loading the mapping for key, unless it is cached, by
+   * evicting the other versions of the same mapping. They are not used once a
+   * new version is loaded, and evicting them first means the new version does
+   * not stream in while the one it replaces is still held. Mappings of other
+   * blobs stay cached, so while the mapping loads, it and the cached mappings
+   * together may exceed the limit until Put evicts down to it. Call this
+   * before loading the mapping.
+   *
+   * @param key
+   */
+  void MakeRoomToLoad(const MatchTableCacheKey& key);
+
+  MatchTableCacheStats GetStats() const;
+
+ private:
+  struct Entry {
+    MatchTableCacheKey key;
+    LoadedMapping mapping;
+    uint64_t num_bytes;
+  };
+
+  // Removes the entry at it.
+  void Erase(std::list<Entry>::iterator it);
+
+  const uint64_t max_bytes_;
+  mutable std::mutex mu_;
+  // The most recently used entry first.
+  std::list<Entry> entries_;
+  absl::flat_hash_map<MatchTableCacheKey, std::list<Entry>::iterator> index_;
+  MatchTableCacheStats stats_;
+};
+
+}  // namespace google::pair::matcher
@@ -14,35 +14,63 @@
 
 #include "match_worker.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+
 #include "absl/strings/str_cat.h"
 #include "cc/common/blob_streamer/src/get_blob_stream_context.h"
+#include "cc/common/csv_parser/src/csv_row_view.h"
 #include "cc/common/csv_parser/src/csv_stream_parser.h"
-#include "cc/matcher/match_table/src/match_table_hash_map.h"
+#include "cc/common/csv_parser/src/csv_stream_parser_config.h"
+#include "cc/matcher/match_worker/src/blob_line_reader.h"
+#include "cc/matcher/match_worker/src/disk_partitions.h"
+#include "cc/matcher/match_table/src/error_codes.h"
+#include "cc/matcher/match_table/src/hashed_id_match_table.h"
+#include "cc/matcher/match_table/src/mapped_file.h"
+#include "cc/matcher/match_table/src/mmap_match_table.h"
+#include "cc/matcher/match_table/src/open_addressing_match_table.h"
 #include "cc/publisher_list_generator/proto/publisher_pair_list.pb.h"
 
 #include "error_codes.h"
 
-using google::cmrt::sdk::blob_storage_service::v1::GetBlobRequest;
-using google::cmrt::sdk::blob_storage_service::v1::GetBlobResponse;
 using google::pair::common::BlobStreamerInterface;
+using google::pair::common::CsvRowView;
 using google::pair::common::CsvStreamParser;
 using google::pair::common::CsvStreamParserConfig;
 using google::pair::common::GetBlobStreamContext;
 using google::pair::common::PutBlobCallback;
 using google::pair::common::PutBlobStreamContext;
 using google::pair::common::PutBlobStreamDoneMarker;
+using google::pair::matcher::DetectHashedIdEncoding;
+using google::pair::matcher::HashedIdMatchTable;
+using google::pair::matcher::IsUuid;
+using google::pair::matcher::MappedFile;
+using google::pair::matcher::MatchedBitset;
+using google::pair::matcher::MatchTable;
+using google::pair::matcher::MmapMatchTable;
+using google::pair::matcher::OpenAddressingMatchTable;
 using google::scp::core::AsyncContext;
+using google::scp::core::AsyncExecutorInterface;
+using google::scp::core::AsyncPriority;
 using google::scp::core::ExecutionResult;
 using google::scp::core::ExecutionResultOr;
 using google::scp::core::FailureExecutionResult;
 using google::scp::core::SuccessExecutionResult;
 using google::scp::cpio::BlobStorageClientInterface;
-using std::atomic_bool;
+using std::condition_variable;
 using std::function;
+using std::make_shared;
 using std::make_unique;
+using std::map;
 using std::move;
+using std::mutex;
+using std::optional;
 using std::shared_ptr;
 using std::string;
+using std::string_view;
+using std::unique_lock;
 using std::unique_ptr;
 using std::vector;
 
@@ -52,6 +80,22 @@ constexpr char kMatchWorker[] = "MatchWorker";
 constexpr size_t kNumPublisherCsvColumns = 2;
 constexpr size_t kNumAdvertiserCsvColumns = 1;
 constexpr size_t kBytesPerResponse = 80 * 1024 * 1024;
+// Number of publisher mapping rows taken from the CSV parser at once.
+constexpr size_t kMappingRowBatchSize = 1024;
+// Number of advertiser IDs looked up in the match table at once.
+constexpr size_t kMarkMatchedBatchSize = 1024;
+// Number of publisher mapping rows added to the match table at once.
+constexpr size_t kBulkLoadBatchSize = 64 * 1024;
+// The advertiser list is split into blocks of whole lines of about this size,
+// each of which is matched by one task.
+constexpr size_t kMatchBlockSizeBytes = 1024 * 1024;
+// Maximum number of blocks split off but not yet uploaded. This bounds the
+// memory the match pipeline holds on to when matching or uploading can't keep
+// up with the download.
+constexpr uint64_t kMaxMatchBlocksInFlight = 64;
+// Upper bound on the memory reserved for the upload buffer up front, so large
+// flush sizes only take the memory the matches need.
+constexpr uint64_t kMaxUploadBufferReserveBytes = 64 * 1024 * 1024;
 
 // Forwards result to add_chunk_functor, indicating to the BlobStreamer that we
 // should cancel the upload. This is only done if the upload has started i.e.
@@ -63,133 +107,1157 @@ void CancelUploadIfStarted(PutBlobCallback& add_chunk_functor,
   }
 }
 
+// Picks the match table implementation based on the first row of the
+// publisher mapping. Mappings from hashed IDs to UUIDs use the compact
+// HashedIdMatchTable, anything else uses a string-keyed
+// OpenAddressingMatchTable.
+unique_ptr<MatchTable<string, string>> CreateMatchTable(
+    const string& plaintext_id, const string& encrypted_id) {
+  bool uppercase_values;
+  if (auto encoding = DetectHashedIdEncoding(plaintext_id);
+      encoding && IsUuid(encrypted_id, uppercase_values)) {
+    return make_unique<HashedIdMatchTable>(*encoding, uppercase_values);
+  }
+  return make_unique<OpenAddressingMatchTable<string, string>>();
+}
+
+// Marks a batch of advertiser IDs as matched and appends the encrypted IDs of
+// those which match, each followed by a line break, to matched.matched_ids.
+// Unless mode is kExportAll, IDs whose row was already matched are counted,
+// and with kExportOnce left out. Rows count as matched in matched_bits, if
+// not null, rather than in the table, so that lists sharing a table each find
+// their own duplicates.
+template <typename Matched>
+void MatchBatch(MatchTable<string, string>& table,
+                absl::Span<const string> plaintext_ids,
+                google::pair::matcher::DuplicateMatchMode mode,
+                MatchedBitset* matched_bits, Matched& matched) {
+  using google::pair::matcher::DuplicateMatchMode;
+  bool find_duplicates = mode != DuplicateMatchMode::kExportAll;
+  vector<optional<string>> encrypted_ids;
+  vector<bool> newly_matched;
+  if (find_duplicates && matched_bits) {
+    vector<size_t> element_indices;
+    matched.result = table.MarkMatchedBatchWithIndices(
+        plaintext_ids, &encrypted_ids, &element_indices);
+    if (!matched.result.Successful()) {
+      return;
+    }
+    newly_matched.assign(encrypted_ids.size(), false);
+    for (size_t i = 0; i < encrypted_ids.size(); i++) {
+      if (encrypted_ids[i].has_value()) {
+        newly_matched[i] = matched_bits->Set(element_indices[i]);
+      }
+    }
+  } else {
+    table.MarkMatchedBatch(plaintext_ids, &encrypted_ids,
+                           find_duplicates ? &newly_matched : nullptr);
+  }
+  for (size_t i = 0; i < encrypted_ids.size(); i++) {
+    if (!encrypted_ids[i].has_value()) {
+      continue;
+    }
+    if (find_duplicates && !newly_matched[i]) {
+      matched.num_duplicate_matches++;
+      if (mode == DuplicateMatchMode::kExportOnce) {
+        continue;
+      }
+    }
+    absl::StrAppend(&matched.matched_ids, *encrypted_ids[i], "\n");
+    matched.num_matched++;
+  }
+}
+
 }  // namespace
 
 namespace google::pair::matcher {
 
 MatchWorker::MatchWorker(
     shared_ptr<BlobStorageClientInterface> blob_storage_client,
-    unique_ptr<BlobStreamerInterface> blob_streamer)
+    unique_ptr<BlobStreamerInterface> blob_streamer,
+    string on_disk_match_table_directory,
+    shared_ptr<AsyncExecutorInterface> cpu_async_executor,
+    shared_ptr<MatchTableCache> match_table_cache)
     : blob_storage_client_(move(blob_storage_client)),
-      blob_streamer_(move(blob_streamer)) {}
+      blob_streamer_(move(blob_streamer)),
+      on_disk_match_table_directory_(move(on_disk_match_table_directory)),
+      cpu_async_executor_(move(cpu_async_executor)),
+      match_table_cache_(move(match_table_cache)) {}
 
-ExecutionResult MatchWorker::ParseBlobResponseIntoMatchTable(
-    const string& blob_response) {
-  // Parse the blob_response as a CSV where each row is a comma separated
-  // key-value pairing.
-  CsvStreamParser csv_parser{CsvStreamParserConfig(
+// State of streaming the publisher mapping into the match table.
+struct MappingLoad {
+  mutex mu;
+  // Notified when the stream ends.
+  condition_variable cv;
+  bool stream_done = false;
+  // The first failure of the stream or of loading it.
+  ExecutionResult result = SuccessExecutionResult();
+  // The members below are only accessed by the stream callback, which is
+  // never called concurrently, until the stream ends.
+  // Splits the chunks into rows. A last row without a line break is never
+  // taken.
+  CsvStreamParser parser{CsvStreamParserConfig(
       kNumPublisherCsvColumns, /* remove_whitespace */ true,
-      /* delimiter */ kDefaultCsvRowDelimiter,
-      /* line_break */ kDefaultCsvLineBreak,
-      /* max_buffered_data_size */
-      kMaxCsvStreamParserBufferedDataSizeBytes)};
-  RETURN_IF_FAILURE(csv_parser.AddCsvChunk(blob_response));
-  while (csv_parser.HasRow()) {
-    ASSIGN_OR_RETURN(auto row, csv_parser.GetNextRow());
-    ASSIGN_OR_RETURN(auto plaintext_id, row.GetColumn(0));
-    ASSIGN_OR_RETURN(auto encrypted_id, row.GetColumn(1));
-    RETURN_IF_FAILURE(match_table_->AddElement(plaintext_id, encrypted_id));
+      kDefaultCsvRowDelimiter, kDefaultCsvLineBreak,
+      kMaxCsvStreamParserBufferedDataSizeBytes, /* zero_copy */ true,
+      /* simd_scan */ true)};
+  vector<CsvRowView> row_views;
+  uint64_t num_bytes = 0;
+  // Rows not loaded into the match table yet.
+  vector<std::pair<string, string>> rows;
+  vector<string> duplicate_ids;
+  // Hashes of the plaintext IDs. The prefilter is built from these once the
+  // number of rows, which it is sized by, is known.
+  vector<uint64_t> prefilter_hashes;
+};
+
+ExecutionResult MatchWorker::AddMappingChunk(
+    MappingLoad& load, string_view chunk, const ExportMatchesRequest& request) {
+  load.num_bytes += chunk.size();
+  RETURN_IF_FAILURE(load.parser.AddCsvChunk(chunk));
+  while (load.parser.HasRow()) {
+    load.row_views.clear();
+    // The rows before a bad one are still taken, so they are added before
+    // its failure is returned.
+    auto rows_result =
+        load.parser.GetNextRowViews(kMappingRowBatchSize, &load.row_views);
+    for (const auto& row : load.row_views) {
+      // Each row is a comma separated key-value pairing.
+      ASSIGN_OR_RETURN(auto plaintext_id_view, row.GetColumnView(0));
+      ASSIGN_OR_RETURN(auto encrypted_id_view, row.GetColumnView(1));
+      string plaintext_id(plaintext_id_view);
+      string encrypted_id(encrypted_id_view);
+      if (mapping_partitions_) {
+        RETURN_IF_FAILURE(
+            mapping_partitions_->Add(plaintext_id, encrypted_id));
+        continue;
+      }
+      // Unless the mapping may go to disk, which is only known once enough
+      // of it is streamed, pick the table as soon as the first row is in.
+      if (!match_table_ && !request.on_disk_match_table_threshold_bytes &&
+          !request.join_memory_budget_bytes) {
+        match_table_ = CreateMatchTable(plaintext_id, encrypted_id);
+        // Size the table up front rather than rehashing as it fills. The
+        // stream does not tell the size of the mapping, so estimate its rows
+        // from what is streamed so far, which is all of it unless it spans
+        // more than one chunk, and the size of this row with its delimiter
+        // and line break.
+        match_table_->Reserve(load.num_bytes /
+                              (plaintext_id.size() + encrypted_id.size() + 2));
+      }
+      if (request.prefilter_false_positive_rate) {
+        load.prefilter_hashes.push_back(
+            BlockedBloomFilter::Hash(plaintext_id));
+      }
+      load.rows.emplace_back(move(plaintext_id), move(encrypted_id));
+      if (match_table_ && load.rows.size() >= kBulkLoadBatchSize) {
+        RETURN_IF_FAILURE(
+            match_table_->BulkLoad(move(load.rows), &load.duplicate_ids));
+        load.rows.clear();
+      }
+    }
+    RETURN_IF_FAILURE(rows_result);
+  }
+  if (request.join_memory_budget_bytes) {
+    // Mappings over the budget are partitioned on disk rather than loaded.
+    // Until then the rows are held back, at most the budget's worth.
+    if (!mapping_partitions_ &&
+        load.num_bytes > *request.join_memory_budget_bytes) {
+      mapping_partitions_ = make_unique<DiskPartitions>(
+          on_disk_match_table_directory_,
+          request.num_join_partitions.value_or(kDefaultNumJoinPartitions));
+      for (const auto& [plaintext_id, encrypted_id] : load.rows) {
+        RETURN_IF_FAILURE(mapping_partitions_->Add(plaintext_id, encrypted_id));
+      }
+      load.rows = vector<std::pair<string, string>>();
+      load.prefilter_hashes = vector<uint64_t>();
+    }
+    return SuccessExecutionResult();
+  }
+  // Mappings which may not fit in RAM go to disk, whatever their IDs look
+  // like. Until then the rows are held back, at most the threshold's worth.
+  if (!match_table_ && request.on_disk_match_table_threshold_bytes &&
+      load.num_bytes > *request.on_disk_match_table_threshold_bytes) {
+    ASSIGN_OR_RETURN(match_table_,
+                     MmapMatchTable::Create(on_disk_match_table_directory_));
+    stats_.used_on_disk_match_table = true;
   }
   return SuccessExecutionResult();
 }
 
-ExecutionResult MatchWorker::GetExistingRows(
-    const ExportMatchesRequest& request, CsvStreamParser& csv_parser,
-    PutBlobCallback& add_chunk_functor) {
-  while (csv_parser.HasRow()) {
-    auto row_or = csv_parser.GetNextRow();
-    if (!row_or.Successful()) {
-      CancelUploadIfStarted(add_chunk_functor, row_or.result());
-      return row_or.result();
+ExecutionResult MatchWorker::FinishMappingLoad(
+    MappingLoad& load, const ExportMatchesRequest& request) {
+  if (mapping_partitions_) {
+    // The partitions are loaded one at a time once the advertiser list is
+    // partitioned as well.
+    return SuccessExecutionResult();
+  }
+  if (!match_table_) {
+    if (load.rows.empty()) {
+      match_table_ = make_unique<OpenAddressingMatchTable<string, string>>();
+    } else {
+      match_table_ =
+          CreateMatchTable(load.rows.front().first, load.rows.front().second);
+      // All rows were held back, so the table can be sized up front.
+      match_table_->Reserve(load.rows.size());
     }
-    auto plaintext_id_or = row_or->GetColumn(0);
-    if (!plaintext_id_or.Successful()) {
-      CancelUploadIfStarted(add_chunk_functor, plaintext_id_or.result());
-      return plaintext_id_or.result();
-    }
-    // Mark the row as matched and get the corresponding encrypted ID for it
-    // so we can add it to the upload.
-    auto encrypted_id_or = match_table_->MarkMatched(*plaintext_id_or);
-    // If it matched.
-    if (encrypted_id_or.has_value()) {
-      // If the upload stream hasn't been initiated yet, initiate it.
-      if (!add_chunk_functor) {
-        PutBlobStreamContext put_blob_context(
-            request.output_bucket, request.matched_ids_name,
-            absl::StrCat(encrypted_id_or.release(), "\n"),
-            request.publisher_cloud_identity_info);
-        ASSIGN_OR_RETURN(add_chunk_functor,
-                         blob_streamer_->PutBlobStream(put_blob_context));
-      } else {
-        RETURN_IF_FAILURE(
-            add_chunk_functor(absl::StrCat(encrypted_id_or.release(), "\n")));
-      }
+  }
+  RETURN_IF_FAILURE(
+      match_table_->BulkLoad(move(load.rows), &load.duplicate_ids));
+  // Duplicates are reported once the whole mapping is loaded, so the stats
+  // count all of them rather than just the first.
+  stats_.num_duplicate_publisher_ids = load.duplicate_ids.size();
+  if (!load.duplicate_ids.empty()) {
+    return FailureExecutionResult(errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS);
+  }
+  if (request.prefilter_false_positive_rate) {
+    auto prefilter = make_shared<BlockedBloomFilter>(
+        load.prefilter_hashes.size(), *request.prefilter_false_positive_rate);
+    for (auto hash : load.prefilter_hashes) {
+      prefilter->AddHash(hash);
     }
+    prefilter_ = move(prefilter);
   }
+  // The mapping is fully loaded, so lookups no longer need to lock.
+  match_table_->Freeze();
   return SuccessExecutionResult();
 }
 
-ExecutionResult MatchWorker::ExportMatches(
+ExecutionResult MatchWorker::LoadPublisherMapping(
     const ExportMatchesRequest& request) {
-  match_table_ = make_unique<MatchTableHashMap<string, string>>();
-  // Acquire Pub mapping - blob_storage
-  GetBlobRequest get_blob_request;
-  get_blob_request.mutable_blob_metadata()->set_bucket_name(
-      request.publisher_mapping_bucket);
-  get_blob_request.mutable_blob_metadata()->set_blob_name(
-      request.publisher_mapping_name);
-  if (request.publisher_cloud_identity_info) {
-    *get_blob_request.mutable_cloud_identity_info() =
-        move(*request.publisher_cloud_identity_info);
-  }
-  ASSIGN_OR_RETURN(auto get_blob_response,
-                   blob_storage_client_->GetBlobSync(get_blob_request));
-  // Parse the mapping
-  RETURN_IF_FAILURE(
-      ParseBlobResponseIntoMatchTable(get_blob_response.blob().data()));
-  // Stream Adv list
-  CsvStreamParser csv_parser{CsvStreamParserConfig(
-      kNumAdvertiserCsvColumns, /* remove_whitespace */ true,
-      /* delimiter */ kDefaultCsvRowDelimiter,
-      /* line_break */ kDefaultCsvLineBreak,
-      /* max_buffered_data_size */
-      kMaxCsvStreamParserBufferedDataSizeBytes)};
-  atomic_bool all_advertiser_ids_received(false);
-  ExecutionResult get_stream_result;
+  match_table_.reset();
+  mapping_partitions_.reset();
+  prefilter_.reset();
+  optional<MatchTableCacheKey> cache_key;
+  // Duplicates are found through matched state kept per advertiser list, not
+  // through the table's own, so every request can share a cached table.
+  if (match_table_cache_ && request.publisher_mapping_version) {
+    cache_key = MatchTableCacheKey{request.publisher_mapping_bucket,
+                                   request.publisher_mapping_name,
+                                   *request.publisher_mapping_version,
+                                   request.prefilter_false_positive_rate};
+    if (auto mapping = match_table_cache_->Get(*cache_key); mapping) {
+      match_table_ = move(mapping->match_table);
+      prefilter_ = move(mapping->prefilter);
+      stats_.used_cached_match_table = true;
+      return SuccessExecutionResult();
+    }
+    // Do not hold on to an older version while this one streams in.
+    match_table_cache_->MakeRoomToLoad(*cache_key);
+  }
+  // The mapping is parsed and loaded as it streams in, so it is never held in
+  // memory next to the match table.
+  MappingLoad load;
   RETURN_IF_FAILURE(blob_streamer_->GetBlobStream(GetBlobStreamContext(
-      request.advertiser_list_bucket, request.advertiser_list_name,
+      request.publisher_mapping_bucket, request.publisher_mapping_name,
       kBytesPerResponse,
-      [&csv_parser, &get_stream_result, &all_advertiser_ids_received](
-          auto chunk, bool is_done, const auto& result) {
-        if (is_done) {
-          // Do not overwrite get_stream_result if it has an error
-          if (!get_stream_result.Successful()) {
-            get_stream_result = result;
-          }
-          all_advertiser_ids_received = true;
-        } else {
-          // Forward the chunks to the CSV parser.
-          auto add_chunk_result = csv_parser.AddCsvChunk(chunk);
-          if (!add_chunk_result.Successful()) {
-            get_stream_result = add_chunk_result;
+      [this, &load, &request](auto chunk, bool is_done, const auto& result) {
+        if (!is_done) {
+          // Once loading failed, the rest of the mapping is dropped.
+          if (load.result.Successful()) {
+            load.result = AddMappingChunk(load, chunk, request);
           }
+          return;
+        }
+        unique_lock lock(load.mu);
+        // Do not overwrite an earlier error.
+        if (!result.Successful() && load.result.Successful()) {
+          load.result = result;
         }
+        load.stream_done = true;
+        load.cv.notify_all();
       },
-      request.advertiser_cloud_identity_info)));
+      request.publisher_cloud_identity_info)));
+  // The stream callback references the load, so wait for the stream to end
+  // even if loading already failed.
+  unique_lock lock(load.mu);
+  load.cv.wait(lock, [&load] { return load.stream_done; });
+  RETURN_IF_FAILURE(load.result);
+  RETURN_IF_FAILURE(FinishMappingLoad(load, request));
+  // On-disk tables would not count against the cache's memory, and
+  // partitions only live for the request.
+  if (cache_key && match_table_ && !stats_.used_on_disk_match_table) {
+    // The mapping is counted by the memory its table uses, which is several
+    // times the bytes streamed for it. The tables the worker loads count the
+    // memory of their elements as they are added, so this does not walk them.
+    uint64_t num_bytes = match_table_->GetMemoryUsageBytes();
+    if (prefilter_) {
+      num_bytes += prefilter_->GetMemoryUsageBytes();
+    }
+    match_table_cache_->Put(*cache_key,
+                            LoadedMapping{match_table_, prefilter_},
+                            num_bytes);
+  }
+  return SuccessExecutionResult();
+}
+
+namespace {
+
+// Checks the options of a request which do not depend on the inputs.
+ExecutionResult ValidateRequest(const ExportMatchesRequest& request) {
+  if (request.prefilter_false_positive_rate &&
+      (*request.prefilter_false_positive_rate <= 0 ||
+       *request.prefilter_false_positive_rate >= 1)) {
+    return FailureExecutionResult(
+        errors::MATCH_WORKER_INVALID_PREFILTER_FALSE_POSITIVE_RATE);
+  }
+  if (request.num_join_partitions && *request.num_join_partitions == 0) {
+    return FailureExecutionResult(
+        errors::MATCH_WORKER_INVALID_NUM_JOIN_PARTITIONS);
+  }
+  return SuccessExecutionResult();
+}
+
+// Checks that the requests of a batch can share one match table.
+ExecutionResult ValidateBatch(const vector<ExportMatchesRequest>& requests,
+                              size_t max_concurrent_lists) {
+  if (max_concurrent_lists == 0) {
+    return FailureExecutionResult(errors::MATCH_WORKER_INVALID_BATCH);
+  }
+  for (const auto& request : requests) {
+    RETURN_IF_FAILURE(ValidateRequest(request));
+    if (request.publisher_mapping_bucket !=
+            requests.front().publisher_mapping_bucket ||
+        request.publisher_mapping_name !=
+            requests.front().publisher_mapping_name ||
+        request.sorted_inputs || request.join_memory_budget_bytes ||
+        request.concurrent_download_buffer_bytes) {
+      return FailureExecutionResult(errors::MATCH_WORKER_INVALID_BATCH);
+    }
+  }
+  return SuccessExecutionResult();
+}
+
+}  // namespace
+
+// The result of parsing and matching one block of the advertiser list.
+struct MatchedBlock {
+  ExecutionResult result = SuccessExecutionResult();
+  // The encrypted IDs of the matched rows, each followed by a line break.
+  string matched_ids;
+  uint64_t num_prefilter_hits = 0;
+  uint64_t num_prefilter_misses = 0;
+  uint64_t num_matched = 0;
+  uint64_t num_duplicate_matches = 0;
+};
+
+// The upload of the matched IDs.
+struct MatchUpload {
+  // Matched IDs which are not pushed to the upload yet.
+  string buffer;
+  // Set once the upload is started.
   PutBlobCallback add_chunk_functor;
-  // Loop through CSV parser and mark rows as matched - adding them to the
+};
+
+// State shared by the stages of matching the advertiser list.
+struct MatchPipeline {
+  explicit MatchPipeline(ExportMatchesStats& stats) : stats(stats) {}
+
+  // The stats of the export the advertiser list belongs to. Only the uploading
+  // thread and the stream callback update them.
+  ExportMatchesStats& stats;
+  mutex mu;
+  // Notified whenever a block is uploaded or the stream ends.
+  condition_variable cv;
+  // The first failure of any stage.
+  ExecutionResult result = SuccessExecutionResult();
+  // Whether the stream called back with is_done.
+  bool stream_ended = false;
+  // Whether all of the advertiser list was handed to SplitChunk.
+  bool stream_done = false;
+  // Whether chunks are held back until the match table is ready, see
+  // ExportMatchesRequest::concurrent_download_buffer_bytes. Whoever clears
+  // this releases the held back chunks.
+  bool holding_back = false;
+  bool table_ready = false;
+  // The chunks held back in memory, up to the buffer size.
+  string held_back;
+  // The chunks held back after the buffer filled up, spilled to local disk.
+  unique_ptr<MappedFile> spilled;
+  uint64_t num_spilled_bytes = 0;
+  // The incomplete last line of the chunks split so far. Chunks are never
+  // split concurrently.
+  string partial_line;
+  // Index of the next block to be split off.
+  uint64_t next_block = 0;
+  // Index of the next block to be uploaded.
+  uint64_t next_upload = 0;
+  // Matched blocks waiting for the blocks before them to be uploaded.
+  map<uint64_t, MatchedBlock> matched_blocks;
+  // Whether a thread is uploading matched blocks. Only that thread accesses
   // upload.
-  while (!all_advertiser_ids_received) {
-    RETURN_IF_FAILURE(GetExistingRows(request, csv_parser, add_chunk_functor));
+  bool uploading = false;
+  MatchUpload upload;
+  // The advertiser list download, kept to cancel it.
+  optional<GetBlobStreamContext> download;
+  // The rows of the match table matched by this list, unless duplicates are
+  // not looked for. The table may be shared with other lists, so its own
+  // matched state does not tell this list's duplicates.
+  MatchedBitset matched_bits;
+};
+
+namespace {
+
+// Gives the list a matched flag for every row of the match table, once the
+// table is ready and before any block of the list is matched.
+void InitMatchedBits(MatchPipeline& pipeline,
+                     const MatchTable<string, string>& table,
+                     const ExportMatchesRequest& request) {
+  if (request.duplicate_match_mode != DuplicateMatchMode::kExportAll) {
+    pipeline.matched_bits.Resize(table.GetNumElementIndices());
+  }
+}
+
+}  // namespace
+
+ExecutionResult MatchWorker::StreamAdvertiserList(
+    MatchPipeline& pipeline, const ExportMatchesRequest& request) {
+  pipeline.download.emplace(
+      request.advertiser_list_bucket, request.advertiser_list_name,
+      kBytesPerResponse,
+      [this, &pipeline, &request](auto chunk, bool is_done,
+                                  const auto& result) {
+        if (!is_done) {
+          AddAdvertiserChunk(pipeline, chunk, request);
+          return;
+        }
+        unique_lock lock(pipeline.mu);
+        // Do not overwrite an earlier error.
+        if (!result.Successful() && pipeline.result.Successful()) {
+          pipeline.result = result;
+        }
+        pipeline.stream_ended = true;
+        pipeline.cv.notify_all();
+        if (pipeline.holding_back) {
+          if (!pipeline.table_ready) {
+            // Released by ExportMatches once the table is ready.
+            return;
+          }
+          pipeline.holding_back = false;
+          lock.unlock();
+          ReleaseHeldBackChunks(pipeline, request);
+          lock.lock();
+        }
+        pipeline.stream_done = true;
+        pipeline.cv.notify_all();
+      },
+      request.advertiser_cloud_identity_info);
+  return blob_streamer_->GetBlobStream(*pipeline.download);
+}
+
+void MatchWorker::AddAdvertiserChunk(MatchPipeline& pipeline,
+                                     string_view chunk,
+                                     const ExportMatchesRequest& request) {
+  unique_lock lock(pipeline.mu);
+  if (pipeline.holding_back) {
+    if (!pipeline.table_ready) {
+      // Once the export has failed, the rest of the list is dropped.
+      if (pipeline.result.Successful()) {
+        pipeline.result = HoldBackChunk(pipeline, chunk, request);
+        if (!pipeline.result.Successful()) {
+          pipeline.download->TryCancel();
+        }
+      }
+      return;
+    }
+    // The chunks held back come before this one.
+    pipeline.holding_back = false;
+    lock.unlock();
+    ReleaseHeldBackChunks(pipeline, request);
+  } else {
+    lock.unlock();
+  }
+  SplitChunk(pipeline, chunk, request);
+}
+
+ExecutionResult MatchWorker::HoldBackChunk(
+    MatchPipeline& pipeline, string_view chunk,
+    const ExportMatchesRequest& request) {
+  if (!pipeline.spilled && pipeline.held_back.size() + chunk.size() <=
+                               *request.concurrent_download_buffer_bytes) {
+    pipeline.held_back.append(chunk);
+    return SuccessExecutionResult();
   }
-  if (!get_stream_result.Successful()) {
-    CancelUploadIfStarted(add_chunk_functor, get_stream_result);
-    return get_stream_result;
+  // Once the buffer is full, the rest of the list goes to disk.
+  auto num_spilled_bytes = pipeline.num_spilled_bytes + chunk.size();
+  if (!pipeline.spilled) {
+    ASSIGN_OR_RETURN(
+        pipeline.spilled,
+        MappedFile::Create(on_disk_match_table_directory_,
+                           std::max<size_t>(num_spilled_bytes, 1)));
+  } else if (num_spilled_bytes > pipeline.spilled->GetSize()) {
+    RETURN_IF_FAILURE(pipeline.spilled->Grow(
+        std::max(num_spilled_bytes, 2 * pipeline.spilled->GetSize())));
+  }
+  std::copy(chunk.begin(), chunk.end(),
+            pipeline.spilled->GetData() + pipeline.num_spilled_bytes);
+  pipeline.num_spilled_bytes = num_spilled_bytes;
+  return SuccessExecutionResult();
+}
+
+void MatchWorker::ReleaseHeldBackChunks(MatchPipeline& pipeline,
+                                        const ExportMatchesRequest& request) {
+  pipeline.stats.num_advertiser_bytes_spilled = pipeline.num_spilled_bytes;
+  SplitChunk(pipeline, pipeline.held_back, request);
+  string().swap(pipeline.held_back);
+  if (pipeline.spilled) {
+    SplitChunk(pipeline,
+               string_view(pipeline.spilled->GetData(),
+                           pipeline.num_spilled_bytes),
+               request);
+    pipeline.spilled.reset();
+  }
+}
+
+void MatchWorker::SplitChunk(MatchPipeline& pipeline, string_view chunk,
+                             const ExportMatchesRequest& request) {
+  size_t begin = 0;
+  while (begin < chunk.size()) {
+    // Cut at the last line break within the block size, or after the first
+    // line if that alone is longer.
+    auto end = chunk.rfind(kDefaultCsvLineBreak,
+                           begin + kMatchBlockSizeBytes - 1);
+    if (end == string_view::npos || end < begin) {
+      end = chunk.find(kDefaultCsvLineBreak, begin);
+    }
+    if (end == string_view::npos) {
+      pipeline.partial_line.append(chunk.substr(begin));
+      return;
+    }
+    auto block = make_shared<string>(move(pipeline.partial_line));
+    block->append(chunk.substr(begin, end + 1 - begin));
+    pipeline.partial_line.clear();
+    begin = end + 1;
+    if (!ScheduleBlock(pipeline, move(block), request)) {
+      return;
+    }
+  }
+}
+
+bool MatchWorker::ScheduleBlock(MatchPipeline& pipeline,
+                                shared_ptr<const string> block,
+                                const ExportMatchesRequest& request) {
+  uint64_t block_index;
+  {
+    unique_lock lock(pipeline.mu);
+    pipeline.cv.wait(lock, [&pipeline] {
+      return !pipeline.result.Successful() ||
+             pipeline.next_block - pipeline.next_upload <
+                 kMaxMatchBlocksInFlight;
+    });
+    if (!pipeline.result.Successful()) {
+      return false;
+    }
+    block_index = pipeline.next_block++;
+  }
+  if (!cpu_async_executor_) {
+    FinishBlock(pipeline, block_index,
+                MatchBlock(*block, pipeline.matched_bits, request), request);
+    return true;
+  }
+  auto schedule_result = cpu_async_executor_->Schedule(
+      [this, &pipeline, &request, block_index, block = move(block)] {
+        FinishBlock(pipeline, block_index,
+                    MatchBlock(*block, pipeline.matched_bits, request),
+                    request);
+      },
+      AsyncPriority::Normal);
+  if (!schedule_result.Successful()) {
+    MatchedBlock failed_block;
+    failed_block.result = schedule_result;
+    FinishBlock(pipeline, block_index, move(failed_block), request);
+  }
+  return true;
+}
+
+MatchedBlock MatchWorker::MatchBlock(
+    const string& block, MatchedBitset& matched_bits,
+    const ExportMatchesRequest& request) const {
+  MatchedBlock matched_block;
+  vector<string> plaintext_ids;
+  plaintext_ids.reserve(kMarkMatchedBatchSize);
+  // Mark the rows as matched and get the corresponding encrypted IDs for them
+  // so we can add them to the upload.
+  auto mark_matched = [this, &matched_block, &matched_bits, &plaintext_ids,
+                       &request] {
+    MatchBatch(*match_table_, plaintext_ids, request.duplicate_match_mode,
+               &matched_bits, matched_block);
+    plaintext_ids.clear();
+    return matched_block.result.Successful();
+  };
+  // Every block ends in a line break. The rows refer to the block, so only
+  // the IDs looked up are copied.
+  string_view lines(block);
+  for (size_t begin = 0, end; begin < lines.size(); begin = end + 1) {
+    end = lines.find(kDefaultCsvLineBreak, begin);
+    auto row_or = CsvRowView::Build(lines.substr(begin, end - begin),
+                                    kNumAdvertiserCsvColumns,
+                                    /* remove_whitespace */ true,
+                                    kDefaultCsvRowDelimiter);
+    if (!row_or.Successful()) {
+      matched_block.result = row_or.result();
+      return matched_block;
+    }
+    auto plaintext_id_or = row_or->GetColumnView(0);
+    if (!plaintext_id_or.Successful()) {
+      matched_block.result = plaintext_id_or.result();
+      return matched_block;
+    }
+    // Skip the lookup if the ID is certainly not in the mapping.
+    if (prefilter_) {
+      if (!prefilter_->MayContain(*plaintext_id_or)) {
+        matched_block.num_prefilter_misses++;
+        continue;
+      }
+      matched_block.num_prefilter_hits++;
+    }
+    plaintext_ids.emplace_back(*plaintext_id_or);
+    if (plaintext_ids.size() == kMarkMatchedBatchSize && !mark_matched()) {
+      return matched_block;
+    }
+  }
+  mark_matched();
+  return matched_block;
+}
+
+void MatchWorker::FinishBlock(MatchPipeline& pipeline, uint64_t block_index,
+                              MatchedBlock matched_block,
+                              const ExportMatchesRequest& request) {
+  unique_lock lock(pipeline.mu);
+  pipeline.matched_blocks.emplace(block_index, move(matched_block));
+  if (pipeline.uploading) {
+    // The uploading thread picks the block up once it is next in order.
+    return;
+  }
+  pipeline.uploading = true;
+  for (auto it = pipeline.matched_blocks.find(pipeline.next_upload);
+       it != pipeline.matched_blocks.end();
+       it = pipeline.matched_blocks.find(pipeline.next_upload)) {
+    auto block = move(it->second);
+    pipeline.matched_blocks.erase(it);
+    bool failed = !pipeline.result.Successful();
+    lock.unlock();
+    auto result = block.result;
+    // Once the export has failed, the remaining blocks are only drained.
+    if (!failed && result.Successful()) {
+      pipeline.stats.num_prefilter_hits += block.num_prefilter_hits;
+      pipeline.stats.num_prefilter_misses += block.num_prefilter_misses;
+      pipeline.stats.num_matched += block.num_matched;
+      pipeline.stats.num_duplicate_matches += block.num_duplicate_matches;
+      if (!block.matched_ids.empty()) {
+        result = BufferMatches(pipeline.upload, move(block.matched_ids),
+                               request);
+      }
+    }
+    lock.lock();
+    if (!result.Successful() && pipeline.result.Successful()) {
+      pipeline.result = result;
+    }
+    pipeline.next_upload++;
+    pipeline.cv.notify_all();
+  }
+  pipeline.uploading = false;
+  pipeline.cv.notify_all();
+}
+
+ExecutionResult MatchWorker::BufferMatches(
+    MatchUpload& upload, string matched_ids,
+    const ExportMatchesRequest& request) {
+  auto flush_bytes =
+      request.upload_flush_bytes.value_or(kDefaultUploadFlushBytes);
+  auto& buffer = upload.buffer;
+  if (buffer.empty() && matched_ids.size() >= flush_bytes) {
+    return UploadMatches(request, move(matched_ids), upload.add_chunk_functor);
+  }
+  if (buffer.empty()) {
+    // Allocate the whole chunk up front rather than growing it block by block.
+    buffer.reserve(std::min(flush_bytes, kMaxUploadBufferReserveBytes) +
+                   matched_ids.size());
+  }
+  buffer.append(matched_ids);
+  if (buffer.size() < flush_bytes) {
+    return SuccessExecutionResult();
+  }
+  auto result = UploadMatches(request, move(buffer), upload.add_chunk_functor);
+  buffer.clear();
+  return result;
+}
+
+ExecutionResult MatchWorker::UploadMatches(const ExportMatchesRequest& request,
+                                           string matched_ids,
+                                           PutBlobCallback& add_chunk_functor) {
+  // If the upload stream hasn't been initiated yet, initiate it.
+  if (!add_chunk_functor) {
+    PutBlobStreamContext put_blob_context(
+        request.output_bucket, request.matched_ids_name, move(matched_ids),
+        request.publisher_cloud_identity_info);
+    ASSIGN_OR_RETURN(add_chunk_functor,
+                     blob_streamer_->PutBlobStream(put_blob_context));
+    return SuccessExecutionResult();
+  }
+  auto result = add_chunk_functor(move(matched_ids));
+  if (!result.Successful()) {
+    // A failed push cancels the upload itself, so there is nothing left to
+    // cancel.
+    add_chunk_functor = nullptr;
+  }
+  return result;
+}
+
+ExecutionResult MatchWorker::FinishUpload(MatchUpload& upload,
+                                          const ExportMatchesRequest& request) {
+  if (!upload.buffer.empty()) {
+    auto result =
+        UploadMatches(request, move(upload.buffer), upload.add_chunk_functor);
+    if (!result.Successful()) {
+      CancelUploadIfStarted(upload.add_chunk_functor, result);
+      return result;
+    }
   }
   // TODO handle no IDs matched and upload an empty file. Creating an empty
   // file may not be supported by the BlobStorageClient API yet.
-  RETURN_IF_FAILURE(GetExistingRows(request, csv_parser, add_chunk_functor));
-  return add_chunk_functor(PutBlobStreamDoneMarker);
+  return upload.add_chunk_functor(PutBlobStreamDoneMarker);
+}
+
+ExecutionResult MatchWorker::ExportSortedMatches(
+    const ExportMatchesRequest& request) {
+  // Each input holds at most one chunk besides the one being read.
+  BlobLineReader mapping(kBytesPerResponse);
+  BlobLineReader advertiser_list(kBytesPerResponse);
+  RETURN_IF_FAILURE(blob_streamer_->GetBlobStream(GetBlobStreamContext(
+      request.publisher_mapping_bucket, request.publisher_mapping_name,
+      kBytesPerResponse, mapping.GetCallback(),
+      request.publisher_cloud_identity_info)));
+  MatchUpload upload;
+  auto result = blob_streamer_->GetBlobStream(GetBlobStreamContext(
+      request.advertiser_list_bucket, request.advertiser_list_name,
+      kBytesPerResponse, advertiser_list.GetCallback(),
+      request.advertiser_cloud_identity_info));
+  if (result.Successful()) {
+    result = MergeSortedInputs(mapping, advertiser_list, upload, request);
+    // The merge stops once either input ends, drop the rest of the other.
+    advertiser_list.Close();
+  }
+  mapping.Close();
+  if (!result.Successful()) {
+    CancelUploadIfStarted(upload.add_chunk_functor, result);
+    return result;
+  }
+  return FinishUpload(upload, request);
+}
+
+ExecutionResult MatchWorker::MergeSortedInputs(
+    BlobLineReader& mapping, BlobLineReader& advertiser_list,
+    MatchUpload& upload, const ExportMatchesRequest& request) {
+  string line;
+  // The plaintext IDs of the current row of each input, unset once the input
+  // ended.
+  optional<string> publisher_id;
+  optional<string> advertiser_id;
+  string encrypted_id;
+  // Whether an advertiser row matched the current row of the mapping yet.
+  bool publisher_row_matched = false;
+  // Reads the next row of the mapping, whose IDs must strictly increase.
+  auto next_publisher_row = [&]() -> ExecutionResult {
+    ASSIGN_OR_RETURN(auto has_line, mapping.NextLine(line));
+    if (!has_line) {
+      publisher_id.reset();
+      return SuccessExecutionResult();
+    }
+    ASSIGN_OR_RETURN(auto row,
+                     CsvRowView::Build(line, kNumPublisherCsvColumns,
+                                       /* remove_whitespace */ true,
+                                       kDefaultCsvRowDelimiter));
+    ASSIGN_OR_RETURN(auto plaintext_id, row.GetColumnView(0));
+    if (publisher_id && plaintext_id <= *publisher_id) {
+      if (plaintext_id == *publisher_id) {
+        stats_.num_duplicate_publisher_ids++;
+        return FailureExecutionResult(
+            errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS);
+      }
+      return FailureExecutionResult(
+          errors::MATCH_WORKER_UNSORTED_PUBLISHER_MAPPING);
+    }
+    publisher_id = string(plaintext_id);
+    publisher_row_matched = false;
+    ASSIGN_OR_RETURN(auto encrypted_id_view, row.GetColumnView(1));
+    encrypted_id.assign(encrypted_id_view);
+    return SuccessExecutionResult();
+  };
+  // Reads the next row of the advertiser list, which may repeat IDs.
+  auto next_advertiser_row = [&]() -> ExecutionResult {
+    ASSIGN_OR_RETURN(auto has_line, advertiser_list.NextLine(line));
+    if (!has_line) {
+      advertiser_id.reset();
+      return SuccessExecutionResult();
+    }
+    ASSIGN_OR_RETURN(auto row,
+                     CsvRowView::Build(line, kNumAdvertiserCsvColumns,
+                                       /* remove_whitespace */ true,
+                                       kDefaultCsvRowDelimiter));
+    ASSIGN_OR_RETURN(auto plaintext_id, row.GetColumnView(0));
+    if (advertiser_id && plaintext_id < *advertiser_id) {
+      return FailureExecutionResult(
+          errors::MATCH_WORKER_UNSORTED_ADVERTISER_LIST);
+    }
+    advertiser_id = string(plaintext_id);
+    return SuccessExecutionResult();
+  };
+
+  RETURN_IF_FAILURE(next_publisher_row());
+  RETURN_IF_FAILURE(next_advertiser_row());
+  string matched_ids;
+  while (publisher_id && advertiser_id) {
+    if (*advertiser_id < *publisher_id) {
+      RETURN_IF_FAILURE(next_advertiser_row());
+    } else if (*publisher_id < *advertiser_id) {
+      RETURN_IF_FAILURE(next_publisher_row());
+    } else {
+      // Repeated advertiser IDs are next to each other, so they are
+      // duplicates exactly if the mapping row already matched.
+      bool duplicate =
+          publisher_row_matched &&
+          request.duplicate_match_mode != DuplicateMatchMode::kExportAll;
+      publisher_row_matched = true;
+      if (duplicate) {
+        stats_.num_duplicate_matches++;
+      }
+      if (!duplicate ||
+          request.duplicate_match_mode != DuplicateMatchMode::kExportOnce) {
+        absl::StrAppend(&matched_ids, encrypted_id, "\n");
+        stats_.num_matched++;
+      }
+      if (matched_ids.size() >= kMatchBlockSizeBytes) {
+        RETURN_IF_FAILURE(BufferMatches(upload, move(matched_ids), request));
+        matched_ids.clear();
+      }
+      RETURN_IF_FAILURE(next_advertiser_row());
+    }
+  }
+  if (!matched_ids.empty()) {
+    RETURN_IF_FAILURE(BufferMatches(upload, move(matched_ids), request));
+  }
+  return SuccessExecutionResult();
+}
+
+// The result of joining one partition of the inputs.
+struct JoinedPartition {
+  ExecutionResult result = SuccessExecutionResult();
+  // The encrypted IDs of the matched rows, each followed by a line break.
+  string matched_ids;
+  uint64_t num_matched = 0;
+  uint64_t num_duplicate_matches = 0;
+  uint64_t num_duplicate_publisher_ids = 0;
+};
+
+// State shared by the joins of the partitions of the inputs.
+struct PartitionedJoin {
+  mutex mu;
+  // Notified whenever a partition is joined.
+  condition_variable cv;
+  // The first failure of any partition.
+  ExecutionResult result = SuccessExecutionResult();
+  // The number of partitions being joined or uploaded, and the size of the
+  // mappings of those being joined.
+  size_t num_joining = 0;
+  uint64_t num_bytes_joining = 0;
+  // Index of the next partition to be uploaded.
+  size_t next_upload = 0;
+  // Joined partitions waiting for the partitions before them to be uploaded.
+  map<size_t, JoinedPartition> joined_partitions;
+  // Whether a thread is uploading joined partitions. Only that thread
+  // accesses upload and the stats.
+  bool uploading = false;
+  MatchUpload upload;
+};
+
+ExecutionResult MatchWorker::ExportPartitionedMatches(
+    const ExportMatchesRequest& request) {
+  auto num_partitions = mapping_partitions_->GetNumPartitions();
+  stats_.num_join_partitions = num_partitions;
+  DiskPartitions advertiser_partitions(on_disk_match_table_directory_,
+                                       num_partitions);
+  BlobLineReader advertiser_list(kBytesPerResponse);
+  RETURN_IF_FAILURE(blob_streamer_->GetBlobStream(GetBlobStreamContext(
+      request.advertiser_list_bucket, request.advertiser_list_name,
+      kBytesPerResponse, advertiser_list.GetCallback(),
+      request.advertiser_cloud_identity_info)));
+  auto partition_result =
+      PartitionAdvertiserList(advertiser_list, advertiser_partitions);
+  advertiser_list.Close();
+  RETURN_IF_FAILURE(partition_result);
+
+  PartitionedJoin join;
+  for (size_t index = 0; index < num_partitions; index++) {
+    uint64_t num_bytes = mapping_partitions_->GetPartition(index).size();
+    {
+      unique_lock lock(join.mu);
+      // Join as many partitions at once as the memory budget allows, and
+      // always at least one.
+      join.cv.wait(lock, [&join, &request, num_bytes] {
+        return !join.result.Successful() || join.num_bytes_joining == 0 ||
+               join.num_bytes_joining + num_bytes <=
+                   *request.join_memory_budget_bytes;
+      });
+      if (!join.result.Successful()) {
+        break;
+      }
+      join.num_joining++;
+      join.num_bytes_joining += num_bytes;
+    }
+    auto join_partition = [this, &join, &advertiser_partitions, &request,
+                           index, num_bytes] {
+      auto joined =
+          JoinPartition(mapping_partitions_->GetPartition(index),
+                        advertiser_partitions.GetPartition(index), request);
+      mapping_partitions_->Release(index);
+      advertiser_partitions.Release(index);
+      FinishPartition(join, index, num_bytes, move(joined), request);
+    };
+    if (!cpu_async_executor_) {
+      join_partition();
+      continue;
+    }
+    auto schedule_result =
+        cpu_async_executor_->Schedule(join_partition, AsyncPriority::Normal);
+    if (!schedule_result.Successful()) {
+      JoinedPartition failed_partition;
+      failed_partition.result = schedule_result;
+      FinishPartition(join, index, num_bytes, move(failed_partition),
+                      request);
+    }
+  }
+  // The joins reference the partitions, so wait for them even if one failed.
+  unique_lock lock(join.mu);
+  join.cv.wait(lock, [&join] { return join.num_joining == 0; });
+  mapping_partitions_.reset();
+  if (!join.result.Successful()) {
+    CancelUploadIfStarted(join.upload.add_chunk_functor, join.result);
+    return join.result;
+  }
+  return FinishUpload(join.upload, request);
+}
+
+ExecutionResult MatchWorker::PartitionAdvertiserList(
+    BlobLineReader& advertiser_list, DiskPartitions& partitions) {
+  string line;
+  while (true) {
+    ASSIGN_OR_RETURN(auto has_line, advertiser_list.NextLine(line));
+    if (!has_line) {
+      return SuccessExecutionResult();
+    }
+    ASSIGN_OR_RETURN(auto row,
+                     CsvRowView::Build(line, kNumAdvertiserCsvColumns,
+                                       /* remove_whitespace */ true,
+                                       kDefaultCsvRowDelimiter));
+    ASSIGN_OR_RETURN(auto plaintext_id, row.GetColumnView(0));
+    RETURN_IF_FAILURE(partitions.Add(plaintext_id));
+  }
+}
+
+JoinedPartition MatchWorker::JoinPartition(
+    string_view mapping, string_view advertiser_ids,
+    const ExportMatchesRequest& request) const {
+  JoinedPartition joined;
+  // The partitions hold the parsed columns, so they are split as they are.
+  vector<std::pair<string, string>> rows;
+  for (size_t begin = 0, end; begin < mapping.size(); begin = end + 1) {
+    end = mapping.find(kDefaultCsvLineBreak, begin);
+    auto row = mapping.substr(begin, end - begin);
+    auto delimiter = row.find(kDefaultCsvRowDelimiter);
+    rows.emplace_back(row.substr(0, delimiter), row.substr(delimiter + 1));
+  }
+  unique_ptr<MatchTable<string, string>> table;
+  if (rows.empty()) {
+    table = make_unique<OpenAddressingMatchTable<string, string>>();
+  } else {
+    table = CreateMatchTable(rows.front().first, rows.front().second);
+    table->Reserve(rows.size());
+  }
+  vector<string> duplicate_ids;
+  joined.result = table->BulkLoad(move(rows), &duplicate_ids);
+  if (!joined.result.Successful()) {
+    return joined;
+  }
+  if (!duplicate_ids.empty()) {
+    joined.num_duplicate_publisher_ids = duplicate_ids.size();
+    joined.result =
+        FailureExecutionResult(errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS);
+    return joined;
+  }
+  table->Freeze();
+
+  vector<string> plaintext_ids;
+  plaintext_ids.reserve(kMarkMatchedBatchSize);
+  auto mark_matched = [&table, &joined, &plaintext_ids, &request] {
+    // The partition's table is only used by this list.
+    MatchBatch(*table, plaintext_ids, request.duplicate_match_mode,
+               /* matched_bits */ nullptr, joined);
+    plaintext_ids.clear();
+  };
+  for (size_t begin = 0, end; begin < advertiser_ids.size(); begin = end + 1) {
+    end = advertiser_ids.find(kDefaultCsvLineBreak, begin);
+    plaintext_ids.emplace_back(advertiser_ids.substr(begin, end - begin));
+    if (plaintext_ids.size() == kMarkMatchedBatchSize) {
+      mark_matched();
+    }
+  }
+  mark_matched();
+  return joined;
+}
+
+void MatchWorker::FinishPartition(PartitionedJoin& join, size_t index,
+                                  uint64_t num_bytes, JoinedPartition joined,
+                                  const ExportMatchesRequest& request) {
+  unique_lock lock(join.mu);
+  // The partition's table is gone, so its share of the budget is freed before
+  // its matches wait for the partitions before it.
+  join.num_bytes_joining -= num_bytes;
+  join.joined_partitions.emplace(index, move(joined));
+  join.cv.notify_all();
+  if (join.uploading) {
+    // The uploading thread picks the partition up once it is next in order.
+    join.num_joining--;
+    return;
+  }
+  join.uploading = true;
+  for (auto it = join.joined_partitions.find(join.next_upload);
+       it != join.joined_partitions.end();
+       it = join.joined_partitions.find(join.next_upload)) {
+    auto partition = move(it->second);
+    join.joined_partitions.erase(it);
+    bool failed = !join.result.Successful();
+    lock.unlock();
+    auto result = partition.result;
+    stats_.num_duplicate_publisher_ids += partition.num_duplicate_publisher_ids;
+    // Once the export has failed, the remaining partitions are only drained.
+    if (!failed && result.Successful()) {
+      stats_.num_matched += partition.num_matched;
+      stats_.num_duplicate_matches += partition.num_duplicate_matches;
+      if (!partition.matched_ids.empty()) {
+        result =
+            BufferMatches(join.upload, move(partition.matched_ids), request);
+      }
+    }
+    lock.lock();
+    if (!result.Successful() && join.result.Successful()) {
+      join.result = result;
+    }
+    join.next_upload++;
+  }
+  join.uploading = false;
+  // Only counted as done once the partitions it picked up are uploaded, so
+  // the export does not finish the upload while it is still buffering.
+  join.num_joining--;
+  join.cv.notify_all();
+}
+
+ExecutionResult MatchWorker::FinishAdvertiserList(
+    MatchPipeline& pipeline, const ExportMatchesRequest& request) {
+  // The stream callback references the pipeline, so wait for the stream to
+  // end even if matching already failed.
+  unique_lock lock(pipeline.mu);
+  pipeline.cv.wait(lock, [&pipeline] {
+    return pipeline.stream_done && !pipeline.uploading &&
+           pipeline.next_upload == pipeline.next_block;
+  });
+  if (!pipeline.result.Successful()) {
+    CancelUploadIfStarted(pipeline.upload.add_chunk_functor, pipeline.result);
+    return pipeline.result;
+  }
+  return FinishUpload(pipeline.upload, request);
+}
+
+ExecutionResult MatchWorker::ExportMatches(
+    const ExportMatchesRequest& request) {
+  stats_ = ExportMatchesStats();
+  RETURN_IF_FAILURE(ValidateRequest(request));
+  if (request.sorted_inputs) {
+    return ExportSortedMatches(request);
+  }
+  MatchPipeline pipeline(stats_);
+  if (!request.concurrent_download_buffer_bytes ||
+      request.join_memory_budget_bytes) {
+    // Stream Pub mapping into the match table.
+    RETURN_IF_FAILURE(LoadPublisherMapping(request));
+    if (mapping_partitions_) {
+      return ExportPartitionedMatches(request);
+    }
+    InitMatchedBits(pipeline, *match_table_, request);
+    // Stream Adv list, matching it as it comes in.
+    RETURN_IF_FAILURE(StreamAdvertiserList(pipeline, request));
+  } else {
+    // Stream Adv list while the Pub mapping is streamed into the match table,
+    // holding it back until the table is ready.
+    pipeline.holding_back = true;
+    RETURN_IF_FAILURE(StreamAdvertiserList(pipeline, request));
+    auto load_result = LoadPublisherMapping(request);
+    unique_lock lock(pipeline.mu);
+    if (!load_result.Successful()) {
+      pipeline.result = load_result;
+      // Stop the download and drop what was held back. Nothing was matched
+      // yet, but the stream callback references the pipeline until it ends.
+      pipeline.download->TryCancel();
+      string().swap(pipeline.held_back);
+      pipeline.spilled.reset();
+      pipeline.cv.wait(lock, [&pipeline] { return pipeline.stream_ended; });
+      return load_result;
+    }
+    InitMatchedBits(pipeline, *match_table_, request);
+    pipeline.table_ready = true;
+    // Unless the stream already ended, the next stream callback releases the
+    // held back chunks.
+    if (pipeline.stream_ended && pipeline.holding_back) {
+      pipeline.holding_back = false;
+      lock.unlock();
+      ReleaseHeldBackChunks(pipeline, request);
+      lock.lock();
+      pipeline.stream_done = true;
+    }
+  }
+  return FinishAdvertiserList(pipeline, request);
+}
+
+vector<ExecutionResult> MatchWorker::ExportMatchesBatch(
+    const vector<ExportMatchesRequest>& requests,
+    size_t max_concurrent_lists) {
+  stats_ = ExportMatchesStats();
+  vector<ExecutionResult> results(requests.size(), SuccessExecutionResult());
+  batch_stats_.assign(requests.size(), ExportMatchesStats());
+  if (requests.empty()) {
+    return results;
+  }
+  auto result = ValidateBatch(requests, max_concurrent_lists);
+  if (result.Successful()) {
+    // Stream Pub mapping into the match table, once for all lists.
+    result = LoadPublisherMapping(requests.front());
+  }
+  if (!result.Successful()) {
+    results.assign(requests.size(), result);
+    batch_stats_.assign(requests.size(), stats_);
+    return results;
+  }
+  // Stream the Adv lists in groups, each list matched in its own pipeline
+  // against the shared match table, with matched state of its own.
+  for (size_t begin = 0; begin < requests.size();
+       begin += max_concurrent_lists) {
+    auto end = std::min(begin + max_concurrent_lists, requests.size());
+    vector<unique_ptr<MatchPipeline>> pipelines;
+    for (auto i = begin; i < end; i++) {
+      // Each list starts out with the stats of loading the mapping.
+      batch_stats_[i] = stats_;
+      pipelines.push_back(make_unique<MatchPipeline>(batch_stats_[i]));
+      InitMatchedBits(*pipelines.back(), *match_table_, requests[i]);
+      results[i] = StreamAdvertiserList(*pipelines.back(), requests[i]);
+    }
+    for (auto i = begin; i < end; i++) {
+      if (results[i].Successful()) {
+        results[i] =
+            FinishAdvertiserList(*pipelines[i - begin], requests[i]);
+      }
+    }
+  }
+  return results;
 }
 
 }  // namespace google::pair::matcher
@@ -14,18 +14,43 @@
 
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "cc/common/blob_streamer/src/blob_streamer.h"
-#include "cc/common/csv_parser/src/csv_stream_parser.h"
+#include "cc/core/interface/async_executor_interface.h"
+#include "cc/matcher/match_table/src/blocked_bloom_filter.h"
 #include "cc/matcher/match_table/src/match_table.h"
+#include "cc/matcher/match_table/src/matched_bitset.h"
+#include "cc/matcher/match_worker/src/blob_line_reader.h"
+#include "cc/matcher/match_worker/src/disk_partitions.h"
+#include "cc/matcher/match_worker/src/match_table_cache.h"
 #include "cc/public/core/interface/execution_result.h"
 #include "cc/public/cpio/interface/blob_storage_client/blob_storage_client_interface.h"
 
 namespace google::pair::matcher {
 
+/**
+ * @brief How advertiser IDs are handled which match a row of the publisher
+ * mapping that an earlier advertiser ID already matched, e.g. because the ID
+ * appears twice in the advertiser list.
+ *
+ */
+enum class DuplicateMatchMode {
+  // Every matched advertiser ID is exported, duplicates are not looked for.
+  kExportAll,
+  // Every matched advertiser ID is exported, and duplicates are counted in
+  // ExportMatchesStats::num_duplicate_matches.
+  kCount,
+  // Each matched row is exported once, and duplicates are counted in
+  // ExportMatchesStats::num_duplicate_matches.
+  kExportOnce,
+};
+
 struct ExportMatchesRequest {
   // The name of the bucket that the publisher mapping is in.
   std::string publisher_mapping_bucket;
@@ -47,8 +72,122 @@ struct ExportMatchesRequest {
   // provider here.
   std::optional<google::cmrt::sdk::common::v1::CloudIdentityInfo>
       advertiser_cloud_identity_info;
+  // If set, advertiser IDs are first checked against a Bloom filter of the
+  // publisher mapping with this false positive rate, in (0, 1). This skips
+  // the match table lookup for most IDs that do not match, which pays off for
+  // jobs with low match rates.
+  std::optional<double> prefilter_false_positive_rate;
+  // If set, publisher mappings larger than this many bytes are loaded into a
+  // match table in memory-mapped files on local disk rather than in RAM.
+  std::optional<uint64_t> on_disk_match_table_threshold_bytes;
+  // If set, the advertiser list is downloaded while the publisher mapping is
+  // loaded rather than after it. Up to this many bytes of it are held in
+  // memory until the match table is ready, the rest is spilled to local disk
+  // next to on-disk match tables.
+  std::optional<uint64_t> concurrent_download_buffer_bytes;
+  // The number of bytes of matched IDs to gather before they are pushed to the
+  // upload as one chunk. Defaults to kDefaultUploadFlushBytes.
+  std::optional<uint64_t> upload_flush_bytes;
+  // If set, both the publisher mapping and the advertiser list must be sorted
+  // by plaintext ID in ascending byte order, as by `LC_ALL=C sort`. They are
+  // then matched with a merge join while they stream in, which only holds a
+  // few chunks of each in memory rather than the whole mapping in a match
+  // table. The export fails on the first row out of order. The prefilter, the
+  // on-disk match table and the concurrent download do not apply.
+  bool sorted_inputs = false;
+  // If set, publisher mappings larger than this many bytes are joined
+  // partition by partition. Both inputs are hash-partitioned by plaintext ID
+  // into files on local disk next to on-disk match tables, then each
+  // partition of the mapping is loaded into a match table in memory and
+  // joined with the same partition of the advertiser list. Partitions are
+  // joined in parallel on the CPU executor as long as the size of their
+  // mappings stays within this budget. Matches are uploaded in partition
+  // order rather than in advertiser list order, partitions joined ahead of
+  // the ones before them waiting with their matches until those are
+  // uploaded. The prefilter, the on-disk match table and the concurrent
+  // download do not apply.
+  std::optional<uint64_t> join_memory_budget_bytes;
+  // The number of partitions of mappings over join_memory_budget_bytes.
+  // Defaults to kDefaultNumJoinPartitions.
+  std::optional<uint32_t> num_join_partitions;
+  // The version of the publisher mapping blob, such as its generation. If set
+  // and the MatchWorker has a MatchTableCache, the loaded mapping is cached
+  // under it, and later requests for the same version of the mapping skip
+  // loading it. Other versions of the mapping are evicted from the cache
+  // before a new version is loaded. Mappings loaded into an on-disk match
+  // table or joined in partitions are not cached.
+  std::optional<std::string> publisher_mapping_version;
+  // Duplicates are found through matched state kept per advertiser list, so
+  // lists and requests sharing a match table, including a cached one, each
+  // find their own duplicates.
+  DuplicateMatchMode duplicate_match_mode = DuplicateMatchMode::kExportAll;
+};
+
+/**
+ * @brief Default directory for the files of on-disk match tables and of the
+ * advertiser list spilled to disk.
+ *
+ */
+inline constexpr char kDefaultOnDiskMatchTableDirectory[] = "/tmp";
+
+/**
+ * @brief Default number of bytes of matched IDs pushed to the upload at once.
+ *
+ */
+inline constexpr uint64_t kDefaultUploadFlushBytes = 8 * 1024 * 1024;
+
+/**
+ * @brief Default number of partitions of a partitioned join, see
+ * ExportMatchesRequest::join_memory_budget_bytes.
+ *
+ */
+inline constexpr uint32_t kDefaultNumJoinPartitions = 64;
+
+/**
+ * @brief Default number of advertiser lists MatchWorker::ExportMatchesBatch
+ * streams at once.
+ *
+ */
+inline constexpr size_t kDefaultMaxConcurrentAdvertiserLists = 4;
+
+/**
+ * @brief Statistics about a call to MatchWorker::ExportMatches.
+ *
+ */
+struct ExportMatchesStats {
+  // The number of advertiser IDs which passed the prefilter and were looked up
+  // in the match table.
+  uint64_t num_prefilter_hits = 0;
+  // The number of advertiser IDs rejected by the prefilter.
+  uint64_t num_prefilter_misses = 0;
+  // The number of advertiser IDs which matched and were exported.
+  uint64_t num_matched = 0;
+  // The number of matched advertiser IDs whose row an earlier advertiser ID
+  // already matched. Always 0 with DuplicateMatchMode::kExportAll.
+  uint64_t num_duplicate_matches = 0;
+  // The number of publisher mapping rows whose plaintext ID was already in the
+  // mapping. The export fails if this is not 0.
+  uint64_t num_duplicate_publisher_ids = 0;
+  // Whether the publisher mapping was loaded into an on-disk match table.
+  bool used_on_disk_match_table = false;
+  // The number of bytes of the advertiser list spilled to local disk while
+  // the publisher mapping was loaded.
+  uint64_t num_advertiser_bytes_spilled = 0;
+  // The number of partitions the inputs were joined in, 0 unless the mapping
+  // was over ExportMatchesRequest::join_memory_budget_bytes.
+  uint64_t num_join_partitions = 0;
+  // Whether the publisher mapping was taken from the MatchTableCache rather
+  // than loaded.
+  bool used_cached_match_table = false;
 };
 
+struct MappingLoad;
+struct MatchPipeline;
+struct MatchedBlock;
+struct MatchUpload;
+struct JoinedPartition;
+struct PartitionedJoin;
+
 /**
  * @brief Class to use an existing Publisher PAIR mapping and an input
  * Advertiser IDs list to export the matched IDs into a Google-Owned bucket.
@@ -56,9 +195,30 @@ struct ExportMatchesRequest {
  */
 class MatchWorker {
  public:
+  /**
+   * @brief Construct a new Match Worker object
+   *
+   * @param blob_storage_client
+   * @param blob_streamer
+   * @param on_disk_match_table_directory the directory on local disk to keep
+   * on-disk match tables and the spilled advertiser list in, see
+   * ExportMatchesRequest::on_disk_match_table_threshold_bytes and
+   * ExportMatchesRequest::concurrent_download_buffer_bytes
+   * @param cpu_async_executor the executor to parse and match the advertiser
+   * list on. If null, the advertiser list is matched on the thread which
+   * streams it in.
+   * @param match_table_cache the cache to keep loaded publisher mappings in
+   * across requests, see ExportMatchesRequest::publisher_mapping_version. If
+   * null, every request loads its mapping.
+   */
   MatchWorker(std::shared_ptr<scp::cpio::BlobStorageClientInterface>
                   blob_storage_client,
-              std::unique_ptr<common::BlobStreamerInterface> blob_streamer);
+              std::unique_ptr<common::BlobStreamerInterface> blob_streamer,
+              std::string on_disk_match_table_directory =
+                  kDefaultOnDiskMatchTableDirectory,
+              std::shared_ptr<scp::core::AsyncExecutorInterface>
+                  cpu_async_executor = nullptr,
+              std::shared_ptr<MatchTableCache> match_table_cache = nullptr);
 
   /**
    * @brief Exports all of the matched IDs (encrypted IDs) between the publisher
@@ -69,17 +229,183 @@ class MatchWorker {
    */
   scp::core::ExecutionResult ExportMatches(const ExportMatchesRequest& request);
 
+  /**
+   * @brief Exports the matched IDs of many advertiser lists against one
+   * publisher mapping, which is loaded only once. The lists are streamed and
+   * matched concurrently in groups of max_concurrent_lists, each into its own
+   * output.
+   *
+   * All requests must name the same publisher mapping, which is loaded as the
+   * first request asks. The lists share the one match table, but each keeps
+   * its own matched state, so duplicates are found per list as its
+   * DuplicateMatchMode asks. Sorted inputs, the partitioned join and the
+   * concurrent download are not supported.
+   *
+   * @param requests one request per advertiser list
+   * @param max_concurrent_lists the number of lists streamed at once. Every
+   * list being streamed takes up a thread of the BlobStreamer's executor, so
+   * this should leave threads of the CPU executor free for matching.
+   * @return std::vector<scp::core::ExecutionResult> the result of each request
+   */
+  std::vector<scp::core::ExecutionResult> ExportMatchesBatch(
+      const std::vector<ExportMatchesRequest>& requests,
+      size_t max_concurrent_lists = kDefaultMaxConcurrentAdvertiserLists);
+
+  /**
+   * @brief Get the statistics of the last call to ExportMatches.
+   *
+   * @return const ExportMatchesStats&
+   */
+  const ExportMatchesStats& GetLastExportMatchesStats() const {
+    return stats_;
+  }
+
+  /**
+   * @brief Get the statistics of each request of the last call to
+   * ExportMatchesBatch.
+   *
+   * @return const std::vector<ExportMatchesStats>&
+   */
+  const std::vector<ExportMatchesStats>& GetLastExportMatchesBatchStats()
+      const {
+    return batch_stats_;
+  }
+
  private:
-  scp::core::ExecutionResult ParseBlobResponseIntoMatchTable(
-      const std::string& blob_response);
+  // Streams the publisher mapping into match_table_ and builds prefilter_,
+  // unless both are in match_table_cache_.
+  scp::core::ExecutionResult LoadPublisherMapping(
+      const ExportMatchesRequest& request);
+
+  // Parses the whole rows of a chunk of the publisher mapping and loads them
+  // into match_table_ in batches, creating it once its kind is known.
+  scp::core::ExecutionResult AddMappingChunk(
+      MappingLoad& load, std::string_view chunk,
+      const ExportMatchesRequest& request);
+
+  // Loads the rows left over once the stream ended and freezes match_table_.
+  scp::core::ExecutionResult FinishMappingLoad(
+      MappingLoad& load, const ExportMatchesRequest& request);
+
+  // Streams both inputs in at once and matches them with MergeSortedInputs,
+  // see ExportMatchesRequest::sorted_inputs.
+  scp::core::ExecutionResult ExportSortedMatches(
+      const ExportMatchesRequest& request);
+
+  // Merge joins the sorted publisher mapping and advertiser list, validating
+  // their order as it goes.
+  scp::core::ExecutionResult MergeSortedInputs(
+      BlobLineReader& mapping, BlobLineReader& advertiser_list,
+      MatchUpload& upload, const ExportMatchesRequest& request);
+
+  // Partitions the advertiser list like the mapping in mapping_partitions_
+  // and joins the partitions, see
+  // ExportMatchesRequest::join_memory_budget_bytes.
+  scp::core::ExecutionResult ExportPartitionedMatches(
+      const ExportMatchesRequest& request);
+
+  // Adds the rows of the advertiser list to partitions.
+  scp::core::ExecutionResult PartitionAdvertiserList(
+      BlobLineReader& advertiser_list, DiskPartitions& partitions);
+
+  // Loads a partition of the mapping into a match table and matches the same
+  // partition of the advertiser list against it.
+  JoinedPartition JoinPartition(std::string_view mapping,
+                                std::string_view advertiser_ids,
+                                const ExportMatchesRequest& request) const;
+
+  // Frees the share of the memory budget of a joined partition, then uploads
+  // its matches once the partitions before it are uploaded, in the order of
+  // their index.
+  void FinishPartition(PartitionedJoin& join, size_t index,
+                       uint64_t num_bytes, JoinedPartition joined,
+                       const ExportMatchesRequest& request);
+
+  // The advertiser list is matched in a pipeline of three stages:
+  //  1. SplitChunk splits the streamed chunks into blocks of whole lines.
+  //  2. MatchBlock parses and matches each block, in parallel on the
+  //     cpu_async_executor_.
+  //  3. FinishBlock gathers the matches of the blocks in order and uploads
+  //     them in chunks of ExportMatchesRequest::upload_flush_bytes.
+  // At most kMaxMatchBlocksInFlight blocks are between stages 1 and 3, the
+  // stream callback waits for blocks to be uploaded before splitting more.
+
+  // Starts streaming the advertiser list into the pipeline.
+  scp::core::ExecutionResult StreamAdvertiserList(
+      MatchPipeline& pipeline, const ExportMatchesRequest& request);
+
+  // Handles a chunk of the advertiser list from the stream. Chunks are held
+  // back while the match table is loaded, and released into SplitChunk ahead
+  // of the first chunk after that.
+  void AddAdvertiserChunk(MatchPipeline& pipeline, std::string_view chunk,
+                          const ExportMatchesRequest& request);
+
+  // Holds back a chunk of the advertiser list, in memory or on disk.
+  scp::core::ExecutionResult HoldBackChunk(
+      MatchPipeline& pipeline, std::string_view chunk,
+      const ExportMatchesRequest& request);
+
+  // Splits the held back advertiser list, if the match table is ready and the
+  // caller is the first to see that.
+  void ReleaseHeldBackChunks(MatchPipeline& pipeline,
+                             const ExportMatchesRequest& request);
+
+  // Splits a chunk of the advertiser list into blocks and schedules them.
+  void SplitChunk(MatchPipeline& pipeline, std::string_view chunk,
+                  const ExportMatchesRequest& request);
+
+  // Schedules a block to be matched. Returns false if the export has failed,
+  // in which case the rest of the advertiser list is dropped.
+  bool ScheduleBlock(MatchPipeline& pipeline,
+                     std::shared_ptr<const std::string> block,
+                     const ExportMatchesRequest& request);
+
+  // Parses the rows of a block and marks them as matched, in matched_bits
+  // unless duplicates are not looked for.
+  MatchedBlock MatchBlock(const std::string& block,
+                          MatchedBitset& matched_bits,
+                          const ExportMatchesRequest& request) const;
+
+  // Hands over a matched block and, unless another thread already is, uploads
+  // all blocks which are next in order.
+  void FinishBlock(MatchPipeline& pipeline, uint64_t block_index,
+                   MatchedBlock matched_block,
+                   const ExportMatchesRequest& request);
+
+  // Gathers the encrypted IDs of matched rows in the upload's buffer and
+  // uploads the buffer once it reaches the flush size.
+  scp::core::ExecutionResult BufferMatches(
+      MatchUpload& upload, std::string matched_ids,
+      const ExportMatchesRequest& request);
+
+  // Uploads what is left in the upload's buffer and completes the upload.
+  scp::core::ExecutionResult FinishUpload(MatchUpload& upload,
+                                          const ExportMatchesRequest& request);
+
+  // Waits for the advertiser list to be matched and completes its upload.
+  scp::core::ExecutionResult FinishAdvertiserList(
+      MatchPipeline& pipeline, const ExportMatchesRequest& request);
 
-  scp::core::ExecutionResult GetExistingRows(
-      const ExportMatchesRequest& request, common::CsvStreamParser& csv_parser,
+  // Adds the encrypted IDs of matched rows to the upload, starting it if
+  // needed.
+  scp::core::ExecutionResult UploadMatches(
+      const ExportMatchesRequest& request, std::string matched_ids,
       common::PutBlobCallback& add_chunk_functor);
 
   std::shared_ptr<scp::cpio::BlobStorageClientInterface> blob_storage_client_;
   std::unique_ptr<common::BlobStreamerInterface> blob_streamer_;
-  std::unique_ptr<matcher::MatchTable<std::string, std::string>> match_table_;
+  const std::string on_disk_match_table_directory_;
+  std::shared_ptr<scp::core::AsyncExecutorInterface> cpu_async_executor_;
+  std::shared_ptr<MatchTableCache> match_table_cache_;
+  // Shared with match_table_cache_ if the mapping is cached.
+  std::shared_ptr<matcher::MatchTable<std::string, std::string>> match_table_;
+  // Only set while a mapping over the join's memory budget is joined, instead
+  // of match_table_.
+  std::unique_ptr<DiskPartitions> mapping_partitions_;
+  // Only set if the request asks for a prefilter.
+  std::shared_ptr<const BlockedBloomFilter> prefilter_;
+  ExportMatchesStats stats_;
+  std::vector<ExportMatchesStats> batch_stats_;
 };
 
 }  // namespace google::pair::matcher
@@ -0,0 +1,134 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/matcher/match_worker/src/blob_line_reader.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cc/public/core/interface/execution_result.h"
+#include "cc/public/core/test/interface/execution_result_matchers.h"
+
+using google::scp::core::FailureExecutionResult;
+using google::scp::core::SuccessExecutionResult;
+using google::scp::core::test::ResultIs;
+using std::atomic_int;
+using std::string;
+using std::thread;
+using std::vector;
+
+namespace google::pair::matcher::test {
+
+// Reads all lines until the blob ends.
+vector<string> ReadLines(BlobLineReader& reader) {
+  vector<string> lines;
+  string line;
+  while (true) {
+    auto has_line_or = reader.NextLine(line);
+    EXPECT_SUCCESS(has_line_or);
+    if (!has_line_or.Successful() || !*has_line_or) {
+      return lines;
+    }
+    lines.push_back(line);
+  }
+}
+
+TEST(BlobLineReaderTest, ReadsLinesSplitAcrossChunks) {
+  BlobLineReader reader(1024);
+  auto callback = reader.GetCallback();
+  callback("a,1\nbb", false, SuccessExecutionResult());
+  callback("b,2", false, SuccessExecutionResult());
+  callback("\n\nc,3\n", false, SuccessExecutionResult());
+  callback("", true, SuccessExecutionResult());
+
+  EXPECT_EQ(ReadLines(reader), (vector<string>{"a,1", "bbb,2", "", "c,3"}));
+  reader.Close();
+}
+
+TEST(BlobLineReaderTest, ReadsLastLineWithoutLineBreak) {
+  BlobLineReader reader(1024);
+  auto callback = reader.GetCallback();
+  callback("a\nb", false, SuccessExecutionResult());
+  callback("", true, SuccessExecutionResult());
+
+  EXPECT_EQ(ReadLines(reader), (vector<string>{"a", "b"}));
+  reader.Close();
+}
+
+TEST(BlobLineReaderTest, ReturnsFailureOfTheStreamAfterItsLines) {
+  BlobLineReader reader(1024);
+  auto callback = reader.GetCallback();
+  callback("a\n", false, SuccessExecutionResult());
+  callback("", true, FailureExecutionResult(12345));
+
+  string line;
+  auto has_line_or = reader.NextLine(line);
+  ASSERT_SUCCESS(has_line_or);
+  EXPECT_TRUE(*has_line_or);
+  EXPECT_EQ(line, "a");
+  EXPECT_THAT(reader.NextLine(line), ResultIs(FailureExecutionResult(12345)));
+  reader.Close();
+}
+
+TEST(BlobLineReaderTest, BlocksTheStreamWhileTheBufferIsFull) {
+  BlobLineReader reader(4);
+  atomic_int num_chunks_added(0);
+  thread stream_thread([&reader, &num_chunks_added] {
+    auto callback = reader.GetCallback();
+    for (int i = 0; i < 100; i++) {
+      callback("ab\n", false, SuccessExecutionResult());
+      num_chunks_added++;
+    }
+    callback("", true, SuccessExecutionResult());
+  });
+
+  string line;
+  for (int i = 0; i < 100; i++) {
+    auto has_line_or = reader.NextLine(line);
+    ASSERT_SUCCESS(has_line_or);
+    ASSERT_TRUE(*has_line_or);
+    EXPECT_EQ(line, "ab");
+    // The chunk read plus at most two buffered ones.
+    EXPECT_LE(num_chunks_added.load(), i + 3);
+  }
+  auto has_line_or = reader.NextLine(line);
+  ASSERT_SUCCESS(has_line_or);
+  EXPECT_FALSE(*has_line_or);
+  stream_thread.join();
+  reader.Close();
+}
+
+TEST(BlobLineReaderTest, CloseDropsTheRestOfTheBlob) {
+  BlobLineReader reader(4);
+  thread stream_thread([&reader] {
+    auto callback = reader.GetCallback();
+    for (int i = 0; i < 100; i++) {
+      callback("ab\n", false, SuccessExecutionResult());
+    }
+    callback("", true, SuccessExecutionResult());
+  });
+
+  string line;
+  ASSERT_SUCCESS(reader.NextLine(line));
+  EXPECT_EQ(line, "ab");
+  // Returns once the stream, which is unblocked by closing, ended.
+  reader.Close();
+  stream_thread.join();
+}
+
+}  // namespace google::pair::matcher::test
@@ -0,0 +1,81 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/matcher/match_worker/src/disk_partitions.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <string>
+
+#include "absl/strings/str_cat.h"
+#include "cc/public/core/test/interface/execution_result_matchers.h"
+
+
+namespace google::pair::matcher::test {
+
+TEST(DiskPartitionsTest, AddsRowsToThePartitionOfTheirKey) {
+  constexpr size_t kNumPartitions = 4;
+  DiskPartitions partitions(testing::TempDir(), kNumPartitions);
+  EXPECT_SUCCESS(partitions.Add("key1", "val1"));
+  EXPECT_SUCCESS(partitions.Add("key2"));
+  EXPECT_SUCCESS(partitions.Add("key1", "val2"));
+
+  auto partition1 = DiskPartitions::GetPartitionIndex("key1", kNumPartitions);
+  auto partition2 = DiskPartitions::GetPartitionIndex("key2", kNumPartitions);
+  ASSERT_LT(partition1, kNumPartitions);
+  ASSERT_LT(partition2, kNumPartitions);
+  if (partition1 == partition2) {
+    EXPECT_EQ(partitions.GetPartition(partition1),
+              "key1,val1\nkey2\nkey1,val2\n");
+  } else {
+    EXPECT_EQ(partitions.GetPartition(partition1), "key1,val1\nkey1,val2\n");
+    EXPECT_EQ(partitions.GetPartition(partition2), "key2\n");
+  }
+  EXPECT_EQ(partitions.GetNumPartitions(), kNumPartitions);
+}
+
+TEST(DiskPartitionsTest, SpreadsKeysOverAllPartitions) {
+  constexpr size_t kNumPartitions = 8;
+  constexpr int kNumRows = 100000;
+  DiskPartitions partitions(testing::TempDir(), kNumPartitions);
+  size_t expected_num_bytes = 0;
+  for (int i = 0; i < kNumRows; i++) {
+    auto key = absl::StrCat("key", i);
+    ASSERT_SUCCESS(partitions.Add(key, "value"));
+    expected_num_bytes += key.size() + 7;
+  }
+
+  size_t num_bytes = 0;
+  for (size_t i = 0; i < kNumPartitions; i++) {
+    auto partition = partitions.GetPartition(i);
+    num_bytes += partition.size();
+    // Each partition holds roughly its share of the rows.
+    auto num_rows = std::count(partition.begin(), partition.end(), '\n');
+    EXPECT_GT(num_rows, kNumRows / kNumPartitions * 9 / 10);
+    EXPECT_LT(num_rows, kNumRows / kNumPartitions * 11 / 10);
+  }
+  EXPECT_EQ(num_bytes, expected_num_bytes);
+}
+
+TEST(DiskPartitionsTest, ReleaseEmptiesThePartition) {
+  DiskPartitions partitions(testing::TempDir(), 1);
+  EXPECT_SUCCESS(partitions.Add("key1", "val1"));
+  EXPECT_EQ(partitions.GetPartition(0), "key1,val1\n");
+
+  partitions.Release(0);
+  EXPECT_EQ(partitions.GetPartition(0), "");
+}
+
+}  // namespace google::pair::matcher::test
@@ -0,0 +1,124 @@
+// Copyright 2024 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cc/matcher/match_worker/src/match_table_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+
+#include "cc/matcher/match_table/src/open_addressing_match_table.h"
+
+using std::make_shared;
+using std::string;
+
+namespace google::pair::matcher::test {
+
+// The memory each mapping built below counts against the limit.
+constexpr uint64_t kMappingBytes = 100;
+
+// Returns a mapping whose table holds one row.
+LoadedMapping BuildMapping(const string& plaintext_id) {
+  auto table = make_shared<OpenAddressingMatchTable<string, string>>();
+  EXPECT_TRUE(table->AddElement(plaintext_id, "value").Successful());
+  table->Freeze();
+  return LoadedMapping{table, nullptr};
+}
+
+MatchTableCacheKey BuildKey(const string& version,
+                            const string& name = "mapping") {
+  return MatchTableCacheKey{"bucket", name, version, std::nullopt};
+}
+
+TEST(MatchTableCacheTest, GetsWhatWasPut) {
+  MatchTableCache cache(1024 * 1024);
+  auto mapping = BuildMapping("key1");
+  cache.Put(BuildKey("1"), mapping, kMappingBytes);
+
+  auto cached = cache.Get(BuildKey("1"));
+  ASSERT_TRUE(cached);
+  EXPECT_EQ(cached->match_table, mapping.match_table);
+  EXPECT_FALSE(cache.Get(BuildKey("2")));
+  auto key = BuildKey("1");
+  key.prefilter_false_positive_rate = 0.01;
+  EXPECT_FALSE(cache.Get(key));
+
+  auto stats = cache.GetStats();
+  EXPECT_EQ(stats.num_hits, 1);
+  EXPECT_EQ(stats.num_misses, 2);
+  EXPECT_EQ(stats.num_entries, 1);
+  EXPECT_EQ(stats.num_bytes, kMappingBytes);
+}
+
+TEST(MatchTableCacheTest, EvictsLeastRecentlyUsed) {
+  MatchTableCache cache(2 * kMappingBytes);
+  cache.Put(BuildKey("1"), BuildMapping("key1"), kMappingBytes);
+  cache.Put(BuildKey("2"), BuildMapping("key2"), kMappingBytes);
+  // 1 is now more recently used than 2.
+  EXPECT_TRUE(cache.Get(BuildKey("1")));
+  cache.Put(BuildKey("3"), BuildMapping("key3"), kMappingBytes);
+
+  EXPECT_TRUE(cache.Get(BuildKey("1")));
+  EXPECT_FALSE(cache.Get(BuildKey("2")));
+  EXPECT_TRUE(cache.Get(BuildKey("3")));
+  EXPECT_EQ(cache.GetStats().num_entries, 2);
+  EXPECT_EQ(cache.GetStats().num_bytes, 2 * kMappingBytes);
+}
+
+TEST(MatchTableCacheTest, DoesNotCacheMappingsOverTheLimit) {
+  MatchTableCache cache(kMappingBytes - 1);
+  cache.Put(BuildKey("1"), BuildMapping("key1"), kMappingBytes);
+
+  EXPECT_FALSE(cache.Get(BuildKey("1")));
+  EXPECT_EQ(cache.GetStats().num_entries, 0);
+  EXPECT_EQ(cache.GetStats().num_bytes, 0);
+}
+
+TEST(MatchTableCacheTest, EvictedMappingStaysAliveWhileInUse) {
+  MatchTableCache cache(kMappingBytes);
+  cache.Put(BuildKey("1"), BuildMapping("key1"), kMappingBytes);
+  auto cached = cache.Get(BuildKey("1"));
+  ASSERT_TRUE(cached);
+  cache.Put(BuildKey("2"), BuildMapping("key2"), kMappingBytes);
+
+  EXPECT_FALSE(cache.Get(BuildKey("1")));
+  auto value_or = cached->match_table->MarkMatched("key1");
+  ASSERT_TRUE(value_or.Successful());
+  EXPECT_EQ(*value_or, "value");
+}
+
+TEST(MatchTableCacheTest, MakingRoomToLoadEvictsOtherVersions) {
+  MatchTableCache cache(3 * kMappingBytes);
+  cache.Put(BuildKey("1"), BuildMapping("key1"), kMappingBytes);
+  cache.Put(BuildKey("1", "other"), BuildMapping("key1"), kMappingBytes);
+
+  cache.MakeRoomToLoad(BuildKey("2"));
+
+  EXPECT_FALSE(cache.Get(BuildKey("1")));
+  EXPECT_TRUE(cache.Get(BuildKey("1", "other")));
+  EXPECT_EQ(cache.GetStats().num_entries, 1);
+  EXPECT_EQ(cache.GetStats().num_bytes, kMappingBytes);
+}
+
+TEST(MatchTableCacheTest, MakingRoomToLoadKeepsTheMappingIfCached) {
+  MatchTableCache cache(kMappingBytes);
+  cache.Put(BuildKey("1"), BuildMapping("key1"), kMappingBytes);
+
+  cache.MakeRoomToLoad(BuildKey("1"));
+
+  EXPECT_TRUE(cache.Get(BuildKey("1")));
+}
+
+}  // namespace google::pair::matcher::test
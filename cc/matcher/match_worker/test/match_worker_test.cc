@@ -18,13 +18,17 @@
 
 #include <gtest/gtest.h>
 
+#include <map>
 #include <string>
 
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
 #include "absl/strings/str_split.h"
 #include "cc/common/attestation/src/attestation_info.h"
 #include "cc/common/blob_streamer/mock/mock_blob_streamer.h"
+#include "cc/core/async_executor/src/async_executor.h"
 #include "cc/matcher/match_table/src/error_codes.h"
+#include "cc/matcher/match_worker/src/error_codes.h"
 #include "cc/public/core/interface/execution_result.h"
 #include "cc/public/core/test/interface/execution_result_matchers.h"
 #include "cc/public/cpio/mock/blob_storage_client/mock_blob_storage_client.h"
@@ -32,12 +36,14 @@
 #include "core/test/utils/conditional_wait.h"
 #include "core/test/utils/proto_test_utils.h"
 
-using google::cmrt::sdk::blob_storage_service::v1::GetBlobResponse;
 using google::pair::common::BlobStreamerInterface;
 using google::pair::common::BuildGcpCloudIdentityInfo;
 using google::pair::common::GetBlobStreamChunkProcessorCallback;
 using google::pair::common::GetBlobStreamContext;
 using google::pair::common::MockBlobStreamer;
+using google::pair::matcher::errors::
+    MATCH_WORKER_INVALID_PREFILTER_FALSE_POSITIVE_RATE;
+using google::scp::core::AsyncExecutor;
 using google::scp::core::ExecutionResult;
 using google::scp::core::FailureExecutionResult;
 using google::scp::core::SuccessExecutionResult;
@@ -49,6 +55,7 @@ using std::atomic_bool;
 using std::atomic_int;
 using std::initializer_list;
 using std::make_shared;
+using std::map;
 using std::pair;
 using std::shared_ptr;
 using std::string;
@@ -57,6 +64,7 @@ using std::unique_ptr;
 using std::vector;
 using std::chrono::milliseconds;
 using std::this_thread::sleep_for;
+using testing::ElementsAre;
 using testing::Optional;
 using testing::Pair;
 using testing::Return;
@@ -73,6 +81,14 @@ constexpr char kOutputList[] = "output_list";
 constexpr char kEmail1[] = "key1", kEmail2[] = "key2", kEmail3[] = "key3";
 constexpr char kEncrypted1[] = "val1", kEncrypted2[] = "val2",
                kEncrypted3[] = "val3";
+
+// SHA-256 hashed IDs mapped to UUIDs, which the worker stores in binary form.
+constexpr char kHashedEmail1[] =
+    "973dfe463ec85785f5f95af5ba3906eedb2d931c24e69824a89ea65dba4e813b";
+constexpr char kHashedEmail2[] =
+    "0d9c7a2a0c2f4ba0bbb1b8b5b1f0cb9b3c5e5f0c9c1f2b9d6f0e3f4a5b6c7d8e";
+constexpr char kUuid1[] = "0ba0e3b4-5b6c-4d8e-9f00-112233445566",
+               kUuid2[] = "ffeeddcc-bbaa-4998-8877-665544332211";
 }  // namespace
 
 namespace google::pair::matcher::test {
@@ -83,7 +99,8 @@ class MatchWorkerTest : public testing::Test {
       : blob_storage_client_(make_shared<MockBlobStorageClient>()),
         blob_streamer_(*new MockBlobStreamer()),
         matcher_(blob_storage_client_,
-                 unique_ptr<BlobStreamerInterface>(&blob_streamer_)) {
+                 unique_ptr<BlobStreamerInterface>(&blob_streamer_),
+                 testing::TempDir()) {
     absl::StrAppend(&mapping_, kEmail1, ",", kEncrypted1, "\n");
     absl::StrAppend(&mapping_, kEmail2, ",", kEncrypted2, "\n");
     absl::StrAppend(&mapping_, kEmail3, ",", kEncrypted3, "\n");
@@ -103,6 +120,23 @@ void CallCallbackWithEmails(const GetBlobStreamChunkProcessorCallback& callback,
   callback("", true, SuccessExecutionResult());
 }
 
+MATCHER_P(IsForBucket, bucket_name, "") {
+  return arg.GetBucketName() == bucket_name;
+}
+
+MATCHER_P(IsForBlob, blob_path, "") {
+  return arg.GetBlobPath() == blob_path;
+}
+
+// Returns an action for GetBlobStream which streams the mapping in one chunk.
+auto StreamMapping(const string& mapping) {
+  return [&mapping](auto context) {
+    context.GetCallback()(mapping, false, SuccessExecutionResult());
+    context.GetCallback()("", true, SuccessExecutionResult());
+    return SuccessExecutionResult();
+  };
+}
+
 // Splits ids_string on newlines '\n' - removes trailing empty string if
 // present.
 vector<string> IdsStringToVector(string& ids_string) {
@@ -112,32 +146,31 @@ vector<string> IdsStringToVector(string& ids_string) {
 }
 
 TEST_F(MatchWorkerTest, ExportWorks) {
-  EXPECT_CALL(*blob_storage_client_, GetBlobSync)
-      .WillOnce([this](auto request) {
-        EXPECT_EQ(request.blob_metadata().bucket_name(), kPublisherBucketName);
-        EXPECT_EQ(request.blob_metadata().blob_name(), kPublisherMapping);
-        EXPECT_FALSE(request.has_cloud_identity_info())
-            << request.cloud_identity_info().DebugString();
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce([this](auto context) {
+        EXPECT_EQ(context.GetBlobPath(), kPublisherMapping);
+        EXPECT_FALSE(context.GetCloudIdentityInfo());
 
-        GetBlobResponse response;
-        response.mutable_blob()->set_data(mapping_);
-        return response;
+        return StreamMapping(mapping_)(context);
       });
 
-  EXPECT_CALL(blob_streamer_, GetBlobStream).WillOnce([this](auto context) {
-    EXPECT_EQ(context.GetBucketName(), kAdvertiserBucketName);
-    EXPECT_EQ(context.GetBlobPath(), kAdvertiserList);
-    EXPECT_FALSE(context.GetCloudIdentityInfo());
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([this](auto context) {
+        EXPECT_EQ(context.GetBucketName(), kAdvertiserBucketName);
+        EXPECT_EQ(context.GetBlobPath(), kAdvertiserList);
+        EXPECT_FALSE(context.GetCloudIdentityInfo());
 
-    CallCallbackWithEmails(context.GetCallback(), {kEmail1, kEmail3});
-    return SuccessExecutionResult();
-  });
+        CallCallbackWithEmails(context.GetCallback(), {kEmail1, kEmail3});
+        return SuccessExecutionResult();
+      });
   string matched_encrypted_ids_string;
   EXPECT_CALL(blob_streamer_, PutBlobStream)
       .WillOnce([this, &matched_encrypted_ids_string](auto context) {
         EXPECT_EQ(context.GetBucketName(), kOutputBucketName);
         EXPECT_EQ(context.GetBlobPath(), kOutputList);
-        EXPECT_EQ(context.GetInitialData(), absl::StrCat(kEncrypted1, "\n"));
+        // All matches fit in the first flush.
+        EXPECT_EQ(context.GetInitialData(),
+                  absl::StrCat(kEncrypted1, "\n", kEncrypted3, "\n"));
         EXPECT_FALSE(context.GetCloudIdentityInfo());
         matched_encrypted_ids_string += context.GetInitialData();
 
@@ -159,40 +192,267 @@ TEST_F(MatchWorkerTest, ExportWorks) {
               UnorderedElementsAre(kEncrypted1, kEncrypted3));
 }
 
+TEST_F(MatchWorkerTest, ExportWorksWithMappingStreamedInPieces) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce([this](auto context) {
+        // Chunks are cut in the middle of rows.
+        for (char c : mapping_) {
+          context.GetCallback()(string(1, c), false, SuccessExecutionResult());
+        }
+        context.GetCallback()("", true, SuccessExecutionResult());
+        return SuccessExecutionResult();
+      });
+
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {kEmail2, kEmail3});
+        return SuccessExecutionResult();
+      });
+  string matched_encrypted_ids_string;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .WillOnce([&matched_encrypted_ids_string](auto context) {
+        matched_encrypted_ids_string += context.GetInitialData();
+        return
+            [&matched_encrypted_ids_string](auto chunk_or) -> ExecutionResult {
+              if (!chunk_or.Successful()) {
+                ADD_FAILURE();
+              } else if (chunk_or->has_value()) {
+                matched_encrypted_ids_string += **chunk_or;
+              }
+              return SuccessExecutionResult();
+            };
+      });
+  EXPECT_SUCCESS(matcher_.ExportMatches(
+      {kPublisherBucketName, kPublisherMapping, kAdvertiserBucketName,
+       kAdvertiserList, kOutputBucketName, kOutputList}));
+  EXPECT_THAT(IdsStringToVector(matched_encrypted_ids_string),
+              UnorderedElementsAre(kEncrypted2, kEncrypted3));
+}
+
+TEST_F(MatchWorkerTest, ExportWorksWithOnDiskMatchTable) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {kEmail1, kEmail3});
+        return SuccessExecutionResult();
+      });
+  string matched_encrypted_ids_string;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .WillOnce([&matched_encrypted_ids_string](auto context) {
+        matched_encrypted_ids_string += context.GetInitialData();
+        return
+            [&matched_encrypted_ids_string](auto chunk_or) -> ExecutionResult {
+              if (!chunk_or.Successful()) {
+                ADD_FAILURE();
+              } else if (chunk_or->has_value()) {
+                matched_encrypted_ids_string += **chunk_or;
+              }
+              return SuccessExecutionResult();
+            };
+      });
+  ExportMatchesRequest request{
+      kPublisherBucketName, kPublisherMapping, kAdvertiserBucketName,
+      kAdvertiserList,      kOutputBucketName, kOutputList};
+  request.on_disk_match_table_threshold_bytes = mapping_.size() - 1;
+  EXPECT_SUCCESS(matcher_.ExportMatches(request));
+
+  EXPECT_TRUE(matcher_.GetLastExportMatchesStats().used_on_disk_match_table);
+  EXPECT_THAT(IdsStringToVector(matched_encrypted_ids_string),
+              UnorderedElementsAre(kEncrypted1, kEncrypted3));
+}
+
+TEST_F(MatchWorkerTest, ExportWorksWithConcurrentDownloadAndSpilling) {
+  // The advertiser list streams in before the mapping.
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(),
+                               {kEmail1, kEmail2, kEmail3});
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  string matched_encrypted_ids_string;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .WillOnce([&matched_encrypted_ids_string](auto context) {
+        matched_encrypted_ids_string += context.GetInitialData();
+        return
+            [&matched_encrypted_ids_string](auto chunk_or) -> ExecutionResult {
+              if (!chunk_or.Successful()) {
+                ADD_FAILURE();
+              } else if (chunk_or->has_value()) {
+                matched_encrypted_ids_string += **chunk_or;
+              }
+              return SuccessExecutionResult();
+            };
+      });
+  ExportMatchesRequest request{
+      kPublisherBucketName, kPublisherMapping, kAdvertiserBucketName,
+      kAdvertiserList,      kOutputBucketName, kOutputList};
+  // Only the first row fits in memory, the other two are spilled.
+  request.concurrent_download_buffer_bytes = 6;
+  EXPECT_SUCCESS(matcher_.ExportMatches(request));
+
+  EXPECT_EQ(matched_encrypted_ids_string,
+            absl::StrCat(kEncrypted1, "\n", kEncrypted2, "\n", kEncrypted3,
+                         "\n"));
+  EXPECT_EQ(matcher_.GetLastExportMatchesStats().num_advertiser_bytes_spilled,
+            10);
+}
+
+TEST_F(MatchWorkerTest, ConcurrentDownloadKeepsStreamingOnceTableIsReady) {
+  thread stream_thread;
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([&stream_thread](auto context) {
+        stream_thread = thread([callback = context.GetCallback()] {
+          callback(absl::StrCat(kEmail3, "\n"), false,
+                   SuccessExecutionResult());
+          // Give the main thread time to load the mapping, so the rest of the
+          // list comes in after the held back chunk is released.
+          sleep_for(milliseconds(100));
+          CallCallbackWithEmails(callback, {kEmail1});
+        });
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  string matched_encrypted_ids_string;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .WillOnce([&matched_encrypted_ids_string](auto context) {
+        matched_encrypted_ids_string += context.GetInitialData();
+        return
+            [&matched_encrypted_ids_string](auto chunk_or) -> ExecutionResult {
+              if (!chunk_or.Successful()) {
+                ADD_FAILURE();
+              } else if (chunk_or->has_value()) {
+                matched_encrypted_ids_string += **chunk_or;
+              }
+              return SuccessExecutionResult();
+            };
+      });
+  ExportMatchesRequest request{
+      kPublisherBucketName, kPublisherMapping, kAdvertiserBucketName,
+      kAdvertiserList,      kOutputBucketName, kOutputList};
+  request.concurrent_download_buffer_bytes = 1024;
+  EXPECT_SUCCESS(matcher_.ExportMatches(request));
+  stream_thread.join();
+
+  // The held back row is matched first.
+  EXPECT_EQ(matched_encrypted_ids_string,
+            absl::StrCat(kEncrypted3, "\n", kEncrypted1, "\n"));
+  EXPECT_EQ(matcher_.GetLastExportMatchesStats().num_advertiser_bytes_spilled,
+            0);
+}
+
+TEST_F(MatchWorkerTest, ConcurrentDownloadFailsIfLoadingTheMappingFails) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {kEmail1, kEmail3});
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(Return(FailureExecutionResult(12345)));
+  EXPECT_CALL(blob_streamer_, PutBlobStream).Times(0);
+  ExportMatchesRequest request{
+      kPublisherBucketName, kPublisherMapping, kAdvertiserBucketName,
+      kAdvertiserList,      kOutputBucketName, kOutputList};
+  request.concurrent_download_buffer_bytes = 1024;
+  EXPECT_THAT(matcher_.ExportMatches(request),
+              ResultIs(FailureExecutionResult(12345)));
+}
+
+TEST_F(MatchWorkerTest,
+       ConcurrentDownloadIsCancelledWhenLoadingTheMappingFails) {
+  thread stream_thread;
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([&stream_thread](auto context) {
+        stream_thread = thread([context] {
+          context.GetCallback()(absl::StrCat(kEmail3, "\n"), false,
+                                SuccessExecutionResult());
+          // The rest of the list is only streamed if the download is not
+          // cancelled.
+          WaitUntil([&context]() { return context.IsCancelled(); });
+          context.GetCallback()("", true, FailureExecutionResult(678910));
+        });
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(Return(FailureExecutionResult(12345)));
+  EXPECT_CALL(blob_streamer_, PutBlobStream).Times(0);
+  ExportMatchesRequest request{
+      kPublisherBucketName, kPublisherMapping, kAdvertiserBucketName,
+      kAdvertiserList,      kOutputBucketName, kOutputList};
+  request.concurrent_download_buffer_bytes = 1024;
+  EXPECT_THAT(matcher_.ExportMatches(request),
+              ResultIs(FailureExecutionResult(12345)));
+  stream_thread.join();
+}
+
+TEST_F(MatchWorkerTest, ExportWorksWithHashedIds) {
+  string mapping = absl::StrCat(kHashedEmail1, ",", kUuid1, "\n",
+                                kHashedEmail2, ",", kUuid2, "\n",
+                                // Does not fit the binary form.
+                                kEmail3, ",", kEncrypted3, "\n");
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping));
+
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(),
+                               {kHashedEmail2, kEmail3, kEmail1});
+        return SuccessExecutionResult();
+      });
+  string matched_encrypted_ids_string;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .WillOnce([&matched_encrypted_ids_string](auto context) {
+        matched_encrypted_ids_string += context.GetInitialData();
+        return
+            [&matched_encrypted_ids_string](auto chunk_or) -> ExecutionResult {
+              if (!chunk_or.Successful()) {
+                ADD_FAILURE();
+              } else if (chunk_or->has_value()) {
+                matched_encrypted_ids_string += **chunk_or;
+              }
+              return SuccessExecutionResult();
+            };
+      });
+  EXPECT_SUCCESS(matcher_.ExportMatches(
+      {kPublisherBucketName, kPublisherMapping, kAdvertiserBucketName,
+       kAdvertiserList, kOutputBucketName, kOutputList}));
+  EXPECT_THAT(IdsStringToVector(matched_encrypted_ids_string),
+              UnorderedElementsAre(kUuid2, kEncrypted3));
+}
+
 TEST_F(MatchWorkerTest, ExportPassesWipProvider) {
-  EXPECT_CALL(*blob_storage_client_, GetBlobSync)
-      .WillOnce([this](auto request) {
-        EXPECT_EQ(request.blob_metadata().bucket_name(), kPublisherBucketName);
-        EXPECT_EQ(request.blob_metadata().blob_name(), kPublisherMapping);
-        EXPECT_EQ(request.cloud_identity_info().owner_id(),
-                  "publisher_project");
-        EXPECT_EQ(request.cloud_identity_info()
-                      .attestation_info()
-                      .gcp_attestation_info()
-                      .wip_provider(),
-                  "publisher_wip_provider");
-
-        GetBlobResponse response;
-        response.mutable_blob()->set_data(mapping_);
-        return response;
-      });
-
-  EXPECT_CALL(blob_streamer_, GetBlobStream).WillOnce([this](auto context) {
-    EXPECT_EQ(context.GetBucketName(), kAdvertiserBucketName);
-    EXPECT_EQ(context.GetBlobPath(), kAdvertiserList);
-    EXPECT_THAT(context.GetCloudIdentityInfo(),
-                Optional(EqualsProto(BuildGcpCloudIdentityInfo(
-                    "advertiser_project", "advertiser_wip_provider"))));
-
-    CallCallbackWithEmails(context.GetCallback(), {kEmail1, kEmail3});
-    return SuccessExecutionResult();
-  });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce([this](auto context) {
+        EXPECT_EQ(context.GetBlobPath(), kPublisherMapping);
+        EXPECT_THAT(context.GetCloudIdentityInfo(),
+                    Optional(EqualsProto(BuildGcpCloudIdentityInfo(
+                        "publisher_project", "publisher_wip_provider"))));
+
+        return StreamMapping(mapping_)(context);
+      });
+
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([this](auto context) {
+        EXPECT_EQ(context.GetBucketName(), kAdvertiserBucketName);
+        EXPECT_EQ(context.GetBlobPath(), kAdvertiserList);
+        EXPECT_THAT(context.GetCloudIdentityInfo(),
+                    Optional(EqualsProto(BuildGcpCloudIdentityInfo(
+                        "advertiser_project", "advertiser_wip_provider"))));
+
+        CallCallbackWithEmails(context.GetCallback(), {kEmail1, kEmail3});
+        return SuccessExecutionResult();
+      });
   string matched_encrypted_ids_string;
   EXPECT_CALL(blob_streamer_, PutBlobStream)
       .WillOnce([this, &matched_encrypted_ids_string](auto context) {
         EXPECT_EQ(context.GetBucketName(), kOutputBucketName);
         EXPECT_EQ(context.GetBlobPath(), kOutputList);
-        EXPECT_EQ(context.GetInitialData(), absl::StrCat(kEncrypted1, "\n"));
+        EXPECT_EQ(context.GetInitialData(),
+                  absl::StrCat(kEncrypted1, "\n", kEncrypted3, "\n"));
         EXPECT_THAT(context.GetCloudIdentityInfo(),
                     Optional(EqualsProto(BuildGcpCloudIdentityInfo(
                         "publisher_project", "publisher_wip_provider"))));
@@ -221,11 +481,792 @@ TEST_F(MatchWorkerTest, ExportPassesWipProvider) {
               UnorderedElementsAre(kEncrypted1, kEncrypted3));
 }
 
-TEST_F(MatchWorkerTest, FailsIfGettingTheMappingFails) {
-  EXPECT_CALL(*blob_storage_client_, GetBlobSync)
+TEST_F(MatchWorkerTest, ExportWithPrefilterSkipsMostUnmatchedIds) {
+  constexpr int kNumUnmatched = 1000;
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        const auto& callback = context.GetCallback();
+        callback(absl::StrCat(kEmail2, "\n"), false, SuccessExecutionResult());
+        for (int i = 0; i < kNumUnmatched; i++) {
+          callback(absl::StrCat("unmatched", i, "\n"), false,
+                   SuccessExecutionResult());
+        }
+        callback("", true, SuccessExecutionResult());
+        return SuccessExecutionResult();
+      });
+  string matched_encrypted_ids_string;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .WillOnce([&matched_encrypted_ids_string](auto context) {
+        matched_encrypted_ids_string += context.GetInitialData();
+        return [](auto chunk_or) -> ExecutionResult {
+          if (!chunk_or.Successful() || chunk_or->has_value()) {
+            ADD_FAILURE() << "Expected only the done marker";
+          }
+          return SuccessExecutionResult();
+        };
+      });
+  ExportMatchesRequest request{
+      kPublisherBucketName, kPublisherMapping, kAdvertiserBucketName,
+      kAdvertiserList,      kOutputBucketName, kOutputList};
+  request.prefilter_false_positive_rate = 0.01;
+  EXPECT_SUCCESS(matcher_.ExportMatches(request));
+
+  EXPECT_EQ(matched_encrypted_ids_string, absl::StrCat(kEncrypted2, "\n"));
+  const auto& stats = matcher_.GetLastExportMatchesStats();
+  EXPECT_EQ(stats.num_prefilter_hits + stats.num_prefilter_misses,
+            kNumUnmatched + 1);
+  // 1% of the unmatched IDs are expected to pass the prefilter.
+  EXPECT_LT(stats.num_prefilter_hits, 1 + kNumUnmatched / 20);
+  EXPECT_EQ(stats.num_matched, 1);
+}
+
+TEST_F(MatchWorkerTest, ExportMatchesBlocksInParallelAndInOrder) {
+  constexpr int kNumMappingRows = 500000;
+  constexpr size_t kChunkSize = 64 * 1024;
+  auto cpu_async_executor = make_shared<AsyncExecutor>(4, 100000);
+  EXPECT_SUCCESS(cpu_async_executor->Init());
+  EXPECT_SUCCESS(cpu_async_executor->Run());
+  auto* blob_streamer = new MockBlobStreamer();
+  MatchWorker matcher(blob_storage_client_,
+                      unique_ptr<BlobStreamerInterface>(blob_streamer),
+                      testing::TempDir(), cpu_async_executor);
+  string mapping, advertiser_list, expected_matches;
+  for (int i = 0; i < kNumMappingRows; i++) {
+    absl::StrAppend(&mapping, "key", i, ",val", i, "\n");
+    absl::StrAppend(&expected_matches, "val", i, "\n");
+  }
+  // Every other advertiser ID matches. The list spans many blocks.
+  for (int i = 0; i < kNumMappingRows * 2; i++) {
+    absl::StrAppend(&advertiser_list, i % 2 == 0 ? "key" : "other", i / 2,
+                    "\n");
+  }
+  EXPECT_CALL(*blob_streamer, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping));
+
+  EXPECT_CALL(*blob_streamer, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([&advertiser_list](auto context) {
+        // Chunks are cut in the middle of rows.
+        for (size_t i = 0; i < advertiser_list.size(); i += kChunkSize) {
+          context.GetCallback()(advertiser_list.substr(i, kChunkSize), false,
+                                SuccessExecutionResult());
+        }
+        context.GetCallback()("", true, SuccessExecutionResult());
+        return SuccessExecutionResult();
+      });
+  string matched_encrypted_ids_string;
+  EXPECT_CALL(*blob_streamer, PutBlobStream)
+      .WillOnce([&matched_encrypted_ids_string](auto context) {
+        matched_encrypted_ids_string += context.GetInitialData();
+        return
+            [&matched_encrypted_ids_string](auto chunk_or) -> ExecutionResult {
+              if (!chunk_or.Successful()) {
+                ADD_FAILURE();
+              } else if (chunk_or->has_value()) {
+                matched_encrypted_ids_string += **chunk_or;
+              }
+              return SuccessExecutionResult();
+            };
+      });
+  EXPECT_SUCCESS(matcher.ExportMatches(
+      {kPublisherBucketName, kPublisherMapping, kAdvertiserBucketName,
+       kAdvertiserList, kOutputBucketName, kOutputList}));
+  EXPECT_SUCCESS(cpu_async_executor->Stop());
+
+  // The matches are uploaded in the order of the advertiser list.
+  EXPECT_EQ(matched_encrypted_ids_string, expected_matches);
+  EXPECT_EQ(matcher.GetLastExportMatchesStats().num_matched, kNumMappingRows);
+}
+
+TEST_F(MatchWorkerTest, ExportWorksWithPartitionedJoin) {
+  constexpr int kNumMappingRows = 10000;
+  constexpr size_t kChunkSize = 4096;
+  constexpr uint32_t kNumPartitions = 8;
+  string mapping, advertiser_list;
+  vector<string> expected_matches;
+  for (int i = 0; i < kNumMappingRows; i++) {
+    absl::StrAppend(&mapping, "key", i, ",val", i, "\n");
+    expected_matches.push_back(absl::StrCat("val", i));
+  }
+  // Every other advertiser ID matches.
+  for (int i = 0; i < kNumMappingRows * 2; i++) {
+    absl::StrAppend(&advertiser_list, i % 2 == 0 ? "key" : "other", i / 2,
+                    "\n");
+  }
+  // Exports the matches, joining the partitions on cpu_async_executor if set,
+  // and returns what was uploaded.
+  auto export_matches = [this, &mapping, &advertiser_list](
+                            shared_ptr<AsyncExecutor> cpu_async_executor) {
+    auto* blob_streamer = new MockBlobStreamer();
+    MatchWorker matcher(blob_storage_client_,
+                        unique_ptr<BlobStreamerInterface>(blob_streamer),
+                        testing::TempDir(), cpu_async_executor);
+    EXPECT_CALL(*blob_streamer,
+                GetBlobStream(IsForBucket(kPublisherBucketName)))
+        .WillOnce([&mapping](auto context) {
+          // The mapping goes over the budget after a few chunks.
+          for (size_t i = 0; i < mapping.size(); i += kChunkSize) {
+            context.GetCallback()(mapping.substr(i, kChunkSize), false,
+                                  SuccessExecutionResult());
+          }
+          context.GetCallback()("", true, SuccessExecutionResult());
+          return SuccessExecutionResult();
+        });
+    EXPECT_CALL(*blob_streamer,
+                GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+        .WillOnce([&advertiser_list](auto context) {
+          context.GetCallback()(advertiser_list, false,
+                                SuccessExecutionResult());
+          context.GetCallback()("", true, SuccessExecutionResult());
+          return SuccessExecutionResult();
+        });
+    string matched_encrypted_ids_string;
+    EXPECT_CALL(*blob_streamer, PutBlobStream)
+        .WillOnce([&matched_encrypted_ids_string](auto context) {
+          matched_encrypted_ids_string += context.GetInitialData();
+          return [&matched_encrypted_ids_string](
+                     auto chunk_or) -> ExecutionResult {
+            if (!chunk_or.Successful()) {
+              ADD_FAILURE();
+            } else if (chunk_or->has_value()) {
+              matched_encrypted_ids_string += **chunk_or;
+            }
+            return SuccessExecutionResult();
+          };
+        });
+    ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                                 kAdvertiserBucketName, kAdvertiserList,
+                                 kOutputBucketName,     kOutputList};
+    request.join_memory_budget_bytes = 3 * kChunkSize;
+    request.num_join_partitions = kNumPartitions;
+    EXPECT_SUCCESS(matcher.ExportMatches(request));
+    EXPECT_EQ(matcher.GetLastExportMatchesStats().num_matched,
+              kNumMappingRows);
+    EXPECT_EQ(matcher.GetLastExportMatchesStats().num_join_partitions,
+              kNumPartitions);
+    return matched_encrypted_ids_string;
+  };
+  auto cpu_async_executor = make_shared<AsyncExecutor>(4, 100000);
+  EXPECT_SUCCESS(cpu_async_executor->Init());
+  EXPECT_SUCCESS(cpu_async_executor->Run());
+
+  auto matched_encrypted_ids_string = export_matches(cpu_async_executor);
+  EXPECT_SUCCESS(cpu_async_executor->Stop());
+
+  EXPECT_THAT(IdsStringToVector(matched_encrypted_ids_string),
+              testing::UnorderedElementsAreArray(expected_matches));
+  // The matches are uploaded partition by partition, in the order of the
+  // partitions, however the parallel joins finish.
+  EXPECT_EQ(matched_encrypted_ids_string,
+            export_matches(/* cpu_async_executor */ nullptr));
+}
+
+TEST_F(MatchWorkerTest, PartitionedJoinFailsWithDuplicatesInTheMapping) {
+  absl::StrAppend(&mapping_, kEmail1, ",", kEncrypted2, "\n");
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {kEmail1, kEmail3});
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, PutBlobStream).Times(0);
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+  request.join_memory_budget_bytes = 1;
+  request.num_join_partitions = 1;
+  EXPECT_THAT(matcher_.ExportMatches(request),
+              ResultIs(FailureExecutionResult(
+                  errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS)));
+  EXPECT_EQ(matcher_.GetLastExportMatchesStats().num_duplicate_publisher_ids,
+            1);
+}
+
+TEST_F(MatchWorkerTest, FailsIfNumJoinPartitionsIsInvalid) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream).Times(0);
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+  request.join_memory_budget_bytes = 1;
+  request.num_join_partitions = 0;
+  EXPECT_THAT(matcher_.ExportMatches(request),
+              ResultIs(FailureExecutionResult(
+                  errors::MATCH_WORKER_INVALID_NUM_JOIN_PARTITIONS)));
+}
+
+TEST_F(MatchWorkerTest, ExportUploadsMatchesInChunksOfTheFlushSize) {
+  constexpr int kNumRows = 100;
+  constexpr uint64_t kFlushBytes = 64;
+  string mapping;
+  for (int i = 0; i < kNumRows; i++) {
+    absl::StrAppend(&mapping, "user", i, "@example.com,encrypted", i, "\n");
+  }
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping));
+
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        // One row per chunk, so every row is matched in a block of its own.
+        const auto& callback = context.GetCallback();
+        for (int i = 0; i < kNumRows; i++) {
+          callback(absl::StrCat("user", i, "@example.com\n"), false,
+                   SuccessExecutionResult());
+        }
+        callback("", true, SuccessExecutionResult());
+        return SuccessExecutionResult();
+      });
+  vector<string> chunks;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .WillOnce([&chunks](auto context) {
+        chunks.push_back(context.GetInitialData());
+        return [&chunks](auto chunk_or) -> ExecutionResult {
+          if (!chunk_or.Successful()) {
+            ADD_FAILURE();
+          } else if (chunk_or->has_value()) {
+            chunks.push_back(**chunk_or);
+          }
+          return SuccessExecutionResult();
+        };
+      });
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+  request.upload_flush_bytes = kFlushBytes;
+  EXPECT_SUCCESS(matcher_.ExportMatches(request));
+
+  string expected;
+  for (int i = 0; i < kNumRows; i++) {
+    absl::StrAppend(&expected, "encrypted", i, "\n");
+  }
+  EXPECT_EQ(absl::StrJoin(chunks, ""), expected);
+  // Every chunk but the last one is flushed once it reaches the flush size.
+  ASSERT_GT(chunks.size(), 1);
+  for (size_t i = 0; i + 1 < chunks.size(); i++) {
+    EXPECT_GE(chunks[i].size(), kFlushBytes);
+    EXPECT_LT(chunks[i].size(), kFlushBytes + 12);
+  }
+  EXPECT_LE(chunks.size(), expected.size() / kFlushBytes + 1);
+}
+
+TEST_F(MatchWorkerTest, ExportWorksWithSortedInputs) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce([this](auto context) {
+        // Split a row across chunks.
+        context.GetCallback()(mapping_.substr(0, 7), false,
+                              SuccessExecutionResult());
+        context.GetCallback()(mapping_.substr(7), false,
+                              SuccessExecutionResult());
+        context.GetCallback()("", true, SuccessExecutionResult());
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(),
+                               {"key0", kEmail1, kEmail1, kEmail3, "key4"});
+        return SuccessExecutionResult();
+      });
+  string matched_encrypted_ids_string;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .WillOnce([&matched_encrypted_ids_string](auto context) {
+        matched_encrypted_ids_string += context.GetInitialData();
+        return
+            [&matched_encrypted_ids_string](auto chunk_or) -> ExecutionResult {
+              if (!chunk_or.Successful()) {
+                ADD_FAILURE();
+              } else if (chunk_or->has_value()) {
+                matched_encrypted_ids_string += **chunk_or;
+              }
+              return SuccessExecutionResult();
+            };
+      });
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+  request.sorted_inputs = true;
+  EXPECT_SUCCESS(matcher_.ExportMatches(request));
+
+  EXPECT_EQ(matched_encrypted_ids_string,
+            absl::StrCat(kEncrypted1, "\n", kEncrypted1, "\n", kEncrypted3,
+                         "\n"));
+  EXPECT_EQ(matcher_.GetLastExportMatchesStats().num_matched, 3);
+}
+
+TEST_F(MatchWorkerTest, SortedInputsFailIfTheMappingIsOutOfOrder) {
+  absl::StrAppend(&mapping_, kEmail2, ",", kEncrypted2, "\n");
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {kEmail3, "key4"});
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, PutBlobStream).Times(0);
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+  request.sorted_inputs = true;
+  EXPECT_THAT(matcher_.ExportMatches(request),
+              ResultIs(FailureExecutionResult(
+                  errors::MATCH_WORKER_UNSORTED_PUBLISHER_MAPPING)));
+}
+
+TEST_F(MatchWorkerTest, SortedInputsFailWithDuplicatesInTheMapping) {
+  absl::StrAppend(&mapping_, kEmail3, ",", kEncrypted1, "\n");
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {"key4"});
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, PutBlobStream).Times(0);
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+  request.sorted_inputs = true;
+  EXPECT_THAT(matcher_.ExportMatches(request),
+              ResultIs(FailureExecutionResult(
+                  errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS)));
+  EXPECT_EQ(matcher_.GetLastExportMatchesStats().num_duplicate_publisher_ids,
+            1);
+}
+
+TEST_F(MatchWorkerTest, SortedInputsFailIfTheAdvertiserListIsOutOfOrder) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {kEmail2, kEmail1});
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, PutBlobStream).Times(0);
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+  request.sorted_inputs = true;
+  EXPECT_THAT(matcher_.ExportMatches(request),
+              ResultIs(FailureExecutionResult(
+                  errors::MATCH_WORKER_UNSORTED_ADVERTISER_LIST)));
+}
+
+// Returns an action for PutBlobStream which appends everything uploaded to
+// uploaded.
+auto RecordUpload(string& uploaded) {
+  return [&uploaded](auto context) {
+    uploaded += context.GetInitialData();
+    return [&uploaded](auto chunk_or) -> ExecutionResult {
+      if (!chunk_or.Successful()) {
+        ADD_FAILURE();
+      } else if (chunk_or->has_value()) {
+        uploaded += **chunk_or;
+      }
+      return SuccessExecutionResult();
+    };
+  };
+}
+
+TEST_F(MatchWorkerTest, ExportOnceExportsEachMatchOnce) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(),
+                               {kEmail1, kEmail3, kEmail1, "key4", kEmail1});
+        return SuccessExecutionResult();
+      });
+  string matched_encrypted_ids_string;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .WillOnce(RecordUpload(matched_encrypted_ids_string));
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+  request.duplicate_match_mode = DuplicateMatchMode::kExportOnce;
+  EXPECT_SUCCESS(matcher_.ExportMatches(request));
+
+  EXPECT_THAT(IdsStringToVector(matched_encrypted_ids_string),
+              UnorderedElementsAre(kEncrypted1, kEncrypted3));
+  EXPECT_EQ(matcher_.GetLastExportMatchesStats().num_matched, 2);
+  EXPECT_EQ(matcher_.GetLastExportMatchesStats().num_duplicate_matches, 2);
+}
+
+TEST_F(MatchWorkerTest, CountModeExportsAndCountsDuplicateMatches) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(),
+                               {kEmail1, kEmail3, kEmail1, "key4"});
+        return SuccessExecutionResult();
+      });
+  string matched_encrypted_ids_string;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .WillOnce(RecordUpload(matched_encrypted_ids_string));
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+  request.duplicate_match_mode = DuplicateMatchMode::kCount;
+  EXPECT_SUCCESS(matcher_.ExportMatches(request));
+
+  EXPECT_THAT(IdsStringToVector(matched_encrypted_ids_string),
+              UnorderedElementsAre(kEncrypted1, kEncrypted3, kEncrypted1));
+  EXPECT_EQ(matcher_.GetLastExportMatchesStats().num_matched, 3);
+  EXPECT_EQ(matcher_.GetLastExportMatchesStats().num_duplicate_matches, 1);
+}
+
+TEST_F(MatchWorkerTest, ExportOnceWorksWithSortedInputs) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(),
+                               {kEmail1, kEmail1, kEmail3, kEmail3, "key4"});
+        return SuccessExecutionResult();
+      });
+  string matched_encrypted_ids_string;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .WillOnce(RecordUpload(matched_encrypted_ids_string));
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+  request.sorted_inputs = true;
+  request.duplicate_match_mode = DuplicateMatchMode::kExportOnce;
+  EXPECT_SUCCESS(matcher_.ExportMatches(request));
+
+  EXPECT_EQ(matched_encrypted_ids_string,
+            absl::StrCat(kEncrypted1, "\n", kEncrypted3, "\n"));
+  EXPECT_EQ(matcher_.GetLastExportMatchesStats().num_matched, 2);
+  EXPECT_EQ(matcher_.GetLastExportMatchesStats().num_duplicate_matches, 2);
+}
+
+// Returns a request for the batch which matches the advertiser list named
+// list_name into the output named after it.
+ExportMatchesRequest BuildBatchRequest(const string& list_name) {
+  return {kPublisherBucketName,  kPublisherMapping,
+          kAdvertiserBucketName, list_name,
+          kOutputBucketName,     absl::StrCat(list_name, "_matches")};
+}
+
+TEST_F(MatchWorkerTest, ExportMatchesBatchLoadsTheMappingOnce) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBlob("list0")))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {kEmail1});
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBlob("list1")))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {kEmail1, kEmail3});
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBlob("list2")))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {"other", kEmail2});
+        return SuccessExecutionResult();
+      });
+  // The matches of each list, by output name.
+  map<string, string> outputs;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .Times(3)
+      .WillRepeatedly([&outputs](auto context) {
+        auto& output = outputs[context.GetBlobPath()];
+        output += context.GetInitialData();
+        return [&output](auto chunk_or) -> ExecutionResult {
+          if (!chunk_or.Successful()) {
+            ADD_FAILURE();
+          } else if (chunk_or->has_value()) {
+            output += **chunk_or;
+          }
+          return SuccessExecutionResult();
+        };
+      });
+  auto results = matcher_.ExportMatchesBatch(
+      {BuildBatchRequest("list0"), BuildBatchRequest("list1"),
+       BuildBatchRequest("list2")},
+      /* max_concurrent_lists */ 2);
+
+  ASSERT_EQ(results.size(), 3);
+  for (const auto& result : results) {
+    EXPECT_SUCCESS(result);
+  }
+  EXPECT_EQ(outputs["list0_matches"], absl::StrCat(kEncrypted1, "\n"));
+  EXPECT_EQ(outputs["list1_matches"],
+            absl::StrCat(kEncrypted1, "\n", kEncrypted3, "\n"));
+  EXPECT_EQ(outputs["list2_matches"], absl::StrCat(kEncrypted2, "\n"));
+  const auto& stats = matcher_.GetLastExportMatchesBatchStats();
+  ASSERT_EQ(stats.size(), 3);
+  EXPECT_EQ(stats[0].num_matched, 1);
+  EXPECT_EQ(stats[1].num_matched, 2);
+  EXPECT_EQ(stats[2].num_matched, 1);
+}
+
+TEST_F(MatchWorkerTest, ExportMatchesBatchOnlyFailsTheListsWhichFail) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBlob("list0")))
+      .WillOnce([](auto context) {
+        context.GetCallback()("", true, FailureExecutionResult(12345));
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBlob("list1")))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {kEmail1});
+        return SuccessExecutionResult();
+      });
+  string matched_encrypted_ids_string;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .WillOnce([&matched_encrypted_ids_string](auto context) {
+        EXPECT_EQ(context.GetBlobPath(), "list1_matches");
+        matched_encrypted_ids_string += context.GetInitialData();
+        return [](auto chunk_or) -> ExecutionResult {
+          return SuccessExecutionResult();
+        };
+      });
+  auto results = matcher_.ExportMatchesBatch(
+      {BuildBatchRequest("list0"), BuildBatchRequest("list1")});
+
+  ASSERT_EQ(results.size(), 2);
+  EXPECT_THAT(results[0], ResultIs(FailureExecutionResult(12345)));
+  EXPECT_SUCCESS(results[1]);
+  EXPECT_EQ(matched_encrypted_ids_string, absl::StrCat(kEncrypted1, "\n"));
+}
+
+TEST_F(MatchWorkerTest, ExportMatchesBatchFailsEveryListIfLoadingFails) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
       .WillOnce(Return(FailureExecutionResult(12345)));
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .Times(0);
+  EXPECT_CALL(blob_streamer_, PutBlobStream).Times(0);
+  auto results = matcher_.ExportMatchesBatch(
+      {BuildBatchRequest("list0"), BuildBatchRequest("list1")});
+
+  ASSERT_EQ(results.size(), 2);
+  EXPECT_THAT(results[0], ResultIs(FailureExecutionResult(12345)));
+  EXPECT_THAT(results[1], ResultIs(FailureExecutionResult(12345)));
+}
+
+TEST_F(MatchWorkerTest, ExportMatchesBatchFailsIfTheMappingsDiffer) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream).Times(0);
+  auto other_mapping_request = BuildBatchRequest("list1");
+  other_mapping_request.publisher_mapping_name = "other_mapping";
+  auto results = matcher_.ExportMatchesBatch(
+      {BuildBatchRequest("list0"), other_mapping_request});
+
+  ASSERT_EQ(results.size(), 2);
+  EXPECT_THAT(results[0], ResultIs(FailureExecutionResult(
+                              errors::MATCH_WORKER_INVALID_BATCH)));
+  EXPECT_THAT(results[1], ResultIs(FailureExecutionResult(
+                              errors::MATCH_WORKER_INVALID_BATCH)));
+}
+
+TEST_F(MatchWorkerTest, ExportMatchesBatchFindsDuplicatesPerList) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBlob("list0")))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {kEmail1, kEmail1});
+        return SuccessExecutionResult();
+      });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBlob("list1")))
+      .WillOnce([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(),
+                               {kEmail1, kEmail3, kEmail1});
+        return SuccessExecutionResult();
+      });
+  map<string, string> outputs;
+  EXPECT_CALL(blob_streamer_, PutBlobStream)
+      .Times(2)
+      .WillRepeatedly([&outputs](auto context) {
+        auto& output = outputs[context.GetBlobPath()];
+        output += context.GetInitialData();
+        return [&output](auto chunk_or) -> ExecutionResult {
+          if (!chunk_or.Successful()) {
+            ADD_FAILURE();
+          } else if (chunk_or->has_value()) {
+            output += **chunk_or;
+          }
+          return SuccessExecutionResult();
+        };
+      });
+  auto export_once_request = BuildBatchRequest("list0");
+  export_once_request.duplicate_match_mode = DuplicateMatchMode::kExportOnce;
+  auto count_request = BuildBatchRequest("list1");
+  count_request.duplicate_match_mode = DuplicateMatchMode::kCount;
+  auto results = matcher_.ExportMatchesBatch(
+      {export_once_request, count_request}, /* max_concurrent_lists */ 2);
+
+  ASSERT_EQ(results.size(), 2);
+  EXPECT_SUCCESS(results[0]);
+  EXPECT_SUCCESS(results[1]);
+  // The row of kEmail1 matched by one list is not a duplicate for the other.
+  EXPECT_EQ(outputs["list0_matches"], absl::StrCat(kEncrypted1, "\n"));
+  EXPECT_THAT(IdsStringToVector(outputs["list1_matches"]),
+              UnorderedElementsAre(kEncrypted1, kEncrypted3, kEncrypted1));
+  const auto& stats = matcher_.GetLastExportMatchesBatchStats();
+  ASSERT_EQ(stats.size(), 2);
+  EXPECT_EQ(stats[0].num_matched, 1);
+  EXPECT_EQ(stats[0].num_duplicate_matches, 1);
+  EXPECT_EQ(stats[1].num_matched, 3);
+  EXPECT_EQ(stats[1].num_duplicate_matches, 1);
+}
+
+TEST_F(MatchWorkerTest, ReusesCachedMappingOfTheSameVersion) {
+  auto cache = make_shared<MatchTableCache>(1024 * 1024);
+  auto& blob_streamer = *new MockBlobStreamer();
+  MatchWorker matcher(blob_storage_client_,
+                      unique_ptr<BlobStreamerInterface>(&blob_streamer),
+                      testing::TempDir(), /* cpu_async_executor */ nullptr,
+                      cache);
+  // Loaded once for each of the two versions.
+  EXPECT_CALL(blob_streamer, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .Times(2)
+      .WillRepeatedly(StreamMapping(mapping_));
+  EXPECT_CALL(blob_streamer, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .Times(3)
+      .WillRepeatedly([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {kEmail1, "other"});
+        return SuccessExecutionResult();
+      });
+  vector<string> outputs;
+  EXPECT_CALL(blob_streamer, PutBlobStream)
+      .Times(3)
+      .WillRepeatedly([&outputs](auto context) {
+        outputs.push_back(context.GetInitialData());
+        return [](auto chunk_or) -> ExecutionResult {
+          return SuccessExecutionResult();
+        };
+      });
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+
+  request.publisher_mapping_version = "1";
+  EXPECT_SUCCESS(matcher.ExportMatches(request));
+  EXPECT_FALSE(matcher.GetLastExportMatchesStats().used_cached_match_table);
+  EXPECT_SUCCESS(matcher.ExportMatches(request));
+  EXPECT_TRUE(matcher.GetLastExportMatchesStats().used_cached_match_table);
+  request.publisher_mapping_version = "2";
+  EXPECT_SUCCESS(matcher.ExportMatches(request));
+  EXPECT_FALSE(matcher.GetLastExportMatchesStats().used_cached_match_table);
+
+  EXPECT_THAT(outputs, testing::Each(absl::StrCat(kEncrypted1, "\n")));
+  auto stats = cache->GetStats();
+  EXPECT_EQ(stats.num_hits, 1);
+  EXPECT_EQ(stats.num_misses, 2);
+  // Version 1 was evicted before version 2 was loaded.
+  EXPECT_EQ(stats.num_entries, 1);
+}
+
+TEST_F(MatchWorkerTest, RequestsFindingDuplicatesShareCachedMappings) {
+  auto cache = make_shared<MatchTableCache>(1024 * 1024);
+  auto& blob_streamer = *new MockBlobStreamer();
+  MatchWorker matcher(blob_storage_client_,
+                      unique_ptr<BlobStreamerInterface>(&blob_streamer),
+                      testing::TempDir(), /* cpu_async_executor */ nullptr,
+                      cache);
+  // Loaded once for all of the requests.
+  EXPECT_CALL(blob_streamer, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+  EXPECT_CALL(blob_streamer, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .Times(5)
+      .WillRepeatedly([](auto context) {
+        CallCallbackWithEmails(context.GetCallback(), {kEmail1, kEmail1});
+        return SuccessExecutionResult();
+      });
+  vector<string> outputs;
+  EXPECT_CALL(blob_streamer, PutBlobStream)
+      .Times(5)
+      .WillRepeatedly([&outputs](auto context) {
+        outputs.push_back(context.GetInitialData());
+        return [](auto chunk_or) -> ExecutionResult {
+          return SuccessExecutionResult();
+        };
+      });
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+  request.publisher_mapping_version = "1";
+  auto export_once = request;
+  export_once.duplicate_match_mode = DuplicateMatchMode::kExportOnce;
+
+  // Each request exporting matches once sees none of the earlier matches.
+  EXPECT_SUCCESS(matcher.ExportMatches(export_once));
+  EXPECT_SUCCESS(matcher.ExportMatches(export_once));
+  EXPECT_TRUE(matcher.GetLastExportMatchesStats().used_cached_match_table);
+  EXPECT_EQ(matcher.GetLastExportMatchesStats().num_duplicate_matches, 1);
+  EXPECT_SUCCESS(matcher.ExportMatches(request));
+  EXPECT_SUCCESS(matcher.ExportMatches(request));
+  EXPECT_SUCCESS(matcher.ExportMatches(export_once));
+  EXPECT_TRUE(matcher.GetLastExportMatchesStats().used_cached_match_table);
+  EXPECT_EQ(matcher.GetLastExportMatchesStats().num_matched, 1);
 
+  auto once = absl::StrCat(kEncrypted1, "\n");
+  auto twice = absl::StrCat(kEncrypted1, "\n", kEncrypted1, "\n");
+  EXPECT_THAT(outputs, ElementsAre(once, once, twice, twice, once));
+  auto stats = cache->GetStats();
+  EXPECT_EQ(stats.num_hits, 4);
+  EXPECT_EQ(stats.num_misses, 1);
+  EXPECT_EQ(stats.num_entries, 1);
+}
+
+TEST_F(MatchWorkerTest, FailsIfPrefilterFalsePositiveRateIsInvalid) {
   EXPECT_CALL(blob_streamer_, GetBlobStream).Times(0);
+  ExportMatchesRequest request{
+      kPublisherBucketName, kPublisherMapping, kAdvertiserBucketName,
+      kAdvertiserList,      kOutputBucketName, kOutputList};
+
+  for (double false_positive_rate : {0.0, 1.0, -0.5}) {
+    request.prefilter_false_positive_rate = false_positive_rate;
+    EXPECT_THAT(matcher_.ExportMatches(request),
+                ResultIs(FailureExecutionResult(
+                    MATCH_WORKER_INVALID_PREFILTER_FALSE_POSITIVE_RATE)));
+  }
+}
+
+TEST_F(MatchWorkerTest, FailsWithAllDuplicatesInTheMapping) {
+  absl::StrAppend(&mapping_, kEmail1, ",", kEncrypted2, "\n");
+  absl::StrAppend(&mapping_, kEmail3, ",", kEncrypted1, "\n");
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
+
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .Times(0);
+  EXPECT_CALL(blob_streamer_, PutBlobStream).Times(0);
+  EXPECT_THAT(matcher_.ExportMatches({kPublisherBucketName, kPublisherMapping,
+                                      kAdvertiserBucketName, kAdvertiserList,
+                                      kOutputBucketName, kOutputList}),
+              ResultIs(FailureExecutionResult(
+                  errors::MATCH_TABLE_ELEMENT_ALREADY_EXISTS)));
+  EXPECT_EQ(matcher_.GetLastExportMatchesStats().num_duplicate_publisher_ids,
+            2);
+}
+
+TEST_F(MatchWorkerTest, FailsIfGettingTheMappingFails) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(Return(FailureExecutionResult(12345)));
+
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .Times(0);
+  EXPECT_CALL(blob_streamer_, PutBlobStream).Times(0);
+  EXPECT_THAT(matcher_.ExportMatches({kPublisherBucketName, kPublisherMapping,
+                                      kAdvertiserBucketName, kAdvertiserList,
+                                      kOutputBucketName, kOutputList}),
+              ResultIs(FailureExecutionResult(12345)));
+}
+
+TEST_F(MatchWorkerTest, FailsIfStreamingTheMappingFailsAsync) {
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce([this](auto context) {
+        context.GetCallback()(mapping_, false, SuccessExecutionResult());
+        context.GetCallback()("", true, FailureExecutionResult(12345));
+        return SuccessExecutionResult();
+      });
+
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .Times(0);
   EXPECT_CALL(blob_streamer_, PutBlobStream).Times(0);
   EXPECT_THAT(matcher_.ExportMatches({kPublisherBucketName, kPublisherMapping,
                                       kAdvertiserBucketName, kAdvertiserList,
@@ -234,13 +1275,10 @@ TEST_F(MatchWorkerTest, FailsIfGettingTheMappingFails) {
 }
 
 TEST_F(MatchWorkerTest, FailsIfGetBlobStreamFailsSync) {
-  EXPECT_CALL(*blob_storage_client_, GetBlobSync).WillOnce([this](auto) {
-    GetBlobResponse response;
-    response.mutable_blob()->set_data(mapping_);
-    return response;
-  });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
 
-  EXPECT_CALL(blob_streamer_, GetBlobStream)
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
       .WillOnce(Return(FailureExecutionResult(12345)));
   EXPECT_CALL(blob_streamer_, PutBlobStream).Times(0);
   EXPECT_THAT(matcher_.ExportMatches({kPublisherBucketName, kPublisherMapping,
@@ -250,17 +1288,14 @@ TEST_F(MatchWorkerTest, FailsIfGetBlobStreamFailsSync) {
 }
 
 TEST_F(MatchWorkerTest, FailsIfGetBlobStreamFailsAsync) {
-  EXPECT_CALL(*blob_storage_client_, GetBlobSync)
-      .WillOnce([this](auto request) {
-        GetBlobResponse response;
-        response.mutable_blob()->set_data(mapping_);
-        return response;
-      });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
 
-  EXPECT_CALL(blob_streamer_, GetBlobStream).WillOnce([this](auto context) {
-    context.GetCallback()("", true, FailureExecutionResult(12345));
-    return SuccessExecutionResult();
-  });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
+      .WillOnce([this](auto context) {
+        context.GetCallback()("", true, FailureExecutionResult(12345));
+        return SuccessExecutionResult();
+      });
   EXPECT_CALL(blob_streamer_, PutBlobStream).Times(0);
   EXPECT_THAT(matcher_.ExportMatches({kPublisherBucketName, kPublisherMapping,
                                       kAdvertiserBucketName, kAdvertiserList,
@@ -269,16 +1304,12 @@ TEST_F(MatchWorkerTest, FailsIfGetBlobStreamFailsAsync) {
 }
 
 TEST_F(MatchWorkerTest, FailsIfGetBlobStreamFailureCancelsUpload) {
-  EXPECT_CALL(*blob_storage_client_, GetBlobSync)
-      .WillOnce([this](auto request) {
-        GetBlobResponse response;
-        response.mutable_blob()->set_data(mapping_);
-        return response;
-      });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
 
   atomic_bool context_acquired(false);
   GetBlobStreamChunkProcessorCallback get_blob_stream_cb;
-  EXPECT_CALL(blob_streamer_, GetBlobStream)
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
       .WillOnce(
           [this, &context_acquired, &get_blob_stream_cb](auto context) mutable {
             context.GetCallback()(absl::StrCat(kEmail1, "\n"), false,
@@ -306,23 +1337,22 @@ TEST_F(MatchWorkerTest, FailsIfGetBlobStreamFailureCancelsUpload) {
         sleep_for(milliseconds(100));
         get_blob_stream_cb("", true, FailureExecutionResult(12345));
       });
-  EXPECT_THAT(matcher_.ExportMatches({kPublisherBucketName, kPublisherMapping,
-                                      kAdvertiserBucketName, kAdvertiserList,
-                                      kOutputBucketName, kOutputList}),
+  ExportMatchesRequest request{kPublisherBucketName,  kPublisherMapping,
+                               kAdvertiserBucketName, kAdvertiserList,
+                               kOutputBucketName,     kOutputList};
+  // Upload every match right away so the upload is open when the stream fails.
+  request.upload_flush_bytes = 1;
+  EXPECT_THAT(matcher_.ExportMatches(request),
               ResultIs(FailureExecutionResult(12345)));
   EXPECT_EQ(call_count.load(), 1);
   listener_thread.join();
 }
 
 TEST_F(MatchWorkerTest, FailsIfPutBlobStreamFails) {
-  EXPECT_CALL(*blob_storage_client_, GetBlobSync)
-      .WillOnce([this](auto request) {
-        GetBlobResponse response;
-        response.mutable_blob()->set_data(mapping_);
-        return response;
-      });
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kPublisherBucketName)))
+      .WillOnce(StreamMapping(mapping_));
 
-  EXPECT_CALL(blob_streamer_, GetBlobStream)
+  EXPECT_CALL(blob_streamer_, GetBlobStream(IsForBucket(kAdvertiserBucketName)))
       .WillOnce([this](auto context) mutable {
         CallCallbackWithEmails(context.GetCallback(), {kEmail1, kEmail3});
         return SuccessExecutionResult();
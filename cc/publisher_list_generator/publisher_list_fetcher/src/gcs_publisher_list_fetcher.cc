@@ -26,15 +26,18 @@
 using google::cmrt::sdk::blob_storage_service::v1::GetBlobRequest;
 using google::cmrt::sdk::blob_storage_service::v1::GetBlobResponse;
 using google::scp::core::AsyncContext;
+using google::scp::core::AsyncExecutorInterface;
 using google::scp::core::ExecutionResult;
 using google::scp::core::ExecutionResultOr;
 using google::scp::core::FailureExecutionResult;
+using google::scp::core::SuccessExecutionResult;
 using google::scp::core::common::kZeroUuid;
 using google::scp::cpio::BlobStorageClientInterface;
 using std::function;
 using std::getline;
 using std::ifstream;
 using std::ios_base;
+using std::make_shared;
 using std::make_unique;
 using std::move;
 using std::shared_ptr;
@@ -45,6 +48,8 @@ using std::vector;
 namespace {
 
 constexpr size_t kNumCsvColumns = 1;
+// The number of rows taken from the CSV parser at a time.
+constexpr size_t kCsvRowBatchSize = 1024;
 constexpr char kGcsPublisherListFetcher[] = "GcsPublisherListFetcher";
 
 }  // namespace
@@ -52,13 +57,23 @@ constexpr char kGcsPublisherListFetcher[] = "GcsPublisherListFetcher";
 namespace google::pair::publisher_list_generator {
 
 GcsPublisherListFetcher::GcsPublisherListFetcher(
-    shared_ptr<BlobStorageClientInterface> blob_storage_client)
+    shared_ptr<BlobStorageClientInterface> blob_storage_client,
+    shared_ptr<AsyncExecutorInterface> cpu_async_executor)
     : blob_storage_client_(move(blob_storage_client)),
       csv_parser_(
           make_unique<common::CsvStreamParser>(common::CsvStreamParserConfig(
               kNumCsvColumns, true, kDefaultCsvRowDelimiter,
               kDefaultCsvLineBreak,
-              kMaxCsvStreamParserBufferedDataSizeBytes))) {}
+              kMaxCsvStreamParserBufferedDataSizeBytes))) {
+  if (cpu_async_executor) {
+    parallel_csv_parser_ = make_unique<common::ParallelCsvParser>(
+        move(cpu_async_executor),
+        common::CsvStreamParserConfig(
+            kNumCsvColumns, true, kDefaultCsvRowDelimiter,
+            kDefaultCsvLineBreak, kMaxCsvStreamParserBufferedDataSizeBytes,
+            /* zero_copy */ true, /* simd_scan */ true));
+  }
+}
 
 ExecutionResultOr<FetchIdsResponse> GcsPublisherListFetcher::FetchPublisherIds(
     FetchIdsRequest request) {
@@ -76,21 +91,61 @@ ExecutionResultOr<FetchIdsResponse> GcsPublisherListFetcher::FetchPublisherIds(
       kGcsPublisherListFetcher, kZeroUuid, "Failed getting ID blob %s/%s",
       request.bucket_name.c_str(), request.blob_name.c_str());
 
+  if (parallel_csv_parser_) {
+    return ParseInParallel(
+        make_shared<const string>(
+            move(*get_blob_response.mutable_blob()->mutable_data())));
+  }
+
   RETURN_AND_LOG_IF_FAILURE(
       csv_parser_->AddCsvChunk(get_blob_response.blob().data()),
       kGcsPublisherListFetcher, kZeroUuid, "Failed adding CSV chunk");
 
   FetchIdsResponse response;
-  auto row_or = csv_parser_->GetNextRow();
-  while (row_or.Successful()) {
-    ASSIGN_OR_LOG_AND_RETURN(auto id, row_or->GetColumn(0),
-                             kGcsPublisherListFetcher, kZeroUuid,
-                             "Failed getting column 0");
-    response.ids.emplace_back(move(id));
-    row_or = csv_parser_->GetNextRow();
+  vector<common::CsvRow> rows;
+  ExecutionResult result = SuccessExecutionResult();
+  // Stops at the first row which fails to parse.
+  while (result.Successful() && csv_parser_->HasRow()) {
+    rows.clear();
+    result = csv_parser_->GetNextRows(kCsvRowBatchSize, &rows);
+    for (const auto& row : rows) {
+      ASSIGN_OR_LOG_AND_RETURN(auto id, row.GetColumn(0),
+                               kGcsPublisherListFetcher, kZeroUuid,
+                               "Failed getting column 0");
+      response.ids.emplace_back(move(id));
+    }
   }
 
   return response;
 }
 
+ExecutionResultOr<FetchIdsResponse> GcsPublisherListFetcher::ParseInParallel(
+    shared_ptr<const string> blob_data) {
+  ASSIGN_OR_LOG_AND_RETURN(auto batches,
+                           parallel_csv_parser_->Parse(move(blob_data)),
+                           kGcsPublisherListFetcher, kZeroUuid,
+                           "Failed parsing ID blob");
+
+  FetchIdsResponse response;
+  size_t num_rows = 0;
+  for (const auto& batch : batches) {
+    num_rows += batch.rows.size();
+  }
+  response.ids.reserve(num_rows);
+  // Stops at the first row which fails to parse, as FetchPublisherIds does
+  // when parsing on one thread.
+  for (const auto& batch : batches) {
+    for (const auto& row : batch.rows) {
+      ASSIGN_OR_LOG_AND_RETURN(auto id, row.GetColumnView(0),
+                               kGcsPublisherListFetcher, kZeroUuid,
+                               "Failed getting column 0");
+      response.ids.emplace_back(id);
+    }
+    if (!batch.result.Successful()) {
+      break;
+    }
+  }
+  return response;
+}
+
 }  // namespace google::pair::publisher_list_generator
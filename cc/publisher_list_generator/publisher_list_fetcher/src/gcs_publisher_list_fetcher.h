@@ -14,12 +14,15 @@
 
 #pragma once
 
+#include <memory>
 #include <optional>
 #include <string>
 #include <vector>
 
 #include "cc/public/core/interface/execution_result.h"
 #include "cc/common/csv_parser/src/csv_stream_parser_interface.h"
+#include "cc/common/csv_parser/src/parallel_csv_parser.h"
+#include "cc/core/interface/async_executor_interface.h"
 #include "cc/public/cpio/interface/blob_storage_client/blob_storage_client_interface.h"
 #include "publisher_list_fetcher.h"
 
@@ -27,16 +30,35 @@ namespace google::pair::publisher_list_generator {
 
 class GcsPublisherListFetcher : public PublisherListFetcher {
  public:
+  /**
+   * @brief Construct a new Gcs Publisher List Fetcher object
+   *
+   * @param blob_storage_client the client to get the ID blobs with
+   * @param cpu_async_executor if set, each blob is parsed on many threads of
+   * it at once rather than on the calling thread alone
+   */
   explicit GcsPublisherListFetcher(
       std::shared_ptr<scp::cpio::BlobStorageClientInterface>
-          blob_storage_client);
+          blob_storage_client,
+      std::shared_ptr<scp::core::AsyncExecutorInterface> cpu_async_executor =
+          nullptr);
 
   google::scp::core::ExecutionResultOr<FetchIdsResponse> FetchPublisherIds(
       FetchIdsRequest request) override;
 
  private:
+  /**
+   * @brief Parses the IDs out of a whole blob with the parallel parser,
+   * returning the same IDs as parsing it on one thread would.
+   *
+   */
+  google::scp::core::ExecutionResultOr<FetchIdsResponse> ParseInParallel(
+      std::shared_ptr<const std::string> blob_data);
+
   std::shared_ptr<scp::cpio::BlobStorageClientInterface> blob_storage_client_;
   std::unique_ptr<common::CsvStreamParserInterface> csv_parser_;
+  // Set if the fetcher was given a CPU executor.
+  std::unique_ptr<common::ParallelCsvParser> parallel_csv_parser_;
 };
 
 }  // namespace google::pair::publisher_list_generator
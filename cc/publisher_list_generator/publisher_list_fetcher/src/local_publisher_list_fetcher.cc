@@ -25,8 +25,10 @@
 
 #include "error_codes.h"
 
+using google::scp::core::ExecutionResult;
 using google::scp::core::ExecutionResultOr;
 using google::scp::core::FailureExecutionResult;
+using google::scp::core::SuccessExecutionResult;
 using google::scp::core::common::kZeroUuid;
 using std::getline;
 using std::ifstream;
@@ -35,9 +37,12 @@ using std::make_unique;
 using std::move;
 using std::strerror;
 using std::string;
+using std::vector;
 
 constexpr char kLocalPublisherListFetcher[] = "LocalPublisherListFetcher";
 constexpr size_t kNumCsvColumns = 1;
+// The number of rows taken from the CSV parser at a time.
+constexpr size_t kCsvRowBatchSize = 1024;
 
 namespace google::pair::publisher_list_generator {
 
@@ -69,11 +74,16 @@ LocalPublisherListFetcher::FetchPublisherIds(FetchIdsRequest request) {
               strerror(errno));
     return result;
   }
-  auto row_or = csv_parser_->GetNextRow();
-  while (row_or.Successful()) {
-    ASSIGN_OR_RETURN(auto id, row_or->GetColumn(0));
-    resp.ids.emplace_back(move(id));
-    row_or = csv_parser_->GetNextRow();
+  vector<common::CsvRow> rows;
+  ExecutionResult result = SuccessExecutionResult();
+  // Stops at the first row which fails to parse.
+  while (result.Successful() && csv_parser_->HasRow()) {
+    rows.clear();
+    result = csv_parser_->GetNextRows(kCsvRowBatchSize, &rows);
+    for (const auto& row : rows) {
+      ASSIGN_OR_RETURN(auto id, row.GetColumn(0));
+      resp.ids.emplace_back(move(id));
+    }
   }
   return resp;
 }
@@ -18,7 +18,11 @@
 
 #include <gtest/gtest.h>
 
+#include <string>
+
+#include "absl/strings/str_cat.h"
 #include "cc/common/attestation/src/attestation_info.h"
+#include "cc/core/async_executor/src/async_executor.h"
 #include "cc/core/test/utils/proto_test_utils.h"
 #include "cc/public/core/interface/execution_result.h"
 #include "cc/public/core/test/interface/execution_result_matchers.h"
@@ -26,6 +30,7 @@
 
 using google::cmrt::sdk::blob_storage_service::v1::GetBlobResponse;
 using google::pair::common::BuildGcpCloudIdentityInfo;
+using google::scp::core::AsyncExecutor;
 using google::scp::core::FailureExecutionResult;
 using google::scp::core::SuccessExecutionResult;
 using google::scp::core::test::EqualsProto;
@@ -35,6 +40,7 @@ using google::scp::cpio::MockBlobStorageClient;
 using std::make_shared;
 using std::move;
 using std::shared_ptr;
+using std::string;
 using testing::Return;
 using testing::UnorderedElementsAre;
 
@@ -113,6 +119,98 @@ TEST_F(GcsPublisherListFetcherTest, PassesWipInfo) {
                            "yet.another.person@hotmail.com"));
 }
 
+TEST_F(GcsPublisherListFetcherTest, ReturnsIdsOfManyRowBatches) {
+  string ids_string;
+  for (int i = 0; i < 3000; i++) {
+    absl::StrAppend(&ids_string, "user", i, "@example.com\n");
+  }
+  EXPECT_CALL(mock_blob_storage_client_, GetBlobSync)
+      .WillOnce([&ids_string](auto request) {
+        GetBlobResponse response;
+        response.mutable_blob()->set_data(ids_string);
+        return response;
+      });
+
+  ASSERT_SUCCESS_AND_ASSIGN(
+      auto fetch_ids_response,
+      fetcher_.FetchPublisherIds({kBucketName, kBlobName}));
+
+  ASSERT_EQ(fetch_ids_response.ids.size(), 3000);
+  EXPECT_EQ(fetch_ids_response.ids[0], "user0@example.com");
+  EXPECT_EQ(fetch_ids_response.ids[2999], "user2999@example.com");
+}
+
+TEST_F(GcsPublisherListFetcherTest, ReturnsIdsInOrderWhenParsingInParallel) {
+  auto cpu_async_executor = make_shared<AsyncExecutor>(4, 100000);
+  ASSERT_SUCCESS(cpu_async_executor->Init());
+  ASSERT_SUCCESS(cpu_async_executor->Run());
+  GcsPublisherListFetcher fetcher(
+      shared_ptr<BlobStorageClientInterface>(&mock_blob_storage_client_,
+                                             [](auto*) {}),
+      cpu_async_executor);
+  string ids_string;
+  for (int i = 0; i < 3000; i++) {
+    absl::StrAppend(&ids_string, "user", i, "@example.com\n");
+  }
+  EXPECT_CALL(mock_blob_storage_client_, GetBlobSync)
+      .WillOnce([&ids_string](auto request) {
+        GetBlobResponse response;
+        response.mutable_blob()->set_data(ids_string);
+        return response;
+      });
+
+  ASSERT_SUCCESS_AND_ASSIGN(
+      auto fetch_ids_response,
+      fetcher.FetchPublisherIds({kBucketName, kBlobName}));
+
+  ASSERT_EQ(fetch_ids_response.ids.size(), 3000);
+  for (int i = 0; i < 3000; i++) {
+    EXPECT_EQ(fetch_ids_response.ids[i],
+              absl::StrCat("user", i, "@example.com"));
+  }
+  EXPECT_SUCCESS(cpu_async_executor->Stop());
+}
+
+TEST_F(GcsPublisherListFetcherTest, ReturnsTheSameIdsWhenParsingInParallel) {
+  auto cpu_async_executor = make_shared<AsyncExecutor>(4, 100000);
+  ASSERT_SUCCESS(cpu_async_executor->Init());
+  ASSERT_SUCCESS(cpu_async_executor->Run());
+  GcsPublisherListFetcher parallel_fetcher(
+      shared_ptr<BlobStorageClientInterface>(&mock_blob_storage_client_,
+                                             [](auto*) {}),
+      cpu_async_executor);
+  // Whitespace inside IDs is collapsed, parsing stops at the blank line and
+  // the last line, which has no line break, is not a row.
+  string ids_string;
+  for (int i = 0; i < 3000; i++) {
+    absl::StrAppend(&ids_string, " user \t ", i, "@example.com\t\n");
+    if (i == 2000) {
+      ids_string += "\n";
+    }
+  }
+  ids_string += "last@example.com";
+  EXPECT_CALL(mock_blob_storage_client_, GetBlobSync)
+      .Times(2)
+      .WillRepeatedly([&ids_string](auto request) {
+        GetBlobResponse response;
+        response.mutable_blob()->set_data(ids_string);
+        return response;
+      });
+
+  ASSERT_SUCCESS_AND_ASSIGN(
+      auto serial_response,
+      fetcher_.FetchPublisherIds({kBucketName, kBlobName}));
+  ASSERT_SUCCESS_AND_ASSIGN(
+      auto parallel_response,
+      parallel_fetcher.FetchPublisherIds({kBucketName, kBlobName}));
+
+  ASSERT_EQ(serial_response.ids.size(), 2001);
+  EXPECT_EQ(serial_response.ids[0], "user 0@example.com");
+  EXPECT_EQ(serial_response.ids[2000], "user 2000@example.com");
+  EXPECT_EQ(parallel_response.ids, serial_response.ids);
+  EXPECT_SUCCESS(cpu_async_executor->Stop());
+}
+
 TEST_F(GcsPublisherListFetcherTest, FailsOnSyncFailure) {
   EXPECT_CALL(mock_blob_storage_client_, GetBlobSync)
       .WillOnce(Return(FailureExecutionResult(12345)));
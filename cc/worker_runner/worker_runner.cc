@@ -12,8 +12,11 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <unistd.h>
+
 #include <iostream>
 #include <optional>
+#include <vector>
 
 #include <google/protobuf/util/time_util.h>
 
@@ -33,6 +36,7 @@
 #include "public/cpio/interface/cpio.h"
 #include "public/cpio/interface/job_client/job_client_interface.h"
 #include "public/cpio/interface/job_client/type_def.h"
+#include "public/cpio/interface/metric_client/metric_client_interface.h"
 #include "public/cpio/utils/configuration_fetcher/interface/configuration_fetcher_interface.h"
 #include "public/cpio/utils/configuration_fetcher/src/configuration_fetcher.h"
 #include "public/cpio/utils/job_lifecycle_helper/src/job_lifecycle_helper.h"
@@ -43,11 +47,21 @@ using google::cmrt::sdk::job_lifecycle_helper::v1::JobLifecycleHelperOptions;
 using google::cmrt::sdk::job_lifecycle_helper::v1::MarkJobCompletedRequest;
 using google::cmrt::sdk::job_lifecycle_helper::v1::PrepareNextJobResponse;
 using google::cmrt::sdk::job_service::v1::JobStatus;
+using google::cmrt::sdk::metric_service::v1::MetricUnit;
+using google::cmrt::sdk::metric_service::v1::PutMetricsRequest;
+using google::cmrt::sdk::metric_service::v1::PutMetricsResponse;
 using google::pair::common::BlobStreamer;
 using google::pair::common::BuildGcpCloudIdentityInfo;
 using google::pair::job::JobType;
+using google::pair::job::MatchDuplicateMode;
 using google::pair::job::PairJobData;
+using google::pair::matcher::DuplicateMatchMode;
+using google::pair::matcher::ExportMatchesRequest;
+using google::pair::matcher::ExportMatchesStats;
+using google::pair::matcher::MatchTableCache;
+using google::pair::matcher::MatchTableCacheStats;
 using google::pair::matcher::MatchWorker;
+using google::pair::matcher::kDefaultOnDiskMatchTableDirectory;
 using google::pair::publisher_list_generator::GcsPublisherListFetcher;
 using google::pair::publisher_list_generator::GcsPublisherMappingUploader;
 using google::pair::publisher_list_generator::GeneratePublisherListRequest;
@@ -55,6 +69,7 @@ using google::pair::publisher_list_generator::Generator;
 using google::pair::publisher_list_generator::RandomIdEncryptor;
 using google::protobuf::util::JsonStringToMessage;
 using google::protobuf::util::TimeUtil;
+using google::scp::core::AsyncContext;
 using google::scp::core::AsyncExecutor;
 using google::scp::core::ExecutionResult;
 using google::scp::core::ExecutionResultOr;
@@ -100,6 +115,7 @@ using std::pair;
 using std::shared_ptr;
 using std::string;
 using std::unique_ptr;
+using std::vector;
 using std::chrono::duration_cast;
 using std::chrono::milliseconds;
 using std::chrono::steady_clock;
@@ -107,6 +123,11 @@ using std::this_thread::sleep_for;
 
 constexpr char kWorkerRunnerMain[] = "WorkerRunnerMain";
 constexpr milliseconds kLogPeriod = milliseconds(5000);
+constexpr char kMetricNamespace[] = "PairWorker";
+// Share of the worker's RAM loaded publisher mappings are kept in across jobs.
+// A mapping replaced by a new version is evicted before the new version is
+// loaded, so it is not held next to the one loading.
+constexpr uint64_t kMatchTableCacheRamDivisor = 4;
 
 shared_ptr<AsyncExecutor> cpu_async_executor;
 shared_ptr<AsyncExecutor> io_async_executor;
@@ -268,6 +289,213 @@ optional<CloudIdentityInfo> GetAdvertiserProjectIdAndWipProvider(
   return std::nullopt;
 }
 
+optional<double> GetMatchPrefilterFalsePositiveRate(
+    const PairJobData& pair_job_data) {
+  if (pair_job_data.has_match_prefilter_false_positive_rate()) {
+    return pair_job_data.match_prefilter_false_positive_rate();
+  }
+  return std::nullopt;
+}
+
+optional<uint64_t> GetMatchOnDiskTableThresholdBytes(
+    const PairJobData& pair_job_data) {
+  if (pair_job_data.has_match_on_disk_table_threshold_bytes()) {
+    return pair_job_data.match_on_disk_table_threshold_bytes();
+  }
+  return std::nullopt;
+}
+
+optional<uint64_t> GetMatchConcurrentDownloadBufferBytes(
+    const PairJobData& pair_job_data) {
+  if (pair_job_data.has_match_concurrent_download_buffer_bytes()) {
+    return pair_job_data.match_concurrent_download_buffer_bytes();
+  }
+  return std::nullopt;
+}
+
+optional<uint64_t> GetMatchUploadFlushBytes(const PairJobData& pair_job_data) {
+  if (pair_job_data.has_match_upload_flush_bytes()) {
+    return pair_job_data.match_upload_flush_bytes();
+  }
+  return std::nullopt;
+}
+
+optional<uint64_t> GetMatchJoinMemoryBudgetBytes(
+    const PairJobData& pair_job_data) {
+  if (pair_job_data.has_match_join_memory_budget_bytes()) {
+    return pair_job_data.match_join_memory_budget_bytes();
+  }
+  return std::nullopt;
+}
+
+optional<uint32_t> GetMatchNumJoinPartitions(const PairJobData& pair_job_data) {
+  if (pair_job_data.has_match_num_join_partitions()) {
+    return pair_job_data.match_num_join_partitions();
+  }
+  return std::nullopt;
+}
+
+optional<string> GetPublisherMappingVersion(const PairJobData& pair_job_data) {
+  if (pair_job_data.has_publisher_mapping_version()) {
+    return pair_job_data.publisher_mapping_version();
+  }
+  return std::nullopt;
+}
+
+uint64_t GetMatchTableCacheBytes() {
+  auto num_pages = sysconf(_SC_PHYS_PAGES);
+  auto page_size = sysconf(_SC_PAGESIZE);
+  if (num_pages <= 0 || page_size <= 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(num_pages) * page_size /
+         kMatchTableCacheRamDivisor;
+}
+
+// Returns how the job wants duplicate matches handled, exporting all of them
+// unless it says otherwise.
+DuplicateMatchMode GetDuplicateMatchMode(const PairJobData& pair_job_data) {
+  switch (pair_job_data.match_duplicate_mode()) {
+    case MatchDuplicateMode::MATCH_DUPLICATE_MODE_COUNT:
+      return DuplicateMatchMode::kCount;
+    case MatchDuplicateMode::MATCH_DUPLICATE_MODE_EXPORT_ONCE:
+      return DuplicateMatchMode::kExportOnce;
+    default:
+      return DuplicateMatchMode::kExportAll;
+  }
+}
+
+// A metric to publish, named name, with the value in the given unit.
+struct JobMetric {
+  string name;
+  string value;
+  MetricUnit unit;
+};
+
+// Publishes metrics, all stamped with the current time. description names the
+// metrics in the log if publishing them fails.
+void PutJobMetrics(const vector<JobMetric>& metrics,
+                   const string& description) {
+  auto request = make_shared<PutMetricsRequest>();
+  request->set_metric_namespace(kMetricNamespace);
+  auto timestamp = TimeUtil::GetCurrentTime();
+  for (const auto& job_metric : metrics) {
+    auto* metric = request->add_metrics();
+    metric->set_name(job_metric.name);
+    metric->set_value(job_metric.value);
+    metric->set_unit(job_metric.unit);
+    *metric->mutable_timestamp() = timestamp;
+  }
+  AsyncContext<PutMetricsRequest, PutMetricsResponse> context(
+      move(request), [description](auto& context) {
+        if (!context.result.Successful()) {
+          SCP_ERROR(kWorkerRunnerMain, kZeroUuid, context.result,
+                    "Failed putting %s metrics", description.c_str());
+        }
+      });
+  if (auto result = metric_client->PutMetrics(context); !result.Successful()) {
+    SCP_ERROR(kWorkerRunnerMain, kZeroUuid, result,
+              "Failed putting %s metrics", description.c_str());
+  }
+}
+
+// Publishes how many advertiser IDs passed the match prefilter, which shows
+// whether the prefilter is worth its cost for the job.
+void PutPrefilterMetrics(const ExportMatchesStats& stats) {
+  auto num_checked = stats.num_prefilter_hits + stats.num_prefilter_misses;
+  if (num_checked == 0) {
+    return;
+  }
+  double hit_percent = 100.0 * stats.num_prefilter_hits / num_checked;
+  SCP_INFO(kWorkerRunnerMain, kZeroUuid,
+           "Prefilter hits: %llu, misses: %llu (%.2f%% hits), matched: %llu",
+           static_cast<unsigned long long>(stats.num_prefilter_hits),
+           static_cast<unsigned long long>(stats.num_prefilter_misses),
+           hit_percent, static_cast<unsigned long long>(stats.num_matched));
+
+  PutJobMetrics(
+      {{"MatchPrefilterHits", std::to_string(stats.num_prefilter_hits),
+        MetricUnit::METRIC_UNIT_COUNT},
+       {"MatchPrefilterMisses", std::to_string(stats.num_prefilter_misses),
+        MetricUnit::METRIC_UNIT_COUNT},
+       {"MatchPrefilterHitPercent", std::to_string(hit_percent),
+        MetricUnit::METRIC_UNIT_PERCENT}},
+      "prefilter");
+}
+
+// Publishes how often match jobs found their publisher mapping already loaded,
+// and the memory the loaded mappings take up.
+void PutMatchTableCacheMetrics(const MatchTableCacheStats& stats) {
+  auto num_lookups = stats.num_hits + stats.num_misses;
+  if (num_lookups == 0) {
+    return;
+  }
+  double hit_percent = 100.0 * stats.num_hits / num_lookups;
+  SCP_INFO(kWorkerRunnerMain, kZeroUuid,
+           "Match table cache hits: %llu, misses: %llu (%.2f%% hits), "
+           "entries: %llu, bytes: %llu",
+           static_cast<unsigned long long>(stats.num_hits),
+           static_cast<unsigned long long>(stats.num_misses), hit_percent,
+           static_cast<unsigned long long>(stats.num_entries),
+           static_cast<unsigned long long>(stats.num_bytes));
+
+  PutJobMetrics(
+      {{"MatchTableCacheHitPercent", std::to_string(hit_percent),
+        MetricUnit::METRIC_UNIT_PERCENT},
+       {"MatchTableCacheEntries", std::to_string(stats.num_entries),
+        MetricUnit::METRIC_UNIT_COUNT},
+       {"MatchTableCacheBytes", std::to_string(stats.num_bytes),
+        MetricUnit::METRIC_UNIT_BYTES}},
+      "match table cache");
+}
+
+// Matches the advertiser list of request and all additional lists of the job
+// against the publisher mapping of request, which is loaded only once.
+ExecutionResult ExportMatchesBatch(MatchWorker& worker,
+                                   const PairJobData& pair_job_data,
+                                   const ExportMatchesRequest& request) {
+  vector<ExportMatchesRequest> requests = {request};
+  for (const auto& list : pair_job_data.additional_match_lists()) {
+    auto& list_request = requests.emplace_back(request);
+    list_request.advertiser_list_bucket = list.advertiser_input_bucket();
+    list_request.advertiser_list_name = list.advertiser_user_list_blob_path();
+    list_request.output_bucket = list.match_output_bucket();
+    list_request.matched_ids_name = list.match_list_blob_path();
+    list_request.advertiser_cloud_identity_info = nullopt;
+    if (list.has_advertiser_bucket_attestation_info()) {
+      list_request.advertiser_cloud_identity_info = BuildGcpCloudIdentityInfo(
+          list.advertiser_bucket_attestation_info().project_id(),
+          list.advertiser_bucket_attestation_info().wip_provider());
+    }
+  }
+
+  auto results = worker.ExportMatchesBatch(requests);
+  const auto& batch_stats = worker.GetLastExportMatchesBatchStats();
+  ExecutionResult batch_result = SuccessExecutionResult();
+  for (size_t i = 0; i < results.size(); i++) {
+    if (results[i].Successful()) {
+      SCP_INFO(kWorkerRunnerMain, kZeroUuid,
+               "Successfully exported matches to %s%s",
+               requests[i].matched_ids_name.c_str(),
+               batch_stats[i].used_on_disk_match_table
+                   ? " using an on-disk match table"
+                   : "");
+      if (requests[i].duplicate_match_mode != DuplicateMatchMode::kExportAll) {
+        SCP_INFO(kWorkerRunnerMain, kZeroUuid, "Duplicate matches: %llu",
+                 static_cast<unsigned long long>(
+                     batch_stats[i].num_duplicate_matches));
+      }
+      PutPrefilterMetrics(batch_stats[i]);
+    } else {
+      SCP_ERROR(kWorkerRunnerMain, kZeroUuid, results[i],
+                "Failed exporting matches to %s",
+                requests[i].matched_ids_name.c_str());
+      batch_result = results[i];
+    }
+  }
+  return batch_result;
+}
+
 int main(int argc, char* argv[]) {
   // Install signal handler for printing verbose core dumps.
   // https://github.com/abseil/abseil-cpp/blob/master/absl/debugging/failure_signal_handler.h
@@ -372,7 +600,8 @@ int main(int argc, char* argv[]) {
   }
 
   Generator<string, Uuid> generator(
-      make_unique<GcsPublisherListFetcher>(blob_storage_client),
+      make_unique<GcsPublisherListFetcher>(blob_storage_client,
+                                          cpu_async_executor),
       make_unique<RandomIdEncryptor>(cpu_async_executor),
       make_unique<GcsPublisherMappingUploader>(blob_storage_client),
       blob_storage_client);
@@ -393,7 +622,11 @@ int main(int argc, char* argv[]) {
     StopAllClients();
     exit(EXIT_FAILURE);
   }
-  MatchWorker worker(blob_storage_client, move(blob_streamer));
+  auto match_table_cache =
+      make_shared<MatchTableCache>(GetMatchTableCacheBytes());
+  MatchWorker worker(blob_storage_client, move(blob_streamer),
+                     kDefaultOnDiskMatchTableDirectory, cpu_async_executor,
+                     match_table_cache);
 
   while (true) {
     SCP_INFO_EVERY_PERIOD(kLogPeriod, kWorkerRunnerMain, kZeroUuid,
@@ -448,24 +681,51 @@ int main(int argc, char* argv[]) {
         }
       } else if (pair_job_data.job_type() == JobType::JOB_TYPE_MATCH) {
         SCP_INFO(kWorkerRunnerMain, kZeroUuid, "Processing match job.");
-        result = worker.ExportMatches(
-            {pair_job_data.publisher_input_bucket(),
-             pair_job_data.publisher_mapping_blob_path(),
-             pair_job_data.advertiser_input_bucket(),
-             pair_job_data.advertiser_user_list_blob_path(),
-             pair_job_data.match_output_bucket(),
-             pair_job_data.match_list_blob_path(),
-             GetPublisherProjectIdAndWipProvider(pair_job_data),
-             GetAdvertiserProjectIdAndWipProvider(pair_job_data)});
-        if (result.Successful()) {
-          SCP_INFO(kWorkerRunnerMain, kZeroUuid,
-                   "Successfully exported matches to %s",
-                   pair_job_data.match_list_blob_path().c_str());
+        ExportMatchesRequest request{
+            pair_job_data.publisher_input_bucket(),
+            pair_job_data.publisher_mapping_blob_path(),
+            pair_job_data.advertiser_input_bucket(),
+            pair_job_data.advertiser_user_list_blob_path(),
+            pair_job_data.match_output_bucket(),
+            pair_job_data.match_list_blob_path(),
+            GetPublisherProjectIdAndWipProvider(pair_job_data),
+            GetAdvertiserProjectIdAndWipProvider(pair_job_data),
+            GetMatchPrefilterFalsePositiveRate(pair_job_data),
+            GetMatchOnDiskTableThresholdBytes(pair_job_data),
+            GetMatchConcurrentDownloadBufferBytes(pair_job_data),
+            GetMatchUploadFlushBytes(pair_job_data),
+            pair_job_data.match_sorted_inputs(),
+            GetMatchJoinMemoryBudgetBytes(pair_job_data),
+            GetMatchNumJoinPartitions(pair_job_data),
+            GetPublisherMappingVersion(pair_job_data),
+            GetDuplicateMatchMode(pair_job_data)};
+        if (!pair_job_data.additional_match_lists().empty()) {
+          result = ExportMatchesBatch(worker, pair_job_data, request);
         } else {
+          result = worker.ExportMatches(request);
+          if (result.Successful()) {
+            SCP_INFO(kWorkerRunnerMain, kZeroUuid,
+                     "Successfully exported matches to %s%s",
+                     pair_job_data.match_list_blob_path().c_str(),
+                     worker.GetLastExportMatchesStats().used_on_disk_match_table
+                         ? " using an on-disk match table"
+                         : "");
+            if (request.duplicate_match_mode !=
+                DuplicateMatchMode::kExportAll) {
+              SCP_INFO(kWorkerRunnerMain, kZeroUuid, "Duplicate matches: %llu",
+                       static_cast<unsigned long long>(
+                           worker.GetLastExportMatchesStats()
+                               .num_duplicate_matches));
+            }
+            PutPrefilterMetrics(worker.GetLastExportMatchesStats());
+          }
+        }
+        if (!result.Successful()) {
           SCP_ERROR(kWorkerRunnerMain, kZeroUuid, result,
                     "Failed exporting matches");
           job_status = JobStatus::JOB_STATUS_FAILURE;
         }
+        PutMatchTableCacheMetrics(match_table_cache->GetStats());
       } else {
         SCP_ERROR(kWorkerRunnerMain, kZeroUuid,
                   FailureExecutionResult(SC_UNKNOWN),